@@ -1,11 +1,12 @@
-#define Nfold 2					// network will be unfolded for N time steps
+#include <stddef.h>
+#include "NN-real.h"
+
+#define Nfold 2					// default # of time steps to unfold (any # works at run time)
 
 //**********************struct for NEURON**********************************//
 typedef struct rNEURON
 	{
-    double output[Nfold];
-    double *weights;
-    double grad[Nfold];			// "local gradient", allow for 2 time steps
+    real *weights;
 	} rNEURON;
 
 //**********************struct for LAYER***********************************//
@@ -13,13 +14,85 @@ typedef struct rLAYER
 	{
     int numNeurons;
     rNEURON *neurons;
+    int offset;					// of the layer's neurons within one time step of the buffers
 	} rLAYER;
 
 //*********************struct for RNN************************************//
+// The outputs and local gradients of all time steps are 2 time-major buffers,
+// [time step][layer][neuron]:  one time step is "stride" consecutive reals (the layers one
+// after the other, padded to a cache line), so each step of the unfolding is contiguous.
+// They hold "capacity" time steps and grow when a longer sequence comes, so they are
+// reused by every call.
+//
+// Gradient checkpointing (BPTT_checkpoint()) trades compute for memory on long
+// unfoldings:  forward_BPTT() then keeps only the input layer of every segment's first
+// step, and the time steps of one segment at a time (step t in slot t mod "segment"), and
+// backprop_through_time() recomputes each earlier segment from its checkpoint.
 typedef struct RNN
 	{
     int numLayers;
     rLAYER *layers;
+    int stride;					// reals per time step
+    int capacity;				// time steps allocated
+    real *outputs;
+    real *grads;				// "local gradients"
+
+    int checkpointEvery;		// 0 = keep all steps, else see BPTT_checkpoint()
+    int segment;				// steps per segment in the last forward_BPTT(), 0 = all kept
+    int numCheckpoints;			// allocated
+    real *checkpoints;			// [checkpoint][input neuron]
+    real *dW;					// weight changes summed over the segments
+    size_t peakBytes;			// most bytes of the buffers above, see BPTT_peak_bytes()
 	} RNN;
 
+// Outputs / local gradients of layer l in slot t of the buffers
+#define BPTT_OUTPUTS(net, t, l)	((net)->outputs + (size_t) (t) * (net)->stride + (net)->layers[l].offset)
+#define BPTT_GRADS(net, t, l)	((net)->grads + (size_t) (t) * (net)->stride + (net)->layers[l].offset)
+// Slot of time step t after forward_BPTT() (when checkpointing, only the last segment's
+// steps are there)
+#define BPTT_SLOT(net, t)		((net)->segment > 0 ? (t) % (net)->segment : (t))
+
+// BPTT_checkpoint(net, every):  every = 0, keep every step;  every > 0, a checkpoint every
+// "every" steps;  BPTT_SqrtT, every ⌈√T⌉ steps of each unfolding of T steps.  Memory is
+// ~ every steps + T / every inputs instead of T steps, for ≤ 1 extra forward pass.
+#define BPTT_SqrtT	(-1)
+
 #define dim_K	10
+
+//******************** truncated BPTT on a stream **************************//
+// (backprop-through-time.c)  Back-props every "every" (K1) steps through the last
+// "window" (K) steps, kept in a ring:  fixed memory for a stream of any length.
+typedef struct BPTT_STREAM
+	{
+	RNN *net;
+	int window;					// K:  time steps back-propagated through
+	int every;					// K1:  time steps between back-props
+	long steps;					// run so far
+	int slot;					// of the last step in the net's buffers
+	int numErrors;				// = # of output neurons
+	real *deltas;				// ∇ of the window, [window][stride] as the net's buffers
+	double *errors;				// of the window, [window][numErrors]
+	} BPTT_STREAM;
+
+//******************** batched BPTT **************************************//
+// (backprop-through-time.c)  B independent sequences unfolded in lockstep.  Outputs and
+// local gradients are [T][B][stride]:  the B rows of one time step are consecutive, so
+// each layer of a step is one matrix-matrix product of the B inputs with the weights.
+// Sequence b runs lengths[b] ≤ T steps;  mask[t][b] = 1 while t < lengths[b], and the
+// masked-out steps are neither computed nor trained.
+typedef struct BPTT_BATCH
+	{
+	int size;					// maximum B
+	int capacity;				// time steps allocated
+	int B, T;					// of the last forward_BPTT_batch()
+	int *lengths;				// [B]
+	unsigned char *mask;		// [T][B]
+	real *outputs;				// [T][B][stride]
+	real *grads;
+	} BPTT_BATCH;
+
+// Outputs / local gradients of layer l of sequence b at time step t
+#define BATCH_OUTPUTS(net, batch, t, b, l)	((batch)->outputs + \
+		((size_t) (t) * (batch)->B + (b)) * (net)->stride + (net)->layers[l].offset)
+#define BATCH_GRADS(net, batch, t, b, l)	((batch)->grads + \
+		((size_t) (t) * (batch)->B + (b)) * (net)->stride + (net)->layers[l].offset)
@@ -94,7 +94,7 @@ NNET *create_NN(int numLayers, int *neuronsPerLayer)
 		for (int n = 0; n < neuronsPerLayer[l]; ++n) // construct each neuron in the layer
 			{
 			net->layers[l].neurons[n].weights =
-					(double *) malloc((neuronsPerLayer[l - 1] + 1) * sizeof (double));
+					(real *) malloc((neuronsPerLayer[l - 1] + 1) * sizeof (real));
 			for (int i = 0; i <= neuronsPerLayer[l - 1]; ++i)
 				{
 				//construct weights of neuron from previous layer neurons
@@ -1,10 +1,12 @@
+#include "NN-real.h"
+
 #define dimX	10
 
 //**********************struct for NEURON**********************************//
 typedef struct JNEURON
 	{
-    double output;
-    double *weights;
+    real output;
+    real *weights;
 	} JNEURON;
 
 //**********************struct for LAYER***********************************//
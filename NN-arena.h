@@ -0,0 +1,38 @@
+#ifndef NN_ARENA_H
+#define NN_ARENA_H
+
+#include <stdlib.h>
+#include <string.h>
+
+//************************** arena for network construction ****************************//
+// A network is built inside one block of memory.  The create function runs its layout
+// twice:  first with an empty ARENA, which only measures, then again after arena_open()
+// has allocated the measured size, to carve the block.  Every sub-allocation starts on
+// an Arena_Align boundary.  The network struct is the first sub-allocation, so a single
+// free() of the network releases everything.
+
+#define Arena_Align	64				// = NN_Align (one cache line)
+
+typedef struct ARENA
+	{
+	char *base;						// NULL while measuring
+	size_t used;					// bytes taken so far
+	} ARENA;
+
+// Take "bytes" from the arena;  returns NULL while measuring
+static inline void *arena_take(ARENA *a, size_t bytes)
+	{
+	void *p = a->base == NULL ? NULL : a->base + a->used;
+	a->used += (bytes + Arena_Align - 1) / Arena_Align * Arena_Align;
+	return p;
+	}
+
+// Allocate the measured block, zeroed, and rewind the arena to carve it
+static inline void arena_open(ARENA *a)
+	{
+	a->base = (char *) aligned_alloc(Arena_Align, a->used);
+	memset(a->base, 0, a->used);
+	a->used = 0;
+	}
+
+#endif
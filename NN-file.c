@@ -0,0 +1,304 @@
+// Loading and saving feed-forward networks, see NN-file.h for the formats.
+// None of these functions prompt or print;  they return NULL / false on failure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>				// open()
+#include <unistd.h>				// close()
+#include <sys/mman.h>			// mmap()
+#include <sys/stat.h>
+#include "feedforward-NN.h"
+#include "NN-file.h"
+
+extern NNET *blank_NN(int, int *);
+extern NNET *wrap_NN(int, int *, real *);
+extern void free_NN(NNET *);
+
+// File offset of the weights of a network with L layers
+static uint32_t header_bytes(int L)
+	{
+	size_t n = sizeof (NN_HEADER) + L * sizeof (int32_t);
+	return (n + NN_Align - 1) / NN_Align * NN_Align;
+	}
+
+// Row length in reals of a weight matrix with numInputs inputs, as in a file whose rows
+// are padded to "align" bytes and whose reals have "realBytes" bytes
+static int file_stride(int numInputs, int align, int realBytes)
+	{
+	int pad = align / realBytes;
+	return (numInputs + 1 + pad - 1) / pad * pad;
+	}
+
+// 64-bit FNV-1a over the 64-bit words of the weights (payloads are whole cache lines)
+uint64_t NN_checksum(const void *payload, size_t bytes)
+	{
+	const uint64_t *w = (const uint64_t *) payload;
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < bytes / sizeof (uint64_t); ++i)
+		h = (h ^ w[i]) * 1099511628211ULL;
+	return h;
+	}
+
+static void topology(const NNET *net, int32_t neuronsPerLayer[])
+	{
+	for (int l = 0; l < net->numLayers; ++l)
+		neuronsPerLayer[l] = net->layers[l].numNeurons;
+	}
+
+//************************** binary format *****************************************//
+
+// Write a network in binary format to an open file, with the weights taken from
+// "params" (net->params or a snapshot of it with the same layout)
+bool write_NN(FILE *fp, const NNET *net, const real *params, ACTIVATION act)
+	{
+	int L = net->numLayers;
+	NN_HEADER h;
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, NN_Magic, sizeof h.magic);
+	h.version = NN_Version;
+	h.headerBytes = header_bytes(L);
+	h.numLayers = L;
+	h.activation = act;
+	h.realBytes = sizeof (real);
+	h.align = NN_Align;
+	h.payloadBytes = net->numParams * sizeof (real);
+	h.checksum = NN_checksum(params, h.payloadBytes);
+
+	int32_t neuronsPerLayer[L];
+	topology(net, neuronsPerLayer);
+	char padding[NN_Align] = {0};
+	fwrite(&h, sizeof h, 1, fp);
+	fwrite(neuronsPerLayer, sizeof (int32_t), L, fp);
+	fwrite(padding, 1, h.headerBytes - sizeof h - L * sizeof (int32_t), fp);
+	fwrite(params, 1, h.payloadBytes, fp);
+	return !ferror(fp);
+	}
+
+bool save_NN(const NNET *net, ACTIVATION act, const char *fileName)
+	{
+	FILE *fp = fopen(fileName, "wb");
+	if (fp == NULL)
+		return false;
+	bool ok = write_NN(fp, net, net->params, act);
+	return fclose(fp) == 0 && ok;
+	}
+
+// Check the fixed part of a header read from a file of "fileBytes" bytes:  that the
+// topology fits in it
+static bool valid_magic(const NN_HEADER *h, size_t fileBytes)
+	{
+	return !memcmp(h->magic, NN_Magic, sizeof h->magic) && h->version == NN_Version &&
+			h->numLayers >= 3 && h->numLayers <= 1000 &&
+			h->headerBytes == header_bytes(h->numLayers) && h->headerBytes <= fileBytes;
+	}
+
+// Check the rest of a header (that passed valid_magic()), and the topology that follows it:
+// the weights must fit in the file
+static bool valid_header(const NN_HEADER *h, const int32_t neuronsPerLayer[], size_t fileBytes)
+	{
+	if (h->realBytes != sizeof (float) && h->realBytes != sizeof (double))
+		return false;
+	if (h->align == 0 || h->align % h->realBytes != 0)
+		return false;
+	uint64_t count = 0;
+	for (uint32_t l = 0; l < h->numLayers; ++l)
+		if (neuronsPerLayer[l] <= 0)
+			return false;
+	for (uint32_t l = 1; l < h->numLayers; ++l)
+		count += (uint64_t) neuronsPerLayer[l] *
+				file_stride(neuronsPerLayer[l - 1], h->align, h->realBytes);
+	if (count * h->realBytes != h->payloadBytes)
+		return false;
+	return h->headerBytes + h->payloadBytes <= fileBytes;
+	}
+
+// Read the header and topology;  neuronsPerLayer is malloc'ed
+static bool read_header(FILE *fp, NN_HEADER *h, int32_t **neuronsPerLayer)
+	{
+	struct stat st;
+	if (fstat(fileno(fp), &st) != 0 || fread(h, sizeof *h, 1, fp) != 1 ||
+			!valid_magic(h, st.st_size))
+		return false;
+	*neuronsPerLayer = (int32_t *) malloc(h->numLayers * sizeof (int32_t));
+	if (fread(*neuronsPerLayer, sizeof (int32_t), h->numLayers, fp) == h->numLayers &&
+			valid_header(h, *neuronsPerLayer, st.st_size))
+		return true;
+	free(*neuronsPerLayer);
+	return false;
+	}
+
+// Read a binary file into a new network, converting the weights if the file was saved
+// with another precision.  The checksum is verified.
+static NNET *load_binary_NN(FILE *fp, ACTIVATION *act)
+	{
+	NN_HEADER h;
+	int32_t *neuronsPerLayer;
+	if (!read_header(fp, &h, &neuronsPerLayer))
+		return NULL;
+
+	// valid_header() has checked payloadBytes against the length of the file
+	char *payload = (char *) malloc(h.payloadBytes);
+	NNET *net = NULL;
+	if (payload != NULL && fseek(fp, h.headerBytes, SEEK_SET) == 0 &&
+			fread(payload, 1, h.payloadBytes, fp) == h.payloadBytes &&
+			NN_checksum(payload, h.payloadBytes) == h.checksum)
+		{
+		net = blank_NN(h.numLayers, neuronsPerLayer);
+		const char *row = payload;
+		for (int l = 1; l < (int) h.numLayers; ++l)
+			{
+			int n_in = neuronsPerLayer[l - 1];
+			int stride = file_stride(n_in, h.align, h.realBytes);
+			for (int n = 0; n < neuronsPerLayer[l]; ++n, row += stride * h.realBytes)
+				for (int i = 0; i <= n_in; ++i)
+					WEIGHT(net, l, n, i) = h.realBytes == sizeof (float) ?
+							(real) ((const float *) row)[i] : (real) ((const double *) row)[i];
+			}
+		*act = (ACTIVATION) h.activation;
+		}
+	free(payload);
+	free(neuronsPerLayer);
+	return net;
+	}
+
+// Map a binary file and use its weights in place:  nothing is parsed or copied, pages are
+// read on demand.  The file must have been saved with the same precision (and NN_Align).
+// The mapping is private, so training the network does not change the file.  The
+// checksum is not verified (it would read every page);  use load_NN() for that.
+// Free the network with unmap_NN().
+NNET *map_NN(const char *fileName, ACTIVATION *act)
+	{
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	NN_HEADER *h = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof (NN_HEADER))
+		h = (NN_HEADER *) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (h == MAP_FAILED)
+		return NULL;
+
+	const int32_t *neuronsPerLayer = (const int32_t *) (h + 1);
+	if (!valid_magic(h, st.st_size) || h->realBytes != sizeof (real) ||
+			h->align != NN_Align || !valid_header(h, neuronsPerLayer, st.st_size))
+		{
+		munmap(h, st.st_size);
+		return NULL;
+		}
+	// release whole pages after the weights (eg a checkpoint's training state), so that
+	// unmap_NN() can find the length from the network alone
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t used = (h->headerBytes + h->payloadBytes + page - 1) / page * page;
+	if (used < (size_t) st.st_size)
+		munmap((char *) h + used, st.st_size - used);
+
+	*act = (ACTIVATION) h->activation;
+	int L = h->numLayers;
+	int topology[L];
+	for (int l = 0; l < L; ++l)
+		topology[l] = neuronsPerLayer[l];
+	return wrap_NN(L, topology, (real *) ((char *) h + h->headerBytes));
+	}
+
+void unmap_NN(NNET *net)
+	{
+	char *base = (char *) net->params - header_bytes(net->numLayers);
+	munmap(base, header_bytes(net->numLayers) + net->numParams * sizeof (real));
+	free_NN(net);
+	}
+
+//************************** text format *******************************************//
+
+bool save_text_NN(const NNET *net, const char *comments, const char *fileName)
+	{
+	FILE *fp = fopen(fileName, "w");
+	if (fp == NULL)
+		return false;
+	fprintf(fp, "%s\n", comments);
+	fprintf(fp, EndOfComments);
+	fprintf(fp, "%d\n", net->numLayers);
+
+	for (int l = 0; l < net->numLayers; ++l)
+		fprintf(fp, "%d ", net->layers[l].numNeurons);
+	fprintf(fp, "\n");
+
+	for (int l = 1; l < net->numLayers; ++l) // for each layer
+		for (int n = 0; n < net->layers[l].numNeurons; ++n) // for each neuron
+			{
+			for (int i = 0; i <= net->layers[l - 1].numNeurons; ++i) // for each weight
+				fprintf(fp, "%.*g ", REAL_DIGITS, (double) WEIGHT(net, l, n, i));
+			fprintf(fp, "\n");
+			}
+	bool ok = !ferror(fp);
+	return fclose(fp) == 0 && ok;
+	}
+
+static NNET *load_text_NN(FILE *fp)
+	{
+	// skip comments
+	char line[4096];
+	do
+		if (fgets(line, sizeof line, fp) == NULL)
+			return NULL;
+	while (strcmp(line, EndOfComments));
+
+	int L;
+	if (fscanf(fp, "%d", &L) != 1 || L < 3 || L > 1000)
+		return NULL;
+	int neuronsPerLayer[L];
+	for (int l = 0; l < L; ++l)
+		if (fscanf(fp, "%d", &neuronsPerLayer[l]) != 1 || neuronsPerLayer[l] <= 0)
+			return NULL;
+
+	NNET *net = blank_NN(L, neuronsPerLayer);
+	for (int l = 1; l < L; ++l) // for each layer
+		for (int n = 0; n < neuronsPerLayer[l]; ++n) // for each neuron
+			for (int i = 0; i <= neuronsPerLayer[l - 1]; ++i) // for each weight
+				{
+				double x;
+				if (fscanf(fp, "%lf", &x) != 1)
+					{
+					free_NN(net);
+					return NULL;
+					}
+				WEIGHT(net, l, n, i) = (real) x;
+				}
+	return net;
+	}
+
+// Load a network saved in either format.  *act is set from a binary file's header, and
+// left unchanged for a text file (which does not record it).  Loading does not use
+// rand(), so resuming a fixed-seed run does not shift its random numbers.
+NNET *load_NN(const char *fileName, ACTIVATION *act)
+	{
+	FILE *fp = fopen(fileName, "rb");
+	if (fp == NULL)
+		return NULL;
+	char magic[sizeof (NN_Magic)];
+	bool binary = fread(magic, 1, sizeof magic, fp) == sizeof magic &&
+			!memcmp(magic, NN_Magic, sizeof magic);
+	rewind(fp);
+	NNET *net = binary ? load_binary_NN(fp, act) : load_text_NN(fp);
+	fclose(fp);
+	return net;
+	}
+
+// Convert a text .net file to the binary format, recording the activation function
+// (text files do not have it).  The weights keep the precision of this build.
+bool convert_text_NN(const char *textName, const char *binaryName, ACTIVATION act)
+	{
+	FILE *fp = fopen(textName, "r");
+	if (fp == NULL)
+		return false;
+	NNET *net = load_text_NN(fp);
+	fclose(fp);
+	if (net == NULL)
+		return false;
+	bool ok = save_NN(net, act, binaryName);
+	free_NN(net);
+	return ok;
+	}
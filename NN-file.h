@@ -0,0 +1,33 @@
+#include <stdint.h>
+// needs feedforward-NN.h (for ACTIVATION and NN_Align) to be included first
+
+//************************** network files ********************************************//
+// Two formats are read and written by NN-file.c:
+//
+// Text (.net):	a comment line, the EndOfComments line, the # of layers, the neurons per
+//				layer, then one line of weights per neuron (bias first), printed exactly.
+//
+// Binary:		an NN_HEADER, the neurons per layer as int32, zero padding up to
+//				headerBytes, then the weights exactly as they are laid out in net->params
+//				(rows of W padded to "align" bytes, in native byte order).  headerBytes is
+//				a multiple of NN_Align, so a file mapped with map_NN() is used in place.
+//
+// load_NN() recognizes either format by its first bytes.
+
+#define EndOfComments	"**************\n"
+
+#define NN_Magic		"NNETbin"		// 8 bytes with the '\0'
+#define NN_Version		1
+
+typedef struct NN_HEADER
+	{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerBytes;			// offset of the weights in the file
+	uint32_t numLayers;
+	uint32_t activation;			// ACTIVATION the network was trained with
+	uint32_t realBytes;				// 4 (float) or 8 (double) weights
+	uint32_t align;					// rows of W are padded to this many bytes
+	uint64_t payloadBytes;			// size of the weights
+	uint64_t checksum;				// FNV-1a of the weights, see NN_checksum()
+	} NN_HEADER;
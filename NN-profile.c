@@ -0,0 +1,152 @@
+// Counters, latency histograms and timers of NN-profile.h.
+// The timers are always available;  the counters are only fed when the training code is
+// built with -DNN_PROFILE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>				// clock_gettime()
+#include "feedforward-NN.h"		// real
+#include "NN-profile.h"
+
+__thread PROFILE NN_prof;
+double NN_prof_interval = 10.0;
+
+static const char *moduleName[Prof_Modules] = {"FF", "BPTT", "RTRL"};
+static const char *phaseName[Prof_Phases] = {"forward", "backward", "update"};
+
+uint64_t NN_now_ns(void)
+	{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000u + t.tv_nsec;
+	}
+
+//************************** latency histograms ************************************//
+
+void latency_add(LATENCY *h, uint64_t ns)
+	{
+	int b = ns == 0 ? 0 : 63 - __builtin_clzll(ns);		// floor(log2(ns))
+	if (b >= Prof_Buckets)
+		b = Prof_Buckets - 1;
+	++h->bucket[b];
+	++h->count;
+	h->total_ns += ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+	}
+
+// Approximate q-quantile:  interpolated inside its power-of-2 bucket
+double latency_quantile(const LATENCY *h, double q)
+	{
+	if (h->count == 0)
+		return 0.0;
+	double rank = q * h->count, seen = 0.0;
+	for (int b = 0; b < Prof_Buckets; ++b)
+		{
+		if (h->bucket[b] > 0 && seen + h->bucket[b] >= rank)
+			{
+			double lo = b == 0 ? 0.0 : (double) (1ULL << b);
+			double x = lo + (rank - seen) / h->bucket[b] * lo;
+			return x < h->max_ns ? x : h->max_ns;
+			}
+		seen += h->bucket[b];
+		}
+	return h->max_ns;
+	}
+
+void print_latency(FILE *fp, const char *name, const LATENCY *h)
+	{
+	if (h->count == 0)
+		return;
+	fprintf(fp, "%-24s %10llu calls  mean %9.0f  p50 %9.0f  p90 %9.0f  p99 %9.0f  max %9llu ns\n",
+			name, (unsigned long long) h->count, (double) h->total_ns / h->count,
+			latency_quantile(h, 0.5), latency_quantile(h, 0.9), latency_quantile(h, 0.99),
+			(unsigned long long) h->max_ns);
+	}
+
+void end_scope(SCOPE *s)
+	{
+	latency_add(s->h, NN_now_ns() - s->start);
+	}
+
+//************************** per-layer counters ************************************//
+
+static PROF_COUNTER *counter(int module, int l, int phase)
+	{
+	return &NN_prof.layer[module][l < Prof_MaxLayers ? l : Prof_MaxLayers - 1][phase];
+	}
+
+void NN_prof_layer(int module, int l, int phase, uint64_t *t, uint64_t flops)
+	{
+	uint64_t now = NN_now_ns();
+	PROF_COUNTER *c = counter(module, l, phase);
+	++c->calls;
+	c->ns += now - *t;
+	c->flops += flops;
+	*t = now;
+	}
+
+void NN_prof_saturated(int module, int l, const void *g, int n, double gmin)
+	{
+	const real *d = (const real *) g;
+	PROF_COUNTER *c = counter(module, l, Prof_forward);
+	for (int i = 0; i < n; ++i)
+		c->saturated += d[i] < gmin;
+	c->neurons += n;
+	}
+
+void NN_prof_neuron(int module, int l, int saturated)
+	{
+	PROF_COUNTER *c = counter(module, l, Prof_forward);
+	c->saturated += saturated != 0;
+	++c->neurons;
+	}
+
+void NN_prof_call(int module, int phase, uint64_t t0)
+	{
+	uint64_t now = NN_now_ns();
+	latency_add(&NN_prof.call[module][phase], now - t0);
+	if (NN_prof.lastDump == 0)
+		NN_prof.lastDump = now;
+	else if (NN_prof_interval > 0.0 && now - NN_prof.lastDump >= NN_prof_interval * 1e9)
+		{
+		NN_prof_dump(stderr);
+		NN_prof.lastDump = now;
+		}
+	}
+
+// Print the counters of the calling thread since the last NN_prof_reset()
+void NN_prof_dump(FILE *fp)
+	{
+	fprintf(fp, "\n**** profile of thread %p ****\n", (void *) &NN_prof);
+	fprintf(fp, "module layer phase          calls       ms/total   ns/call     GFLOP/s  saturated\n");
+	for (int m = 0; m < Prof_Modules; ++m)
+		for (int l = 0; l < Prof_MaxLayers; ++l)
+			for (int p = 0; p < Prof_Phases; ++p)
+				{
+				const PROF_COUNTER *c = &NN_prof.layer[m][l][p];
+				if (c->calls == 0)
+					continue;
+				fprintf(fp, "%-6s %5d %-8s %12llu %14.3f %9.0f %11.3f", moduleName[m], l,
+						phaseName[p], (unsigned long long) c->calls, c->ns * 1e-6,
+						(double) c->ns / c->calls, c->ns ? (double) c->flops / c->ns : 0.0);
+				if (p == Prof_forward && c->neurons > 0)
+					fprintf(fp, "  %8.2f%%", 100.0 * c->saturated / c->neurons);
+				fprintf(fp, "\n");
+				}
+	char name[64];
+	for (int m = 0; m < Prof_Modules; ++m)
+		for (int p = 0; p < Prof_Phases; ++p)
+			{
+			snprintf(name, sizeof name, "%s %s", moduleName[m], phaseName[p]);
+			print_latency(fp, name, &NN_prof.call[m][p]);
+			}
+	fflush(fp);
+	}
+
+void NN_prof_reset(void)
+	{
+	memset(&NN_prof, 0, sizeof NN_prof);
+	}
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdio.h>
+
+//************************** hot-path instrumentation *********************************//
+// Built with -DNN_PROFILE ("make NNFLAGS=-DNN_PROFILE", then rebuild everything), the
+// training code counts for each module, layer and phase:  calls, nanoseconds, FLOPs, and
+// (forward phase) activations in saturation, ie whose derivative is below
+// Prof_Saturation of its maximum (for ReLU:  on the leaky side).  Whole calls also go
+// into latency histograms.  Counters are thread-local, so threads never contend;  each
+// thread prints its own table to stderr every NN_prof_interval seconds (see
+// NN_prof_call()), or when NN_prof_dump() is called.
+// Without NN_PROFILE every PROF_* macro expands to nothing and costs nothing.
+//
+// Layer 0 holds the whole-network operations (apply_update()).
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { Prof_FF, Prof_BPTT, Prof_RTRL, Prof_Modules };
+enum { Prof_forward, Prof_backward, Prof_update, Prof_Phases };
+
+#define Prof_MaxLayers	32			// deeper layers are added to the last one
+#define Prof_Buckets	40			// latency bucket b counts [2^b, 2^(b+1)) ns
+#define Prof_Saturation	0.05
+
+typedef struct PROF_COUNTER
+	{
+	uint64_t calls, ns, flops, saturated, neurons;
+	} PROF_COUNTER;
+
+typedef struct LATENCY
+	{
+	uint64_t count, total_ns, max_ns;
+	uint64_t bucket[Prof_Buckets];
+	} LATENCY;
+
+typedef struct PROFILE
+	{
+	PROF_COUNTER layer[Prof_Modules][Prof_MaxLayers][Prof_Phases];
+	LATENCY call[Prof_Modules][Prof_Phases];		// whole calls, eg forward_prop_ReLU()
+	uint64_t lastDump;
+	} PROFILE;
+
+extern __thread PROFILE NN_prof;
+extern double NN_prof_interval;		// seconds between dumps of a thread, 0 = never
+
+uint64_t NN_now_ns(void);			// CLOCK_MONOTONIC
+void latency_add(LATENCY *h, uint64_t ns);
+double latency_quantile(const LATENCY *h, double q);
+void print_latency(FILE *fp, const char *name, const LATENCY *h);
+
+void NN_prof_layer(int module, int l, int phase, uint64_t *t, uint64_t flops);
+void NN_prof_saturated(int module, int l, const void *g, int n, double gmin);
+void NN_prof_neuron(int module, int l, int saturated);
+void NN_prof_call(int module, int phase, uint64_t t0);
+void NN_prof_dump(FILE *fp);
+void NN_prof_reset(void);
+
+// Scoped timer:  the time from SCOPED_TIMER(h) to the end of the enclosing block is added
+// to the LATENCY *h (GCC / Clang cleanup attribute)
+typedef struct SCOPE
+	{
+	LATENCY *h;
+	uint64_t start;
+	} SCOPE;
+
+void end_scope(SCOPE *s);
+
+#define SCOPE_NAME(line)		scope_##line
+#define SCOPE_NAME2(line)		SCOPE_NAME(line)
+#define SCOPED_TIMER(latency)	SCOPE SCOPE_NAME2(__LINE__) __attribute__((cleanup(end_scope))) = \
+								{(latency), NN_now_ns()}
+
+#ifdef NN_PROFILE
+
+// uint64_t t = start of the current call (or layer)
+#define PROF_BEGIN(t)					uint64_t t = NN_now_ns()
+// Add the time since t to (module, l, phase) with its FLOPs, and restart t
+#define PROF_LAYER(m, l, phase, t, flops)	NN_prof_layer(m, l, phase, &(t), flops)
+// Count the n derivatives g[] (of type real) below gmin
+#define PROF_SATURATED(m, l, g, n, gmin)	NN_prof_saturated(m, l, g, n, gmin)
+// Count one neuron of layer l, saturated if "cond"
+#define PROF_NEURON(m, l, cond)			NN_prof_neuron(m, l, cond)
+// Add a whole call started at t0 to the latency histograms (and dump if it is time)
+#define PROF_CALL(m, phase, t0)			NN_prof_call(m, phase, t0)
+#define PROF_SCOPE(latency)				SCOPED_TIMER(latency)
+
+#else
+
+#define PROF_BEGIN(t)
+#define PROF_LAYER(m, l, phase, t, flops)	((void) 0)
+#define PROF_SATURATED(m, l, g, n, gmin)	((void) 0)
+#define PROF_NEURON(m, l, cond)			((void) 0)
+#define PROF_CALL(m, phase, t0)			((void) 0)
+#define PROF_SCOPE(latency)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
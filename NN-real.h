@@ -0,0 +1,18 @@
+#ifndef NN_REAL_H
+#define NN_REAL_H
+
+//************************** scalar type of the networks *******************************//
+// Weights, outputs and local gradients of all networks are of type "real":  double by
+// default, or float when every file is compiled with -DNN_FLOAT32.  Single precision
+// doubles the number of SIMD lanes and halves the memory traffic;  dot products are then
+// also accumulated in float.
+
+#ifdef NN_FLOAT32
+typedef float real;
+#define REAL_DIGITS	9			// significant digits to print a real exactly
+#else
+typedef double real;
+#define REAL_DIGITS	17
+#endif
+
+#endif
@@ -0,0 +1,169 @@
+// Timeline tracing of NN-trace.h:  per-thread event chunks, written as Chrome trace JSON
+// ("X" complete events, timestamps in µs).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>				// clock_gettime()
+#include "NN-trace.h"
+
+typedef struct TRACE_EVENT
+	{
+	const char *name;
+	uint64_t start, end;		// ns since trace_start()
+	} TRACE_EVENT;
+
+typedef struct CHUNK
+	{
+	struct CHUNK *next;			// in the list of all chunks
+	int tid;
+	const char *threadName;
+	int n;						// written by its thread only, read after trace_stop()
+	TRACE_EVENT ev[TraceChunk];
+	} CHUNK;
+
+static int recording = 0;			// read and written with atomics
+static uint64_t origin;				// CLOCK_MONOTONIC ns of trace_start()
+static char traceFile[1024];
+static CHUNK *chunks = NULL;		// all chunks, newest first
+static long numEvents = 0;			// reserved by full chunks, for TraceMaxEvents
+static long dropped = 0;
+static int numThreads = 0;
+static int generation = 0;			// of trace_start()
+
+static __thread CHUNK *current = NULL;
+static __thread int currentGeneration = -1;	// "current" is stale from an earlier trace
+static __thread int tid = -1;
+static __thread const char *threadName = NULL;
+
+static uint64_t monotonic_ns(void)
+	{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000u + t.tv_nsec;
+	}
+
+uint64_t trace_clock(void)
+	{
+	if (!__atomic_load_n(&recording, __ATOMIC_RELAXED))
+		return 0;
+	uint64_t t = monotonic_ns() - origin;
+	return t > 0 ? t : 1;
+	}
+
+// A new chunk for the calling thread, pushed onto the list;  NULL past TraceMaxEvents
+static CHUNK *new_chunk(void)
+	{
+	if (__atomic_add_fetch(&numEvents, TraceChunk, __ATOMIC_RELAXED) > TraceMaxEvents)
+		return NULL;
+	CHUNK *c = (CHUNK *) malloc(sizeof (CHUNK));
+	if (c == NULL)
+		return NULL;
+	if (tid < 0)
+		tid = __atomic_fetch_add(&numThreads, 1, __ATOMIC_RELAXED);
+	c->tid = tid;
+	c->threadName = threadName;
+	c->n = 0;
+	c->next = __atomic_load_n(&chunks, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&chunks, &c->next, c, true, __ATOMIC_RELEASE,
+			__ATOMIC_RELAXED))
+		;
+	return c;
+	}
+
+void trace_event(const char *name, uint64_t start)
+	{
+	if (start == 0)
+		return;
+	uint64_t end = trace_clock();
+	if (end == 0)
+		return;
+	int g = __atomic_load_n(&generation, __ATOMIC_RELAXED);
+	if (current == NULL || currentGeneration != g || current->n == TraceChunk)
+		{
+		currentGeneration = g;
+		if ((current = new_chunk()) == NULL)
+			{
+			__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+			return;
+			}
+		}
+	TRACE_EVENT *e = &current->ev[current->n];
+	e->name = name;
+	e->start = start;
+	e->end = end;
+	__atomic_store_n(&current->n, current->n + 1, __ATOMIC_RELEASE);
+	}
+
+void trace_thread_name(const char *name)
+	{
+	threadName = name;
+	if (current != NULL && currentGeneration == __atomic_load_n(&generation, __ATOMIC_RELAXED))
+		current->threadName = name;
+	}
+
+bool trace_start(const char *fileName)
+	{
+	if (fileName == NULL && (fileName = getenv("NN_TRACE")) == NULL)
+		return false;
+	snprintf(traceFile, sizeof traceFile, "%s", fileName);
+	origin = monotonic_ns();
+	__atomic_add_fetch(&generation, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&recording, 1, __ATOMIC_RELEASE);
+	return true;
+	}
+
+long trace_stop(void)
+	{
+	if (!__atomic_exchange_n(&recording, 0, __ATOMIC_ACQ_REL))
+		return 0;
+	CHUNK *list = __atomic_exchange_n(&chunks, NULL, __ATOMIC_ACQUIRE);
+	FILE *fp = fopen(traceFile, "w");
+	if (fp == NULL)
+		fprintf(stderr, "Cannot write trace %s\n", traceFile);
+
+	long written = 0;
+	if (fp != NULL)
+		{
+		fprintf(fp, "{\"traceEvents\":[\n");
+		fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+				"\"args\":{\"name\":\"Genifer\"}}");
+		}
+	// thread names first, one per tid
+	char *named = (char *) calloc(numThreads + 1, 1);
+	for (CHUNK *c = list; c != NULL && fp != NULL; c = c->next)
+		if (c->threadName != NULL && !named[c->tid])
+			{
+			named[c->tid] = 1;
+			fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+					"\"args\":{\"name\":\"%s\"}}", c->tid, c->threadName);
+			}
+	free(named);
+
+	while (list != NULL)
+		{
+		CHUNK *c = list;
+		int n = __atomic_load_n(&c->n, __ATOMIC_ACQUIRE);
+		for (int i = 0; i < n && fp != NULL; ++i)
+			fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+					"\"ts\":%.3f,\"dur\":%.3f}", c->ev[i].name, c->tid,
+					c->ev[i].start * 1e-3, (c->ev[i].end - c->ev[i].start) * 1e-3);
+		written += n;
+		list = c->next;
+		free(c);
+		}
+	if (fp != NULL)
+		{
+		fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+		fclose(fp);
+		}
+
+	// the threads' chunks are freed:  the next trace_start() changes the generation
+	numEvents = 0;
+	if (dropped > 0)
+		fprintf(stderr, "Trace %s:  %ld events dropped beyond %ld\n", traceFile, dropped,
+				(long) TraceMaxEvents);
+	dropped = 0;
+	return written;
+	}
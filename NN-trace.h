@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+//************************** timeline tracing ******************************************//
+// Built with -DNN_TRACE, the training loops record one event per phase of an iteration
+// (data generation, forward, error, back-prop, test set, plot, checkpoint, and the
+// barriers / reductions of the parallel trainer) between trace_start() and trace_stop(),
+// which writes them as a Chrome trace JSON file:  open it in chrome://tracing or
+// https://ui.perfetto.dev to see every thread on one timeline.
+//
+// Each thread appends to its own chunk of TraceChunk events, so recording takes no lock
+// and no atomic read-modify-write except when a chunk is full;  the chunks of all threads
+// are linked into one lock-free list, and written out by trace_stop().
+// Without NN_TRACE the TRACE_* macros expand to nothing.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TraceChunk		4096			// events per chunk
+#define TraceMaxEvents	(1L << 22)		// then further events are dropped (~100 MB)
+
+// Phase names, so that every loop labels the same phase the same way
+#define Trace_transition	"transition"	// data generation
+#define Trace_target		"target_func"
+#define Trace_forward		"forward"
+#define Trace_error			"error"
+#define Trace_backward		"back_prop"
+#define Trace_test			"test_set"
+#define Trace_plot			"plot"
+#define Trace_checkpoint	"checkpoint"
+#define Trace_barrier		"barrier"
+#define Trace_update		"update"
+
+// Start recording, to write fileName on trace_stop();  NULL = the file named by the
+// environment variable NN_TRACE, and if that is not set, do not trace
+bool trace_start(const char *fileName);
+// Stop recording and write the file.  Other threads must not be recording any more (ie
+// joined, or waiting on a barrier).  Returns the # of events written.
+long trace_stop(void);
+// Name the calling thread on the timeline (a static string)
+void trace_thread_name(const char *name);
+
+uint64_t trace_clock(void);					// 0 when not recording
+void trace_event(const char *name, uint64_t start);	// static name, start from trace_clock()
+
+#ifdef NN_TRACE
+// uint64_t t = start of a phase
+#define TRACE_BEGIN(t)			uint64_t t = trace_clock()
+// Record the phase "name" from t to now, and restart t for the next phase
+#define TRACE_END(name, t)		(trace_event(name, t), (t) = trace_clock())
+#else
+#define TRACE_BEGIN(t)
+#define TRACE_END(name, t)		((void) 0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -24,6 +24,7 @@
 #include <time.h>
 
 #include "feedforward-NN.h"
+#include "perf-counters.h"
 
 extern double sigmoid(double v);
 extern double randomWeight();
@@ -31,16 +32,32 @@ extern NNET *create_NN(int numberOfLayers, int *neuronsPerLayer);
 extern void forward_prop_sigmoid(NNET *, int, double *);
 extern double calc_error(NNET *net, double *Y);
 extern void back_prop(NNET *, double *errors);
+extern PLAN *freeze(const NNET *, ACTIVATION);
+extern bool update_plan(PLAN *, const NNET *);
+extern void free_plan(PLAN *);
+extern void evaluate(const PLAN *, const double *, double *);
 extern void plot_W(NNET *);
 extern void start_W_plot(void);
 
 //************************** prepare Q-net ***********************//
 NNET *Qnet;
+PLAN *Qplan = NULL;				// frozen copy of Qnet, for getQ()
 
 #define dimK 9
 int QnumLayers = 4;
 int QneuronsPerLayer[] = {dimK * 2, 10, 7, 1};
 
+// Bring Qplan up to date after Qnet has changed (not while other threads are in getQ)
+void refreeze_Qnet()
+	{
+	if (Qplan == NULL || !update_plan(Qplan, Qnet))
+		{
+		if (Qplan != NULL)
+			free_plan(Qplan);
+		Qplan = freeze(Qnet, Act_sigmoid);
+		}
+	}
+
 void init_Qnet()
 	{
 	// int numLayers2 = 5;
@@ -53,6 +70,7 @@ void init_Qnet()
 	Qnet = (NNET*) malloc(sizeof (NNET));
 	//create neural network for backpropagation
 	Qnet = create_NN(QnumLayers, QneuronsPerLayer);
+	refreeze_Qnet();
 
 	start_W_plot();
 	// return Qnet;
@@ -60,13 +78,16 @@ void init_Qnet()
 
 void load_Qnet(char *fname)
 	{
-	int numLayers2;
-	int *neuronsPerLayer2;
-	extern NNET * loadNet(int *, int *p[], char *);
-	Qnet = loadNet(&numLayers2, &neuronsPerLayer2, fname);
-	// LAYER lastLayer = Vnet->layers[numLayers - 1];
-
-	return;
+	extern NNET *load_NN(const char *, ACTIVATION *);
+	ACTIVATION act;
+	NNET *net = load_NN(fname, &act);			// text or binary (NN-file.c)
+	if (net == NULL)
+		{
+		printf("Cannot load %s\n", fname);
+		return;
+		}
+	Qnet = net;
+	refreeze_Qnet();
 	}
 
 void save_Qnet(char *fname)
@@ -90,7 +111,7 @@ void save_Qnet(char *fname)
 // Thus we use back-prop to adjust the weights in Q-net to achieve this.
 // ==============================================================
 
-// Finds Q value by forward-propagation
+// Finds Q value by forward-propagation (thread-safe)
 
 double getQ(double K[], double K2[])
 	{
@@ -102,11 +123,12 @@ double getQ(double K[], double K2[])
 		K12[k + dimK] = (double) K2[k];
 		}
 
-	forward_prop_sigmoid(Qnet, dimK * 2, K12);
-
-	LAYER LastLayer = (Qnet->layers[QnumLayers - 1]);
+	// Qplan is only read, so getQ() may be called from several threads at once
+	// (but not while Qnet is being trained)
 	// The last layer has only 1 neuron, which outputs the Q value:
-	return LastLayer.neurons[0].output;
+	double Q;
+	evaluate(Qplan, K12, &Q);
+	return Q;
 	}
 
 // returns the Euclidean norm (absolute value, or size) of the gradient vector
@@ -147,6 +169,7 @@ void train_Q(int s[dimK], double Q)
 
 		back_prop(Qnet, error);
 		}
+	refreeze_Qnet();
 
 	if (++count == 1000)
 		{
@@ -202,6 +225,7 @@ void Q_learn(int K1[dimK], int K2[dimK], double R)
 
 		back_prop(Qnet, dQ);
 		}
+	refreeze_Qnet();
 	}
 
 // **** Learn a simple V-value map via backprop
@@ -289,6 +313,7 @@ double maxQ(int K[dimK], double K2[dimK])
 	double gradQ[dimK]; // the gradient vector ∇Q = [∂Q/∂K2]
 	double K1[dimK];
 	double gradSize;
+	PERF_ENTER(Perf_maxQ);
 
 	for (int k = 0; k < dimK; ++k)
 		K1[k] = (double) K[k];
@@ -335,6 +360,7 @@ double maxQ(int K[dimK], double K2[dimK])
 		}
 
 	double result = getQ(K1, K2);
+	PERF_LEAVE(Perf_maxQ);
 	printf("%2.3f ", result);
 	plot_W(Qnet);
 	return result; // return Q value
@@ -1,11 +1,13 @@
+#include "NN-real.h"
+
 #define Nfold 2					// network will be unfolded for N time steps
 
 //**********************struct for NEURON**********************************//
 typedef struct rNEURON
 	{
-    double output;
-    double *weights;
-    double grad;			// "local gradient", allow for 2 time steps
+    real output;
+    real *weights;
+    real grad;			// "local gradient" ∂E / ∂net of the last step (back-prop, Keep_None)
 	} rNEURON;
 
 //**********************struct for LAYER***********************************//
@@ -13,14 +15,41 @@ typedef struct rLAYER
 	{
     int numNeurons;
     rNEURON *neurons;
+    int keep;			// sensitivities kept of its weights:  Keep_None, Keep_Own or Keep_All
+    real *S;			// the sensitivities, see below
+    real *delta;		// [output k][neuron n]  ∂Y_k / ∂net_n of the last step
 	} rLAYER;
 
 //*********************struct for NNET************************************//
+// The output layer is the state of the recurrence:  input r < numRecurrent of each step is
+// output r of the step before (the caller copies it, as in RNN_sine_test()).
+//
+// forward_RTRL() carries the sensitivity tensor p^k_ij = ∂Y_k / ∂W_ij of every output k
+// from step to step, and RTRL() changes each weight by η Σ_k error_k p^k_ij.  It is kept
+// per layer, in the shape of the layer's weight matrix (row n, bias first):
+//		Keep_All	[output k][row n][weight i], all outputs
+//		Keep_Own	[row n][weight i], only for output k = n (output layer only)
+//		Keep_None	not kept:  the gradient of the last step only, by back-prop
+// RTRL_approximate() chooses which layers keep what.
 typedef struct RNN
 	{
     double *inputs;
     int numLayers;
     rLAYER *layers;
+    int approximation;		// see RTRL_approximate()
+    int numRecurrent;		// = min(# of inputs, # of outputs)
+    real *J;				// [output k][recurrent input r]  ∂Y_k / ∂x_r of the last step
+    real *old;				// [R][row length] scratch:  p^r(t - 1) of one row of S
+    real *sensitivities;	// one block for all S, delta, J and old
 	} RNN;
 
+enum { Keep_None, Keep_Own, Keep_All };
+
+// RTRL_approximate(net, n):  SnAp-n keeps p^k_ij only when W_ij reaches output k within
+// n hops of the network (a hop = a layer, or the feedback from an output to its input):
+// the rows of the output layer their own output for n ≥ 1 (all for n > numLayers), and
+// hidden layer l all outputs for n ≥ numLayers - l.  n = 0 keeps nothing (back-prop of
+// each step alone, with the p's of no step before).
+#define RTRL_Exact	(-1)		// keep everything
+
 #define dim_K	10
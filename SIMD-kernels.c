@@ -0,0 +1,762 @@
+// SIMD kernels for the feed-forward network
+// The inner loops of forward-prop and back-prop are dot products (induced local field),
+// "axpy" operations (back-propagated sums and the rank-1 weight update) and element-wise
+// activation functions.  Each of these has a scalar version plus SSE2, AVX2 and AVX-512
+// versions.  The best set supported by the CPU is picked once at start-up.
+
+// The vector versions use unaligned loads because the weights of a neuron start at
+// column 1 of its row (column 0 is the bias).
+
+// The same source serves both precisions:  PK(_mm_add) expands to _mm_add_pd for double
+// or _mm_add_ps for float, and the loop strides are in lanes (N128, N256, N512).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "SIMD-kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NN_X86 1
+
+#ifdef NN_FLOAT32
+#define PK(op)		op##_ps			// packed-real intrinsic
+typedef __m128 v128;
+typedef __m256 v256;
+typedef __m512 v512;
+typedef __mmask16 mask512;
+#define CMP512_MASK	_mm512_cmp_ps_mask
+#define CAST256_128	_mm256_castps256_ps128
+#else
+#define PK(op)		op##_pd
+typedef __m128d v128;
+typedef __m256d v256;
+typedef __m512d v512;
+typedef __mmask8 mask512;
+#define CMP512_MASK	_mm512_cmp_pd_mask
+#define CAST256_128	_mm256_castpd256_pd128
+#endif
+
+#define N128	((int) (16 / sizeof (real)))		// lanes per register
+#define N256	((int) (32 / sizeof (real)))
+#define N512	((int) (64 / sizeof (real)))
+#endif
+
+//*********************************** scalar ******************************************//
+
+static real dot_scalar(const real *x, const real *y, int n)
+	{
+	real sum = 0.0;
+	for (int i = 0; i < n; ++i)
+		sum += x[i] * y[i];
+	return sum;
+	}
+
+static void axpy_scalar(real *y, real a, const real *x, int n)
+	{
+	for (int i = 0; i < n; ++i)
+		y[i] += a * x[i];
+	}
+
+static void ReLU_scalar(real *out, real *grad, const real *v, int n, real leakage)
+	{
+	for (int i = 0; i < n; ++i)
+		if (v[i] < 0.0)
+			{
+			out[i] = leakage * v[i];
+			grad[i] = leakage;
+			}
+		else
+			{
+			out[i] = v[i];
+			grad[i] = 1.0;
+			}
+	}
+
+static void x2_scalar(real *out, real *grad, const real *v, int n)
+	{
+	for (int i = 0; i < n; ++i)
+		{
+		real x = v[i];				// v may alias out
+		out[i] = x * x + x;
+		grad[i] = 2.0 * x + 1.0;
+		}
+	}
+
+// σ'(x) = k σ(x) (1 − σ(x)), computed from the output σ(x)
+static void d_sigmoid_scalar(real *grad, const real *out, int n, real steepness)
+	{
+	for (int i = 0; i < n; ++i)
+		grad[i] = steepness * out[i] * (1.0 - out[i]);
+	}
+
+//************************** fast activation functions ********************************//
+// "fast":		e^x = 2^k e^r with k = round(x / ln 2), |r| ≤ ln 2 / 2, and e^r by its Taylor
+//				polynomial of degree ExpDegree;  log(1 + t) = 2 atanh(t / (2 + t)) by its
+//				series.  Max error:  sigmoid 1e-15, softplus 1e-14 (double);
+//				sigmoid 1e-7, softplus 5e-7 (float, 1-2 ulp of the result).
+// "fastest":	linear interpolation in tables of σ(z), z ∈ [-TabRange, TabRange], and of
+//				log(1 + e^-a), a ∈ [0, TabRange], with TabSize intervals;  beyond the range
+//				σ is clamped to the end values.  Max error:  sigmoid 3e-6, softplus 8e-6.
+// The bounds are for Steepness 3.0 and Slope 1.0, as measured by benchmark_activations()
+// over [-40, 40].
+
+#ifdef NN_FLOAT32
+#define ExpDegree	6
+#define LogTerms	7
+#define ExpMax		87.0			// |x| beyond which 2^k leaves the exponent range
+#define MantBits	23
+#define ExpBias		127
+#define Ln2hi		0.693145751953125
+#define Ln2lo		1.428606765330187045e-06
+typedef int32_t ireal;				// integer of the same size as real
+#else
+#define ExpDegree	11
+#define LogTerms	13
+#define ExpMax		708.0
+#define MantBits	52
+#define ExpBias		1023
+#define Ln2hi		6.93147180369123816490e-01
+#define Ln2lo		1.90821492927058770002e-10
+typedef int64_t ireal;
+#endif
+#define Log2e		1.4426950408889634
+
+#define TabRange	16.0
+#define TabSize		2048
+#define TabScale	(TabSize / (2.0 * TabRange))	// table entries per unit of z
+
+static real ExpCoef[ExpDegree + 1];		// 1 / d!
+static real LogCoef[LogTerms];			// 1 / (2d + 1)
+static real SigTable[TabSize + 2];		// σ(z) at z = -TabRange + j / TabScale
+static real LogTable[TabSize / 2 + 2];	// log(1 + e^-a) at a = j / TabScale
+
+static void init_tables(void)
+	{
+	double f = 1.0;
+	for (int d = 0; d <= ExpDegree; ++d)
+		{
+		ExpCoef[d] = 1.0 / f;
+		f *= d + 1;
+		}
+	for (int d = 0; d < LogTerms; ++d)
+		LogCoef[d] = 1.0 / (2 * d + 1);
+	// the last entry is repeated so that the interpolation at the end of the range
+	// can read j + 1
+	for (int j = 0; j <= TabSize + 1; ++j)
+		{
+		double z = -TabRange + (j <= TabSize ? j : TabSize) / TabScale;
+		SigTable[j] = 1.0 / (1.0 + exp(-z));
+		}
+	for (int j = 0; j <= TabSize / 2 + 1; ++j)
+		{
+		double a = (j <= TabSize / 2 ? j : TabSize / 2) / TabScale;
+		LogTable[j] = log1p(exp(-a));
+		}
+	}
+
+static inline real exp_poly(real x)
+	{
+	x = x < -ExpMax ? -ExpMax : (x > ExpMax ? ExpMax : x);
+	real k = (real) (ireal) (x * Log2e + (x < 0.0 ? -0.5 : 0.5));
+	real r = x - k * (real) Ln2hi - k * (real) Ln2lo;
+	real p = ExpCoef[ExpDegree];
+	for (int d = ExpDegree - 1; d >= 0; --d)
+		p = p * r + ExpCoef[d];
+	ireal bits = ((ireal) k + ExpBias) << MantBits;		// 2^k
+	real pow2;
+	memcpy(&pow2, &bits, sizeof pow2);
+	return p * pow2;
+	}
+
+// log(1 + t) for 0 ≤ t ≤ 1
+static inline real log1p_poly(real t)
+	{
+	real s = t / (2.0 + t), s2 = s * s;
+	real p = LogCoef[LogTerms - 1];
+	for (int d = LogTerms - 2; d >= 0; --d)
+		p = p * s2 + LogCoef[d];
+	return 2.0 * s * p;
+	}
+
+// Linear interpolation in table T at position pos (in entries, 0 ≤ pos ≤ size)
+static inline real interp(const real *T, real pos)
+	{
+	int i = (int) pos;
+	return T[i] + (pos - i) * (T[i + 1] - T[i]);
+	}
+
+static void sigmoid_fast_scalar(real *out, const real *v, int n, real steepness)
+	{
+	for (int i = 0; i < n; ++i)
+		out[i] = 1.0 / (1.0 + exp_poly(-steepness * v[i]));
+	}
+
+static void sigmoid_fastest_scalar(real *out, const real *v, int n, real steepness)
+	{
+	for (int i = 0; i < n; ++i)
+		{
+		real z = steepness * v[i];
+		z = z < -TabRange ? -TabRange : (z > TabRange ? TabRange : z);
+		out[i] = interp(SigTable, (z + TabRange) * TabScale);
+		}
+	}
+
+// softplus(x) = max(x, 0) + log(1 + e^-|x|),  σ(x) = 1 / (1 + e^-|x|) or e^-|x| / (1 + e^-|x|)
+static void softplus_fast_scalar(real *out, real *grad, const real *v, int n, real slope)
+	{
+	for (int i = 0; i < n; ++i)
+		{
+		real x = slope * v[i];
+		real e = exp_poly(-fabs(x));
+		real sig = (x >= 0.0 ? 1.0 : e) / (1.0 + e);
+		out[i] = (x > 0.0 ? x : 0.0) + log1p_poly(e);
+		grad[i] = slope * sig;
+		}
+	}
+
+static void softplus_fastest_scalar(real *out, real *grad, const real *v, int n, real slope)
+	{
+	for (int i = 0; i < n; ++i)
+		{
+		real x = slope * v[i];
+		real z = x < -TabRange ? -TabRange : (x > TabRange ? TabRange : x);
+		real a = fabs(z);
+		grad[i] = slope * interp(SigTable, (z + TabRange) * TabScale);
+		out[i] = (x > 0.0 ? x : 0.0) + interp(LogTable, a * TabScale);
+		}
+	}
+
+#ifdef NN_X86
+
+//************************************ SSE2 *******************************************//
+
+// Horizontal sum of the lanes of a 128-bit register
+__attribute__((target("sse2")))
+static real hsum128(v128 s)
+	{
+	#ifdef NN_FLOAT32
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+	#else
+	return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+	#endif
+	}
+
+__attribute__((target("sse2")))
+static real dot_sse2(const real *x, const real *y, int n)
+	{
+	v128 s0 = PK(_mm_setzero)(), s1 = PK(_mm_setzero)();
+	int i = 0;
+	for (; i + 2 * N128 <= n; i += 2 * N128)
+		{
+		s0 = PK(_mm_add)(s0, PK(_mm_mul)(PK(_mm_loadu)(x + i), PK(_mm_loadu)(y + i)));
+		s1 = PK(_mm_add)(s1, PK(_mm_mul)(PK(_mm_loadu)(x + i + N128), PK(_mm_loadu)(y + i + N128)));
+		}
+	real sum = hsum128(PK(_mm_add)(s0, s1));
+	for (; i < n; ++i)
+		sum += x[i] * y[i];
+	return sum;
+	}
+
+__attribute__((target("sse2")))
+static void axpy_sse2(real *y, real a, const real *x, int n)
+	{
+	v128 va = PK(_mm_set1)(a);
+	int i = 0;
+	for (; i + N128 <= n; i += N128)
+		PK(_mm_storeu)(y + i, PK(_mm_add)(PK(_mm_loadu)(y + i),
+				PK(_mm_mul)(va, PK(_mm_loadu)(x + i))));
+	for (; i < n; ++i)
+		y[i] += a * x[i];
+	}
+
+__attribute__((target("sse2")))
+static void ReLU_sse2(real *out, real *grad, const real *v, int n, real leakage)
+	{
+	v128 vl = PK(_mm_set1)(leakage), one = PK(_mm_set1)(1.0), zero = PK(_mm_setzero)();
+	int i = 0;
+	for (; i + N128 <= n; i += N128)
+		{
+		v128 x = PK(_mm_loadu)(v + i);
+		v128 neg = PK(_mm_cmplt)(x, zero);
+		v128 lx = PK(_mm_mul)(vl, x);
+		PK(_mm_storeu)(out + i, PK(_mm_or)(PK(_mm_and)(neg, lx), PK(_mm_andnot)(neg, x)));
+		PK(_mm_storeu)(grad + i, PK(_mm_or)(PK(_mm_and)(neg, vl), PK(_mm_andnot)(neg, one)));
+		}
+	ReLU_scalar(out + i, grad + i, v + i, n - i, leakage);
+	}
+
+__attribute__((target("sse2")))
+static void x2_sse2(real *out, real *grad, const real *v, int n)
+	{
+	v128 one = PK(_mm_set1)(1.0);
+	int i = 0;
+	for (; i + N128 <= n; i += N128)
+		{
+		v128 x = PK(_mm_loadu)(v + i);
+		PK(_mm_storeu)(out + i, PK(_mm_add)(PK(_mm_mul)(x, x), x));
+		PK(_mm_storeu)(grad + i, PK(_mm_add)(PK(_mm_add)(x, x), one));
+		}
+	x2_scalar(out + i, grad + i, v + i, n - i);
+	}
+
+__attribute__((target("sse2")))
+static void d_sigmoid_sse2(real *grad, const real *out, int n, real steepness)
+	{
+	v128 k = PK(_mm_set1)(steepness), one = PK(_mm_set1)(1.0);
+	int i = 0;
+	for (; i + N128 <= n; i += N128)
+		{
+		v128 y = PK(_mm_loadu)(out + i);
+		PK(_mm_storeu)(grad + i, PK(_mm_mul)(PK(_mm_mul)(k, y), PK(_mm_sub)(one, y)));
+		}
+	d_sigmoid_scalar(grad + i, out + i, n - i, steepness);
+	}
+
+//************************************ AVX2 *******************************************//
+
+__attribute__((target("avx2,fma")))
+static real dot_avx2(const real *x, const real *y, int n)
+	{
+	v256 s0 = PK(_mm256_setzero)(), s1 = PK(_mm256_setzero)();
+	int i = 0;
+	for (; i + 2 * N256 <= n; i += 2 * N256)
+		{
+		s0 = PK(_mm256_fmadd)(PK(_mm256_loadu)(x + i), PK(_mm256_loadu)(y + i), s0);
+		s1 = PK(_mm256_fmadd)(PK(_mm256_loadu)(x + i + N256), PK(_mm256_loadu)(y + i + N256), s1);
+		}
+	for (; i + N256 <= n; i += N256)
+		s0 = PK(_mm256_fmadd)(PK(_mm256_loadu)(x + i), PK(_mm256_loadu)(y + i), s0);
+	s0 = PK(_mm256_add)(s0, s1);
+	real sum = hsum128(PK(_mm_add)(CAST256_128(s0), PK(_mm256_extractf128)(s0, 1)));
+	for (; i < n; ++i)
+		sum += x[i] * y[i];
+	return sum;
+	}
+
+__attribute__((target("avx2,fma")))
+static void axpy_avx2(real *y, real a, const real *x, int n)
+	{
+	v256 va = PK(_mm256_set1)(a);
+	int i = 0;
+	for (; i + N256 <= n; i += N256)
+		PK(_mm256_storeu)(y + i, PK(_mm256_fmadd)(va, PK(_mm256_loadu)(x + i),
+				PK(_mm256_loadu)(y + i)));
+	for (; i < n; ++i)
+		y[i] += a * x[i];
+	}
+
+__attribute__((target("avx2,fma")))
+static void ReLU_avx2(real *out, real *grad, const real *v, int n, real leakage)
+	{
+	v256 vl = PK(_mm256_set1)(leakage), one = PK(_mm256_set1)(1.0);
+	v256 zero = PK(_mm256_setzero)();
+	int i = 0;
+	for (; i + N256 <= n; i += N256)
+		{
+		v256 x = PK(_mm256_loadu)(v + i);
+		v256 neg = PK(_mm256_cmp)(x, zero, _CMP_LT_OQ);
+		PK(_mm256_storeu)(out + i, PK(_mm256_blendv)(x, PK(_mm256_mul)(vl, x), neg));
+		PK(_mm256_storeu)(grad + i, PK(_mm256_blendv)(one, vl, neg));
+		}
+	ReLU_scalar(out + i, grad + i, v + i, n - i, leakage);
+	}
+
+__attribute__((target("avx2,fma")))
+static void x2_avx2(real *out, real *grad, const real *v, int n)
+	{
+	v256 one = PK(_mm256_set1)(1.0);
+	int i = 0;
+	for (; i + N256 <= n; i += N256)
+		{
+		v256 x = PK(_mm256_loadu)(v + i);
+		PK(_mm256_storeu)(out + i, PK(_mm256_fmadd)(x, x, x));
+		PK(_mm256_storeu)(grad + i, PK(_mm256_add)(PK(_mm256_add)(x, x), one));
+		}
+	x2_scalar(out + i, grad + i, v + i, n - i);
+	}
+
+__attribute__((target("avx2,fma")))
+static void d_sigmoid_avx2(real *grad, const real *out, int n, real steepness)
+	{
+	v256 k = PK(_mm256_set1)(steepness), one = PK(_mm256_set1)(1.0);
+	int i = 0;
+	for (; i + N256 <= n; i += N256)
+		{
+		v256 y = PK(_mm256_loadu)(out + i);
+		PK(_mm256_storeu)(grad + i, PK(_mm256_mul)(PK(_mm256_mul)(k, y), PK(_mm256_sub)(one, y)));
+		}
+	d_sigmoid_scalar(grad + i, out + i, n - i, steepness);
+	}
+
+// Fast activations, as in the scalar versions above
+
+__attribute__((target("avx2,fma")))
+static inline v256 exp_avx2(v256 x)
+	{
+	x = PK(_mm256_min)(PK(_mm256_max)(x, PK(_mm256_set1)(-ExpMax)), PK(_mm256_set1)(ExpMax));
+	v256 k = PK(_mm256_round)(PK(_mm256_mul)(x, PK(_mm256_set1)(Log2e)),
+			_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	v256 r = PK(_mm256_fnmadd)(k, PK(_mm256_set1)(Ln2hi), x);
+	r = PK(_mm256_fnmadd)(k, PK(_mm256_set1)(Ln2lo), r);
+	v256 p = PK(_mm256_set1)(ExpCoef[ExpDegree]);
+	for (int d = ExpDegree - 1; d >= 0; --d)
+		p = PK(_mm256_fmadd)(p, r, PK(_mm256_set1)(ExpCoef[d]));
+	// 2^k:  put k + bias into the exponent field
+	#ifdef NN_FLOAT32
+	__m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(k),
+			_mm256_set1_epi32(ExpBias)), MantBits);
+	return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+	#else
+	__m256i e = _mm256_slli_epi64(_mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k)),
+			_mm256_set1_epi64x(ExpBias)), MantBits);
+	return _mm256_mul_pd(p, _mm256_castsi256_pd(e));
+	#endif
+	}
+
+__attribute__((target("avx2,fma")))
+static inline v256 log1p_avx2(v256 t)
+	{
+	v256 s = PK(_mm256_div)(t, PK(_mm256_add)(PK(_mm256_set1)(2.0), t));
+	v256 s2 = PK(_mm256_mul)(s, s);
+	v256 p = PK(_mm256_set1)(LogCoef[LogTerms - 1]);
+	for (int d = LogTerms - 2; d >= 0; --d)
+		p = PK(_mm256_fmadd)(p, s2, PK(_mm256_set1)(LogCoef[d]));
+	return PK(_mm256_mul)(PK(_mm256_add)(s, s), p);
+	}
+
+__attribute__((target("avx2,fma")))
+static inline v256 interp_avx2(const real *T, v256 pos)
+	{
+	#ifdef NN_FLOAT32
+	__m256i i = _mm256_cvttps_epi32(pos);
+	v256 f = _mm256_sub_ps(pos, _mm256_cvtepi32_ps(i));
+	v256 t0 = _mm256_i32gather_ps(T, i, 4), t1 = _mm256_i32gather_ps(T + 1, i, 4);
+	#else
+	__m128i i = _mm256_cvttpd_epi32(pos);
+	v256 f = _mm256_sub_pd(pos, _mm256_cvtepi32_pd(i));
+	v256 t0 = _mm256_i32gather_pd(T, i, 8), t1 = _mm256_i32gather_pd(T + 1, i, 8);
+	#endif
+	return PK(_mm256_fmadd)(f, PK(_mm256_sub)(t1, t0), t0);
+	}
+
+__attribute__((target("avx2,fma")))
+static void sigmoid_fast_avx2(real *out, const real *v, int n, real steepness)
+	{
+	v256 k = PK(_mm256_set1)(-steepness), one = PK(_mm256_set1)(1.0);
+	int i = 0;
+	for (; i + N256 <= n; i += N256)
+		{
+		v256 e = exp_avx2(PK(_mm256_mul)(k, PK(_mm256_loadu)(v + i)));
+		PK(_mm256_storeu)(out + i, PK(_mm256_div)(one, PK(_mm256_add)(one, e)));
+		}
+	sigmoid_fast_scalar(out + i, v + i, n - i, steepness);
+	}
+
+__attribute__((target("avx2,fma")))
+static void sigmoid_fastest_avx2(real *out, const real *v, int n, real steepness)
+	{
+	v256 k = PK(_mm256_set1)(steepness), scale = PK(_mm256_set1)(TabScale);
+	v256 lo = PK(_mm256_set1)(-TabRange), hi = PK(_mm256_set1)(TabRange);
+	int i = 0;
+	for (; i + N256 <= n; i += N256)
+		{
+		v256 z = PK(_mm256_mul)(k, PK(_mm256_loadu)(v + i));
+		z = PK(_mm256_min)(PK(_mm256_max)(z, lo), hi);
+		PK(_mm256_storeu)(out + i, interp_avx2(SigTable, PK(_mm256_mul)(PK(_mm256_sub)(z, lo), scale)));
+		}
+	sigmoid_fastest_scalar(out + i, v + i, n - i, steepness);
+	}
+
+__attribute__((target("avx2,fma")))
+static void softplus_fast_avx2(real *out, real *grad, const real *v, int n, real slope)
+	{
+	v256 s = PK(_mm256_set1)(slope), one = PK(_mm256_set1)(1.0), zero = PK(_mm256_setzero)();
+	v256 sign = PK(_mm256_set1)(-0.0);
+	int i = 0;
+	for (; i + N256 <= n; i += N256)
+		{
+		v256 x = PK(_mm256_mul)(s, PK(_mm256_loadu)(v + i));
+		v256 e = exp_avx2(PK(_mm256_or)(x, sign));				// e^-|x|
+		v256 pos = PK(_mm256_cmp)(x, zero, _CMP_GE_OQ);
+		v256 sig = PK(_mm256_div)(PK(_mm256_blendv)(e, one, pos), PK(_mm256_add)(one, e));
+		PK(_mm256_storeu)(out + i, PK(_mm256_add)(PK(_mm256_max)(x, zero), log1p_avx2(e)));
+		PK(_mm256_storeu)(grad + i, PK(_mm256_mul)(s, sig));
+		}
+	softplus_fast_scalar(out + i, grad + i, v + i, n - i, slope);
+	}
+
+__attribute__((target("avx2,fma")))
+static void softplus_fastest_avx2(real *out, real *grad, const real *v, int n, real slope)
+	{
+	v256 s = PK(_mm256_set1)(slope), scale = PK(_mm256_set1)(TabScale);
+	v256 lo = PK(_mm256_set1)(-TabRange), hi = PK(_mm256_set1)(TabRange);
+	v256 zero = PK(_mm256_setzero)(), sign = PK(_mm256_set1)(-0.0);
+	int i = 0;
+	for (; i + N256 <= n; i += N256)
+		{
+		v256 x = PK(_mm256_mul)(s, PK(_mm256_loadu)(v + i));
+		v256 z = PK(_mm256_min)(PK(_mm256_max)(x, lo), hi);
+		v256 a = PK(_mm256_andnot)(sign, z);					// |z|
+		v256 g = interp_avx2(LogTable, PK(_mm256_mul)(a, scale));
+		v256 sig = interp_avx2(SigTable, PK(_mm256_mul)(PK(_mm256_sub)(z, lo), scale));
+		PK(_mm256_storeu)(out + i, PK(_mm256_add)(PK(_mm256_max)(x, zero), g));
+		PK(_mm256_storeu)(grad + i, PK(_mm256_mul)(s, sig));
+		}
+	softplus_fastest_scalar(out + i, grad + i, v + i, n - i, slope);
+	}
+
+//*********************************** AVX-512 *****************************************//
+// The tails are handled with masked loads / stores instead of a scalar loop.
+
+#define TailMask(r)		((mask512) ((1u << (r)) - 1))
+#define FullMask		((mask512) ~0u)
+
+__attribute__((target("avx512f")))
+static real dot_avx512(const real *x, const real *y, int n)
+	{
+	v512 s0 = PK(_mm512_setzero)(), s1 = PK(_mm512_setzero)();
+	int i = 0;
+	for (; i + 2 * N512 <= n; i += 2 * N512)
+		{
+		s0 = PK(_mm512_fmadd)(PK(_mm512_loadu)(x + i), PK(_mm512_loadu)(y + i), s0);
+		s1 = PK(_mm512_fmadd)(PK(_mm512_loadu)(x + i + N512), PK(_mm512_loadu)(y + i + N512), s1);
+		}
+	for (; i + N512 <= n; i += N512)
+		s0 = PK(_mm512_fmadd)(PK(_mm512_loadu)(x + i), PK(_mm512_loadu)(y + i), s0);
+	if (i < n)
+		{
+		mask512 m = TailMask(n - i);
+		s1 = PK(_mm512_fmadd)(PK(_mm512_maskz_loadu)(m, x + i), PK(_mm512_maskz_loadu)(m, y + i), s1);
+		}
+	return PK(_mm512_reduce_add)(PK(_mm512_add)(s0, s1));
+	}
+
+__attribute__((target("avx512f")))
+static void axpy_avx512(real *y, real a, const real *x, int n)
+	{
+	v512 va = PK(_mm512_set1)(a);
+	int i = 0;
+	for (; i + N512 <= n; i += N512)
+		PK(_mm512_storeu)(y + i, PK(_mm512_fmadd)(va, PK(_mm512_loadu)(x + i),
+				PK(_mm512_loadu)(y + i)));
+	if (i < n)
+		{
+		mask512 m = TailMask(n - i);
+		PK(_mm512_mask_storeu)(y + i, m, PK(_mm512_fmadd)(va, PK(_mm512_maskz_loadu)(m, x + i),
+				PK(_mm512_maskz_loadu)(m, y + i)));
+		}
+	}
+
+__attribute__((target("avx512f")))
+static void ReLU_avx512(real *out, real *grad, const real *v, int n, real leakage)
+	{
+	v512 vl = PK(_mm512_set1)(leakage), one = PK(_mm512_set1)(1.0);
+	v512 zero = PK(_mm512_setzero)();
+	for (int i = 0; i < n; i += N512)
+		{
+		mask512 m = (n - i >= N512) ? FullMask : TailMask(n - i);
+		v512 x = PK(_mm512_maskz_loadu)(m, v + i);
+		mask512 neg = CMP512_MASK(x, zero, _CMP_LT_OQ);
+		PK(_mm512_mask_storeu)(out + i, m, PK(_mm512_mask_mul)(x, neg, vl, x));
+		PK(_mm512_mask_storeu)(grad + i, m, PK(_mm512_mask_blend)(neg, one, vl));
+		}
+	}
+
+__attribute__((target("avx512f")))
+static void x2_avx512(real *out, real *grad, const real *v, int n)
+	{
+	v512 one = PK(_mm512_set1)(1.0);
+	for (int i = 0; i < n; i += N512)
+		{
+		mask512 m = (n - i >= N512) ? FullMask : TailMask(n - i);
+		v512 x = PK(_mm512_maskz_loadu)(m, v + i);
+		PK(_mm512_mask_storeu)(out + i, m, PK(_mm512_fmadd)(x, x, x));
+		PK(_mm512_mask_storeu)(grad + i, m, PK(_mm512_add)(PK(_mm512_add)(x, x), one));
+		}
+	}
+
+__attribute__((target("avx512f")))
+static void d_sigmoid_avx512(real *grad, const real *out, int n, real steepness)
+	{
+	v512 k = PK(_mm512_set1)(steepness), one = PK(_mm512_set1)(1.0);
+	for (int i = 0; i < n; i += N512)
+		{
+		mask512 m = (n - i >= N512) ? FullMask : TailMask(n - i);
+		v512 y = PK(_mm512_maskz_loadu)(m, out + i);
+		PK(_mm512_mask_storeu)(grad + i, m, PK(_mm512_mul)(PK(_mm512_mul)(k, y), PK(_mm512_sub)(one, y)));
+		}
+	}
+
+// Fast activations;  2^k is applied with vscalefpd / vscalefps
+
+__attribute__((target("avx512f")))
+static inline v512 exp_avx512(v512 x)
+	{
+	x = PK(_mm512_min)(PK(_mm512_max)(x, PK(_mm512_set1)(-ExpMax)), PK(_mm512_set1)(ExpMax));
+	v512 k = PK(_mm512_roundscale)(PK(_mm512_mul)(x, PK(_mm512_set1)(Log2e)),
+			_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	v512 r = PK(_mm512_fnmadd)(k, PK(_mm512_set1)(Ln2hi), x);
+	r = PK(_mm512_fnmadd)(k, PK(_mm512_set1)(Ln2lo), r);
+	v512 p = PK(_mm512_set1)(ExpCoef[ExpDegree]);
+	for (int d = ExpDegree - 1; d >= 0; --d)
+		p = PK(_mm512_fmadd)(p, r, PK(_mm512_set1)(ExpCoef[d]));
+	return PK(_mm512_scalef)(p, k);
+	}
+
+__attribute__((target("avx512f")))
+static inline v512 log1p_avx512(v512 t)
+	{
+	v512 s = PK(_mm512_div)(t, PK(_mm512_add)(PK(_mm512_set1)(2.0), t));
+	v512 s2 = PK(_mm512_mul)(s, s);
+	v512 p = PK(_mm512_set1)(LogCoef[LogTerms - 1]);
+	for (int d = LogTerms - 2; d >= 0; --d)
+		p = PK(_mm512_fmadd)(p, s2, PK(_mm512_set1)(LogCoef[d]));
+	return PK(_mm512_mul)(PK(_mm512_add)(s, s), p);
+	}
+
+__attribute__((target("avx512f")))
+static inline v512 interp_avx512(const real *T, v512 pos)
+	{
+	#ifdef NN_FLOAT32
+	__m512i i = _mm512_cvttps_epi32(pos);
+	v512 f = _mm512_sub_ps(pos, _mm512_cvtepi32_ps(i));
+	v512 t0 = _mm512_i32gather_ps(i, T, 4), t1 = _mm512_i32gather_ps(i, T + 1, 4);
+	#else
+	__m256i i = _mm512_cvttpd_epi32(pos);
+	v512 f = _mm512_sub_pd(pos, _mm512_cvtepi32_pd(i));
+	v512 t0 = _mm512_i32gather_pd(i, T, 8), t1 = _mm512_i32gather_pd(i, T + 1, 8);
+	#endif
+	return PK(_mm512_fmadd)(f, PK(_mm512_sub)(t1, t0), t0);
+	}
+
+__attribute__((target("avx512f")))
+static void sigmoid_fast_avx512(real *out, const real *v, int n, real steepness)
+	{
+	v512 k = PK(_mm512_set1)(-steepness), one = PK(_mm512_set1)(1.0);
+	for (int i = 0; i < n; i += N512)
+		{
+		mask512 m = (n - i >= N512) ? FullMask : TailMask(n - i);
+		v512 e = exp_avx512(PK(_mm512_mul)(k, PK(_mm512_maskz_loadu)(m, v + i)));
+		PK(_mm512_mask_storeu)(out + i, m, PK(_mm512_div)(one, PK(_mm512_add)(one, e)));
+		}
+	}
+
+__attribute__((target("avx512f")))
+static void sigmoid_fastest_avx512(real *out, const real *v, int n, real steepness)
+	{
+	v512 k = PK(_mm512_set1)(steepness), scale = PK(_mm512_set1)(TabScale);
+	v512 lo = PK(_mm512_set1)(-TabRange), hi = PK(_mm512_set1)(TabRange);
+	for (int i = 0; i < n; i += N512)
+		{
+		mask512 m = (n - i >= N512) ? FullMask : TailMask(n - i);
+		v512 z = PK(_mm512_mul)(k, PK(_mm512_maskz_loadu)(m, v + i));
+		z = PK(_mm512_min)(PK(_mm512_max)(z, lo), hi);
+		PK(_mm512_mask_storeu)(out + i, m,
+				interp_avx512(SigTable, PK(_mm512_mul)(PK(_mm512_sub)(z, lo), scale)));
+		}
+	}
+
+__attribute__((target("avx512f")))
+static void softplus_fast_avx512(real *out, real *grad, const real *v, int n, real slope)
+	{
+	v512 s = PK(_mm512_set1)(slope), one = PK(_mm512_set1)(1.0), zero = PK(_mm512_setzero)();
+	for (int i = 0; i < n; i += N512)
+		{
+		mask512 m = (n - i >= N512) ? FullMask : TailMask(n - i);
+		v512 x = PK(_mm512_mul)(s, PK(_mm512_maskz_loadu)(m, v + i));
+		v512 e = exp_avx512(PK(_mm512_sub)(zero, PK(_mm512_abs)(x)));	// e^-|x|
+		mask512 pos = CMP512_MASK(x, zero, _CMP_GE_OQ);
+		v512 sig = PK(_mm512_div)(PK(_mm512_mask_blend)(pos, e, one), PK(_mm512_add)(one, e));
+		PK(_mm512_mask_storeu)(out + i, m, PK(_mm512_add)(PK(_mm512_max)(x, zero), log1p_avx512(e)));
+		PK(_mm512_mask_storeu)(grad + i, m, PK(_mm512_mul)(s, sig));
+		}
+	}
+
+__attribute__((target("avx512f")))
+static void softplus_fastest_avx512(real *out, real *grad, const real *v, int n, real slope)
+	{
+	v512 s = PK(_mm512_set1)(slope), scale = PK(_mm512_set1)(TabScale);
+	v512 lo = PK(_mm512_set1)(-TabRange), hi = PK(_mm512_set1)(TabRange);
+	v512 zero = PK(_mm512_setzero)();
+	for (int i = 0; i < n; i += N512)
+		{
+		mask512 m = (n - i >= N512) ? FullMask : TailMask(n - i);
+		v512 x = PK(_mm512_mul)(s, PK(_mm512_maskz_loadu)(m, v + i));
+		v512 z = PK(_mm512_min)(PK(_mm512_max)(x, lo), hi);
+		v512 g = interp_avx512(LogTable, PK(_mm512_mul)(PK(_mm512_abs)(z), scale));
+		v512 sig = interp_avx512(SigTable, PK(_mm512_mul)(PK(_mm512_sub)(z, lo), scale));
+		PK(_mm512_mask_storeu)(out + i, m, PK(_mm512_add)(PK(_mm512_max)(x, zero), g));
+		PK(_mm512_mask_storeu)(grad + i, m, PK(_mm512_mul)(s, sig));
+		}
+	}
+
+#endif // NN_X86
+
+//************************************ dispatch ***************************************//
+
+static const NN_KERNELS kernels_scalar =
+	{"scalar", dot_scalar, axpy_scalar, ReLU_scalar, x2_scalar, d_sigmoid_scalar,
+	sigmoid_fast_scalar, sigmoid_fastest_scalar, softplus_fast_scalar, softplus_fastest_scalar};
+
+#ifdef NN_X86
+static const NN_KERNELS kernels_sse2 =
+	{"sse2", dot_sse2, axpy_sse2, ReLU_sse2, x2_sse2, d_sigmoid_sse2,
+	sigmoid_fast_scalar, sigmoid_fastest_scalar, softplus_fast_scalar, softplus_fastest_scalar};
+static const NN_KERNELS kernels_avx2 =
+	{"avx2", dot_avx2, axpy_avx2, ReLU_avx2, x2_avx2, d_sigmoid_avx2,
+	sigmoid_fast_avx2, sigmoid_fastest_avx2, softplus_fast_avx2, softplus_fastest_avx2};
+static const NN_KERNELS kernels_avx512 =
+	{"avx512", dot_avx512, axpy_avx512, ReLU_avx512, x2_avx512, d_sigmoid_avx512,
+	sigmoid_fast_avx512, sigmoid_fastest_avx512, softplus_fast_avx512, softplus_fastest_avx512};
+#endif
+
+NN_KERNELS NNk =
+	{"scalar", dot_scalar, axpy_scalar, ReLU_scalar, x2_scalar, d_sigmoid_scalar,
+	sigmoid_fast_scalar, sigmoid_fastest_scalar, softplus_fast_scalar, softplus_fastest_scalar};
+
+int NN_select_kernels(const char *name)
+	{
+	if (!strcmp(name, "scalar"))
+		{
+		NNk = kernels_scalar;
+		return 1;
+		}
+	#ifdef NN_X86
+	__builtin_cpu_init();
+	if (!strcmp(name, "sse2") && __builtin_cpu_supports("sse2"))
+		{
+		NNk = kernels_sse2;
+		return 1;
+		}
+	if (!strcmp(name, "avx2") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		{
+		NNk = kernels_avx2;
+		return 1;
+		}
+	if (!strcmp(name, "avx512") && __builtin_cpu_supports("avx512f"))
+		{
+		NNk = kernels_avx512;
+		return 1;
+		}
+	#endif
+	return 0;
+	}
+
+// Runs before main():  pick the widest kernel set the CPU supports
+__attribute__((constructor))
+static void init_kernels(void)
+	{
+	init_tables();
+
+	char *forced = getenv("NN_KERNELS");
+	if (forced != NULL && NN_select_kernels(forced))
+		return;
+
+	if (!NN_select_kernels("avx512"))
+		if (!NN_select_kernels("avx2"))
+			NN_select_kernels("sse2");
+	}
@@ -0,0 +1,32 @@
+
+//******************** vector kernels for forward / backward passes ********************//
+// One set of kernels is chosen at start-up according to what the CPU supports (cpuid).
+// The scalar set is the reference implementation.
+// The activation kernels may be called in place (out == v).
+// All kernels work on "real" (NN-real.h), so the float build gets twice the lanes.
+
+#include "NN-real.h"
+
+typedef struct NN_KERNELS
+	{
+	const char *name;
+	real (*dot)(const real *x, const real *y, int n);				// Σ x_i y_i
+	void (*axpy)(real *y, real a, const real *x, int n);			// y += a x
+	void (*ReLU)(real *out, real *grad, const real *v, int n, real leakage);
+	void (*x2)(real *out, real *grad, const real *v, int n);
+	void (*d_sigmoid)(real *grad, const real *out, int n, real steepness);
+	// Approximate activations without libm calls, see "fast activation functions" in
+	// SIMD-kernels.c for the error bounds.  out = σ(steepness v) or log(1 + e^(slope v)),
+	// grad = slope σ(slope v).
+	void (*sigmoid_fast)(real *out, const real *v, int n, real steepness);
+	void (*sigmoid_fastest)(real *out, const real *v, int n, real steepness);
+	void (*softplus_fast)(real *out, real *grad, const real *v, int n, real slope);
+	void (*softplus_fastest)(real *out, real *grad, const real *v, int n, real slope);
+	} NN_KERNELS;
+
+extern NN_KERNELS NNk;					// the kernels currently in use
+
+// Force a kernel set by name ("scalar", "sse2", "avx2", "avx512");  returns 0 if the
+// CPU does not support it, in which case the current set is kept.
+// The environment variable NN_KERNELS has the same effect at start-up.
+int NN_select_kernels(const char *name);
@@ -16,13 +16,29 @@ extern NNET *create_NN(int numberOfLayers, int *neuronsPerLayer);
 extern void forward_prop_sigmoid(NNET *, int, double *);
 extern double calc_error(NNET *net, double *Y);
 extern void back_prop(NNET *, double *errors);
+extern PLAN *freeze(const NNET *, ACTIVATION);
+extern bool update_plan(PLAN *, const NNET *);
+extern void free_plan(PLAN *);
+extern void evaluate(const PLAN *, const double *, double *);
 
 //************************** prepare Q-net ***********************//
 NNET *Vnet;
+PLAN *Vplan = NULL;				// frozen copy of Vnet, for get_V()
 
 int VnumLayers = 5;
 int VneuronsPerLayer[] = {9, 40, 30, 20, 1};		// success
 
+// Bring Vplan up to date after Vnet has changed (not while other threads are in get_V)
+void refreeze_Vnet()
+	{
+	if (Vplan == NULL || !update_plan(Vplan, Vnet))
+		{
+		if (Vplan != NULL)
+			free_plan(Vplan);
+		Vplan = freeze(Vnet, Act_sigmoid);
+		}
+	}
+
 void init_Vnet()
 	{
 	//the first layer -- input layer
@@ -32,19 +48,23 @@ void init_Vnet()
 	Vnet = (NNET*) malloc(sizeof (NNET));
 	//create neural network for backpropagation
 	Vnet = create_NN(VnumLayers, VneuronsPerLayer);
+	refreeze_Vnet();
 
 	// return Vnet;
 	}
 
 void load_Vnet()
 	{
-	int numLayers2;
-	int *neuronsPerLayer2;
-	extern NNET * loadNet(int *, int *p[], char *);
-	Vnet = loadNet(&numLayers2, &neuronsPerLayer2, "v.net");
-	// LAYER lastLayer = Vnet->layers[numLayers - 1];
-
-	return;
+	extern NNET *load_NN(const char *, ACTIVATION *);
+	ACTIVATION act;
+	NNET *net = load_NN("v.net", &act);			// text or binary (NN-file.c)
+	if (net == NULL)
+		{
+		printf("Cannot load v.net\n");
+		return;
+		}
+	Vnet = net;
+	refreeze_Vnet();
 	}
 
 void save_Vnet(char *fname)
@@ -77,6 +97,7 @@ void train_V(int s[9], double V)
 
 		back_prop(Vnet, error);
 		}
+	refreeze_Vnet();
 	}
 
 // **** Learn a simple V-value map via backprop and Bellman update
@@ -109,9 +130,10 @@ void learn_V(int s2[9], int s[9])
 
 		back_prop(Vnet, error);
 		}
+	refreeze_Vnet();
 	}
 
-// Get V-value by forward propagation
+// Get V-value by forward propagation (thread-safe)
 
 double get_V(int x[9])
 	{
@@ -119,10 +141,10 @@ double get_V(int x[9])
 	for (int k = 0; k < 9; ++k)
 		X[k] = (double) x[k];
 
-	forward_prop_sigmoid(Vnet, 9, X);
-
-	int numLayers = 5;
-	LAYER LastLayer = (Vnet->layers[numLayers - 1]);
-	// The last layer has only 1 neuron, which outputs the Q value:
-	return LastLayer.neurons[0].output;
+	// Vplan is only read, so get_V() may be called from several threads at once
+	// (but not while Vnet is being trained)
+	// The last layer has only 1 neuron, which outputs the V value:
+	double V;
+	evaluate(Vplan, X, &V);
+	return V;
 	}
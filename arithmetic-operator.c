@@ -0,0 +1,128 @@
+// The 2-digit subtraction operator learned by the arithmetic tests (arithmetic-test.c,
+// the genetic NN tests and the time-to-accuracy harness).  Needs no graphics.
+
+#include <stdlib.h>
+#include <math.h>
+
+// **************** 2-Digit Primary-school Subtraction Arithmetic test *****************
+
+// The goal is to perform subtraction like a human child would.
+// Input: 2-digit numbers A and B, for example "12", "07"
+// Output: A - B, eg:  "12" - "07" = "05"
+
+// State vector = [ A1, A0, B1, B0, C1, C0, carry-flag, current-digit, result-ready-flag,
+//		underflow-error-flag ]
+
+// Algorithm:
+
+// If current-digit = 0:
+//		if A0 >= B0 then C0 = A0 - B0
+//		else C0 = 10 + (A0 - B0) , carry-flag = 1
+//		current-digit = 1
+
+// If current-digit = 1:
+//		if A1 >= B1 then
+//			C1 = A1 - B1
+//		else Underflow Error
+//		if carry-flag = 0:
+//			result-ready = 1
+//		else	// carry-flag = 1
+//			if C1 >= 1
+//				--C1
+//			else Underflow error
+//			result-ready = 1
+
+// This defines the transition operator acting on vector space K1 (of dimension 10)
+
+void transition(double K1[], double K2[])
+	{
+	double A1 = floor(K1[0] * 10.0) / 10.0;
+	double A0 = floor(K1[1] * 10.0) / 10.0;
+	double B1 = floor(K1[2] * 10.0) / 10.0;
+	double B0 = floor(K1[3] * 10.0) / 10.0;
+	double carryFlag = K1[4];
+	double currentDigit = K1[5];
+	double C1 = K1[6];
+	double C0 = K1[7];
+	double resultReady = K1[8];
+	double underflowError = K1[9];
+
+	if (currentDigit < 0.5)
+		{
+		if (A0 >= B0) // C seems to support >= for comparison of doubles
+			{
+			C0 = A0 - B0;
+			carryFlag = 0.0;
+			}
+		else
+			{
+			C0 = 1.0 + (A0 - B0);
+			carryFlag = 1.0;
+			}
+		currentDigit = 1.0;
+		resultReady = 0.0;
+		underflowError = 0.0;
+		C1 = 0.0; // optional
+		}
+	else // current digit = 1
+		{
+		resultReady = 1.0;
+
+		if (A1 >= B1)
+			{
+			C1 = A1 - B1;
+			underflowError = 0.0;
+			}
+		else
+			{
+			underflowError = 1.0;
+			C1 = 0.0; // optional
+			}
+
+		if (carryFlag > 0.5)
+			{
+			if (C1 > 0.09999)
+				C1 -= 0.1;
+			else
+				underflowError = 1.0;
+			}
+
+		C0 = C0; // necessary
+		carryFlag = 0.0; // optional
+		currentDigit = 1.0; // optional
+		}
+
+	K2[0] = A1;
+	K2[1] = A0;
+	K2[2] = B1;
+	K2[3] = B0;
+	K2[4] = carryFlag;
+	K2[5] = currentDigit;
+	K2[6] = C1;
+	K2[7] = C0;
+	K2[8] = resultReady;
+	K2[9] = underflowError;
+	}
+
+// Same K vectors as in arithmetic_testB(), but thread-safe (random numbers from *seed)
+// x = K (8 dimensions), y = desired output = components 4..9 of transition(K)
+void arithmetic_sample(unsigned int *seed, double *x, double *y)
+	{
+	double K1[10], K_star[10];
+
+	// Create random K vector (4 + 2 + 2 elements)
+	for (int k = 0; k < 4; ++k)
+		K1[k] = floor((rand_r(seed) / (double) RAND_MAX) * 10.0) / 10.0;
+	for (int k = 4; k < 6; ++k)
+		K1[k] = (rand_r(seed) / (double) RAND_MAX) > 0.5 ? 1.0 : 0.0;
+	for (int k = 6; k < 8; ++k)
+		K1[k] = floor((rand_r(seed) / (double) RAND_MAX) * 10.0) / 10.0;
+	K1[8] = K1[9] = 0.0;
+
+	transition(K1, K_star);
+
+	for (int k = 0; k < 8; ++k)
+		x[k] = K1[k];
+	for (int k = 4; k < 10; ++k)
+		y[k - 4] = K_star[k];
+	}
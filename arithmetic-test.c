@@ -1,20 +1,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>				// strlen()
+#include <ctype.h>				// isspace()
 #include <math.h>
 #include <gsl/gsl_matrix.h>		// GNU scientific library
 #include <gsl/gsl_eigen.h>		// ...for finding matrix eigen values
 #include <gsl/gsl_complex_math.h>	// ...for complex abs value
 #include <stdbool.h>
+#include <time.h>
+#include <unistd.h>				// sysconf()
 #include "BPTT-RNN.h"
 #include "feedforward-NN.h"
+#include "int8-NN.h"
+#include "NN-file.h"
+#include "NN-trace.h"
+#include "training-loops.h"
 
 extern NNET *create_NN(int, int *);
 extern void re_randomize(NNET *, int, int *);
 extern RNN *create_BPTT_NN(int, int *);
 extern void BPTT_re_randomize(RNN *, int, int *);
-extern void free_NN(NNET *, int *);
-extern void free_BPTT_NN(RNN *, int *);
+extern void free_NN(NNET *);
+extern void free_BPTT_NN(RNN *);
 extern void forward_prop(NNET *, int, double *);
 extern void forward_prop_ReLU(NNET *, int, double *);
 extern void forward_prop_SP(NNET *, int, double *);
@@ -22,6 +29,31 @@ extern void forward_BPTT(RNN *, int, double *, int);
 extern void back_prop(NNET *, double *);
 extern void back_prop_ReLU(NNET *, double *);
 extern void backprop_through_time(RNN *, double *, int);
+extern BPTT_BATCH *create_BPTT_batch(RNN *, int, int);
+extern void free_BPTT_batch(BPTT_BATCH *);
+extern void forward_BPTT_batch(RNN *, BPTT_BATCH *, int, double *, int, const int *);
+extern void backprop_BPTT_batch(RNN *, BPTT_BATCH *, double *);
+extern BPTT_STREAM *start_BPTT_stream(RNN *, int, int);
+extern void stop_BPTT_stream(BPTT_STREAM *);
+extern void stream_forward_BPTT(BPTT_STREAM *, int, double *);
+extern void stream_backprop_BPTT(BPTT_STREAM *, double *);
+extern void BPTT_checkpoint(RNN *, int);
+extern double train_hogwild(NNET *, int, ACTIVATION, double, SAMPLER, unsigned int, long, double);
+extern NNET8 *quantize_NN(const NNET *, ACTIVATION, bool, int, const double *);
+extern void free_NN8(NNET8 *);
+extern bool save_NN8(const NNET8 *, const char *);
+extern void int8_report(NNET *, const NNET8 *, int, double *);
+extern bool save_text_NN(const NNET *, const char *, const char *);
+extern NNET *load_NN(const char *, ACTIVATION *);
+extern bool convert_text_NN(const char *, const char *, ACTIVATION);
+extern CHECKPOINTER *start_checkpoints(const NNET *, ACTIVATION, const char *, int, int);
+extern bool checkpoint(CHECKPOINTER *, long, const double *, const double *, int);
+extern void final_checkpoint(CHECKPOINTER *, long, const double *, const double *, int);
+extern int stop_checkpoints(CHECKPOINTER *);
+extern NNET *resume_checkpoint(const char *, int, ACTIVATION *, long *, int, double *, double *, int *);
+extern bool arithmetic_loop(NNET *, int, int *, int, ERR_WINDOW *, long, LOOP *);
+extern bool arithmetic_batch_loop(NNET *, int, int *, int, int, LOOP *);
+extern bool BPTT_arithmetic_loop(RNN *, int, int *, LOOP *);
 extern void pause_graphics();
 extern void quit_graphics();
 extern void start_NN_plot(void);
@@ -51,104 +83,10 @@ extern void start_timer(), end_timer(char *);
 extern double K[];
 
 // **************** 2-Digit Primary-school Subtraction Arithmetic test *****************
+// The transition operator and its training samples are in arithmetic-operator.c
 
-// The goal is to perform subtraction like a human child would.
-// Input: 2-digit numbers A and B, for example "12", "07"
-// Output: A - B, eg:  "12" - "07" = "05"
-
-// State vector = [ A1, A0, B1, B0, C1, C0, carry-flag, current-digit, result-ready-flag,
-//		underflow-error-flag ]
-
-// Algorithm:
-
-// If current-digit = 0:
-//		if A0 >= B0 then C0 = A0 - B0
-//		else C0 = 10 + (A0 - B0) , carry-flag = 1
-//		current-digit = 1
-
-// If current-digit = 1:
-//		if A1 >= B1 then
-//			C1 = A1 - B1
-//		else Underflow Error
-//		if carry-flag = 0:
-//			result-ready = 1
-//		else	// carry-flag = 1
-//			if C1 >= 1
-//				--C1
-//			else Underflow error
-//			result-ready = 1
-
-// This defines the transition operator acting on vector space K1 (of dimension 10)
-
-void transition(double K1[], double K2[])
-	{
-	double A1 = floor(K1[0] * 10.0) / 10.0;
-	double A0 = floor(K1[1] * 10.0) / 10.0;
-	double B1 = floor(K1[2] * 10.0) / 10.0;
-	double B0 = floor(K1[3] * 10.0) / 10.0;
-	double carryFlag = K1[4];
-	double currentDigit = K1[5];
-	double C1 = K1[6];
-	double C0 = K1[7];
-	double resultReady = K1[8];
-	double underflowError = K1[9];
-
-	if (currentDigit < 0.5)
-		{
-		if (A0 >= B0) // C seems to support >= for comparison of doubles
-			{
-			C0 = A0 - B0;
-			carryFlag = 0.0;
-			}
-		else
-			{
-			C0 = 1.0 + (A0 - B0);
-			carryFlag = 1.0;
-			}
-		currentDigit = 1.0;
-		resultReady = 0.0;
-		underflowError = 0.0;
-		C1 = 0.0; // optional
-		}
-	else // current digit = 1
-		{
-		resultReady = 1.0;
-
-		if (A1 >= B1)
-			{
-			C1 = A1 - B1;
-			underflowError = 0.0;
-			}
-		else
-			{
-			underflowError = 1.0;
-			C1 = 0.0; // optional
-			}
-
-		if (carryFlag > 0.5)
-			{
-			if (C1 > 0.09999)
-				C1 -= 0.1;
-			else
-				underflowError = 1.0;
-			}
-
-		C0 = C0; // necessary
-		carryFlag = 0.0; // optional
-		currentDigit = 1.0; // optional
-		}
-
-	K2[0] = A1;
-	K2[1] = A0;
-	K2[2] = B1;
-	K2[3] = B0;
-	K2[4] = carryFlag;
-	K2[5] = currentDigit;
-	K2[6] = C1;
-	K2[7] = C0;
-	K2[8] = resultReady;
-	K2[9] = underflowError;
-	}
+extern void transition(double K1[], double K2[]);
+extern void arithmetic_sample(unsigned int *seed, double *x, double *y);
 
 // Test the transition operator (1 time)
 // This tests both the arithmetics of the digits as well as the settings of flags.
@@ -287,260 +225,299 @@ getA(): return covXY/varX
 getB(): return meanY - getA()*meanX
 */
 
-void arithmetic_testB()
+// Checkpoints of testB (checkpoint.c):  "testB.0.ckpt" is the latest
+#define CheckpointName		"testB"
+#define CheckpointEvery		5000		// iterations
+#define CheckpointKeep		3			// files kept on disk
+
+// Key 2 of the arithmetic tests:  P random questions to the learned operator;  answer()
+// asks one and returns 1 = correct, 2 = negative, 3 = wrong, 4 = non-terminating
+static void test_operator(int (*answer)(void *), void *net)
 	{
-	// int neuronsPerLayer[] = {8, 13, 10, 6}; // first = input layer, last = output layer
-	// int neuronsPerLayer[] = {8, 13, 10, 13, 10, 6};
-	// int neuronsPerLayer[] = {8, 19, 19, 19, 19, 6};
-	int neuronsPerLayer[] = {8, 13, 10, 6};
-	int dimK = 8;
-	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
-	NNET *Net = create_NN(numLayers, neuronsPerLayer);
-	LAYER lastLayer = Net->layers[numLayers - 1];
-	double errors[dimK];
+	printf("\n");
+	int ans_correct = 0, ans_negative = 0, ans_wrong = 0, ans_non_term = 0;
+	#define P 100
+	for (int i = 0; i < P; ++i)
+		{
+		printf("(%d) ", i);
+		switch (answer(net))
+			{
+			case 1:
+				++ans_correct;
+				break;
+			case 2:
+				++ans_negative;
+				break;
+			case 3:
+				++ans_wrong;
+				break;
+			case 4:
+				++ans_non_term;
+				break;
+			default:
+				printf("Answer error!\n");
+				break;
+			}
+		}
 
-	#define M	50			// how many errors to record for averaging
-	double errors1[M], errors2[M]; // two arrays for recording errors
+	printf("\n=======================\n");
+	printf("Answers correct  = %d (%.1f%%)\n", ans_correct, ans_correct * 100 / (float) P);
+	printf("Answers negative = %d (%.1f%%)\n", ans_negative, ans_negative * 100 / (float) P);
+	printf("Answers wrong    = %d (%.1f%%)\n", ans_wrong, ans_wrong * 100 / (float) P);
+	printf("Answers non-term = %d (%.1f%%)\n", ans_non_term, ans_non_term * 100 / (float) P);
+	printf("\n");
+	}
 
-	int userKey = 0;
-	double sum_err1 = 0.0, sum_err2 = 0.0; // sums of errors
-	int tail = 0; // index for cyclic arrays (last-in, first-out)
-	for (int i = 0; i < M; ++i) // clear errors to 0.0
-		errors1[i] = errors2[i] = 0.0;
+static int answer_testC(void *net)
+	{
+	NNET *Net = (NNET *) net;
+	extern int arithmetic_testC_1(NNET *, LAYER);
+	return arithmetic_testC_1(Net, Net->layers[Net->numLayers - 1]);
+	}
 
-	// start_NN_plot();
-	start_W_plot();
-	start_LogErr_plot();
-	// start_K_plot();
-	// start_output_plot();
-	// plot_ideal();
+static int answer_testE(void *net)
+	{
+	NNET *Net = (NNET *) net;
+	extern int arithmetic_testE_1(NNET *, LAYER);
+	return arithmetic_testE_1(Net, Net->layers[Net->numLayers - 1]);
+	}
+
+static int answer_BPTT(void *net)
+	{
+	RNN *Net = (RNN *) net;
+	extern int BPTT_arithmetic_testB_1(RNN *, rLAYER);
+	return BPTT_arithmetic_testB_1(Net, Net->layers[Net->numLayers - 1]);
+	}
+
+// State of the menu's each() for the arithmetic loops
+typedef struct ARITH_MENU
+	{
+	void *Net;						// NNET, or RNN if BPTT
+	bool BPTT;
+	int every;						// status, plots and keys every "every" samples
+	int (*answer)(void *);			// for test_operator()
+	CHECKPOINTER *ckpt;				// NULL = none
+	long i;							// the last sample #
+	char status[1000];
+	} ARITH_MENU;
+
+static void announce_restart(void)
+	{
+	restart_LogErr_plot();
 	start_timer();
-	printf("[Q] quit\n\n");
+	printf("\n****** Network re-randomized.\n");
+	beep();
+	}
 
-	char status[1000], *s;
-	for (int i = 1; true; ++i)
+// each() of testB, arithmetic_testD() and BPTT_arithmetic_test()
+static int arithmetic_progress(LOOP *loop, const PROGRESS *p)
+	{
+	ARITH_MENU *m = (ARITH_MENU *) loop->arg;
+	m->i = p->i;
+	char *s = m->status + sprintf(m->status, "[%05ld] |e|=%lf, mean |e|=%lf, ",
+			p->i, p->error, p->meanErr);
+	if (p->restarted)
 		{
-		s = status + sprintf(status, "[%05d] ", i);
-
-		// Create random K vector (4 + 2 + 2 elements)
-		for (int k = 0; k < 4; ++k)
-			K[k] = floor((rand() / (double) RAND_MAX) * 10.0) / 10.0;
-		for (int k = 4; k < 6; ++k)
-			K[k] = (rand() / (double) RAND_MAX) > 0.5 ? 1.0 : 0.0;
-		for (int k = 6; k < 8; ++k)
-			K[k] = floor((rand() / (double) RAND_MAX) * 10.0) / 10.0;
-		// printf("*** K = <%lf, %lf>\n", K[0], K[1]);
+		printf("%s\n", m->status);
+		printf("Error overflow.\n");
+		beep();
+		pause_key();
+		announce_restart();
+		return Loop_go;
+		}
 
-		ForwardPropMethod(Net, dimK, K); // dim K = 8 (dimension of input-layer vector)
+	if (m->ckpt != NULL && (p->i % CheckpointEvery) == 0)
+		{
+		TRACE_BEGIN(t);
+		checkpoint(m->ckpt, p->i, p->window->errors1, p->window->errors2, p->window->tail);
+		TRACE_END(Trace_checkpoint, t);
+		}
 
-		// Desired value = K_star
-		double K_star[10];
-		transition(K, K_star);
+	if (p->testErr >= 0.0)
+		{
+		s += sprintf(s, "random test e=%1.06lf, ", p->testErr);
+		if (p->ratio > 0)
+			s += sprintf(s, "|e| ratio=%f", p->ratio);
+		else
+			s += sprintf(s, "|e| ratio=\x1b[31m%f\x1b[39;49m", p->ratio);
+		}
 
-		// Difference between actual outcome and desired value:
-		double training_err = 0.0;
-		for (int k = 4; k < 10; ++k)
+	if ((p->i % m->every) == 0) // display status periodically
+		{
+		printf("%s\r", m->status);
+		if (m->BPTT)
 			{
-			double error = K_star[k] - lastLayer.neurons[k - 4].output;
-			errors[k - 4] = error; // record this for back-prop
-
-			training_err += fabs(error); // record sum of errors
+			plot_W_BPTT((RNN *) m->Net);
+			plot_LogErr(p->error, ErrorThreshold);
 			}
-		s += sprintf(s, "|e|=%lf, ", training_err);
-
-		// Update error arrays cyclically
-		// (This is easier to understand by referring to the next block of code)
-		sum_err2 -= errors2[tail];
-		sum_err2 += errors1[tail];
-		sum_err1 -= errors1[tail];
-		sum_err1 += training_err;
-		// printf("sum1, sum2 = %lf %lf\n", sum_err1, sum_err2);
+		else
+			{
+			plot_W((NNET *) m->Net);
+			plot_LogErr(p->meanErr, ErrorThreshold);
+			}
+		switch (delay_vis(0))
+			{
+			case 1:
+				return Loop_stop;
+			case 2:						// Test learned operator
+				test_operator(m->answer, m->Net);
+				pause_key();
+				break;
+			case 3:						// Re-start with new random weights
+				announce_restart();
+				return Loop_restart;
+			}
+		}
+	return Loop_go;
+	}
 
-		double mean_err = (i < M) ? (sum_err1 / i) : (sum_err1 / M);
-		s += sprintf(s, "mean |e|=%lf, ", mean_err);
+// resume = continue from the latest checkpoint, if there is one
+static void testB(bool resume)
+	{
+	// int neuronsPerLayer[] = {8, 13, 10, 13, 10, 6};
+	int neuronsPerLayer[] = ArithmeticB_Layers; // first = input layer, last = output layer
+	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
+	NNET *Net = NULL;
+	ERR_WINDOW w;
 
-		if (mean_err < ErrorThreshold)
-			break;
-		if (mean_err > 1e10 || mean_err < 0.0 || (i > 5000 && isnan(mean_err)))
+	long start = 1;
+	if (resume)
+		{
+		ACTIVATION act;
+		clear_window(&w);
+		Net = resume_checkpoint(CheckpointName, CheckpointKeep, &act, &start,
+				ErrWindow, w.errors1, w.errors2, &w.tail);
+		for (int l = 0; Net != NULL && l < numLayers; ++l)
+			if (Net->numLayers != numLayers || Net->layers[l].numNeurons != neuronsPerLayer[l])
+				{
+				free_NN(Net);
+				Net = NULL;
+				}
+		if (Net == NULL)
+			printf("No checkpoint of testB to resume, starting afresh.\n");
+		else
 			{
-			printf("%s\n", status);
-			printf("Error overflow.\n");
-			beep();
-			pause_key();
-			userKey = 3;
+			printf("Resumed from iteration %ld.\n", start);
+			for (int j = 0; j < ErrWindow; ++j)	// the sums are of the cyclic arrays
+				{
+				w.sum1 += w.errors1[j];
+				w.sum2 += w.errors2[j];
+				}
+			++start;
 			}
+		}
+	if (Net == NULL)
+		{
+		Net = create_NN(numLayers, neuronsPerLayer);
+		clear_window(&w);
+		start = 1;
+		}
+	CHECKPOINTER *ckpt = start_checkpoints(Net, Act_ReLU, CheckpointName, CheckpointKeep, ErrWindow);
 
-		// record new error in cyclic arrays
-		errors2[tail] = errors1[tail];
-		errors1[tail] = training_err;
-		++tail;
-		if (tail == M) // loop back in cycle
-			tail = 0;
+	start_W_plot();
+	start_LogErr_plot();
+	start_timer();
+	printf("[Q] quit\n\n");
+	if (trace_start(NULL))				// NN_TRACE=file.json in the environment
+		trace_thread_name("testB");
 
-		back_prop(Net, errors); // train the network!
+	ARITH_MENU menu = {.Net = Net, .every = 500, .answer = answer_testC, .ckpt = ckpt, .i = start};
+	LOOP loop = {ErrorThreshold, 0, arithmetic_progress, &menu, 0};
+	bool reached = arithmetic_loop(Net, numLayers, neuronsPerLayer, 1, &w, start, &loop);
 
-		// Testing set
-		if ((i % 5000) == 0)
-			{
-			#define NumTrials 20
-			double test_err = 0.0;
-			for (int j = 0; j < NumTrials; ++j)
-				{
-				// Create random K vector (4 + 2 + 2 elements)
-				for (int k = 0; k < 4; ++k)
-					K[k] = floor((rand() / (double) RAND_MAX) * 10.0) / 10.0;
-				for (int k = 4; k < 6; ++k)
-					K[k] = (rand() / (double) RAND_MAX) > 0.5 ? 1.0 : 0.0;
-				for (int k = 6; k < 8; ++k)
-					K[k] = floor((rand() / (double) RAND_MAX) * 10.0) / 10.0;
-				// plot_tester(K[0], K[1]);
+	final_checkpoint(ckpt, menu.i, w.errors1, w.errors2, w.tail);
+	printf("Terminated....\n");
+	printf("%s\n", menu.status);
+	printf("%d checkpoints written.\n", stop_checkpoints(ckpt));
+	long traced = trace_stop();
+	if (traced > 0)
+		printf("%ld trace events written.\n", traced);
+	end_timer(NULL);
+	if (reached)
+		beep();
+	plot_W(Net);
 
-				ForwardPropMethod(Net, dimK, K); // input vector dimension = 8
+	if (reached)
+		pause_graphics();
+	else
+		quit_graphics();
 
-				// Desired value = K_star
-				double K_star[10];
-				transition(K, K_star);
+	extern void saveNet(NNET *, int, int *, char *, char *);
+	printf("Saving network data....\n");
+	saveNet(Net, numLayers, neuronsPerLayer, "", "");
+	free_NN(Net);
+	}
 
-				double single_err = 0.0;
-				for (int k = 4; k < 10; ++k)
-					{
-					double error = K_star[k] - lastLayer.neurons[k - 4].output;
-					single_err += fabs(error); // record sum of errors
-					}
-				test_err += single_err;
-				}
-			test_err /= (float) NumTrials;
-			s += sprintf(s, "random test e=%1.06lf, ", test_err);
+void arithmetic_testB()
+	{
+	testB(false);
+	}
 
-			double ratio = (sum_err2 - sum_err1) / sum_err1;
-			if (ratio > 0)
-				s += sprintf(s, "|e| ratio=%f", ratio);
-			else
-				s += sprintf(s, "|e| ratio=\x1b[31m%f\x1b[39;49m", ratio);
+// Continue testB from its latest checkpoint
+void arithmetic_testB_resume()
+	{
+	testB(true);
+	}
 
-			// if (isnan(ratio))
-			//	break;
-			// if (ratio - 0.5f < 0.0000001)	// ratio == 0.5 means stationary
-			// if (test_err < 0.01)
-			if (test_err < ErrorThreshold)
-				break;
-			}
+// Same as testB, except trained by lock-free asynchronous SGD on all CPU cores
+void arithmetic_testB_async()
+	{
+	int neuronsPerLayer[] = {8, 13, 10, 6};
+	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
+	NNET *Net = create_NN(numLayers, neuronsPerLayer);
 
-		if ((i % 500) == 0) // display status periodically
-			{
-			printf("%s\r", status);
-			// plot_output(Net);
-			// flush_output();
-			plot_W(Net);
-			plot_LogErr(mean_err, ErrorThreshold);
-			// plot_NN(Net);
-			// plot_trainer(0);		// required to clear the window
-			// plot_K();
-			userKey = delay_vis(0);
-			}
+	int numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	printf("Asynchronous SGD with %d threads....\n", numThreads);
+	start_timer();
+	trace_start(NULL);					// NN_TRACE=file.json in the environment
+	train_hogwild(Net, numThreads, Act_ReLU, 0.01, arithmetic_sample,
+			time(NULL), 100000000L, ErrorThreshold);
+	long traced = trace_stop();
+	end_timer(NULL);
+	if (traced > 0)
+		printf("%ld trace events written.\n", traced);
+	beep();
 
-		if (userKey == 1)
-			break;
-		else if (userKey == 3)			// Re-start with new random weights
-			{
-			re_randomize(Net, numLayers, neuronsPerLayer);
-			userKey = 0;
-			sum_err1 = 0.0; sum_err2 = 0.0;
-			tail = 0;
-			for (int j = 0; j < M; ++j) // clear errors to 0.0
-				errors1[j] = errors2[j] = 0.0;
-			i = 1;
+	extern void saveNet(NNET *, int, int *, char *, char *);
+	printf("Saving network data....\n");
+	saveNet(Net, numLayers, neuronsPerLayer, "", "");
+	free_NN(Net);
+	}
 
-			restart_LogErr_plot();
-			start_timer();
-			printf("\n****** Network re-randomized.\n");
-			userKey = 0;
-			beep();
-			// pause_key();
-			}
-		else if (userKey == 2)
-			// Test learned operator
-			{
-			printf("\n");
-			int ans_correct = 0, ans_negative = 0, ans_wrong = 0, ans_non_term = 0;
-			#define P 100
-			for (int i = 0; i < P; ++i)
-				{
-				printf("(%d) ", i);
-				extern int arithmetic_testC_1(NNET *, LAYER);
-				switch (arithmetic_testC_1(Net, lastLayer))
-					{
-					case 1:
-						++ans_correct;
-						break;
-					case 2:
-						++ans_negative;
-						break;
-					case 3:
-						++ans_wrong;
-						break;
-					case 4:
-						++ans_non_term;
-						break;
-					default:
-						printf("Answer error!\n");
-						break;
-					}
-				}
+// Same as testB, except trained by data-parallel mini-batches on all CPU cores
+// (parallel-trainer.c);  the status line counts mini-batches
+void arithmetic_testB_batch()
+	{
+	int neuronsPerLayer[] = ArithmeticB_Layers;
+	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
+	NNET *Net = create_NN(numLayers, neuronsPerLayer);
 
-			printf("\n=======================\n");
-			printf("Answers correct  = %d (%.1f%%)\n", ans_correct, ans_correct * 100 / (float) P);
-			printf("Answers negative = %d (%.1f%%)\n", ans_negative, ans_negative * 100 / (float) P);
-			printf("Answers wrong    = %d (%.1f%%)\n", ans_wrong, ans_wrong * 100 / (float) P);
-			printf("Answers non-term = %d (%.1f%%)\n", ans_non_term, ans_non_term * 100 / (float) P);
-			printf("\n");
-			userKey = 0;
-			pause_key();
-			}
-		}
+	int numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	printf("Mini-batches of %d on %d threads....\n", ArithmeticBatch, numThreads);
+	start_W_plot();
+	start_LogErr_plot();
+	start_timer();
+	printf("[Q] quit\n\n");
+	if (trace_start(NULL))				// NN_TRACE=file.json in the environment
+		trace_thread_name("testB_batch");
+
+	ARITH_MENU menu = {.Net = Net, .every = 20, .answer = answer_testC};
+	LOOP loop = {ErrorThreshold, 0, arithmetic_progress, &menu, 0};
+	bool reached = arithmetic_batch_loop(Net, numLayers, neuronsPerLayer, numThreads,
+			ArithmeticBatch, &loop);
 
 	printf("Terminated....\n");
-	printf("%s\n", status);
+	printf("%s\n", menu.status);
+	printf("%ld samples.\n", loop.samples);
+	long traced = trace_stop();
+	if (traced > 0)
+		printf("%ld trace events written.\n", traced);
 	end_timer(NULL);
-	if (userKey == 0)		// terminated successfully? (not 'quit' key)
+	if (reached)
 		beep();
-	// plot_output(Net);
-	// flush_output();
 	plot_W(Net);
 
-	/****
-	printf("\n\nTest with: 73 - 37 = 36.\n");
-	K[0] = 0.7;		// A1
-	K[1] = 0.3;		// A0
-	K[2] = 0.3;		// B1
-	K[3] = 0.7;		// B0
-	K[4] = 0.0;		// carry
-	K[5] = 0.0;		// current digit
-	K[6] = 0.0;		// C1
-	K[7] = 0.0;		// C0
-	K[8] = 0.0;		// ready
-	K[9] = 0.0;		// overflow
-	forward_prop(Net, 8, K);
-	printf("carry [1.0] = %f\n", lastLayer.neurons[0].output);
-	printf("current-digit [1.0] = %f\n", lastLayer.neurons[1].output);
-	printf("C1 [0.0] = %f\n", lastLayer.neurons[2].output);
-	printf("C0 [0.6] = %f\n", lastLayer.neurons[3].output);
-	printf("ready [0.0] = %f\n", lastLayer.neurons[4].output);
-	printf("overflow [0.0] = %f\n", lastLayer.neurons[5].output);
-
-	// copy output back to K;  second iteration
-	for (int k = 0; k < 6; ++k)
-		K[k + 4] = lastLayer.neurons[k].output;
-	forward_prop(Net, 8, K);
-	printf("\ncarry [0.0] = %f\n", lastLayer.neurons[0].output);
-	printf("current-digit [1.0] = %f\n", lastLayer.neurons[1].output);
-	printf("C1 [0.3] = %f\n", lastLayer.neurons[2].output);
-	printf("C0 [0.6] = %f\n", lastLayer.neurons[3].output);
-	printf("ready [1.0] = %f\n", lastLayer.neurons[4].output);
-	printf("overflow [0.0] = %f\n", lastLayer.neurons[5].output);
-	 ****/
-
-	if (userKey == 0)
+	if (reached)
 		pause_graphics();
 	else
 		quit_graphics();
@@ -548,19 +525,50 @@ void arithmetic_testB()
 	extern void saveNet(NNET *, int, int *, char *, char *);
 	printf("Saving network data....\n");
 	saveNet(Net, numLayers, neuronsPerLayer, "", "");
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
-void saveNet(NNET *net, int numLayers, int *neuronsPerLayer, char *comments, char *defaultName)
+// Quantize the operator learned in testB to int8, and report the accuracy loss
+// with per-layer and per-neuron weight scales
+void arithmetic_test_int8()
 	{
-	FILE *fp;
-	if (strlen(defaultName) > 0)
+	extern NNET *loadNet(int *, int *p[], char *);
+	int numLayers, *neuronsPerLayer;
+	NNET *Net = loadNet(&numLayers, &neuronsPerLayer, "operator.net");
+
+	#define NumCalibration	1000
+	#define NumTestSamples	100000
+	int dimK = neuronsPerLayer[0];
+	double *X = (double *) malloc(NumTestSamples * dimK * sizeof (double));
+	double Y[10];
+	unsigned int seed = time(NULL);
+	for (int s = 0; s < NumTestSamples; ++s)
+		arithmetic_sample(&seed, X + s * dimK, Y);
+
+	for (int perChannel = 0; perChannel <= 1; ++perChannel)
 		{
-		fp = fopen(defaultName, "w");
+		// the first NumCalibration samples are the calibration set
+		NNET8 *Net8 = quantize_NN(Net, Act_ReLU, perChannel, NumCalibration, X);
+		int8_report(Net, Net8, NumTestSamples, X);
+		if (perChannel && save_NN8(Net8, "operator.nn8"))
+			printf("Saved int8 network to operator.nn8\n");
+		free_NN8(Net8);
 		}
+
+	free(X);
+	free_NN(Net);
+	free(neuronsPerLayer);
+	}
+
+// Interactive wrappers of save_text_NN() and load_NN() (NN-file.c).
+// neuronsPerLayer is not needed by save, it is kept for compatibility with existing callers.
+void saveNet(NNET *net, int numLayers, int *neuronsPerLayer, char *comments, char *defaultName)
+	{
+	char fileName[1024];
+	if (strlen(defaultName) > 0)
+		strcpy(fileName, defaultName);
 	else
 		{
-		char fileName[1024];
 		printf("Enter file name [default = %s] :", defaultName);
 		int c;
 		while ( (c = getchar()) != EOF && c != '\n' )
@@ -569,32 +577,18 @@ void saveNet(NNET *net, int numLayers, int *neuronsPerLayer, char *comments, cha
 		fileName[strlen(fileName) - 1] = '\0';
 		if (strlen(fileName) == 0)
 			return;
-		fp = fopen(fileName, "w");
 		}
-	fprintf(fp, "%s\n", comments);
-	#define EndOfComments	"**************\n"
-	fprintf(fp, EndOfComments);
-	fprintf(fp, "%d\n", numLayers);
-
-	for (int l = 0; l < numLayers; ++l)
-		fprintf(fp, "%d ", neuronsPerLayer[l]);
-	fprintf(fp, "\n");
-
-	for (int l = 1; l < numLayers; ++l) // for each layer
-		for (int n = 0; n < neuronsPerLayer[l]; ++n) // for each neuron
-			{
-			for (int i = 0; i <= neuronsPerLayer[l - 1]; ++i) // for each weight
-				fprintf(fp, "%f ", (float) net->layers[l].neurons[n].weights[i]);
-			fprintf(fp, "\n");
-			}
-	fclose(fp);
-	printf("File saved.");
+	if (save_text_NN(net, comments, fileName))
+		printf("File saved.");
+	else
+		printf("Cannot save %s\n", fileName);
 	}
 
+// Either format is accepted.  *pNeuronsOfLayer is malloc'ed.
 NNET *loadNet(int *pNumLayers, int *pNeuronsOfLayer[], char *defaultName)
 	{
 	printf("Existing network files:\n");
-	system("ls *.net");
+	system("ls *.net *.nnb");
 	char fileName[1024];
 	printf("\nEnter file name, default = [%s] :", defaultName);
 	int c;
@@ -604,37 +598,115 @@ NNET *loadNet(int *pNumLayers, int *pNeuronsOfLayer[], char *defaultName)
 	fileName[strlen(fileName) - 1] = '\0';
 	if (strlen(fileName) == 0)
 		strcpy(fileName, defaultName);
-	FILE *fp = fopen(fileName, "r");
 
-	// skip comments
-	char s[2048];
-	do
-		fscanf(fp, "%s\n", s);
-	while (!strcmp(s, EndOfComments));
+	ACTIVATION act;
+	NNET *net = load_NN(fileName, &act);
+	if (net == NULL)
+		{
+		printf("Cannot load %s\n", fileName);
+		exit(1);
+		}
+	*pNumLayers = net->numLayers;
+	*pNeuronsOfLayer = (int *) malloc(*pNumLayers * sizeof(int));
+	for (int l = 0; l < *pNumLayers; ++l)
+		(*pNeuronsOfLayer)[l] = net->layers[l].numNeurons;
+	return net;
+	}
+
+// Convert a saved .net file to single (toFloat32 = true) or double precision.
+// Each weight is rounded to the target type and printed with enough digits to be read
+// back exactly;  the comments and topology lines are copied unchanged.
+// The text format itself does not depend on precision, so either build can load the
+// result.  Returns the # of weights converted, or -1 if a file cannot be opened.
+int convertNet(char *fromName, char *toName, bool toFloat32)
+	{
+	FILE *in = fopen(fromName, "r");
+	if (in == NULL)
+		return -1;
+	FILE *out = fopen(toName, "w");
+	if (out == NULL)
+		{
+		fclose(in);
+		return -1;
+		}
+
+	// copy header:  comments up to EndOfComments, then # of layers and neurons per layer
+	char line[65536];
+	int headerLines = -1;			// becomes 2 after the EndOfComments line
+	while (headerLines != 0 && fgets(line, sizeof(line), in) != NULL)
+		{
+		fputs(line, out);
+		if (headerLines > 0)
+			--headerLines;
+		else if (!strcmp(line, EndOfComments))
+			headerLines = 2;
+		}
 
-	fscanf(fp, "%d\n", pNumLayers);
-	*pNeuronsOfLayer = (int *) malloc(*pNumLayers * sizeof(int));
+	// one line of weights per neuron, read a number at a time (a row of a wide layer is
+	// longer than any line buffer), keeping the line breaks
+	int count = 0;
+	for (int c = getc(in); c != EOF; c = getc(in))
+		{
+		if (c == '\n')
+			fprintf(out, "\n");
+		if (isspace(c))
+			continue;
+		ungetc(c, in);
+		double x;
+		if (fscanf(in, "%lf", &x) != 1)
+			break;
+		if (toFloat32)
+			fprintf(out, "%.9g ", (double) (float) x);
+		else
+			fprintf(out, "%.17g ", x);
+		++count;
+		}
 
-	for (int l = 0; l < *pNumLayers; ++l)
-		fscanf(fp, "%d ", &((*pNeuronsOfLayer)[l]));
-	fscanf(fp, "\n");
+	fclose(in);
+	fclose(out);
+	return count;
+	}
 
-	NNET *net = create_NN(*pNumLayers, *pNeuronsOfLayer);
+void convert_net_precision()
+	{
+	char fromName[1024], toName[1024], precision[16];
+	printf("Existing network files:\n");
+	system("ls *.net");
+	printf("\nConvert file: ");
+	scanf("%1023s", fromName);
+	printf("Save as: ");
+	scanf("%1023s", toName);
+	printf("Precision [s]ingle or [d]ouble: ");
+	scanf("%15s", precision);
+
+	int count = convertNet(fromName, toName, precision[0] == 's');
+	if (count < 0)
+		printf("Cannot open file.\n");
+	else
+		printf("%d weights converted to %s precision.\n", count,
+				precision[0] == 's' ? "single" : "double");
+	}
 
-	for (int l = 1; l < *pNumLayers; ++l) // for each layer
-		for (int n = 0; n < (*pNeuronsOfLayer)[l]; ++n) // for each neuron
-			{
-			for (int i = 0; i <= (*pNeuronsOfLayer)[l - 1]; ++i) // for each weight
-				{
-				float x;
-				fscanf(fp, "%f ", &x);
-				// printf("%f ", x);
-				net->layers[l].neurons[n].weights[i] = (double) x;
-				}
-			fscanf(fp, "\n");
-			}
-	fclose(fp);
-	return net;
+// Convert a text .net file to the binary format (NN-file.h)
+void convert_net_binary()
+	{
+	char fromName[1024], toName[1024], activation[16];
+	printf("Existing network files:\n");
+	system("ls *.net");
+	printf("\nConvert file: ");
+	scanf("%1023s", fromName);
+	printf("Save as (eg Q.nnb): ");
+	scanf("%1023s", toName);
+	printf("Activation [s]igmoid, [r]eLU, soft[p]lus or [x]^2: ");
+	scanf("%15s", activation);
+
+	ACTIVATION act = activation[0] == 'r' ? Act_ReLU :
+			activation[0] == 'p' ? Act_softplus :
+			activation[0] == 'x' ? Act_x2 : Act_sigmoid;
+	if (convert_text_NN(fromName, toName, act))
+		printf("Saved %s\n", toName);
+	else
+		printf("Cannot convert %s\n", fromName);
 	}
 
 void arithmetic_testC()		// verify results for testB
@@ -709,7 +781,7 @@ void arithmetic_testC()		// verify results for testB
 	printf("Answers wrong    = %d (%.1f%%)\n", ans_wrong, ans_wrong * 100 / (float) P);
 	printf("Answers non-term = %d (%.1f%%)\n", ans_non_term, ans_non_term * 100 / (float) P);
 
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	free(neuronsPerLayer);
 	}
 
@@ -830,254 +902,50 @@ LOOP:
 			ans = 4;
 			printf("\x1b[31mNon-termination: ");
 			printf("result ready = %f \x1b[39;49m\n", K2[8]);
-			// beep();
-			}
-		}
-	return ans;
-	}
-
-// Now we combine the 2 arithmetic steps into 1 step, as a single operator.
-// This operator is supposedly very hard to learn.
-#define ForwardPropMethod	forward_prop_ReLU
-#define ErrorThreshold		0.001
-
-void arithmetic_testD()		// same as testB, except learns entire operator in 1 step
-	{
-	// first = input layer, last = output layer
-	int neuronsPerLayer[] = {8, 19, 19, 19, 19, 6};
-	int dimK = 8;
-	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
-	NNET *Net = create_NN(numLayers, neuronsPerLayer);
-	LAYER lastLayer = Net->layers[numLayers - 1];
-	double errors[dimK];
-
-	#define M	50			// how many errors to record for averaging
-	double errors1[M], errors2[M]; // two arrays for recording errors
-
-	int userKey = 0;
-	double sum_err1 = 0.0, sum_err2 = 0.0; // sums of errors
-	int tail = 0; // index for cyclic arrays (last-in, first-out)
-	for (int i = 0; i < M; ++i) // clear errors to 0.0
-		errors1[i] = errors2[i] = 0.0;
-
-	// start_NN_plot();
-	start_W_plot();
-	start_LogErr_plot();
-	// start_K_plot();
-	// start_output_plot();
-	// plot_ideal();
-	start_timer();
-	printf("[Q] quit\n\n");
-
-	char status[1000], *s;
-	for (int i = 1; true; ++i)
-		{
-		s = status + sprintf(status, "[%05d] ", i);
-
-		// Create random K vector (4 + 2 + 2 elements)
-		for (int k = 0; k < 4; ++k)
-			K[k] = floor((rand() / (double) RAND_MAX) * 10.0) / 10.0;
-		for (int k = 4; k < 6; ++k)
-			K[k] = (rand() / (double) RAND_MAX) > 0.5 ? 1.0 : 0.0;
-		for (int k = 6; k < 8; ++k)
-			K[k] = floor((rand() / (double) RAND_MAX) * 10.0) / 10.0;
-		// printf("*** K = <%lf, %lf>\n", K[0], K[1]);
-
-		ForwardPropMethod(Net, dimK, K); // dim K = 8 (dimension of input-layer vector)
-
-		// Desired value = K_star
-		double K_star[10];
-		transition(K, K_star);
-		memcpy(K, K_star, sizeof(K_star));		// order = (target, source) !
-		transition(K, K_star);					// transition again!
-
-		// Difference between actual outcome and desired value:
-		double training_err = 0.0;
-		for (int k = 4; k < 10; ++k)
-			{
-			double error = K_star[k] - lastLayer.neurons[k - 4].output;
-			errors[k - 4] = error; // record this for back-prop
-
-			training_err += fabs(error); // record sum of errors
-			}
-		s += sprintf(s, "|e|=%lf, ", training_err);
-
-		// Update error arrays cyclically
-		// (This is easier to understand by referring to the next block of code)
-		sum_err2 -= errors2[tail];
-		sum_err2 += errors1[tail];
-		sum_err1 -= errors1[tail];
-		sum_err1 += training_err;
-		// printf("sum1, sum2 = %lf %lf\n", sum_err1, sum_err2);
-
-		double mean_err = (i < M) ? (sum_err1 / i) : (sum_err1 / M);
-		s += sprintf(s, "mean |e|=%lf, ", mean_err);
-
-		if (mean_err < ErrorThreshold)
-			break;
-		if (mean_err > 1e10 || mean_err < 0.0 || (i > 5000 && isnan(mean_err)))
-			{
-			printf("%s\n", status);
-			printf("Error overflow.\n");
-			beep();
-			pause_key();
-			userKey = 3;
-			}
-
-		// record new error in cyclic arrays
-		errors2[tail] = errors1[tail];
-		errors1[tail] = training_err;
-		++tail;
-		if (tail == M) // loop back in cycle
-			tail = 0;
-
-		back_prop(Net, errors); // train the network!
-
-		// Testing set
-		if ((i % 5000) == 0)
-			{
-			#define NumTrials 20
-			double test_err = 0.0;
-			for (int j = 0; j < NumTrials; ++j)
-				{
-				// Create random K vector (4 + 2 + 2 elements)
-				for (int k = 0; k < 4; ++k)
-					K[k] = floor((rand() / (double) RAND_MAX) * 10.0) / 10.0;
-				for (int k = 4; k < 6; ++k)
-					K[k] = (rand() / (double) RAND_MAX) > 0.5 ? 1.0 : 0.0;
-				for (int k = 6; k < 8; ++k)
-					K[k] = floor((rand() / (double) RAND_MAX) * 10.0) / 10.0;
-				// plot_tester(K[0], K[1]);
-
-				ForwardPropMethod(Net, dimK, K); // input vector dimension = 8
-
-				// Desired value = K_star
-				double K_star[10];
-				transition(K, K_star);
-
-				double single_err = 0.0;
-				for (int k = 4; k < 10; ++k)
-					{
-					double error = K_star[k] - lastLayer.neurons[k - 4].output;
-					single_err += fabs(error); // record sum of errors
-					}
-				test_err += single_err;
-				}
-			test_err /= (float) NumTrials;
-			s += sprintf(s, "random test |e|=%1.06lf, ", test_err);
-
-			double ratio = (sum_err2 - sum_err1) / sum_err1;
-			if (ratio > 0)
-				s += sprintf(s, "|e| ratio=%f", ratio);
-			else
-				s += sprintf(s, "|e| ratio=\x1b[31m%f\x1b[39;49m", ratio);
-
-			// if (isnan(ratio))
-			//	break;
-			// if (ratio - 0.5f < 0.0000001)	// ratio == 0.5 means stationary
-			// if (test_err < 0.01)
-			if (test_err < ErrorThreshold)
-				break;
-			}
-
-		if ((i % 50) == 0) // display status periodically
-			{
-			printf("%s\r", status);
-			// plot_output(Net);
-			// flush_output();
-			plot_W(Net);
-			plot_LogErr(mean_err, ErrorThreshold);
-			// plot_NN(Net);
-			// plot_trainer(0);		// required to clear the window
-			// plot_K();
-			userKey = delay_vis(0);
-			}
-
-		if (userKey == 1)
-			break;
-		else if (userKey == 3)			// Re-start with new random weights
-			{
-			re_randomize(Net, numLayers, neuronsPerLayer);
-			userKey = 0;
-			sum_err1 = 0.0; sum_err2 = 0.0;
-			tail = 0;
-			for (int j = 0; j < M; ++j) // clear errors to 0.0
-				errors1[j] = errors2[j] = 0.0;
-			i = 1;
-
-			restart_LogErr_plot();
-			start_timer();
-			printf("\n****** Network re-randomized.\n");
-			userKey = 0;
-			beep();
-			// pause_key();
-			}
-		else if (userKey == 2)
-			// Test learned operator
-			{
-			printf("\n");
-
-			int ans_correct = 0, ans_negative = 0, ans_wrong = 0, ans_non_term = 0;
-			#define P 100
-			for (int i = 0; i < P; ++i)
-				{
-				printf("(%d) ", i);
-				extern int arithmetic_testE_1(NNET *, LAYER);
-				switch (arithmetic_testE_1(Net, lastLayer))
-					{
-					case 1:
-						++ans_correct;
-						break;
-					case 2:
-						++ans_negative;
-						break;
-					case 3:
-						++ans_wrong;
-						break;
-					case 4:
-						++ans_non_term;
-						break;
-					default:
-						printf("Answer error!\n");
-						break;
-					}
-				}
-
-			printf("\n=======================\n");
-			printf("Answers correct  = %d (%.1f%%)\n", ans_correct, ans_correct * 100 / (float) P);
-			printf("Answers negative = %d (%.1f%%)\n", ans_negative, ans_negative * 100 / (float) P);
-			printf("Answers wrong    = %d (%.1f%%)\n", ans_wrong, ans_wrong * 100 / (float) P);
-			printf("Answers non-term = %d (%.1f%%)\n", ans_non_term, ans_non_term * 100 / (float) P);
-			printf("\n");
-			userKey = 0;
-			pause_key();
-			}
-		else if (userKey == 4)			// load weights file
-			{
-			// TO-DO...
-
+			// beep();
 			}
 		}
+	return ans;
+	}
+
+// Now we combine the 2 arithmetic steps into 1 step, as a single operator.
+// This operator is supposedly very hard to learn.
+#define ForwardPropMethod	forward_prop_ReLU
+#define ErrorThreshold		0.001
+
+void arithmetic_testD()		// same as testB, except learns entire operator in 1 step
+	{
+	int neuronsPerLayer[] = ArithmeticD_Layers; // first = input layer, last = output layer
+	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
+	NNET *Net = create_NN(numLayers, neuronsPerLayer);
+	ERR_WINDOW w;
+	clear_window(&w);
+
+	start_W_plot();
+	start_LogErr_plot();
+	start_timer();
+	printf("[Q] quit\n\n");
+
+	ARITH_MENU menu = {.Net = Net, .every = 50, .answer = answer_testE};
+	LOOP loop = {ErrorThreshold, 0, arithmetic_progress, &menu, 0};
+	bool reached = arithmetic_loop(Net, numLayers, neuronsPerLayer, 2, &w, 1, &loop);
 
 	printf("Terminated....\n");
-	printf("%s\n", status);
+	printf("%s\n", menu.status);
 	end_timer(NULL);
-	if (userKey == 0)		// terminated successfully? (not 'quit' key)
+	if (reached)
 		beep();
-	// plot_output(Net);
-	// flush_output();
 	plot_W(Net);
 
-	if (userKey == 0)
+	if (reached)
 		pause_graphics();
 	else
 		quit_graphics();
 
-	extern void saveNet();
 	printf("Saving network data....\n");
 	extern void saveNet(NNET *, int, int *, char *, char *);
 	saveNet(Net, numLayers, neuronsPerLayer, "", "operator.net");
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
 void arithmetic_testE()		// verify results for testD
@@ -1118,7 +986,7 @@ void arithmetic_testE()		// verify results for testD
 	printf("Answers wrong    = %d (%.1f%%)\n", ans_wrong, ans_wrong * 100 / (float) P);
 	printf("Answers non-term = %d (%.1f%%)\n", ans_non_term, ans_non_term * 100 / (float) P);
 
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	free(neuronsPerLayer);
 	}
 
@@ -1475,7 +1343,7 @@ void arithmetic_testF()		// same as testD, except learns entire operator in 2 st
 	printf("Saving network data....\n");
 	extern void saveNet(NNET *, int, int *, char *, char *);
 	saveNet(Net, numLayers, neuronsPerLayer, "", "operator.net");
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
 void save_RNN(RNN *net, int numLayers, int *neuronsPerLayer, char *comments)
@@ -1492,7 +1360,7 @@ void save_RNN(RNN *net, int numLayers, int *neuronsPerLayer, char *comments)
 
 	FILE *fp = fopen(fileName, "w");
 	fprintf(fp, "%s\n", comments);
-	fprintf(fp, EndOfComments);				// defined in saveNet()
+	fprintf(fp, EndOfComments);				// defined in NN-file.h
 	fprintf(fp, "%d\n", numLayers);
 
 	for (int l = 0; l < numLayers; ++l)
@@ -1503,7 +1371,7 @@ void save_RNN(RNN *net, int numLayers, int *neuronsPerLayer, char *comments)
 		for (int n = 0; n < neuronsPerLayer[l]; ++n) // for each neuron
 			{
 			for (int i = 0; i <= neuronsPerLayer[l - 1]; ++i) // for each weight
-				fprintf(fp, "%f ", (float) net->layers[l].neurons[n].weights[i]);
+				fprintf(fp, "%.*g ", REAL_DIGITS, (double) net->layers[l].neurons[n].weights[i]);
 			fprintf(fp, "\n");
 			}
 	fclose(fp);
@@ -1545,10 +1413,10 @@ RNN *load_RNN(int *pNumLayers, int *pNeuronsOfLayer[])
 			{
 			for (int i = 0; i <= (*pNeuronsOfLayer)[l - 1]; ++i) // for each weight
 				{
-				float x;
-				fscanf(fp, "%f ", &x);
+				double x;
+				fscanf(fp, "%lf ", &x);
 				// printf("%f ", x);
-				net->layers[l].neurons[n].weights[i] = (double) x;
+				net->layers[l].neurons[n].weights[i] = (real) x;
 				}
 			fscanf(fp, "\n");
 			}
@@ -1559,271 +1427,35 @@ RNN *load_RNN(int *pNumLayers, int *pNeuronsOfLayer[])
 #define ErrorThreshold		0.001
 void BPTT_arithmetic_test()
 	{
-	int neuronsPerLayer[4] = {8, 13, 10, 8}; // first = input layer, last = output layer
+	int neuronsPerLayer[] = BPTT_Layers; // first = input layer, last = output layer
 	// (first- and last-layer dimensions must match because network needs to be recurrent)
-	int dimK = 8;		// dim K = 8 (dimension of input-layer vector)
 	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
 	// create BPTT_NN
 	RNN *Net = create_BPTT_NN(numLayers, neuronsPerLayer);
-	rLAYER lastLayer = Net->layers[numLayers - 1];
-	double errors[dimK];
-
-	int userKey = 0;
-	#define M	50			// how many errors to record for averaging
-	double errors1[M], errors2[M]; // two arrays for recording errors
-	double sum_err1 = 0.0, sum_err2 = 0.0; // sums of errors
-	int tail = 0; // index for cyclic arrays (last-in, first-out)
-
-	for (int i = 0; i < M; ++i) // clear errors to 0.0
-		errors1[i] = errors2[i] = 0.0;
 
-	// start_NN_plot();
 	start_W_plot();
 	start_LogErr_plot();
-	// start_K_plot();
-	// start_output_plot();
-	// plot_ideal();
 	start_timer();
 	printf("[P] to pause, [R] to resume, [Q] to quit\n\n");
 
-	int t = 0;		// t is the final time step
-
-	char status[512], *s;
-	for (int i = 0; true; ++i)
-		{
-		s = status + sprintf(status, "[%05d] ", i);
-
-		// Create random K vector (4 + 2 + 2 elements)
-		for (int k = 0; k < 4; ++k)
-			K[k] = floor((rand() / (double) RAND_MAX) * 10.0) / 10.0;
-		K[4] = 0.0; // carry flag
-		K[5] = 0.0; // current digit (0 or 1)
-		K[6] = 0.0; // C1
-		K[7] = 0.0; // C0
-		K[8] = 0.0; // result ready flag
-		K[9] = 0.0; // underflow flag
-		// printf("*** K = <%lf, %lf>\n", K[0], K[1]);
-
-		forward_BPTT(Net, 8, K, 1);			// unfold 1 time
-		// Note that only 6 of 8 dimensions of the output is significant
-		// ...the last 2 dimensions are ignored
-		// printf("successfully forward propagated\n");
-
-		// Desired value = K_star
-		double K_star[10];
-		transition(K, K_star);
-		memcpy(K, K_star, sizeof(K_star));		// order = (target, source) !
-		transition(K, K_star);					// transition again!
-
-		// Difference between actual outcome and desired value:
-		double training_err = 0.0;
-		for (int k = 4; k < 10; ++k)		// 6 components
-			{
-			double error = K_star[k] - lastLayer.neurons[k - 4].output[t];
-			errors[k - 4] = error;			// record this for back-prop
-
-			training_err += fabs(error);	// record sum of errors
-			}
-		for (int k = 6; k < 8; ++k)			// last 2 errors are always 0
-			errors[k] = 0.0;
-
-		// printf("sum of squared error = %lf  ", training_err);
-
-		// Update error arrays cyclically
-		// (This is easier to understand by referring to the next block of code)
-		sum_err2 -= errors2[tail];
-		sum_err2 += errors1[tail];
-		sum_err1 -= errors1[tail];
-		sum_err1 += training_err;
-		// printf("sum1, sum2 = %lf %lf\n", sum_err1, sum_err2);
-
-		double mean_err = (i < M) ? (sum_err1 / i) : (sum_err1 / M);
-		s += sprintf(s, "mean |e|=%lf, ", mean_err);
-
-		if (training_err < ErrorThreshold)
-			break;
-
-		// record new error in cyclic arrays
-		errors2[tail] = errors1[tail];
-		errors1[tail] = training_err;
-		++tail;
-		if (tail == M) // loop back in cycle
-			tail = 0;
-
-		backprop_through_time(Net, errors, 1); // train the network, n-fold = 1
-
-		// Testing set
-		if ((i % 5000) == 0)
-			{
-			double test_err = 0.0;
-			for (int j = 0; j < 10; ++j)
-				{
-				// Create random K vector (4 + 2 + 2 elements)
-				for (int k = 0; k < 4; ++k)
-					K[k] = floor((rand() / (double) RAND_MAX) * 10.0) / 10.0;
-				K[4] = 0.0; // carry flag
-				K[5] = 0.0; // current digit (0 or 1)
-				K[6] = 0.0; // C1
-				K[7] = 0.0; // C0
-				K[8] = 0.0; // result ready flag
-				K[9] = 0.0; // underflow flag
-				// plot_tester(K[0], K[1]);
-
-				forward_BPTT(Net, 8, K, 1);		// 1-fold backprop
-
-				// Desired value = K_star
-				double K_star[10];
-				transition(K, K_star);
-				memcpy(K, K_star, sizeof(K_star));	// order = (target, source) !
-				transition(K, K_star);				// transition again!
-
-				double single_err = 0.0;
-				for (int k = 4; k < 10; ++k)
-					{
-					double error = K_star[k] - lastLayer.neurons[k - 4].output[t];
-					single_err += fabs(error); // record sum of errors
-					}
-				test_err += single_err;
-				}
-			test_err /= 10.0;
-			s += sprintf(s, "random test e=%1.06lf, ", test_err);
-
-			double ratio = (sum_err2 - sum_err1) / sum_err1;
-			if (ratio > 0)
-				s += sprintf(s, "e ratio=%f", ratio);
-			else
-				s += sprintf(s, "e ratio=\x1b[31m%f\x1b[39;49m", ratio);
-
-			if (isnan(ratio))
-				break;
-			// if (ratio - 0.5f < 0.0000001)	// ratio == 0.5 means stationary
-			// if (test_err < 0.01)
-			if (test_err < ErrorThreshold)
-				break;
-			}
-
-		if (i % 500 == 0) printf("%s\r", status);
-
-		if ((i % 500) == 0) // display status periodically
-			{
-			// plot_output(Net);
-			// flush_output();
-			plot_W_BPTT(Net);
-			plot_LogErr(training_err, ErrorThreshold);
-			// plot_NN(Net);
-			// plot_trainer(0);		// required to clear the window
-			// plot_K();
-			userKey = delay_vis(0);
-			}
-
-		if (userKey == 1)
-			break;
-		else if (userKey == 3)			// Re-start with new random weights
-			{
-			BPTT_re_randomize(Net, numLayers, neuronsPerLayer);
-			userKey = 0;
-			sum_err1 = 0.0; sum_err2 = 0.0;
-			tail = 0;
-			for (int j = 0; j < M; ++j) // clear errors to 0.0
-				errors1[j] = errors2[j] = 0.0;
-			i = 1;
-
-			restart_LogErr_plot();
-			start_timer();
-			printf("\n****** Network re-randomized.\n");
-			userKey = 0;
-			beep();
-			// pause_key();
-			}
-		else if (userKey == 2)
-			// Test learned operator
-			{
-			printf("\n");
-
-			int ans_correct = 0, ans_negative = 0, ans_wrong = 0, ans_non_term = 0;
-			#define P 100
-			for (int i = 0; i < P; ++i)
-				{
-				printf("(%d) ", i);
-				extern int BPTT_arithmetic_testB_1(RNN *, rLAYER);
-				switch (BPTT_arithmetic_testB_1(Net, lastLayer))
-					{
-					case 1:
-						++ans_correct;
-						break;
-					case 2:
-						++ans_negative;
-						break;
-					case 3:
-						++ans_wrong;
-						break;
-					case 4:
-						++ans_non_term;
-						break;
-					default:
-						printf("Answer error!\n");
-						break;
-					}
-				}
-
-			printf("\n=======================\n");
-			printf("Answers correct  = %d (%.1f%%)\n", ans_correct, ans_correct * 100 / (float) P);
-			printf("Answers negative = %d (%.1f%%)\n", ans_negative, ans_negative * 100 / (float) P);
-			printf("Answers wrong    = %d (%.1f%%)\n", ans_wrong, ans_wrong * 100 / (float) P);
-			printf("Answers non-term = %d (%.1f%%)\n", ans_non_term, ans_non_term * 100 / (float) P);
-			printf("\n");
-			userKey = 0;
-			pause_key();
-			}
-		}
+	ARITH_MENU menu = {.Net = Net, .BPTT = true, .every = 50, .answer = answer_BPTT};
+	LOOP loop = {ErrorThreshold, 0, arithmetic_progress, &menu, 0};
+	bool reached = BPTT_arithmetic_loop(Net, numLayers, neuronsPerLayer, &loop);
 
-	printf("\n%s\n", status);
+	printf("\n%s\n", menu.status);
 	end_timer(NULL);
-	beep();
-	// plot_output(Net);
-	// flush_output();
+	if (reached)
+		beep();
 	plot_W_BPTT(Net);
 
-	/****
-	printf("\n\nTest with: 73 - 37 = 36.\n");
-	K[0] = 0.7;		// A1
-	K[1] = 0.3;		// A0
-	K[2] = 0.3;		// B1
-	K[3] = 0.7;		// B0
-	K[4] = 0.0;		// carry
-	K[5] = 0.0;		// current digit
-	K[6] = 0.0;		// C1
-	K[7] = 0.0;		// C0
-	K[8] = 0.0;		// ready
-	K[9] = 0.0;		// overflow
-	forward_prop(Net, 8, K);
-	printf("carry [1.0] = %f\n", lastLayer.neurons[0].output);
-	printf("current-digit [1.0] = %f\n", lastLayer.neurons[1].output);
-	printf("C1 [0.0] = %f\n", lastLayer.neurons[2].output);
-	printf("C0 [0.6] = %f\n", lastLayer.neurons[3].output);
-	printf("ready [0.0] = %f\n", lastLayer.neurons[4].output);
-	printf("overflow [0.0] = %f\n", lastLayer.neurons[5].output);
-
-	// copy output back to K;  second iteration
-	for (int k = 0; k < 6; ++k)
-		K[k + 4] = lastLayer.neurons[k].output;
-	forward_prop(Net, 8, K);
-	printf("\ncarry [0.0] = %f\n", lastLayer.neurons[0].output);
-	printf("current-digit [1.0] = %f\n", lastLayer.neurons[1].output);
-	printf("C1 [0.3] = %f\n", lastLayer.neurons[2].output);
-	printf("C0 [0.6] = %f\n", lastLayer.neurons[3].output);
-	printf("ready [1.0] = %f\n", lastLayer.neurons[4].output);
-	printf("overflow [0.0] = %f\n", lastLayer.neurons[5].output);
-	 ****/
-
-	if (userKey == 0)
+	if (reached)
 		pause_graphics();
 	else
 		quit_graphics();
 
 	extern void save_RNN(RNN *, int, int *, char *);
 	save_RNN(Net, numLayers, neuronsPerLayer, "");
-	free_BPTT_NN(Net, neuronsPerLayer);
+	free_BPTT_NN(Net);
 	}
 
 void BPTT_arithmetic_testB()		// verify results for BPTT_test
@@ -1864,10 +1496,224 @@ void BPTT_arithmetic_testB()		// verify results for BPTT_test
 	printf("Answers wrong    = %d (%.1f%%)\n", ans_wrong, ans_wrong * 100 / (float) P);
 	printf("Answers non-term = %d (%.1f%%)\n", ans_non_term, ans_non_term * 100 / (float) P);
 
-	free_BPTT_NN(Net, neuronsPerLayer);
+	free_BPTT_NN(Net);
 	free(neuronsPerLayer);
 	}
 
+// All weights of an RNN to / from W[], layer by layer, row by row
+static void get_RNN_weights(RNN *net, real *W)
+	{
+	for (int l = 1; l < net->numLayers; ++l)
+		for (int n = 0; n < net->layers[l].numNeurons; ++n)
+			for (int i = 0; i <= net->layers[l - 1].numNeurons; ++i)
+				*W++ = net->layers[l].neurons[n].weights[i];
+	}
+
+static void set_RNN_weights(RNN *net, const real *W)
+	{
+	for (int l = 1; l < net->numLayers; ++l)
+		for (int n = 0; n < net->layers[l].numNeurons; ++n)
+			for (int i = 0; i <= net->layers[l - 1].numNeurons; ++i)
+				net->layers[l].neurons[n].weights[i] = *W++;
+	}
+
+// The batched BPTT (forward_BPTT_batch(), backprop_BPTT_batch()) against forward_BPTT() and
+// backprop_through_time() of each sequence alone, on 3 sequences of 5, 2 and 4 steps (the
+// shorter ones masked):  every output of every step, and the weight change (the mean of
+// the sequences'), must be the same up to rounding.  Returns true if they are.
+bool BPTT_batch_test()
+	{
+	int neuronsPerLayer[] = BPTT_Layers;
+	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
+	enum { B = 3, T = 5 };
+	int lengths[B] = {5, 2, 4};
+	RNN *Net = create_BPTT_NN(numLayers, neuronsPerLayer);
+	int dimV = neuronsPerLayer[0], dimY = neuronsPerLayer[numLayers - 1];
+
+	int numWeights = 0;
+	for (int l = 1; l < numLayers; ++l)
+		numWeights += neuronsPerLayer[l] * (neuronsPerLayer[l - 1] + 1);
+	real W0[numWeights], W[numWeights], sumDW[numWeights];
+	get_RNN_weights(Net, W0);
+	for (int i = 0; i < numWeights; ++i)
+		sumDW[i] = 0.0;
+
+	double V[B * dimV], errors[B * dimY];
+	for (int i = 0; i < B * dimV; ++i)
+		V[i] = rand() / (double) RAND_MAX;
+	for (int i = 0; i < B * dimY; ++i)
+		errors[i] = rand() / (double) RAND_MAX - 0.5;
+
+	BPTT_BATCH *batch = create_BPTT_batch(Net, B, T);
+	forward_BPTT_batch(Net, batch, B, V, T, lengths);
+	real batched[B][T][dimY];				// the batch's outputs, before Net is reused
+	for (int b = 0; b < B; ++b)
+		for (int t = 0; t < lengths[b]; ++t)
+			memcpy(batched[b][t], BATCH_OUTPUTS(Net, batch, t, b, numLayers - 1),
+					dimY * sizeof (real));
+
+	// each sequence alone, from the same weights
+	double maxOut = 0.0, maxDW = 0.0;
+	for (int b = 0; b < B; ++b)
+		{
+		set_RNN_weights(Net, W0);
+		forward_BPTT(Net, dimV, V + b * dimV, lengths[b]);
+		for (int t = 0; t < lengths[b]; ++t)
+			for (int k = 0; k < dimY; ++k)
+				{
+				double y = batched[b][t][k];		// relative to outputs > 1
+				double d = fabs(BPTT_OUTPUTS(Net, t, numLayers - 1)[k] - y) / fmax(1.0, fabs(y));
+				maxOut = fmax(maxOut, d);
+				}
+		backprop_through_time(Net, errors + b * dimY, lengths[b]);
+		get_RNN_weights(Net, W);
+		for (int i = 0; i < numWeights; ++i)
+			sumDW[i] += W[i] - W0[i];
+		}
+
+	// the batch's forward pass is still in its buffers
+	set_RNN_weights(Net, W0);
+	backprop_BPTT_batch(Net, batch, errors);
+	get_RNN_weights(Net, W);
+	for (int i = 0; i < numWeights; ++i)
+		maxDW = fmax(maxDW, fabs((W[i] - W0[i]) - sumDW[i] / B));
+
+	double tolerance = sizeof (real) == 4 ? 1e-4 : 1e-12;
+	bool ok = maxOut < tolerance && maxDW < tolerance;
+	printf("BPTT batch of lengths {%d, %d, %d} vs one sequence at a time:\n", lengths[0],
+			lengths[1], lengths[2]);
+	printf("max relative |Δ output| = %g, max |Δ weight change| = %g:  %s\n", maxOut, maxDW,
+			ok ? "OK" : "\x1b[31mFAILED\x1b[39;49m");
+
+	free_BPTT_batch(batch);
+	free_BPTT_NN(Net);
+	return ok;
+	}
+
+// Truncated BPTT on a stream (stream_forward_BPTT(), stream_backprop_BPTT()) with K1 = K
+// against forward_BPTT() + backprop_through_time() of the same K steps:  with an error only
+// on the last step, one back-prop of the window is BPTT of the whole sequence, so the
+// outputs of every step and the weight change must be the same up to rounding.
+bool BPTT_stream_test()
+	{
+	int neuronsPerLayer[] = BPTT_Layers;
+	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
+	enum { T = 6 };
+	RNN *Net = create_BPTT_NN(numLayers, neuronsPerLayer);
+	int dimV = neuronsPerLayer[0], dimY = neuronsPerLayer[numLayers - 1];
+
+	int numWeights = 0;
+	for (int l = 1; l < numLayers; ++l)
+		numWeights += neuronsPerLayer[l] * (neuronsPerLayer[l - 1] + 1);
+	real W0[numWeights], W1[numWeights], W[numWeights];
+	get_RNN_weights(Net, W0);
+
+	double V[dimV], errors[dimY], none[dimY];
+	for (int k = 0; k < dimV; ++k)
+		V[k] = rand() / (double) RAND_MAX;
+	for (int k = 0; k < dimY; ++k)
+		{
+		errors[k] = rand() / (double) RAND_MAX - 0.5;
+		none[k] = 0.0;
+		}
+
+	// the whole sequence at once
+	forward_BPTT(Net, dimV, V, T);
+	real whole[T][dimY];
+	for (int t = 0; t < T; ++t)
+		memcpy(whole[t], BPTT_OUTPUTS(Net, t, numLayers - 1), dimY * sizeof (real));
+	backprop_through_time(Net, errors, T);
+	get_RNN_weights(Net, W1);
+
+	// one step at a time, each fed the outputs of the step before
+	set_RNN_weights(Net, W0);
+	BPTT_STREAM *stream = start_BPTT_stream(Net, T, T);
+	double in[dimV];
+	memcpy(in, V, sizeof in);
+	double maxOut = 0.0, maxDW = 0.0;
+	for (int t = 0; t < T; ++t)
+		{
+		stream_forward_BPTT(stream, dimV, in);
+		const real *out = BPTT_OUTPUTS(Net, stream->slot, numLayers - 1);
+		for (int k = 0; k < dimY; ++k)
+			maxOut = fmax(maxOut, fabs(out[k] - whole[t][k]) / fmax(1.0, fabs(whole[t][k])));
+		for (int k = 0; k < dimV; ++k)
+			in[k] = out[k];
+		stream_backprop_BPTT(stream, t == T - 1 ? errors : none);
+		}
+	get_RNN_weights(Net, W);
+	for (int i = 0; i < numWeights; ++i)
+		maxDW = fmax(maxDW, fabs((W[i] - W0[i]) - (W1[i] - W0[i])));
+
+	double tolerance = sizeof (real) == 4 ? 1e-4 : 1e-12;
+	bool ok = maxOut < tolerance && maxDW < tolerance;
+	printf("Truncated BPTT stream (K1 = K = %d) vs BPTT of the whole sequence:\n", T);
+	printf("max relative |Δ output| = %g, max |Δ weight change| = %g:  %s\n", maxOut, maxDW,
+			ok ? "OK" : "\x1b[31mFAILED\x1b[39;49m");
+
+	stop_BPTT_stream(stream);
+	free_BPTT_NN(Net);
+	return ok;
+	}
+
+// BPTT with gradient checkpointing (BPTT_checkpoint()) against keeping every step, on a
+// sequence of 7 steps with a checkpoint every 1, 2, 3, ⌈√7⌉ and 7 steps:  the outputs of
+// the last step and the weight change must be the same up to rounding.
+bool BPTT_checkpoint_test()
+	{
+	int neuronsPerLayer[] = BPTT_Layers;
+	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
+	enum { T = 7 };
+	static const int every[] = {1, 2, 3, BPTT_SqrtT, T};
+	RNN *Net = create_BPTT_NN(numLayers, neuronsPerLayer);
+	int dimV = neuronsPerLayer[0], dimY = neuronsPerLayer[numLayers - 1];
+
+	int numWeights = 0;
+	for (int l = 1; l < numLayers; ++l)
+		numWeights += neuronsPerLayer[l] * (neuronsPerLayer[l - 1] + 1);
+	real W0[numWeights], W1[numWeights], W[numWeights];
+	get_RNN_weights(Net, W0);
+
+	double V[dimV], errors[dimY];
+	for (int k = 0; k < dimV; ++k)
+		V[k] = rand() / (double) RAND_MAX;
+	for (int k = 0; k < dimY; ++k)
+		errors[k] = rand() / (double) RAND_MAX - 0.5;
+
+	// every step kept
+	forward_BPTT(Net, dimV, V, T);
+	real last[dimY];
+	memcpy(last, BPTT_OUTPUTS(Net, T - 1, numLayers - 1), dimY * sizeof (real));
+	backprop_through_time(Net, errors, T);
+	get_RNN_weights(Net, W1);
+
+	double tolerance = sizeof (real) == 4 ? 1e-4 : 1e-12;
+	bool ok = true;
+	printf("BPTT with checkpoints vs every step kept, %d steps:\n", T);
+	for (int c = 0; c < (int) (sizeof every / sizeof (int)); ++c)
+		{
+		set_RNN_weights(Net, W0);
+		BPTT_checkpoint(Net, every[c]);
+		forward_BPTT(Net, dimV, V, T);
+		double maxOut = 0.0, maxDW = 0.0;
+		const real *out = BPTT_OUTPUTS(Net, BPTT_SLOT(Net, T - 1), numLayers - 1);
+		for (int k = 0; k < dimY; ++k)
+			maxOut = fmax(maxOut, fabs(out[k] - last[k]) / fmax(1.0, fabs(last[k])));
+		backprop_through_time(Net, errors, T);
+		get_RNN_weights(Net, W);
+		for (int i = 0; i < numWeights; ++i)
+			maxDW = fmax(maxDW, fabs((W[i] - W0[i]) - (W1[i] - W0[i])));
+
+		bool same = maxOut < tolerance && maxDW < tolerance;
+		ok = ok && same;
+		printf("segment %d:  max relative |Δ output| = %g, max |Δ weight change| = %g:  %s\n",
+				Net->segment, maxOut, maxDW, same ? "OK" : "\x1b[31mFAILED\x1b[39;49m");
+		}
+
+	free_BPTT_NN(Net);
+	return ok;
+	}
+
 int BPTT_arithmetic_testB_1(RNN *Net, rLAYER lastLayer)
 	{
 	double K1[10], K2[10];
@@ -1919,7 +1765,7 @@ int BPTT_arithmetic_testB_1(RNN *Net, rLAYER lastLayer)
 	*/
 
 	for (int k = 4; k < 10; ++k)			// 4..10 = output vector
-		K2[k] = lastLayer.neurons[k - 4].output[0];
+		K2[k] = BPTT_OUTPUTS(Net, 0, Net->numLayers - 1)[k - 4];
 
 	// get result
 	if (K2[8] > 0.5) // result ready?
@@ -6,19 +6,26 @@
 #include <math.h>
 #include <assert.h>
 #include <time.h>			// time as random seed in create_NN()
+#include <string.h>			// memset()
 #include "feedforward-NN.h"
+#include "SIMD-kernels.h"
+#include "NN-arena.h"
+#include "NN-profile.h"
+#include "perf-counters.h"
 
 #define Eta 0.01			// learning rate
 #define BIASINPUT 1.0		// input for bias. It's always 1.
 
-#define LastAct	true		// If false, activation function DISABLED on output layer
-
 double randomWeight() // generate random weight between [+1.0, -1.0]
 	{
 	// return 0.5 + (rand() / (double) RAND_MAX) * 0.01;
 	return (rand() / (double) RAND_MAX) * 2.0 - 1.0;
 	}
 
+// Set by a caller that seeds rand() itself (eg the time-to-accuracy harness), so that
+// creating or re-randomizing a network does not reseed it from the clock
+bool NN_fixedSeed = false;
+
 //******** activation functions and random weight generator ********************//
 // Note: sometimes the derivative is calculated in the forward_prop function
 
@@ -65,39 +72,92 @@ double d_x2(double v)
 
 //****************************create neural network*********************//
 // GIVEN: how many layers, and how many neurons in each layer
-NNET *create_NN(int numLayers, int *neuronsPerLayer)
+// All weights live in one aligned buffer net->params;  each layer's W is a slice of it
+// and each neuron's "weights" pointer is a row of W.  The NNET, its layers, neurons and
+// params are all carved from a single arena block (NN-arena.h).
+
+// Row length of a weight matrix whose rows hold (numInputs + 1) weights, rounded up
+// so that each row starts on an NN_Align boundary
+int NN_stride(int numInputs)
 	{
-	NNET *net = (NNET *) malloc(sizeof (NNET));
-	srand(time(NULL));
-	net->numLayers = numLayers;
+	return (numInputs + 1 + NN_RowPad - 1) / NN_RowPad * NN_RowPad;
+	}
 
-	assert(numLayers >= 3);
+// Lay out a network in the arena:  the NNET, its layers, the neurons of each layer and
+// the weights, unless the caller provides them in "params".  While the arena is
+// measuring nothing is written and NULL is returned.
+static NNET *layout_NN(ARENA *a, int numLayers, int *neuronsPerLayer, real *params)
+	{
+	NNET *net = (NNET *) arena_take(a, sizeof (NNET));
+	LAYER *layers = (LAYER *) arena_take(a, numLayers * sizeof (LAYER));
+	NEURON *neurons[numLayers];
+	for (int l = 0; l < numLayers; ++l)
+		neurons[l] = (NEURON *) arena_take(a, neuronsPerLayer[l] * sizeof (NEURON));
+	int numParams = 0;
+	for (int l = 1; l < numLayers; ++l)
+		numParams += neuronsPerLayer[l] * NN_stride(neuronsPerLayer[l - 1]);
+	if (params == NULL)
+		params = (real *) arena_take(a, numParams * sizeof (real));
+	if (net == NULL)
+		return NULL;
+
+	net->numLayers = numLayers;
+	net->layers = layers;
+	net->params = params;
+	net->numParams = numParams;
+	net->accuracy = Acc_exact;
 
-	net->layers = (LAYER *) malloc(numLayers * sizeof (LAYER));
 	//construct input layer, no weights
-	net->layers[0].numNeurons = neuronsPerLayer[0];
-	net->layers[0].neurons = (NEURON *) malloc(neuronsPerLayer[0] * sizeof (NEURON));
+	layers[0].numNeurons = neuronsPerLayer[0];
+	layers[0].neurons = neurons[0];
+	layers[0].stride = 0;
+	layers[0].W = NULL;
 
 	//construct hidden layers
-	for (int l = 1; l < numLayers; ++l) //construct layers
+	real *W = params;
+	for (int l = 1; l < numLayers; ++l)
 		{
-		net->layers[l].neurons = (NEURON *) malloc(neuronsPerLayer[l] * sizeof (NEURON));
-		net->layers[l].numNeurons = neuronsPerLayer[l];
-		for (int n = 0; n < neuronsPerLayer[l]; ++n) // construct each neuron in the layer
-			{
-			net->layers[l].neurons[n].weights =
-					(double *) malloc((neuronsPerLayer[l - 1] + 1) * sizeof (double));
+		layers[l].numNeurons = neuronsPerLayer[l];
+		layers[l].neurons = neurons[l];
+		layers[l].stride = NN_stride(neuronsPerLayer[l - 1]);
+		layers[l].W = W;
+		for (int n = 0; n < neuronsPerLayer[l]; ++n)
+			neurons[l][n].weights = W + n * layers[l].stride;
+		W += neuronsPerLayer[l] * layers[l].stride;
+		}
+	return net;
+	}
+
+// A network with all weights 0, eg to be filled in from a file:  unlike create_NN() it
+// neither reseeds nor draws from rand()
+NNET *blank_NN(int numLayers, int *neuronsPerLayer)
+	{
+	assert(numLayers >= 3);
+	ARENA arena = {NULL, 0};
+	layout_NN(&arena, numLayers, neuronsPerLayer, NULL);		// measure
+	arena_open(&arena);
+	return layout_NN(&arena, numLayers, neuronsPerLayer, NULL);
+	}
+
+NNET *create_NN(int numLayers, int *neuronsPerLayer)
+	{
+	assert(numLayers >= 3);
+	if (!NN_fixedSeed)
+		srand(time(NULL));
+
+	NNET *net = blank_NN(numLayers, neuronsPerLayer);
+	for (int l = 1; l < numLayers; ++l)
+		for (int n = 0; n < neuronsPerLayer[l]; ++n)
 			for (int i = 1; i <= neuronsPerLayer[l - 1]; ++i)
 				//when i = 0, it's bias weight (this can be ignored)
 				net->layers[l].neurons[n].weights[i] = randomWeight();
-			}
-		}
 	return net;
 	}
 
 void re_randomize(NNET *net, int numLayers, int *neuronsPerLayer)
 	{
-	srand(time(NULL));
+	if (!NN_fixedSeed)
+		srand(time(NULL));
 
 	for (int l = 1; l < numLayers; ++l)							// for each layer
 		for (int n = 0; n < neuronsPerLayer[l]; ++n)				// for each neuron
@@ -105,172 +165,232 @@ void re_randomize(NNET *net, int numLayers, int *neuronsPerLayer)
 				net->layers[l].neurons[n].weights[i] = randomWeight();
 	}
 
-void free_NN(NNET *net, int *neuronsPerLayer)
+// Build a network around existing weights laid out as net->params (eg a mapped model
+// file, see NN-file.c).  The weights are not initialized, and free_NN() does not free them.
+NNET *wrap_NN(int numLayers, int *neuronsPerLayer, real *params)
 	{
-	// for input layer
-	free(net->layers[0].neurons);
+	assert(numLayers >= 3);
+	ARENA arena = {NULL, 0};
+	layout_NN(&arena, numLayers, neuronsPerLayer, params);		// measure
+	arena_open(&arena);
+	return layout_NN(&arena, numLayers, neuronsPerLayer, params);
+	}
 
-	// for each hidden layer
-	int numLayers = net->numLayers;
-	for (int l = 1; l < numLayers; l++) // for each layer
+// The whole net is one arena block (see create_NN)
+void free_NN(NNET *net)
+	{
+	free(net);
+	}
+
+//**************************** forward-propagation ***************************//
+// The outputs of each layer are gathered into a contiguous vector x[] so that the
+// induced local fields can be computed with the vector kernels in SIMD-kernels.c.
+
+// Width of the widest layer, for sizing the scratch vectors
+static int max_width(const NNET *net)
+	{
+	int w = 0;
+	for (int l = 0; l < net->numLayers; ++l)
+		if (net->layers[l].numNeurons > w)
+			w = net->layers[l].numNeurons;
+	return w;
+	}
+
+// v = W [1, x]:  induced local fields of layer l given the previous layer's outputs x
+static void local_fields(LAYER *layer, const real x[], int dimX, real v[])
+	{
+	for (int n = 0; n < layer->numNeurons; n++)
 		{
-		for (int n = 0; n < neuronsPerLayer[l]; n++) // for each neuron in the layer
-			{
-			free(net->layers[l].neurons[n].weights);
-			}
-		free(net->layers[l].neurons);
+		const real *w = layer->W + n * layer->stride;
+		v[n] = w[0] * BIASINPUT + NNk.dot(w + 1, x, dimX);
 		}
+	}
 
-	// free all layers
-	free(net->layers);
+// Store outputs and derivatives of a layer into its neurons, and keep outputs in x
+static void set_outputs(LAYER *layer, const real y[], const real g[], real x[])
+	{
+	for (int n = 0; n < layer->numNeurons; n++)
+		{
+		layer->neurons[n].output = x[n] = y[n];
+		layer->neurons[n].grad = g[n];
+		}
+	}
 
-	// free the whole net
-	free(net);
+// y = σ(v) at the accuracy chosen for the net (y may be v)
+static void sigmoids(const NNET *net, real y[], const real v[], int n)
+	{
+	switch (net->accuracy)
+		{
+		case Acc_exact:
+			for (int i = 0; i < n; i++)
+				y[i] = sigmoid(v[i]);
+			break;
+		case Acc_fast:
+			NNk.sigmoid_fast(y, v, n, Steepness);
+			break;
+		case Acc_fastest:
+			NNk.sigmoid_fastest(y, v, n, Steepness);
+			break;
+		}
 	}
 
-//**************************** forward-propagation ***************************//
+// y = softplus(v), g = softplus'(v), at the accuracy chosen for the net (y may be v)
+static void softpluses(const NNET *net, real y[], real g[], const real v[], int n)
+	{
+	switch (net->accuracy)
+		{
+		case Acc_exact:
+			for (int i = 0; i < n; i++)
+				{
+				g[i] = d_softplus(v[i]);
+				y[i] = softplus(v[i]);
+				}
+			break;
+		case Acc_fast:
+			NNk.softplus_fast(y, g, v, n, Slope);
+			break;
+		case Acc_fastest:
+			NNk.softplus_fastest(y, g, v, n, Slope);
+			break;
+		}
+	}
+
+// Set the output of the input layer and copy V into x
+static void set_inputs(NNET *net, int dim_V, double V[], real x[])
+	{
+	for (int i = 0; i < dim_V; ++i)
+		net->layers[0].neurons[i].output = x[i] = V[i];
+	}
 
 void forward_prop_sigmoid(NNET *net, int dim_V, double V[])
 	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(t);
+	PERF_ENTER(Perf_forward_sigmoid);
+	int width = max_width(net);
+	real x[width], v[width], y[width], g[width];
+
 	// set the output of input layer
-	for (int i = 0; i < dim_V; ++i)
-		net->layers[0].neurons[i].output = V[i];
+	set_inputs(net, dim_V, V, x);
 
 	// calculate output from hidden layers to output layer
 	for (int l = 1; l < net->numLayers; l++)
 		{
-		for (int n = 0; n < net->layers[l].numNeurons; n++)
-			{
-			double v = 0; //induced local field for neurons
-			// calculate v, which is the sum of the product of input and weights
-			for (int k = 0; k <= net->layers[l - 1].numNeurons; k++)
-				{
-				if (k == 0)
-					v += net->layers[l].neurons[n].weights[k] * BIASINPUT;
-				else
-					v += net->layers[l].neurons[n].weights[k] *
-						net->layers[l - 1].neurons[k - 1].output;
-				}
+		int nn = net->layers[l].numNeurons;
+		local_fields(&net->layers[l], x, net->layers[l - 1].numNeurons, v);
 
-			// For the last layer, skip the sigmoid function
-			// Note: this idea seems to destroy back-prop convergence
+		// For the last layer, skip the sigmoid function
+		// Note: this idea seems to destroy back-prop convergence
 
-			if (!LastAct && l == net->numLayers - 1)
+		if (!LastAct && l == net->numLayers - 1)
+			for (int n = 0; n < nn; n++)
 				{
-				net->layers[l].neurons[n].output = v;
-				net->layers[l].neurons[n].grad = 1.0;
+				y[n] = v[n];
+				g[n] = 1.0;
 				}
-			else
-				{
-				double output = sigmoid(v);
-				net->layers[l].neurons[n].output = output;
+		else
+			{
+			sigmoids(net, y, v, nn);
 
 // There is a neat trick for the calculation of σ':  σ'(x) = σ(x) (1−σ(x))
 // For its simple derivation you can see this post:
 // http://math.stackexchange.com/questions/78575/derivative-of-sigmoid-function-sigma-x-frac11e-x
 // Therefore in the code, we use "output * (1 - output)" for the value of "σ'(summed input)",
 // because output = σ(summed input), where summed_input_i = Σ_j W_ji input_j.
-				net->layers[l].neurons[n].grad = Steepness * output * (1.0 - output);
-				}
+			NNk.d_sigmoid(g, y, nn, Steepness);
 			}
+
+		set_outputs(&net->layers[l], y, g, x);
+		PROF_SATURATED(Prof_FF, l, g, nn, Prof_Saturation * Steepness / 4);
+		PROF_LAYER(Prof_FF, l, Prof_forward, t, 2 * nn * (net->layers[l - 1].numNeurons + 1));
 		}
+	PERF_LEAVE(Perf_forward_sigmoid);
+	PROF_CALL(Prof_FF, Prof_forward, t0);
 	}
 
 // Same as above, except with soft_plus activation function
 void forward_prop_softplus(NNET *net, int dim_V, double V[])
 	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(t);
+	PERF_ENTER(Perf_forward_softplus);
+	int width = max_width(net);
+	real x[width], v[width], y[width], g[width];
+
 	// set the output of input layer
-	for (int i = 0; i < dim_V; ++i)
-		net->layers[0].neurons[i].output = V[i];
+	set_inputs(net, dim_V, V, x);
 
 	// calculate output from hidden layers to output layer
 	for (int l = 1; l < net->numLayers; l++)
 		{
-		for (int n = 0; n < net->layers[l].numNeurons; n++)
-			{
-			double v = 0.0; // induced local field for neurons
-			// calculate v, which is the sum of the product of input and weights
-			for (int k = 0; k <= net->layers[l - 1].numNeurons; k++)
-				{
-				if (k == 0)
-					v += net->layers[l].neurons[n].weights[k] * BIASINPUT;
-				else
-					v += net->layers[l].neurons[n].weights[k] *
-						net->layers[l - 1].neurons[k - 1].output;
-				}
+		local_fields(&net->layers[l], x, net->layers[l - 1].numNeurons, v);
 
-			net->layers[l].neurons[n].output = softplus(v);
+		softpluses(net, y, g, v, net->layers[l].numNeurons);
 
-			net->layers[l].neurons[n].grad = d_softplus(v);
-			}
+		set_outputs(&net->layers[l], y, g, x);
+		PROF_SATURATED(Prof_FF, l, g, net->layers[l].numNeurons, Prof_Saturation * Slope);
+		PROF_LAYER(Prof_FF, l, Prof_forward, t,
+				2 * net->layers[l].numNeurons * (net->layers[l - 1].numNeurons + 1));
 		}
+	PERF_LEAVE(Perf_forward_softplus);
+	PROF_CALL(Prof_FF, Prof_forward, t0);
 	}
 
 // Same as above, except with rectifier activation function
 // ReLU = "rectified linear unit"
 void forward_prop_ReLU(NNET *net, int dim_V, double V[])
 	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(t);
+	PERF_ENTER(Perf_forward_ReLU);
+	int width = max_width(net);
+	real x[width], v[width], y[width], g[width];
+
 	// set the output of input layer
-	for (int i = 0; i < dim_V; ++i)
-		net->layers[0].neurons[i].output = V[i];
+	set_inputs(net, dim_V, V, x);
 
 	// calculate output from hidden layers to output layer
 	for (int l = 1; l < net->numLayers; l++)
 		{
-		for (int n = 0; n < net->layers[l].numNeurons; n++)
-			{
-			double v = 0.0; // induced local field for neurons
-			// calculate v, which is the sum of the product of input and weights
-			for (int k = 0; k <= net->layers[l - 1].numNeurons; k++)
-				{
-				if (k == 0)
-					v += net->layers[l].neurons[n].weights[k] * BIASINPUT;
-				else
-					v += net->layers[l].neurons[n].weights[k] *
-						net->layers[l - 1].neurons[k - 1].output;
-				}
+		local_fields(&net->layers[l], x, net->layers[l - 1].numNeurons, v);
 
-			net->layers[l].neurons[n].output = rectifier(v);
+		// g[] = Leakage where v < 0, else 1.0;  this is to prepare for back-prop
+		NNk.ReLU(y, g, v, net->layers[l].numNeurons, Leakage);
 
-			// This is to prepare for back-prop
-			if (v < 0.0)
-				net->layers[l].neurons[n].grad = Leakage;
-			// if (v > 1.0)
-			//	net->layers[l].neurons[n].grad = Leakage;
-			else
-				net->layers[l].neurons[n].grad = 1.0;
-			}
+		set_outputs(&net->layers[l], y, g, x);
+		PROF_SATURATED(Prof_FF, l, g, net->layers[l].numNeurons, 1.0);	// leaky side
+		PROF_LAYER(Prof_FF, l, Prof_forward, t,
+				2 * net->layers[l].numNeurons * (net->layers[l - 1].numNeurons + 1));
 		}
+	PERF_LEAVE(Perf_forward_ReLU);
+	PROF_CALL(Prof_FF, Prof_forward, t0);
 	}
 
 // Same as above, except with x² activation function
 void forward_prop_x2(NNET *net, int dim_V, double V[])
 	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(t);
+	PERF_ENTER(Perf_forward_x2);
+	int width = max_width(net);
+	real x[width], v[width], y[width], g[width];
+
 	// set the output of input layer
-	for (int i = 0; i < dim_V; ++i)
-		net->layers[0].neurons[i].output = V[i];
+	set_inputs(net, dim_V, V, x);
 
 	// calculate output from hidden layers to output layer
 	for (int l = 1; l < net->numLayers; l++)
 		{
-		for (int n = 0; n < net->layers[l].numNeurons; n++)
-			{
-			double v = 0.0; // induced local field for neurons
-			// calculate v, which is the sum of the product of input and weights
-			for (int k = 0; k <= net->layers[l - 1].numNeurons; k++)
-				{
-				if (k == 0)
-					v += net->layers[l].neurons[n].weights[k] * BIASINPUT;
-				else
-					v += net->layers[l].neurons[n].weights[k] *
-						net->layers[l - 1].neurons[k - 1].output;
-				}
+		local_fields(&net->layers[l], x, net->layers[l - 1].numNeurons, v);
 
-			net->layers[l].neurons[n].output = x2(v);
+		NNk.x2(y, g, v, net->layers[l].numNeurons);
 
-			net->layers[l].neurons[n].grad = d_x2(v);
-			}
+		set_outputs(&net->layers[l], y, g, x);
+		PROF_LAYER(Prof_FF, l, Prof_forward, t,
+				2 * net->layers[l].numNeurons * (net->layers[l - 1].numNeurons + 1));
 		}
+	PERF_LEAVE(Perf_forward_x2);
+	PROF_CALL(Prof_FF, Prof_forward, t0);
 	}
 
 //****************************** back-propagation ***************************//
@@ -299,6 +419,9 @@ void forward_prop_x2(NNET *net, int dim_V, double V[])
 
 void back_prop(NNET *net, double *errors)
 	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(t);
+	PERF_ENTER(Perf_back_prop);
 	int numLayers = net->numLayers;
 	LAYER lastLayer = net->layers[numLayers - 1];
 
@@ -310,40 +433,49 @@ void back_prop(NNET *net, double *errors)
 		// .grad has been prepared in forward-prop
 		lastLayer.neurons[n].grad *= errors[n];
 		}
+	PROF_LAYER(Prof_FF, numLayers - 1, Prof_backward, t, lastLayer.numNeurons);
 
 	// calculate gradient for hidden layers
+	// Σ_i W_in ∇_i is a column of the next layer's W;  instead of walking down the
+	// column we sweep the rows of W once, accumulating into sum[] (contiguous access).
 	for (int l = numLayers - 2; l > 0; --l)		// for each hidden layer
 		{
-		for (int n = 0; n < net->layers[l].numNeurons; n++)		// for each neuron in layer
-			{
-			// double output = net->layers[l].neurons[n].output;
-			double sum = 0.0f;
-			LAYER prevLayer = net->layers[l + 1];
-			for (int i = 0; i < prevLayer.numNeurons; i++)		// for each weight
-				{
-				sum += prevLayer.neurons[i].weights[n + 1]		// ignore weights[0] = bias
-						* prevLayer.neurons[i].grad;
-				}
-			// .grad has been prepared in forward-prop
-			net->layers[l].neurons[n].grad *= sum;
-			}
+		int nn = net->layers[l].numNeurons;
+		real sum[nn];
+		for (int n = 0; n < nn; n++)
+			sum[n] = 0.0;
+
+		LAYER prevLayer = net->layers[l + 1];
+		for (int i = 0; i < prevLayer.numNeurons; i++)		// for each row of W
+			NNk.axpy(sum, prevLayer.neurons[i].grad,
+					prevLayer.W + i * prevLayer.stride + 1, nn);	// ignore bias column
+
+		// .grad has been prepared in forward-prop
+		for (int n = 0; n < nn; n++)		// for each neuron in layer
+			net->layers[l].neurons[n].grad *= sum[n];
+		PROF_LAYER(Prof_FF, l, Prof_backward, t, (2 * prevLayer.numNeurons + 1) * nn);
 		}
 
 	// update all weights
+	// Each row of W gets a rank-1 update:  W_n += η ∇_n [1, input]
 	for (int l = 1; l < numLayers; ++l)		// except for 0th layer which has no weights
 		{
+		int nx = net->layers[l - 1].numNeurons;
+		real x[nx];
+		for (int i = 0; i < nx; i++)
+			x[i] = net->layers[l - 1].neurons[i].output;
+
 		for (int n = 0; n < net->layers[l].numNeurons; n++)		// for each neuron
 			{
-			net->layers[l].neurons[n].weights[0] += Eta *
-					net->layers[l].neurons[n].grad * 1.0;		// 1.0f = bias input
-			for (int i = 0; i < net->layers[l - 1].numNeurons; i++)	// for each weight
-				{
-				double inputForThisNeuron = net->layers[l - 1].neurons[i].output;
-				net->layers[l].neurons[n].weights[i + 1] += Eta *
-						net->layers[l].neurons[n].grad * inputForThisNeuron;
-				}
+			real *w = net->layers[l].W + n * net->layers[l].stride;
+			real delta = Eta * net->layers[l].neurons[n].grad;
+			w[0] += delta * 1.0;		// 1.0f = bias input
+			NNk.axpy(w + 1, delta, x, nx);
 			}
+		PROF_LAYER(Prof_FF, l, Prof_update, t, 2 * net->layers[l].numNeurons * (nx + 1));
 		}
+	PERF_LEAVE(Perf_back_prop);
+	PROF_CALL(Prof_FF, Prof_backward, t0);
 	}
 
 // Calculate error between output of forward-prop and a given answer Y
@@ -367,6 +499,432 @@ double calc_error(NNET *net, double Y[], double *errors)
 	return mse; //return mean square error
 	}
 
+//******************************** mini-batch *********************************//
+// The batched path splits back-prop into 3 steps so that many samples can share one
+// weight update:
+//		forward_batch()		Y[l] = f(W [1, Y[l-1]]) for all B samples at once
+//		backward_batch()	computes ∇ for all samples and accumulates Σ ∇ [1, input]
+//							into batch->dW, without touching the weights
+//		apply_update()		W += η dW / (# of samples accumulated), then clears dW
+// With B = 1 this is the same computation as forward_prop_*() followed by back_prop().
+
+BATCH *create_batch(NNET *net, int B)
+	{
+	BATCH *batch = (BATCH *) malloc(sizeof (BATCH));
+	batch->size = B;
+	batch->count = 0;
+	batch->Y = (real **) malloc(net->numLayers * sizeof (real *));
+	batch->G = (real **) malloc(net->numLayers * sizeof (real *));
+
+	// all activation matrices in one block
+	int total = 0;
+	for (int l = 0; l < net->numLayers; ++l)
+		total += B * net->layers[l].numNeurons;
+	real *p = (real *) malloc(2 * total * sizeof (real));
+	for (int l = 0; l < net->numLayers; ++l)
+		{
+		batch->Y[l] = p;
+		p += B * net->layers[l].numNeurons;
+		batch->G[l] = p;
+		p += B * net->layers[l].numNeurons;
+		}
+
+	batch->dW = (real *) aligned_alloc(NN_Align, net->numParams * sizeof (real));
+	memset(batch->dW, 0, net->numParams * sizeof (real));
+	return batch;
+	}
+
+void free_batch(BATCH *batch)
+	{
+	free(batch->Y[0]);			// start of the activation block
+	free(batch->Y);
+	free(batch->G);
+	free(batch->dW);
+	free(batch);
+	}
+
+// Propagate B samples through layers 1..L-1 given the inputs in Y[0].
+// Only reads the net, so it is safe to call concurrently with distinct Y, G.
+static void forward_layers(const NNET *net, real **Ys, real **Gs, int B, ACTIVATION act)
+	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(t);
+	for (int l = 1; l < net->numLayers; l++)
+		{
+		const LAYER *layer = &net->layers[l];
+		int nx = net->layers[l - 1].numNeurons, nn = layer->numNeurons;
+		const real *X = Ys[l - 1];
+		real *Y = Ys[l], *G = Gs[l];
+
+		// induced local fields;  each row of W is re-used for all B samples while in cache
+		for (int n = 0; n < nn; n++)
+			{
+			const real *w = layer->W + n * layer->stride;
+			for (int b = 0; b < B; b++)
+				Y[b * nn + n] = w[0] * BIASINPUT + NNk.dot(w + 1, X + b * nx, nx);
+			}
+
+		// activation, in place over the whole B × nn matrix
+		int size = B * nn;
+		switch (act)
+			{
+			case Act_sigmoid:
+				if (!LastAct && l == net->numLayers - 1)
+					for (int i = 0; i < size; i++)
+						G[i] = 1.0;
+				else
+					{
+					sigmoids(net, Y, Y, size);
+					NNk.d_sigmoid(G, Y, size, Steepness);
+					}
+				break;
+			case Act_ReLU:
+				NNk.ReLU(Y, G, Y, size, Leakage);
+				break;
+			case Act_softplus:
+				softpluses(net, Y, G, Y, size);
+				break;
+			case Act_x2:
+				NNk.x2(Y, G, Y, size);
+				break;
+			}
+		PROF_SATURATED(Prof_FF, l, G, act == Act_x2 ? 0 : size, act == Act_sigmoid ?
+				Prof_Saturation * Steepness / 4 : act == Act_ReLU ? 1.0 : Prof_Saturation * Slope);
+		PROF_LAYER(Prof_FF, l, Prof_forward, t, 2 * B * nn * (nx + 1));
+		}
+	PROF_CALL(Prof_FF, Prof_forward, t0);
+	}
+
+// X = B × (# of inputs) matrix, one input vector per row.
+// Outputs are in batch->Y[numLayers - 1], one row per sample.
+void forward_batch(NNET *net, BATCH *batch, int B, double *X, ACTIVATION act)
+	{
+	assert(B <= batch->size);
+	for (int i = 0; i < B * net->layers[0].numNeurons; ++i)
+		batch->Y[0][i] = X[i];
+
+	forward_layers(net, batch->Y, batch->G, B, act);
+	}
+
+// errors = B × (# of outputs) matrix of (desired - actual), as for back_prop()
+void backward_batch(NNET *net, BATCH *batch, int B, double *errors)
+	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(t);
+	int numLayers = net->numLayers;
+
+	// calculate gradient for output layer
+	real *G = batch->G[numLayers - 1];
+	for (int i = 0; i < B * net->layers[numLayers - 1].numNeurons; ++i)
+		G[i] *= errors[i];
+	PROF_LAYER(Prof_FF, numLayers - 1, Prof_backward, t, B * net->layers[numLayers - 1].numNeurons);
+
+	// calculate gradient for hidden layers, sample by sample
+	for (int l = numLayers - 2; l > 0; --l)
+		{
+		int nn = net->layers[l].numNeurons;
+		LAYER *next = &net->layers[l + 1];
+		for (int b = 0; b < B; b++)
+			{
+			real sum[nn];
+			for (int n = 0; n < nn; n++)
+				sum[n] = 0.0;
+
+			const real *Gnext = batch->G[l + 1] + b * next->numNeurons;
+			for (int i = 0; i < next->numNeurons; i++)
+				NNk.axpy(sum, Gnext[i], next->W + i * next->stride + 1, nn);
+
+			real *G = batch->G[l] + b * nn;
+			for (int n = 0; n < nn; n++)
+				G[n] *= sum[n];
+			}
+		PROF_LAYER(Prof_FF, l, Prof_backward, t, B * (2 * next->numNeurons + 1) * nn);
+		}
+
+	// accumulate Σ_b ∇ [1, input] into dW (same layout as the weights)
+	for (int l = 1; l < numLayers; ++l)
+		{
+		LAYER *layer = &net->layers[l];
+		int nx = net->layers[l - 1].numNeurons, nn = layer->numNeurons;
+		real *dW = batch->dW + (layer->W - net->params);
+		for (int n = 0; n < nn; n++)
+			{
+			real *dw = dW + n * layer->stride;
+			for (int b = 0; b < B; b++)
+				{
+				real grad = batch->G[l][b * nn + n];
+				dw[0] += grad * BIASINPUT;
+				NNk.axpy(dw + 1, grad, batch->Y[l - 1] + b * nx, nx);
+				}
+			}
+		PROF_LAYER(Prof_FF, l, Prof_update, t, 2 * B * nn * (nx + 1));
+		}
+
+	batch->count += B;
+	PROF_CALL(Prof_FF, Prof_backward, t0);
+	}
+
+// W += η dW / count;  η = Eta gives the same step size as back_prop() per sample
+void apply_update(NNET *net, BATCH *batch, double eta)
+	{
+	if (batch->count == 0)
+		return;
+	PROF_BEGIN(t);
+
+	NNk.axpy(net->params, eta / batch->count, batch->dW, net->numParams);
+
+	memset(batch->dW, 0, net->numParams * sizeof (real));
+	batch->count = 0;
+	PROF_LAYER(Prof_FF, 0, Prof_update, t, 2 * net->numParams);
+	}
+
+//**************************** re-entrant forward-prop *************************//
+// forward() is forward-prop for a "const" network:  the outputs and derivatives go
+// into a caller-owned WORKSPACE instead of the NEURON structs, so any number of threads
+// can evaluate one network concurrently without copying it.
+
+WORKSPACE *create_workspace(const NNET *net)
+	{
+	WORKSPACE *ws = (WORKSPACE *) malloc(sizeof (WORKSPACE));
+	ws->numLayers = net->numLayers;
+	ws->Y = (real **) malloc(net->numLayers * sizeof (real *));
+	ws->G = (real **) malloc(net->numLayers * sizeof (real *));
+	ws->width = (int *) malloc(net->numLayers * sizeof (int));
+
+	int size = 0;
+	for (int l = 0; l < net->numLayers; ++l)
+		{
+		ws->width[l] = net->layers[l].numNeurons;
+		size += 2 * net->layers[l].numNeurons;
+		}
+	real *p = (real *) malloc(size * sizeof (real));
+	for (int l = 0; l < net->numLayers; ++l)
+		{
+		ws->Y[l] = p;
+		p += net->layers[l].numNeurons;
+		ws->G[l] = p;
+		p += net->layers[l].numNeurons;
+		}
+	return ws;
+	}
+
+void free_workspace(WORKSPACE *ws)
+	{
+	free(ws->Y[0]);				// start of the activation block
+	free(ws->Y);
+	free(ws->G);
+	free(ws->width);
+	free(ws);
+	}
+
+// Does the workspace have the right shape for this net, layer by layer?
+bool workspace_fits(const WORKSPACE *ws, const NNET *net)
+	{
+	if (ws->numLayers != net->numLayers)
+		return false;
+	for (int l = 0; l < net->numLayers; ++l)
+		if (ws->width[l] != net->layers[l].numNeurons)
+			return false;
+	return true;
+	}
+
+// Returns the output vector of the last layer (inside ws)
+real *forward(const NNET *net, WORKSPACE *ws, const double *in, ACTIVATION act)
+	{
+	for (int i = 0; i < net->layers[0].numNeurons; ++i)
+		ws->Y[0][i] = in[i];
+
+	forward_layers(net, ws->Y, ws->G, 1, act);
+
+	return ws->Y[net->numLayers - 1];
+	}
+
+//**************************** frozen inference plan ***************************//
+// freeze() compiles a trained NNET into a PLAN for inference only:  a private packed copy
+// of the weights (biases in a separate vector, so every row starts on a cache line), the
+// layer widths, and an activation kernel chosen once (at the net's accuracy), that
+// computes no derivatives.
+// evaluate() reads nothing but the plan and writes nothing but its own stack, so any
+// number of threads may use one plan at once.  The plan does not follow later training of
+// the NNET;  update_plan() copies the new weights in (while no thread is evaluating).
+
+typedef void (*ACT_KERNEL)(real *v, int n);		// v = f(v), in place
+
+struct PLAN
+	{
+	int numLayers;
+	int maxWidth;
+	int *width;					// # of neurons of each layer
+	int *stride;				// row length of W[l]
+	real **W;					// W[l] = width[l] × stride[l] weights, without biases
+	real **bias;				// bias[l] = bias weight of each neuron of layer l
+	ACT_KERNEL *activate;		// activation of each layer
+	real *block;				// all of W and bias
+	};
+
+static void sigmoid_only(real *v, int n)
+	{
+	for (int i = 0; i < n; ++i)
+		v[i] = 1.0 / (1.0 + exp(-Steepness * v[i]));
+	}
+
+static void sigmoid_fast_only(real *v, int n)
+	{
+	NNk.sigmoid_fast(v, v, n, Steepness);
+	}
+
+static void sigmoid_fastest_only(real *v, int n)
+	{
+	NNk.sigmoid_fastest(v, v, n, Steepness);
+	}
+
+static void ReLU_only(real *v, int n)
+	{
+	for (int i = 0; i < n; ++i)
+		v[i] = v[i] < 0.0 ? Leakage * v[i] : v[i];
+	}
+
+static void softplus_only(real *v, int n)
+	{
+	for (int i = 0; i < n; ++i)
+		v[i] = log(1.0 + exp(Slope * v[i]));
+	}
+
+static void softplus_fast_only(real *v, int n)
+	{
+	real g[n];
+	NNk.softplus_fast(v, g, v, n, Slope);
+	}
+
+static void softplus_fastest_only(real *v, int n)
+	{
+	real g[n];
+	NNk.softplus_fastest(v, g, v, n, Slope);
+	}
+
+static void x2_only(real *v, int n)
+	{
+	for (int i = 0; i < n; ++i)
+		v[i] = v[i] * v[i] + v[i];
+	}
+
+static void identity(real *v, int n)
+	{
+	(void) v;
+	(void) n;
+	}
+
+// Copy the weights of net into the plan;  false if the topologies differ
+bool update_plan(PLAN *plan, const NNET *net)
+	{
+	if (plan->numLayers != net->numLayers)
+		return false;
+	for (int l = 0; l < net->numLayers; ++l)
+		if (plan->width[l] != net->layers[l].numNeurons)
+			return false;
+
+	for (int l = 1; l < net->numLayers; ++l)
+		for (int n = 0; n < plan->width[l]; ++n)
+			{
+			const real *w = net->layers[l].W + n * net->layers[l].stride;
+			plan->bias[l][n] = w[0];
+			memcpy(plan->W[l] + n * plan->stride[l], w + 1, plan->width[l - 1] * sizeof (real));
+			}
+	return true;
+	}
+
+PLAN *freeze(const NNET *net, ACTIVATION act)
+	{
+	int L = net->numLayers;
+	PLAN *plan = (PLAN *) malloc(sizeof (PLAN));
+	plan->numLayers = L;
+	plan->width = (int *) malloc(L * sizeof (int));
+	plan->stride = (int *) malloc(L * sizeof (int));
+	plan->W = (real **) malloc(L * sizeof (real *));
+	plan->bias = (real **) malloc(L * sizeof (real *));
+	plan->activate = (ACT_KERNEL *) malloc(L * sizeof (ACT_KERNEL));
+
+	plan->maxWidth = max_width(net);
+	size_t size = 0;
+	for (int l = 0; l < L; ++l)
+		{
+		plan->width[l] = net->layers[l].numNeurons;
+		// row length:  width of the previous layer rounded up to a cache line
+		plan->stride[l] = l == 0 ? 0 : NN_stride(plan->width[l - 1] - 1);
+		size += plan->width[l] * plan->stride[l] + NN_stride(plan->width[l] - 1);
+		}
+
+	plan->block = (real *) aligned_alloc(NN_Align, size * sizeof (real));
+	memset(plan->block, 0, size * sizeof (real));
+	real *p = plan->block;
+	for (int l = 0; l < L; ++l)
+		{
+		plan->W[l] = p;
+		p += plan->width[l] * plan->stride[l];
+		plan->bias[l] = p;
+		p += NN_stride(plan->width[l] - 1);
+		}
+	update_plan(plan, net);
+
+	// the sigmoid and softplus kernels follow net->accuracy
+	static const ACT_KERNEL sigmoid_kernels[] = {sigmoid_only, sigmoid_fast_only, sigmoid_fastest_only};
+	static const ACT_KERNEL softplus_kernels[] = {softplus_only, softplus_fast_only, softplus_fastest_only};
+	ACT_KERNEL f = identity;
+	switch (act)
+		{
+		case Act_sigmoid:	f = sigmoid_kernels[net->accuracy];		break;
+		case Act_ReLU:		f = ReLU_only;							break;
+		case Act_softplus:	f = softplus_kernels[net->accuracy];	break;
+		case Act_x2:		f = x2_only;							break;
+		}
+	for (int l = 0; l < L; ++l)
+		plan->activate[l] = f;
+	if (act == Act_sigmoid && !LastAct)
+		plan->activate[L - 1] = identity;
+	return plan;
+	}
+
+void free_plan(PLAN *plan)
+	{
+	free(plan->block);
+	free(plan->width);
+	free(plan->stride);
+	free(plan->W);
+	free(plan->bias);
+	free(plan->activate);
+	free(plan);
+	}
+
+// Evaluate the network on input "in";  the outputs of the last layer go into "out"
+void evaluate(const PLAN *plan, const double *in, double *out)
+	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(t);
+	real buf1[plan->maxWidth], buf2[plan->maxWidth];
+	real *x = buf1, *v = buf2;
+
+	for (int i = 0; i < plan->width[0]; ++i)
+		x[i] = in[i];
+
+	for (int l = 1; l < plan->numLayers; ++l)
+		{
+		int nx = plan->width[l - 1], nn = plan->width[l];
+		const real *W = plan->W[l], *bias = plan->bias[l];
+		for (int n = 0; n < nn; ++n)
+			v[n] = bias[n] + NNk.dot(W + n * plan->stride[l], x, nx);
+		plan->activate[l](v, nn);
+
+		real *swap = x;
+		x = v;
+		v = swap;
+		PROF_LAYER(Prof_FF, l, Prof_forward, t, 2 * nn * (nx + 1));
+		}
+
+	for (int n = 0; n < plan->width[plan->numLayers - 1]; ++n)
+		out[n] = x[n];
+	PROF_CALL(Prof_FF, Prof_forward, t0);
+	}
+
 // **************************** Old code, currently not used *****************************
 
 /*
@@ -1,15 +1,22 @@
 // *********************** Back-Prop Through Time ***************************
 // Try to learn input-output pairs with flexible iteration
 
-// As a first step we only unfold once (to learn a 2-step operation).
+// The network is unfolded for any # of time steps, given to each call;  the outputs and
+// local gradients of all steps live in the time-major buffers of the RNN (BPTT-RNN.h).
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
 #include <time.h>				// time as random seed in create_NN()
 #include "BPTT-RNN.h"
+#include "NN-arena.h"
+#include "NN-profile.h"
+#include "SIMD-kernels.h"
+
+extern bool NN_fixedSeed;
 
 extern double rectifier(double);
 
@@ -19,47 +26,143 @@ extern double rectifier(double);
 //************************ create neural network *********************//
 // GIVEN: how many layers, and how many neurons in each layer
 
-RNN *create_BPTT_NN(int numLayers, int *neuronsPerLayer)
+// Lay out a network in the arena:  the RNN, its layers, the neurons of each layer and
+// one weight matrix per layer, whose rows are the neurons' weights (bias first).
+// While the arena is measuring nothing is written and NULL is returned.
+static RNN *layout_RNN(ARENA *a, int numLayers, int *neuronsPerLayer)
 	{
-	RNN *net = (RNN *) malloc(sizeof(RNN));
+	RNN *net = (RNN *) arena_take(a, sizeof (RNN));
+	rLAYER *layers = (rLAYER *) arena_take(a, numLayers * sizeof (rLAYER));
+	rNEURON *neurons[numLayers];
+	real *W[numLayers];
+	for (int l = 0; l < numLayers; ++l)
+		{
+		neurons[l] = (rNEURON *) arena_take(a, neuronsPerLayer[l] * sizeof (rNEURON));
+		W[l] = l == 0 ? NULL :
+			(real *) arena_take(a, neuronsPerLayer[l] * (neuronsPerLayer[l - 1] + 1) * sizeof (real));
+		}
+	if (net == NULL)
+		return NULL;
 
-	srand(time(NULL));
 	net->numLayers = numLayers;
+	net->layers = layers;
+	int offset = 0;
+	for (int l = 0; l < numLayers; ++l)
+		{
+		layers[l].numNeurons = neuronsPerLayer[l];
+		layers[l].neurons = neurons[l];
+		layers[l].offset = offset;
+		offset += neuronsPerLayer[l];
+		if (l > 0)
+			// Only 1 array of weights per neuron, because weights are shared across folds
+			for (int n = 0; n < neuronsPerLayer[l]; ++n)
+				neurons[l][n].weights = W[l] + n * (neuronsPerLayer[l - 1] + 1);
+		}
+	#define StepAlign	(Arena_Align / (int) sizeof (real))
+	net->stride = (offset + StepAlign - 1) / StepAlign * StepAlign;
+	net->capacity = 0;
+	net->outputs = net->grads = NULL;
+	net->checkpointEvery = net->segment = net->numCheckpoints = 0;
+	net->checkpoints = net->dW = NULL;
+	net->peakBytes = 0;
+	return net;
+	}
 
-	assert(numLayers >= 3);
+// # of weights (biases included)
+static size_t num_weights(RNN *net)
+	{
+	size_t n = 0;
+	for (int l = 1; l < net->numLayers; ++l)
+		n += (size_t) net->layers[l].numNeurons * (net->layers[l - 1].numNeurons + 1);
+	return n;
+	}
+
+static void note_peak(RNN *net)
+	{
+	size_t bytes = ((size_t) 2 * net->capacity * net->stride +
+			(size_t) net->numCheckpoints * net->layers[0].numNeurons) * sizeof (real);
+	if (net->dW != NULL)
+		bytes += num_weights(net) * sizeof (real);
+	if (bytes > net->peakBytes)
+		net->peakBytes = bytes;
+	}
 
-	net->layers = (rLAYER *) malloc(numLayers * sizeof (rLAYER));
-	//construct input layer, no weights
-	net->layers[0].numNeurons = neuronsPerLayer[0];
-	net->layers[0].neurons = (rNEURON *) malloc(neuronsPerLayer[0] * sizeof (rNEURON));
+// Make room for T time steps in the buffers (at least doubling, so that growing a step
+// at a time does not reallocate every call)
+static void reserve_steps(RNN *net, int T)
+	{
+	if (T <= net->capacity)
+		return;
+	int capacity = 2 * net->capacity > T ? 2 * net->capacity : T;
+	size_t bytes = (size_t) capacity * net->stride * sizeof (real);
+	free(net->outputs);
+	free(net->grads);
+	net->outputs = (real *) aligned_alloc(Arena_Align, bytes);
+	net->grads = (real *) aligned_alloc(Arena_Align, bytes);
+	net->capacity = capacity;
+	note_peak(net);
+	}
 
-	//construct hidden layers
-	for (int l = 1; l < numLayers; l++) //construct layers
+// Make room for the checkpoints and segments of an unfolding of T steps;  returns the
+// segment length
+static int reserve_checkpoints(RNN *net, int T)
+	{
+	int every = net->checkpointEvery;
+	if (every == BPTT_SqrtT)
+		every = (int) ceil(sqrt(T));
+	int numCheckpoints = (T + every - 1) / every;
+	if (numCheckpoints > net->numCheckpoints)
 		{
-		// This takes cares of n-folds of outputs and gradients:
-		net->layers[l].neurons = (rNEURON *) malloc(neuronsPerLayer[l] * sizeof (rNEURON));
-		net->layers[l].numNeurons = neuronsPerLayer[l];
-		for (int n = 0; n < neuronsPerLayer[l]; n++) // construct each neuron in the layer
-			{
-			// Only 1 array of weights per neuron, because weights are shared across folds
-			net->layers[l].neurons[n].weights =
-					(double *) malloc((neuronsPerLayer[l - 1] + 1) * sizeof (double));
+		free(net->checkpoints);
+		net->checkpoints = (real *) malloc((size_t) numCheckpoints *
+				net->layers[0].numNeurons * sizeof (real));
+		net->numCheckpoints = numCheckpoints;
+		}
+	if (net->dW == NULL)
+		net->dW = (real *) malloc(num_weights(net) * sizeof (real));
+	reserve_steps(net, every);
+	note_peak(net);
+	return every;
+	}
+
+// Gradient checkpointing (see BPTT-RNN.h):  every = 0 (off), > 0 or BPTT_SqrtT
+void BPTT_checkpoint(RNN *net, int every)
+	{
+	assert(every >= 0 || every == BPTT_SqrtT);
+	net->checkpointEvery = every;
+	}
+
+// Most bytes held for time steps, checkpoints and summed weight changes so far
+size_t BPTT_peak_bytes(RNN *net)
+	{
+	return net->peakBytes;
+	}
+
+RNN *create_BPTT_NN(int numLayers, int *neuronsPerLayer)
+	{
+	assert(numLayers >= 3);
+	if (!NN_fixedSeed)
+		srand(time(NULL));
+
+	ARENA arena = {NULL, 0};
+	layout_RNN(&arena, numLayers, neuronsPerLayer);		// measure
+	arena_open(&arena);
+	RNN *net = layout_RNN(&arena, numLayers, neuronsPerLayer);
+
+	extern double randomWeight();
+	for (int l = 1; l < numLayers; l++)
+		for (int n = 0; n < neuronsPerLayer[l]; n++)
+			//when i = 0, it's bias weight
 			for (int i = 0; i <= neuronsPerLayer[l - 1]; i++)
-				{
-				//construct weights of neuron from previous layer neurons
-				//when k = 0, it's bias weight
-				extern double randomWeight();
 				net->layers[l].neurons[n].weights[i] = randomWeight();
-				//net->layers[i].neurons[j].weights[k] = 0.0f;
-				}
-			}
-		}
+	reserve_steps(net, Nfold);
 	return net;
 	}
 
 void BPTT_re_randomize(RNN *net, int numLayers, int *neuronsPerLayer)
 	{
-	srand(time(NULL));
+	if (!NN_fixedSeed)
+		srand(time(NULL));
 
 	for (int l = 1; l < numLayers; ++l)							// for each layer
 		for (int n = 0; n < neuronsPerLayer[l]; ++n)				// for each neuron
@@ -70,26 +173,13 @@ void BPTT_re_randomize(RNN *net, int numLayers, int *neuronsPerLayer)
 				}
 	}
 
-void free_BPTT_NN(RNN *net, int *neuronsPerLayer)
+// The whole net is one arena block (see create_BPTT_NN), plus the time-step buffers
+void free_BPTT_NN(RNN *net)
 	{
-	// for input layer
-	free(net->layers[0].neurons);
-
-	// for each hidden layer
-	int numLayers = net->numLayers;
-	for (int l = 1; l < numLayers; l++) // for each layer
-		{
-		for (int n = 0; n < neuronsPerLayer[l]; n++) // for each neuron in the layer
-			{
-			free(net->layers[l].neurons[n].weights);
-			}
-		free(net->layers[l].neurons);
-		}
-
-	// free all layers
-	free(net->layers);
-
-	// free the whole net
+	free(net->outputs);
+	free(net->grads);
+	free(net->checkpoints);
+	free(net->dW);
 	free(net);
 	}
 
@@ -97,118 +187,519 @@ void free_BPTT_NN(RNN *net, int *neuronsPerLayer)
 // Propagate throught the *unfolded* network n times.
 // Record all activities (output)
 
+// Layers 1.. of time step "step" of the buffers, from the input layer already set
+static void forward_step(RNN *net, int step)
+	{
+	PROF_BEGIN(tl);
+	for (int l = 1; l < net->numLayers; l++)
+		{
+		int numInputs = net->layers[l - 1].numNeurons;
+		const real *in = BPTT_OUTPUTS(net, step, l - 1);
+		real *out = BPTT_OUTPUTS(net, step, l);
+		real *grad = BPTT_GRADS(net, step, l);
+		for (int n = 0; n < net->layers[l].numNeurons; n++)
+			{
+			const real *w = net->layers[l].neurons[n].weights;
+			//calculate v, the induced local field:  bias + inputs ∙ weights
+			real v = w[0] * BIASOUTPUT;
+			for (int k = 0; k < numInputs; k++)
+				v += w[k + 1] * in[k];
+
+			out[n] = rectifier(v);
+
+			// This is to prepare for back-prop
+			#define Leakage 0.1
+			if (v < 0.0)
+				grad[n] = Leakage;
+			// if (v > 1.0)
+			//	grad[n] = Leakage;
+			else
+				grad[n] = 1.0;
+			PROF_NEURON(Prof_BPTT, l, v < 0.0);			// on the leaky side
+			}
+		PROF_LAYER(Prof_BPTT, l, Prof_forward, tl,
+				2 * net->layers[l].numNeurons * (numInputs + 1));
+		}
+	}
+
 void forward_BPTT(RNN *net, int dim_V, double V[], int nfold)
 	{
+	PROF_BEGIN(t0);
 	int numLayers = net->numLayers;
-	rLAYER lastLayer = net->layers[numLayers - 1];
+	// checkpointing:  step t in slot t mod segment
+	int segment = net->segment = net->checkpointEvery != 0 ? reserve_checkpoints(net, nfold) : 0;
+	if (segment == 0)
+		reserve_steps(net, nfold);
 
 	for (int t = 0; t < nfold; ++t) // for each unfolding...
 		{
 		//set the output of input layer
-		for (int k = 0; k < dim_V; ++k)
-			net->layers[0].neurons[k].output[t] =
-				(t == 0 ?
-				V[k] :
-				// feed output of last layer back to input
-				lastLayer.neurons[k].output[t - 1]);
+		int slot = BPTT_SLOT(net, t);
+		real *input = BPTT_OUTPUTS(net, slot, 0);
+		if (t == 0)
+			for (int k = 0; k < dim_V; ++k)
+				input[k] = V[k];
+		else
+			{
+			// feed output of last layer back to input
+			const real *fedBack = BPTT_OUTPUTS(net, BPTT_SLOT(net, t - 1), numLayers - 1);
+			for (int k = 0; k < dim_V; ++k)
+				input[k] = fedBack[k];
+			}
+		if (segment > 0 && slot == 0)
+			memcpy(net->checkpoints + (size_t) (t / segment) * net->layers[0].numNeurons,
+					input, net->layers[0].numNeurons * sizeof (real));
 
 		//calculate output from hidden layers to output layer
-		for (int l = 1; l < numLayers; l++)
-			{
-			for (int n = 0; n < net->layers[l].numNeurons; n++)
-				{
-				double v = 0.0; //induced local field for neurons
-				//calculate v, which is the sum of the product of input and weights
-				for (int k = 0; k <= net->layers[l - 1].numNeurons; k++)
-					{
-					if (k == 0)
-						v += net->layers[l].neurons[n].weights[k] * BIASOUTPUT;
-					else
-						v += net->layers[l].neurons[n].weights[k] *
-							net->layers[l - 1].neurons[k - 1].output[t];
-					}
+		forward_step(net, slot);
+		}
+	PROF_CALL(Prof_BPTT, Prof_forward, t0);
+	}
 
-				extern double rectifier(double);
-				net->layers[l].neurons[n].output[t] = rectifier(v);
+//*************************** Back-Prop Through Time ***************************//
 
-				// This is to prepare for back-prop
-				#define Leakage 0.1
-				if (v < 0.0)
-					net->layers[l].neurons[n].grad[t] = Leakage;
-				// if (v > 1.0)
-				//	net->layers[l].neurons[n].grad[t] = Leakage;
-				else
-					net->layers[l].neurons[n].grad[t] = 1.0;
-				}
+// ∇ of the hidden layers of one time step, from the ∇ of its last layer:
+// delta = σ' ∙ Σ (weights ∙ ∇ of the next layer).  delta and sigma' are time steps of
+// [layer][neuron] buffers;  they may be the same one (∇ computed in place of σ').
+static void hidden_deltas(RNN *net, real *delta, const real *sigma)
+	{
+	PROF_BEGIN(tl);
+	for (int l = net->numLayers - 2; l > 0; --l) // for each hidden layer (except layer 0 has no weights)
+		{
+		rLAYER nextLayer = net->layers[l + 1];
+		const real *nextDelta = delta + nextLayer.offset;
+		real *d = delta + net->layers[l].offset;
+		const real *g = sigma + net->layers[l].offset;
+		for (int n = 0; n < net->layers[l].numNeurons; n++) // for each neuron in layer
+			{
+			real sum = 0.0f;
+			for (int i = 0; i < nextLayer.numNeurons; i++) // for each weight
+				sum += nextLayer.neurons[i].weights[n + 1] // ignore weights[0] = bias
+						* nextDelta[i];
+			d[n] = g[n] * sum;
 			}
+		PROF_LAYER(Prof_BPTT, l, Prof_backward, tl,
+				(2 * nextLayer.numNeurons + 1) * net->layers[l].numNeurons);
 		}
 	}
 
-//*************************** Back-Prop Through Time ***************************//
+// Update all weights, each row once:  its changes are summed over the T time steps
+// step[0..T-1] of the buffers first (∇ in "deltas", inputs in the net's outputs).
+// If "sum" is not NULL the changes are added to it instead (laid out as the weights).
+static void update_weights(RNN *net, const real *deltas, const int *step, int T, real *sum)
+	{
+	PROF_BEGIN(tl);
+	for (int l = 1; l < net->numLayers; ++l) // except for 0th layer which has no weights
+		{
+		int numInputs = net->layers[l - 1].numNeurons;
+		real dW[numInputs + 1];
+		for (int n = 0; n < net->layers[l].numNeurons; n++) // for each neuron
+			{
+			for (int i = 0; i <= numInputs; i++)
+				dW[i] = 0.0;
+			for (int t = 0; t < T; ++t) // sum over all time...
+				{
+				size_t at = (size_t) step[t] * net->stride;
+				real g = deltas[at + net->layers[l].offset + n];
+				const real *in = net->outputs + at + net->layers[l - 1].offset;
+				dW[0] += g * 1.0; // 1.0f = bias input
+				for (int i = 0; i < numInputs; i++) // for each weight
+					dW[i + 1] += g * in[i];
+				}
+			if (sum != NULL)
+				{
+				for (int i = 0; i <= numInputs; i++)
+					sum[i] += dW[i];
+				sum += numInputs + 1;
+				continue;
+				}
+			real *w = net->layers[l].neurons[n].weights;
+			for (int i = 0; i <= numInputs; i++)
+				w[i] += Eta * dW[i];
+			}
+		PROF_LAYER(Prof_BPTT, l, Prof_update, tl,
+				(2 * T + 2) * net->layers[l].numNeurons * (numInputs + 1));
+		}
+	}
 
-void backprop_through_time(RNN *net, double *errors, int nfold)
+// ∇ of steps last..first of the buffers (slots), given the recurrent ∇ from the step
+// after "last" (0 if none) or the errors if "last" is the final step;  returns the
+// recurrent ∇ for the step before "first"
+static real backprop_steps(RNN *net, double *errors, int first, int last, real recurrent)
 	{
+	PROF_BEGIN(tl);
 	int numLayers = net->numLayers;
 	rLAYER lastLayer = net->layers[numLayers - 1];
 
-	for (int t = nfold - 1; t >= 0; --t) // back-prop through time...
+	for (int t = last; t >= first; --t) // back-prop through time...
 		{
-		if (t == nfold - 1)
+		real *grad = BPTT_GRADS(net, t, numLayers - 1);
+		if (errors != NULL && t == last)
 			// calculate ∇ for output layer
 			for (int n = 0; n < lastLayer.numNeurons; ++n)
-				{
-				// double output = lastLayer.neurons[n].output[t];
 				//for output layer, ∇ = σ'(x)∙error
-				lastLayer.neurons[n].grad[t] *= errors[n];
-				}
+				grad[n] *= errors[n];
 		else
 			// for the "recurrent" layer
 			for (int n = 0; n < lastLayer.numNeurons; ++n)
+				grad[n] *= recurrent;
+		PROF_LAYER(Prof_BPTT, numLayers - 1, Prof_backward, tl,
+				errors != NULL && t == last ? lastLayer.numNeurons :
+				(net->layers[1].numNeurons + 1) * lastLayer.numNeurons);
+
+		// calculate ∇ for hidden layers
+		real *step = BPTT_GRADS(net, t, 0);
+		hidden_deltas(net, step, step);
+
+		// the recurrent ∇ of step t - 1:  Σ ∇ of layer 1
+		const real *nextGrad = BPTT_GRADS(net, t, 1);
+		recurrent = 0.0f;
+		for (int i = 0; i < net->layers[1].numNeurons; i++) // for each weight
+			recurrent += nextGrad[i];
+		}
+	return recurrent;
+	}
+
+void backprop_through_time(RNN *net, double *errors, int nfold)
+	{
+	PROF_BEGIN(t0);
+	int segment = net->segment;
+	if (segment == 0)
+		{
+		backprop_steps(net, errors, 0, nfold - 1, 0.0f);
+		int steps[nfold];
+		for (int t = 0; t < nfold; ++t)
+			steps[t] = t;
+		update_weights(net, net->grads, steps, nfold, NULL);
+		PROF_CALL(Prof_BPTT, Prof_backward, t0);
+		return;
+		}
+
+	// Checkpointed:  segments last to first, each but the last recomputed from its
+	// checkpoint;  the weight changes are summed in dW and applied at the end, since the
+	// weights must stay those of forward_BPTT() until then
+	int numLayers = net->numLayers, dim_V = net->layers[0].numNeurons;
+	size_t numWeights = num_weights(net);
+	memset(net->dW, 0, numWeights * sizeof (real));
+	real recurrent = 0.0f;
+	int numSegments = (nfold + segment - 1) / segment;
+	for (int s = numSegments - 1; s >= 0; --s)
+		{
+		int first = s * segment;
+		int n = (s == numSegments - 1 ? nfold : first + segment) - first;
+		if (s < numSegments - 1)
+			{
+			memcpy(BPTT_OUTPUTS(net, 0, 0), net->checkpoints + (size_t) s * dim_V,
+					dim_V * sizeof (real));
+			forward_step(net, 0);
+			for (int t = 1; t < n; ++t)
 				{
-				// double output = lastLayer.neurons[n].output[t];
-				double sum = 0.0f;
-				rLAYER nextLayer = net->layers[1];
-				for (int i = 0; i < nextLayer.numNeurons; i++) // for each weight
-					{
-					sum += nextLayer.neurons[i].grad[t + 1];
-					}
-				lastLayer.neurons[n].grad[t] *= sum;
+				memcpy(BPTT_OUTPUTS(net, t, 0), BPTT_OUTPUTS(net, t - 1, numLayers - 1),
+						dim_V * sizeof (real));
+				forward_step(net, t);
 				}
+			}
+		recurrent = backprop_steps(net, s == numSegments - 1 ? errors : NULL, 0, n - 1,
+				recurrent);
+		int steps[n];
+		for (int t = 0; t < n; ++t)
+			steps[t] = t;
+		update_weights(net, net->grads, steps, n, net->dW);
+		}
 
-		// calculate ∇ for hidden layers
-		for (int l = numLayers - 2; l > 0; --l) // for each hidden layer (except layer 0 has no weights)
+	const real *dW = net->dW;
+	for (int l = 1; l < numLayers; ++l)
+		for (int n = 0; n < net->layers[l].numNeurons; n++)
+			{
+			real *w = net->layers[l].neurons[n].weights;
+			for (int i = 0; i <= net->layers[l - 1].numNeurons; i++)
+				w[i] += Eta * *dW++;
+			}
+	PROF_CALL(Prof_BPTT, Prof_backward, t0);
+	}
+
+//*************************** truncated BPTT on a stream ***************************//
+// TBPTT(K1, K):  the network is run one time step per stream_forward_BPTT(), and every
+// K1 steps stream_backprop_BPTT() back-props through the last K steps, with the errors
+// of each of them.  The K steps are a ring in the net's buffers (step t in slot t mod K),
+// so memory stays the same however long the stream.  As in forward_BPTT(), the input of a
+// step is taken to be the output of the step before for the recurrent ∇ (the caller feeds
+// it back, possibly with other inputs).
+
+BPTT_STREAM *start_BPTT_stream(RNN *net, int window, int every)
+	{
+	assert(every >= 1 && every <= window);
+	reserve_steps(net, window);
+	BPTT_STREAM *s = (BPTT_STREAM *) malloc(sizeof (BPTT_STREAM));
+	s->net = net;
+	s->window = window;
+	s->every = every;
+	s->steps = 0;
+	s->slot = 0;
+	s->numErrors = net->layers[net->numLayers - 1].numNeurons;
+	s->deltas = (real *) aligned_alloc(Arena_Align, (size_t) window * net->stride * sizeof (real));
+	s->errors = (double *) malloc((size_t) window * s->numErrors * sizeof (double));
+	return s;
+	}
+
+void stop_BPTT_stream(BPTT_STREAM *s)
+	{
+	free(s->deltas);
+	free(s->errors);
+	free(s);
+	}
+
+// Run the next time step on input V;  its outputs are BPTT_OUTPUTS(s->net, s->slot, l)
+void stream_forward_BPTT(BPTT_STREAM *s, int dim_V, double V[])
+	{
+	PROF_BEGIN(t0);
+	s->slot = s->steps % s->window;
+	real *input = BPTT_OUTPUTS(s->net, s->slot, 0);
+	for (int k = 0; k < dim_V; ++k)
+		input[k] = V[k];
+	forward_step(s->net, s->slot);
+	PROF_CALL(Prof_BPTT, Prof_forward, t0);
+	}
+
+// The errors of the step just run;  back-props and updates the weights every K1 steps
+void stream_backprop_BPTT(BPTT_STREAM *s, double *errors)
+	{
+	RNN *net = s->net;
+	for (int n = 0; n < s->numErrors; ++n)
+		s->errors[s->slot * s->numErrors + n] = errors[n];
+	if (++s->steps % s->every != 0)
+		return;
+
+	PROF_BEGIN(t0);
+	PROF_BEGIN(tl);
+	int numLayers = net->numLayers;
+	rLAYER lastLayer = net->layers[numLayers - 1];
+	int T = s->steps < s->window ? s->steps : s->window;
+	int steps[T];						// oldest first
+	for (int j = 0; j < T; ++j)
+		steps[j] = (s->steps - T + j) % s->window;
+
+	for (int j = T - 1; j >= 0; --j)	// back-prop through time, newest first...
+		{
+		size_t at = (size_t) steps[j] * net->stride;
+		real *delta = s->deltas + at;
+		const real *sigma = net->grads + at;
+		const double *e = s->errors + steps[j] * s->numErrors;
+
+		// ∇ for the output layer:  its own error, plus the "recurrent" ∇ of the next step
+		real sum = 0.0f;
+		if (j < T - 1)
 			{
-			for (int n = 0; n < net->layers[l].numNeurons; n++) // for each neuron in layer
+			const real *nextDelta = s->deltas + (size_t) steps[j + 1] * net->stride +
+					net->layers[1].offset;
+			for (int i = 0; i < net->layers[1].numNeurons; i++)
+				sum += nextDelta[i];
+			}
+		for (int n = 0; n < lastLayer.numNeurons; ++n)
+			delta[lastLayer.offset + n] = sigma[lastLayer.offset + n] * (e[n] + sum);
+		PROF_LAYER(Prof_BPTT, numLayers - 1, Prof_backward, tl,
+				(net->layers[1].numNeurons + 2) * lastLayer.numNeurons);
+
+		hidden_deltas(net, delta, sigma);
+		}
+
+	update_weights(net, s->deltas, steps, T, NULL);
+	PROF_CALL(Prof_BPTT, Prof_backward, t0);
+	}
+
+//*************************** batched BPTT ***************************//
+// B independent sequences in lockstep (BPTT-RNN.h):  the same computation as
+// forward_BPTT() + backprop_through_time() for each sequence, with the weight changes of
+// all of them summed and applied once, scaled by 1 / B (so B = 1 is backprop_through_time()).
+// Each row of W is re-used for the B sequences of a time step while in cache.
+
+static void reserve_batch_steps(RNN *net, BPTT_BATCH *batch, int T)
+	{
+	if (T <= batch->capacity)
+		return;
+	int capacity = 2 * batch->capacity > T ? 2 * batch->capacity : T;
+	size_t bytes = (size_t) capacity * batch->size * net->stride * sizeof (real);
+	free(batch->outputs);
+	free(batch->grads);
+	free(batch->mask);
+	batch->outputs = (real *) aligned_alloc(Arena_Align, bytes);
+	batch->grads = (real *) aligned_alloc(Arena_Align, bytes);
+	batch->mask = (unsigned char *) malloc((size_t) capacity * batch->size);
+	batch->capacity = capacity;
+	}
+
+BPTT_BATCH *create_BPTT_batch(RNN *net, int B, int T)
+	{
+	BPTT_BATCH *batch = (BPTT_BATCH *) malloc(sizeof (BPTT_BATCH));
+	batch->size = B;
+	batch->capacity = 0;
+	batch->B = batch->T = 0;
+	batch->lengths = (int *) malloc(B * sizeof (int));
+	batch->mask = NULL;
+	batch->outputs = batch->grads = NULL;
+	reserve_batch_steps(net, batch, T);
+	return batch;
+	}
+
+void free_BPTT_batch(BPTT_BATCH *batch)
+	{
+	free(batch->lengths);
+	free(batch->mask);
+	free(batch->outputs);
+	free(batch->grads);
+	free(batch);
+	}
+
+// V = B × (# of inputs) matrix, the first input of each sequence;  sequence b runs
+// lengths[b] ≤ nfold steps (lengths NULL:  all nfold)
+void forward_BPTT_batch(RNN *net, BPTT_BATCH *batch, int B, double *V, int nfold,
+		const int *lengths)
+	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(tl);
+	assert(B <= batch->size);
+	int numLayers = net->numLayers, dim_V = net->layers[0].numNeurons;
+	reserve_batch_steps(net, batch, nfold);
+	batch->B = B;
+	batch->T = nfold;
+	for (int b = 0; b < B; ++b)
+		{
+		batch->lengths[b] = lengths == NULL ? nfold : lengths[b];
+		assert(batch->lengths[b] <= nfold);
+		}
+	for (int t = 0; t < nfold; ++t)
+		for (int b = 0; b < B; ++b)
+			batch->mask[t * B + b] = t < batch->lengths[b];
+
+	int stride = net->stride;
+	for (int t = 0; t < nfold; ++t) // for each unfolding...
+		{
+		const unsigned char *mask = batch->mask + t * B;
+		real *step = batch->outputs + (size_t) t * B * stride;	// the B rows of step t
+		real *stepGrads = batch->grads + (size_t) t * B * stride;
+
+		//set the outputs of the input layer:  V, or the last layer fed back
+		for (int b = 0; b < B; ++b)
+			if (mask[b])
 				{
-				// double output = net->layers[l].neurons[n].output[t];
-				double sum = 0.0f;
-				rLAYER nextLayer = net->layers[l + 1];
-				for (int i = 0; i < nextLayer.numNeurons; i++) // for each weight
-					{
-					sum += nextLayer.neurons[i].weights[n + 1] // ignore weights[0] = bias
-							* nextLayer.neurons[i].grad[t];
-					}
-				net->layers[l].neurons[n].grad[t] *= sum;
+				real *input = BATCH_OUTPUTS(net, batch, t, b, 0);
+				if (t == 0)
+					for (int k = 0; k < dim_V; ++k)
+						input[k] = V[b * dim_V + k];
+				else
+					memcpy(input, BATCH_OUTPUTS(net, batch, t - 1, b, numLayers - 1),
+							dim_V * sizeof (real));
 				}
+
+		for (int l = 1; l < numLayers; l++)
+			{
+			int nx = net->layers[l - 1].numNeurons, nn = net->layers[l].numNeurons;
+			int in = net->layers[l - 1].offset, out = net->layers[l].offset;
+			for (int n = 0; n < nn; n++)
+				{
+				const real *w = net->layers[l].neurons[n].weights;
+				real *row = step;
+				for (int b = 0; b < B; ++b, row += stride)
+					if (mask[b])
+						row[out + n] = w[0] * BIASOUTPUT + NNk.dot(w + 1, row + in, nx);
+				}
+			for (int b = 0; b < B; ++b)
+				if (mask[b])
+					NNk.ReLU(step + (size_t) b * stride + out,
+							stepGrads + (size_t) b * stride + out,
+							step + (size_t) b * stride + out, nn, Leakage);
+			PROF_LAYER(Prof_BPTT, l, Prof_forward, tl, 2 * B * nn * (nx + 1));
 			}
 		}
+	PROF_CALL(Prof_BPTT, Prof_forward, t0);
+	}
 
-	// update all weights
-	for (int t = nfold - 1; t >= 0; --t) // sum over all time...
+// errors = B × (# of outputs) matrix, the errors of each sequence at its last step;
+// back-props all sequences and updates the weights
+void backprop_BPTT_batch(RNN *net, BPTT_BATCH *batch, double *errors)
+	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(tl);
+	int numLayers = net->numLayers, B = batch->B;
+	rLAYER lastLayer = net->layers[numLayers - 1];
+
+	for (int t = batch->T - 1; t >= 0; --t) // back-prop through time...
 		{
-		for (int l = 1; l < numLayers; ++l) // except for 0th layer which has no weights
+		const unsigned char *mask = batch->mask + t * B;
+		for (int b = 0; b < B; ++b)
 			{
-			for (int n = 0; n < net->layers[l].numNeurons; n++) // for each neuron
+			if (!mask[b])
+				continue;
+			real *grad = BATCH_GRADS(net, batch, t, b, numLayers - 1);
+			if (t == batch->lengths[b] - 1)
+				//for output layer, ∇ = σ'(x)∙error
+				for (int n = 0; n < lastLayer.numNeurons; ++n)
+					grad[n] *= errors[b * lastLayer.numNeurons + n];
+			else
 				{
-				net->layers[l].neurons[n].weights[0] += Eta *
-						net->layers[l].neurons[n].grad[t] * 1.0; // 1.0f = bias input
-				for (int i = 0; i < net->layers[l - 1].numNeurons; i++) // for each weight
+				// for the "recurrent" layer
+				const real *nextGrad = BATCH_GRADS(net, batch, t + 1, b, 1);
+				real sum = 0.0f;
+				for (int i = 0; i < net->layers[1].numNeurons; i++)
+					sum += nextGrad[i];
+				for (int n = 0; n < lastLayer.numNeurons; ++n)
+					grad[n] *= sum;
+				}
+			}
+		PROF_LAYER(Prof_BPTT, numLayers - 1, Prof_backward, tl,
+				B * (net->layers[1].numNeurons + 1) * lastLayer.numNeurons);
+
+		// ∇ for hidden layers, sequence by sequence
+		for (int l = numLayers - 2; l > 0; --l)
+			{
+			int nn = net->layers[l].numNeurons;
+			rLAYER nextLayer = net->layers[l + 1];
+			for (int b = 0; b < B; ++b)
+				{
+				if (!mask[b])
+					continue;
+				real sum[nn];
+				for (int n = 0; n < nn; n++)
+					sum[n] = 0.0;
+				const real *nextGrad = BATCH_GRADS(net, batch, t, b, l + 1);
+				for (int i = 0; i < nextLayer.numNeurons; i++)
+					NNk.axpy(sum, nextGrad[i], nextLayer.neurons[i].weights + 1, nn);
+				real *grad = BATCH_GRADS(net, batch, t, b, l);
+				for (int n = 0; n < nn; n++)
+					grad[n] *= sum[n];
+				}
+			PROF_LAYER(Prof_BPTT, l, Prof_backward, tl,
+					B * (2 * nextLayer.numNeurons + 1) * nn);
+			}
+		}
+
+	// update all weights, each row once:  summed over all sequences and time steps, ie
+	// over the T × B rows of the buffers (row t * B + b is masked by mask[t * B + b])
+	real eta = Eta / B;
+	int stride = net->stride, rows = batch->T * B;
+	for (int l = 1; l < numLayers; ++l)
+		{
+		int nx = net->layers[l - 1].numNeurons;
+		const real *grads = batch->grads + net->layers[l].offset;
+		const real *inputs = batch->outputs + net->layers[l - 1].offset;
+		real dW[nx + 1];
+		for (int n = 0; n < net->layers[l].numNeurons; n++)
+			{
+			for (int i = 0; i <= nx; i++)
+				dW[i] = 0.0;
+			for (int r = 0; r < rows; ++r)
+				if (batch->mask[r])
 					{
-					double inputForThisNeuron = net->layers[l - 1].neurons[i].output[t];
-					net->layers[l].neurons[n].weights[i + 1] += Eta *
-							net->layers[l].neurons[n].grad[t] * inputForThisNeuron;
+					real g = grads[(size_t) r * stride + n];
+					dW[0] += g * 1.0; // 1.0f = bias input
+					NNk.axpy(dW + 1, g, inputs + (size_t) r * stride, nx);
 					}
-				}
+			real *w = net->layers[l].neurons[n].weights;
+			for (int i = 0; i <= nx; i++)
+				w[i] += eta * dW[i];
 			}
+		PROF_LAYER(Prof_BPTT, l, Prof_update, tl,
+				(2 * B * batch->T + 2) * net->layers[l].numNeurons * (nx + 1));
 		}
+	PROF_CALL(Prof_BPTT, Prof_backward, t0);
 	}
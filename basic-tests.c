@@ -1,17 +1,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <time.h>
 #include <gsl/gsl_matrix.h>		// GNU scientific library
 #include <gsl/gsl_eigen.h>		// ...for finding matrix eigen values
 #include <gsl/gsl_complex_math.h>	// ...for complex abs value
 #include <stdbool.h>
 #include "RNN.h"
 #include "feedforward-NN.h"
+#include "SIMD-kernels.h"
+#include "training-loops.h"
 
 extern NNET *create_NN(int, int *);
-extern void create_RTRL_NN(RNN *, int, int *);
-extern void free_NN(NNET *, int *);
-extern void free_RTRL_NN(RNN *, int *);
+extern RNN *create_RTRL_NN(int, int *);
+extern void free_NN(NNET *);
+extern void free_RTRL_NN(RNN *);
 extern void forward_prop_sigmoid(NNET *, int, double *);
 extern void forward_prop_ReLU(NNET *, int, double *);
 extern void forward_prop_softplus(NNET *, int, double *);
@@ -20,6 +23,8 @@ extern void forward_RTRL(RNN *, int, double *);
 extern void back_prop(NNET *, double *);
 extern void back_prop_ReLU(NNET *, double *);
 extern void RTRL(RNN *, double *);
+extern bool XOR_loop(NNET *, int, int *, LOOP *);
+extern bool sine_loop(NNET *, int, int *, double *, LOOP *);
 extern void pause_graphics();
 extern void quit_graphics();
 extern void start_NN_plot(void);
@@ -140,7 +145,7 @@ void K_wandering_test()
 		pause_graphics();
 	else
 		quit_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
 // Train RNN to reproduce a sine wave time-series
@@ -149,93 +154,41 @@ void K_wandering_test()
 // In other words, K moves like the sine wave, but K's magnitude is free to vary and
 // will be different every time this test is called.
 
+// each() of sine_wave_test():  plots every step, the error of every period
+static int sine_progress(LOOP *loop, const PROGRESS *p)
+	{
+	NNET *Net = (NNET *) loop->arg;
+	plot_W(Net);
+	plot_NN(Net);
+	plot_trainer(p->target / 5.0 * 20);
+	plot_K();
+	if (delay_vis(0))
+		return Loop_stop;
+	if (p->testErr >= 0.0)
+		printf("iteration: %05ld, error: %lf\n", p->samples / 20 - 1, p->testErr);
+	return Loop_go;
+	}
+
 void sine_wave_test()
 	{
-	int neuronsPerLayer[3] = {10, 12, 10}; // first = input layer, last = output layer
+	int neuronsPerLayer[] = Sine_Layers; // first = input layer, last = output layer
 	int numLayers = sizeof (neuronsPerLayer) / sizeof (int);
 	NNET *Net = create_NN(numLayers, neuronsPerLayer);
-	LAYER lastLayer = Net->layers[numLayers - 1];
-	double K2[dim_K];
-	double errors[dim_K];
-	int quit;
-	double sum_error2;
 
 	start_NN_plot();
 	start_W_plot();
 	start_K_plot();
 	printf("Press 'Q' to quit\n\n");
 
-	// Initialize K vector
-	for (int k = 0; k < dim_K; ++k)
-		K[k] = (rand() / (float) RAND_MAX) * 2.0 - 1.0;
-
-	for (int i = 0; 1; ++i)
-		{
-		sum_error2 = 0.0f;
-
-		#define N 20		// loop from 0 to 2π in N divisions
-		for (int j = 0; j < N; j++)
-			{
-			#define Pi 3.141592654
-			K[1] = cos(2 * Pi * j / N) + 1.0f; // Phase information to aid learning
-
-			// Allow multiple forward propagations
-			ForwardPropMethod(Net, dim_K, K);
-
-			// The difference between K[0] and K'[0] should be equal to [sin(θ+dθ) - sinθ]
-			// where θ = 2π j/60.
-			#define Pi 3.141592654
-			#define Amplitude 0.5f
-			double dK_star = Amplitude * (sin(2 * Pi * (j + 1) / N) - sin(2 * Pi * j / N));
-
-			// Calculate actual difference between K[0] and K'[0]:
-			double dK = lastLayer.neurons[0].output - K[0];
-
-			// The error is the difference between the above two values:
-			double error = dK_star - dK;
-
-			// Error in the back-prop NN is recorded as [ideal - actual]:
-			//		K* - K = dK*
-			//		K' - K = dK
-			// thus, K* - k' = dK* - dK
-			errors[0] = error;
-
-			// The rest of the errors are zero:
-			for (int k = 1; k < dim_K; ++k)
-				errors[k] = 0.0f;
-
-			back_prop(Net, errors);
-
-			// copy output to input
-			for (int k = 0; k < dim_K; ++k)
-				K[k] = lastLayer.neurons[k].output;
-
-			sum_error2 += (error * error); // record sum of squared errors
-
-			plot_W(Net);
-			plot_NN(Net);
-			plot_trainer(dK_star / 5.0 * N);
-			plot_K();
-			if (quit = delay_vis(0))
-				break;
-			}
-
-		printf("iteration: %05d, error: %lf\n", i, sum_error2);
-		if (isnan(sum_error2))
-			break;
-
-		if (sum_error2 < 0.01)
-			break;
-
-		if (quit)
-			break;
-		}
+	// the loop moves K, which plot_K() shows
+	LOOP loop = {0.01, 0, sine_progress, Net, 0};
+	bool reached = sine_loop(Net, numLayers, neuronsPerLayer, K, &loop);
 
-	if (!quit)
+	if (reached)
 		pause_graphics();
 	else
 		quit_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
 // Train RNN to reproduce a sine wave time-series
@@ -323,7 +276,7 @@ void sine_wave_test2()
 		pause_graphics();
 	else
 		quit_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
 // Test classical back-prop
@@ -334,209 +287,86 @@ void sine_wave_test2()
 //			ReLU units, learning rate 0.05, leakage 0.0
 #define ForwardPropMethod	forward_prop_ReLU
 #define ErrorThreshold		0.02
+// each() of classic_BP_test():  status, plots and keys every 10 samples
+static int XOR_progress(LOOP *loop, const PROGRESS *p)
+	{
+	NNET *Net = (NNET *) loop->arg;
+	static char status[1024];
+	char *s = status;
+	if (p->restarted)
+		{
+		restart_LogErr_plot();
+		start_timer();
+		printf("\n****** Network re-randomized.\n");
+		}
+
+	s += sprintf(s, "[%05ld] ", p->i);
+	if (p->meanErr < 2.0)
+		s += sprintf(s, "mean |e|=%1.06lf, ", p->meanErr);
+	else
+		s += sprintf(s, "mean |e|=%e, ", p->meanErr);
+	if (p->testErr >= 0.0)
+		{
+		if (p->testErr < 2.0)
+			s += sprintf(s, "random test |e|=%1.06lf, ", p->testErr);
+		else
+			s += sprintf(s, "random test |e|=%e, ", p->testErr);
+		}
+	if ((p->i % 50) == 0)
+		{
+		if (p->ratio > 0)
+			s += sprintf(s, "|e| ratio=%e", p->ratio);
+		else
+			s += sprintf(s, "|e| ratio=\x1b[31m%e\x1b[39;49m", p->ratio);
+		}
+
+	if ((p->i % 10) == 0) // display status periodically
+		{
+		printf("%s\n", status);
+		plot_W(Net);
+		plot_LogErr(p->meanErr, ErrorThreshold);
+		plot_output(Net, ForwardPropMethod);
+		flush_output();
+		switch (delay_vis(0))
+			{
+			case 1:
+				return Loop_stop;
+			case 3:						// Re-start with new random weights
+				restart_LogErr_plot();
+				start_timer();
+				printf("\n****** Network re-randomized.\n");
+				beep();
+				return Loop_restart;
+			}
+		}
+	return Loop_go;
+	}
+
 void classic_BP_test()
 	{
-	int neuronsPerLayer[] = {2, 10, 9, 1}; // first = input layer, last = output layer
+	int neuronsPerLayer[] = XOR_Layers; // first = input layer, last = output layer
 	int numLayers = sizeof (neuronsPerLayer) / sizeof (int);
 	NNET *Net = create_NN(numLayers, neuronsPerLayer);
-	LAYER lastLayer = Net->layers[numLayers - 1];
-	double errors[dim_K];
 
-	int userKey = 0;
-	#define M	50			// how many errors to record for averaging
-	double errors1[M], errors2[M]; // two arrays for recording errors
-	double sum_err1 = 0.0, sum_err2 = 0.0; // sums of errors
-	int tail = 0; // index for cyclic arrays (last-in, first-out)
-
-	for (int i = 0; i < M; ++i) // clear errors to 0.0
-		errors1[i] = errors2[i] = 0.0;
-
-	// start_NN_plot();
 	start_W_plot();
-	// start_K_plot();
 	start_output_plot();
 	start_LogErr_plot();
-	// plot_ideal();
 	printf("Press 'Q' to quit\n\n");
 	start_timer();
 
-	char status[1024], *s;
-	for (int i = 1; 1; ++i)
-		{
-		s = status + sprintf(status, "[%05d] ", i);
-
-		// Create random K vector
-		for (int k = 0; k < 2; ++k)
-			K[k] = (rand() / (float) RAND_MAX);
-		// printf("*** K = <%lf, %lf>\n", K[0], K[1]);
-
-		//		if ((i % 4) == 0)
-		//			K[0] = 1.0, K[1] = 0.0;
-		//		if ((i % 4) == 1)
-		//			K[0] = 0.0, K[1] = 0.0;
-		//		if ((i % 4) == 2)
-		//			K[0] = 0.0, K[1] = 1.0;
-		//		if ((i % 4) == 3)
-		//			K[0] = 1.0, K[1] = 1.0;
-
-		ForwardPropMethod(Net, 2, K); // dim K = 2
-
-		// Desired value = K_star
-		double training_err = 0.0;
-		for (int k = 0; k < 1; ++k) // output has only 1 component
-			{
-			// double ideal = K[k];				/* identity function */
-			#define f2b(x) (x > 0.5f ? 1 : 0)	// convert float to binary
-			// ^ = binary XOR
-			double ideal = ((double) (f2b(K[0]) ^ f2b(K[1]))); // ^ f2b(K[2]) ^ f2b(K[3])))
-			// #define Ideal ((double) (f2b(K[k]) ^ f2b(K[2]) ^ f2b(K[3])))
-			// double ideal = 1.0f - (0.5f - K[0]) * (0.5f - K[1]);
-			// printf("*** ideal = %lf\n", ideal);
-
-			// Difference between actual outcome and desired value:
-			double error = ideal - lastLayer.neurons[k].output;
-			errors[k] = error; // record this for back-prop
-
-			training_err += fabs(error); // record sum of errors
-			}
-		// printf("sum of squared error = %lf  ", training_err);
-
-		// update error arrays cyclically
-		// (This is easier to understand by referring to the next block of code)
-		sum_err2 -= errors2[tail];
-		sum_err2 += errors1[tail];
-		sum_err1 -= errors1[tail];
-		sum_err1 += training_err;
-		// printf("sum1, sum2 = %lf %lf\n", sum_err1, sum_err2);
-
-		double mean_err = (i < M) ? (sum_err1 / i) : (sum_err1 / M);
-		if (mean_err < 2.0)
-			s += sprintf(s, "mean |e|=%1.06lf, ", mean_err);
-		else
-			s += sprintf(s, "mean |e|=%e, ", mean_err);
-
-		// record new error in cyclic arrays
-		errors2[tail] = errors1[tail];
-		errors1[tail] = training_err;
-		++tail;
-		if (tail == M) // loop back in cycle
-			tail = 0;
-
-		// plot_W(Net);
-		back_prop(Net, errors);
-		// plot_W(Net);
-		// pause_graphics();
-
-		if ((i % 200) == 0)
-			{
-			// Testing set
-			double test_err = 0.0;
-			#define numTests 50
-			for (int j = 0; j < numTests; ++j)
-				{
-				// Create random K vector
-				for (int k = 0; k < 2; ++k)
-					K[k] = ((double) rand() / (double) RAND_MAX);
-				// plot_tester(K[0], K[1]);
-
-				ForwardPropMethod(Net, 2, K);
-
-				// Desired value = K_star
-				double single_err = 0.0;
-				for (int k = 0; k < 1; ++k)
-					{
-					// double ideal = 1.0f - (0.5f - K[0]) * (0.5f - K[1]);
-					double ideal = (double) (f2b(K[0]) ^ f2b(K[1]));
-					// double ideal = K[k];				/* identity function */
-
-					// Difference between actual outcome and desired value:
-					double error = ideal - lastLayer.neurons[k].output;
-
-					single_err += fabs(error); // record sum of errors
-					}
-				test_err += single_err;
-				}
-			test_err /= ((double) numTests);
-			if (test_err < 2.0)
-				s += sprintf(s, "random test |e|=%1.06lf, ", test_err);
-			else
-				s += sprintf(s, "random test |e|=%e, ", test_err);
-			if (test_err < ErrorThreshold)
-				break;
-			}
-
-		if (i > 50 && (isnan(mean_err) || mean_err > 10.0))
-			{
-			re_randomize(Net, numLayers, neuronsPerLayer);
-			sum_err1 = 0.0; sum_err2 = 0.0;
-			tail = 0;
-			for (int j = 0; j < M; ++j) // clear errors to 0.0
-				errors1[j] = errors2[j] = 0.0;
-			i = 1;
-
-			restart_LogErr_plot();
-			start_timer();
-			printf("\n****** Network re-randomized.\n");
-			}
-
-		if ((i % 50) == 0)
-			{
-			double ratio = (sum_err2 - sum_err1) / sum_err1;
-			if (ratio > 0)
-				s += sprintf(s, "|e| ratio=%e", ratio);
-			else
-				s += sprintf(s, "|e| ratio=\x1b[31m%e\x1b[39;49m", ratio);
-			//if (isnan(ratio))
-			//	break;
-			}
-
-		if ((i % 10) == 0) // display status periodically
-			{
-			printf("%s\n", status);
-			// plot_NN(Net);
-			plot_W(Net);
-			plot_LogErr(mean_err, ErrorThreshold);
-			plot_output(Net, ForwardPropMethod);
-			flush_output();
-			// plot_trainer(0);		// required to clear the window
-			// plot_K();
-			userKey = delay_vis(0);
-			}
-
-		// if (ratio - 0.5f < 0.0000001)	// ratio == 0.5 means stationary
-		// if (test_err < 0.01)
-
-		if (userKey == 1)
-			break;
-		else if (userKey == 3)			// Re-start with new random weights
-			{
-			re_randomize(Net, numLayers, neuronsPerLayer);
-			sum_err1 = 0.0; sum_err2 = 0.0;
-			tail = 0;
-			for (int j = 0; j < M; ++j) // clear errors to 0.0
-				errors1[j] = errors2[j] = 0.0;
-			i = 1;
-
-			restart_LogErr_plot();
-			start_timer();
-			printf("\n****** Network re-randomized.\n");
-			userKey = 0;
-			beep();
-			// pause_key();
-			}
-		}
+	LOOP loop = {ErrorThreshold, 0, XOR_progress, Net, 0};
+	bool reached = XOR_loop(Net, numLayers, neuronsPerLayer, &loop);
 
 	end_timer(NULL);
 	beep();
-	// plot_output(Net, ForwardPropMethod);
 	flush_output();
 	plot_W(Net);
 
-	if (userKey == 0)
+	if (reached)
 		pause_graphics();
 	else
 		quit_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
 // Test forward propagation
@@ -597,7 +427,7 @@ void forward_test()
 		}
 
 	pause_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
 // Randomly generate a loop of K vectors;  make the RNN learn to traverse this loop.
@@ -662,16 +492,15 @@ void loop_dance_test()
 		}
 
 	pause_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
 void RNN_sine_test()
 	{
 	// create RNN
-	RNN *Net = (RNN *) malloc(sizeof (RNN));
 	int neuronsPerLayer[4] = {2, 10, 10, 1}; // first = input layer, last = output layer
 	int numLayers = sizeof (neuronsPerLayer) / sizeof (int);
-	create_RTRL_NN(Net, numLayers, neuronsPerLayer);
+	RNN *Net = create_RTRL_NN(numLayers, neuronsPerLayer);
 	rLAYER lastLayer = Net->layers[numLayers - 1];
 
 	int dimK = 2;
@@ -746,5 +575,94 @@ void RNN_sine_test()
 		pause_graphics();
 	else
 		quit_graphics();
-	free_RTRL_NN(Net, neuronsPerLayer);
+	free_RTRL_NN(Net);
+	}
+
+// **** Micro-benchmark of the activation functions
+// libm-based sigmoid(double) and softplus(double) versus the "fast" and "fastest" kernels
+// of every kernel set the CPU supports.  Prints the time per element and the max error
+// against libm over v ∈ [-40, 40], at Steepness 3.0 (as in sigmoid()) and Slope 1.0.
+
+extern double softplus(double), d_softplus(double);
+
+static double elapsed_ns(struct timespec *t0)
+	{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) * 1e9 + (t.tv_nsec - t0->tv_nsec);
+	}
+
+void benchmark_activations()
+	{
+	#define BenchN			4096
+	#define BenchReps		500
+	#define BenchSteepness	3.0		// = Steepness in back-prop.c
+	#define BenchSlope		1.0		// = Slope in back-prop.c
+	static real v[BenchN], y[BenchN], g[BenchN];
+	static double sig[BenchN], sp[BenchN], dsp[BenchN];
+	struct timespec t0;
+	double check = 0.0;
+
+	for (int i = 0; i < BenchN; ++i)
+		v[i] = -40.0 + 80.0 * i / (BenchN - 1);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int r = 0; r < BenchReps; ++r)
+		for (int i = 0; i < BenchN; ++i)
+			sig[i] = sigmoid(v[i]);
+	double tSig = elapsed_ns(&t0) / BenchReps / BenchN;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int r = 0; r < BenchReps; ++r)
+		for (int i = 0; i < BenchN; ++i)
+			{
+			sp[i] = softplus(v[i]);
+			dsp[i] = d_softplus(v[i]);
+			}
+	double tSp = elapsed_ns(&t0) / BenchReps / BenchN;
+
+	printf("Activation functions, %d elements × %d repeats, ns/element (max error):\n",
+			BenchN, BenchReps);
+	printf("  libm       sigmoid %6.2f                  softplus+d %6.2f\n", tSig, tSp);
+
+	const char *saved = NNk.name;
+	const char *sets[] = {"scalar", "sse2", "avx2", "avx512"};
+	for (int s = 0; s < 4; ++s)
+		{
+		if (!NN_select_kernels(sets[s]))
+			continue;
+		printf("  %-7s", sets[s]);
+
+		void (*sigmoid_kernel[2])(real *, const real *, int, real) =
+				{NNk.sigmoid_fast, NNk.sigmoid_fastest};
+		void (*softplus_kernel[2])(real *, real *, const real *, int, real) =
+				{NNk.softplus_fast, NNk.softplus_fastest};
+		for (int k = 0; k < 2; ++k)
+			{
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			for (int r = 0; r < BenchReps; ++r)
+				sigmoid_kernel[k](y, v, BenchN, BenchSteepness);
+			double t = elapsed_ns(&t0) / BenchReps / BenchN;
+			double err = 0.0;
+			for (int i = 0; i < BenchN; ++i)
+				err = fmax(err, fabs(y[i] - sig[i]));
+			check += y[BenchN / 3];
+			printf(" %s %5.2f (%.1e)", k == 0 ? "fast" : "fastest", t, err);
+			}
+		for (int k = 0; k < 2; ++k)
+			{
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			for (int r = 0; r < BenchReps; ++r)
+				softplus_kernel[k](y, g, v, BenchN, BenchSlope);
+			double t = elapsed_ns(&t0) / BenchReps / BenchN;
+			double err = 0.0;
+			for (int i = 0; i < BenchN; ++i)
+				err = fmax(err, fmax(fabs(y[i] - sp[i]), fabs(g[i] - dsp[i])));
+			check += y[BenchN / 3];
+			printf(" %s %5.2f (%.1e)", k == 0 ? "softplus fast" : "fastest", t, err);
+			}
+		printf("\n");
+		}
+	NN_select_kernels(saved);
+	printf("(checksum %g)\n", check);
 	}
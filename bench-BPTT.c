@@ -0,0 +1,125 @@
+// Benchmarks of forward_BPTT() and backprop_through_time(), see benchmark.c
+// (separate from bench-RTRL.c because BPTT-RNN.h and RNN.h both define RNN)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "BPTT-RNN.h"
+#include "benchmark.h"
+
+extern RNN *create_BPTT_NN(int, int *);
+extern void free_BPTT_NN(RNN *);
+extern void forward_BPTT(RNN *, int, double *, int);
+extern void backprop_through_time(RNN *, double *, int);
+extern void BPTT_checkpoint(RNN *, int);
+extern size_t BPTT_peak_bytes(RNN *);
+extern BPTT_BATCH *create_BPTT_batch(RNN *, int, int);
+extern void free_BPTT_batch(BPTT_BATCH *);
+extern void forward_BPTT_batch(RNN *, BPTT_BATCH *, int, double *, int, const int *);
+extern void backprop_BPTT_batch(RNN *, BPTT_BATCH *, double *);
+
+typedef struct BPTT_ARG
+	{
+	RNN *net;
+	int dim;
+	int nfold;					// sequence length
+	double *V, *errors;			// MaxBatch rows
+	BPTT_BATCH *batch;
+	int B;
+	} BPTT_ARG;
+
+static void run_forward(void *arg)
+	{
+	BPTT_ARG *a = (BPTT_ARG *) arg;
+	forward_BPTT(a->net, a->dim, a->V, a->nfold);
+	}
+
+static void run_train(void *arg)
+	{
+	BPTT_ARG *a = (BPTT_ARG *) arg;
+	forward_BPTT(a->net, a->dim, a->V, a->nfold);
+	backprop_through_time(a->net, a->errors, a->nfold);
+	}
+
+static void run_forward_batch(void *arg)
+	{
+	BPTT_ARG *a = (BPTT_ARG *) arg;
+	forward_BPTT_batch(a->net, a->batch, a->B, a->V, a->nfold, NULL);
+	}
+
+static void run_train_batch(void *arg)
+	{
+	BPTT_ARG *a = (BPTT_ARG *) arg;
+	forward_BPTT_batch(a->net, a->batch, a->B, a->V, a->nfold, NULL);
+	backprop_BPTT_batch(a->net, a->batch, a->errors);
+	}
+
+// The network is unfolded Nfold times, and LongFold times (kernels named "..._T<LongFold>"),
+// also with gradient checkpointing every √LongFold steps ("..._ckpt");  its output layer
+// is fed back to its input layer.  The peak bytes held for the unfolding go to stderr.
+// Then batches of B sequences of Nfold steps, timed per sequence.
+#define LongFold	64
+#define MaxBatch	32
+void bench_BPTT(int numLayers, int *neuronsPerLayer)
+	{
+	char topology[256];
+	bench_topology(topology, numLayers, neuronsPerLayer);
+	double W = bench_weights(numLayers, neuronsPerLayer);
+	double neurons = 0.0;
+	for (int l = 0; l < numLayers; ++l)
+		neurons += neuronsPerLayer[l];
+
+	BPTT_ARG a;
+	a.net = create_BPTT_NN(numLayers, neuronsPerLayer);
+	a.dim = neuronsPerLayer[0];
+	a.V = (double *) malloc(MaxBatch * a.dim * sizeof (double));
+	a.errors = (double *) malloc(MaxBatch * neuronsPerLayer[numLayers - 1] * sizeof (double));
+	for (int i = 0; i < MaxBatch * a.dim; ++i)
+		a.V[i] = rand() / (double) RAND_MAX;
+	for (int i = 0; i < MaxBatch * neuronsPerLayer[numLayers - 1]; ++i)
+		a.errors[i] = 1e-6 * (rand() / (double) RAND_MAX - 0.5);
+
+	// per fold:  forward 2 W FLOPs, weights read once;  backward ∇ 2 W, update 2 W
+	int folds[3] = {Nfold, LongFold, LongFold};
+	for (int f = 0; f < 3; ++f)
+		{
+		int T = a.nfold = folds[f];
+		char forward[64], train[64], suffix[16] = "";
+		if (T != Nfold)
+			sprintf(suffix, f == 2 ? "_T%d_ckpt" : "_T%d", T);
+		sprintf(forward, "forward_BPTT%s", suffix);
+		sprintf(train, "forward_BPTT+backprop_through_time%s", suffix);
+
+		// a fresh network, so that the peak bytes are those of this unfolding
+		free_BPTT_NN(a.net);
+		a.net = create_BPTT_NN(numLayers, neuronsPerLayer);
+		BPTT_checkpoint(a.net, f == 2 ? BPTT_SqrtT : 0);
+		double fwdFlops = T * 2.0 * W;
+		double fwdBytes = T * (W + 2.0 * neurons) * sizeof (real);
+		bench(forward, topology, 1, fwdFlops, fwdBytes, run_forward, &a);
+		bench(train, topology, 1, fwdFlops + T * 4.0 * W,
+				fwdBytes + T * (3.0 * W + 2.0 * neurons) * sizeof (real), run_train, &a);
+		fprintf(stderr, "%s %s:  peak %zu bytes held for the unfolding\n", train, topology,
+				BPTT_peak_bytes(a.net));
+		}
+
+	// batched:  weights are read once per time step of B sequences
+	free_BPTT_NN(a.net);
+	a.net = create_BPTT_NN(numLayers, neuronsPerLayer);
+	a.nfold = Nfold;
+	a.batch = create_BPTT_batch(a.net, MaxBatch, Nfold);
+	int batchSizes[] = {8, MaxBatch};
+	for (int b = 0; b < 2; ++b)
+		{
+		a.B = batchSizes[b];
+		double fwdFlops = Nfold * 2.0 * W;
+		bench("forward_BPTT_batch", topology, a.B, fwdFlops,
+				Nfold * (W / a.B + 2.0 * neurons) * sizeof (real), run_forward_batch, &a);
+		bench("forward_BPTT_batch+backprop_BPTT_batch", topology, a.B, fwdFlops + Nfold * 4.0 * W,
+				Nfold * (4.0 * W / a.B + 4.0 * neurons) * sizeof (real), run_train_batch, &a);
+		}
+	free_BPTT_batch(a.batch);
+
+	free(a.V);
+	free(a.errors);
+	free_BPTT_NN(a.net);
+	}
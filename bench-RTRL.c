@@ -0,0 +1,112 @@
+// Benchmarks of forward_RTRL() and RTRL(), see benchmark.c
+// (separate from bench-BPTT.c because RNN.h and BPTT-RNN.h both define RNN)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "RNN.h"
+#include "benchmark.h"
+
+extern RNN *create_RTRL_NN(int, int *);
+extern void free_RTRL_NN(RNN *);
+extern void forward_RTRL(RNN *, int, double *);
+extern void RTRL(RNN *, double *);
+extern void RTRL_approximate(RNN *, int);
+
+typedef struct RTRL_ARG
+	{
+	RNN *net;
+	int dim;
+	double *V, *errors;
+	} RTRL_ARG;
+
+static void run_forward(void *arg)
+	{
+	RTRL_ARG *a = (RTRL_ARG *) arg;
+	forward_RTRL(a->net, a->dim, a->V);
+	}
+
+static void run_train(void *arg)
+	{
+	RTRL_ARG *a = (RTRL_ARG *) arg;
+	forward_RTRL(a->net, a->dim, a->V);
+	RTRL(a->net, a->errors);
+	}
+
+// FLOPs and # of sensitivities kept of one step with the net's RTRL_approximate():
+// forward 2 W, one back-prop per output, J, p(t) = ∂Y/∂W + J p(t - 1);  update 2 per p
+static double sensitivity_flops(RNN *net, double *kept, double *update)
+	{
+	int L = net->numLayers, m = net->layers[L - 1].numNeurons, R = net->numRecurrent;
+	double flops = 0.0;
+	*kept = *update = 0.0;
+	if (net->approximation == 0)
+		return 0.0;
+	for (int l = 1; l < L - 1; ++l)
+		flops += 2.0 * m * net->layers[l + 1].numNeurons * net->layers[l].numNeurons;
+	flops += 2.0 * m * R * net->layers[1].numNeurons;
+	for (int l = 1; l < L; ++l)
+		{
+		double W = (double) net->layers[l].numNeurons * (net->layers[l - 1].numNeurons + 1);
+		if (net->layers[l].keep == Keep_All)
+			{
+			flops += (2.0 * R + 1.0) * m * W;
+			*kept += m * W;
+			*update += 2.0 * m * W;
+			}
+		else
+			{
+			if (net->layers[l].keep == Keep_Own)
+				{
+				flops += 3.0 * W;
+				*kept += W;
+				}
+			*update += 2.0 * W;
+			}
+		}
+	return flops;
+	}
+
+// One time step:  forward_RTRL() does not feed the outputs back itself.  Exact RTRL, then
+// the SnAp-2, SnAp-1 approximations, and back-prop of each step alone ("..._SnAp0").
+void bench_RTRL(int numLayers, int *neuronsPerLayer)
+	{
+	char topology[256];
+	bench_topology(topology, numLayers, neuronsPerLayer);
+	double W = bench_weights(numLayers, neuronsPerLayer);
+	double neurons = 0.0;
+	for (int l = 0; l < numLayers; ++l)
+		neurons += neuronsPerLayer[l];
+
+	RTRL_ARG a;
+	a.net = create_RTRL_NN(numLayers, neuronsPerLayer);
+	a.dim = neuronsPerLayer[0];
+	a.V = (double *) malloc(a.dim * sizeof (double));
+	a.errors = (double *) malloc(neuronsPerLayer[numLayers - 1] * sizeof (double));
+	for (int i = 0; i < a.dim; ++i)
+		a.V[i] = rand() / (double) RAND_MAX;
+	for (int i = 0; i < neuronsPerLayer[numLayers - 1]; ++i)
+		a.errors[i] = 1e-6 * (rand() / (double) RAND_MAX - 0.5);
+
+	int approximations[] = {RTRL_Exact, 2, 1, 0};
+	const char *suffix[] = {"", "_SnAp2", "_SnAp1", "_SnAp0"};
+	for (int i = 0; i < 4; ++i)
+		{
+		RTRL_approximate(a.net, approximations[i]);
+		double kept, update;
+		double fwdFlops = 2.0 * W + sensitivity_flops(a.net, &kept, &update);
+		// weights read once, the sensitivities read and written
+		double fwdBytes = (W + neurons + 2.0 * kept) * sizeof (real);
+		char name[2][64];
+		sprintf(name[0], "forward_RTRL%s", suffix[i]);
+		sprintf(name[1], "forward_RTRL+RTRL%s", suffix[i]);
+		bench(name[0], topology, 1, fwdFlops, fwdBytes, run_forward, &a);
+		// SnAp0:  backward ∇ 2 W, update 2 W;  else the update, reading p and W once
+		bench(name[1], topology, 1, fwdFlops + (kept > 0 ? update : 4.0 * W),
+				fwdBytes + (kept > 0 ? 2.0 * W + kept : 3.0 * W + 2.0 * neurons) * sizeof (real),
+				run_train, &a);
+		}
+
+	free(a.V);
+	free(a.errors);
+	free_RTRL_NN(a.net);
+	}
@@ -0,0 +1,59 @@
+// Benchmarks of forward_prop_quadratic() and back_prop_quadratic(), see benchmark.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "QNET.h"
+#include "benchmark.h"
+
+extern QNET *create_QNN(int);
+extern void free_QNN(QNET *);
+extern void forward_prop_quadratic(QNET *, double *);
+extern void back_prop_quadratic(QNET *, double *);
+
+typedef struct QUADRATIC_ARG
+	{
+	QNET *net;
+	double V[dim_V], errors[dim_V];
+	} QUADRATIC_ARG;
+
+static void run_forward(void *arg)
+	{
+	QUADRATIC_ARG *a = (QUADRATIC_ARG *) arg;
+	forward_prop_quadratic(a->net, a->V);
+	}
+
+static void run_train(void *arg)
+	{
+	QUADRATIC_ARG *a = (QUADRATIC_ARG *) arg;
+	forward_prop_quadratic(a->net, a->V);
+	back_prop_quadratic(a->net, a->errors);
+	}
+
+// All layers have width dim_V and 4 shared weights;  each output is a quadratic form
+// over the dim_V² pairs of inputs (3 FLOPs per pair)
+void bench_quadratic(int numLayers)
+	{
+	int neuronsPerLayer[numLayers];
+	for (int l = 0; l < numLayers; ++l)
+		neuronsPerLayer[l] = dim_V;
+	char topology[256];
+	bench_topology(topology, numLayers, neuronsPerLayer);
+
+	QUADRATIC_ARG a;
+	a.net = create_QNN(numLayers);
+	for (int i = 0; i < dim_V; ++i)
+		{
+		a.V[i] = rand() / (double) RAND_MAX;
+		a.errors[i] = 1e-6 * (rand() / (double) RAND_MAX - 0.5);
+		}
+
+	double flops = (numLayers - 1) * 3.0 * dim_V * dim_V * dim_V;
+	double bytes = numLayers * dim_V * sizeof (NEURON) + (numLayers - 1) * 4 * sizeof (double);
+	bench("forward_prop_quadratic", topology, 1, flops, bytes, run_forward, &a);
+	// back_prop_quadratic() computes ∇ of the hidden layers (2 FLOPs per pair);  its weight
+	// update is not written back to the 4 shared weights yet, so it is not counted
+	bench("forward_prop_quadratic+back_prop_quadratic", topology, 1,
+			flops + (numLayers - 2) * 2.0 * dim_V * dim_V * dim_V,
+			bytes + numLayers * dim_V * sizeof (NEURON), run_train, &a);
+	free_QNN(a.net);
+	}
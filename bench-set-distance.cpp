@@ -0,0 +1,42 @@
+// Benchmark of set_distance(), see benchmark.c
+// set-distance.cpp is a stand-alone test program, so it is compiled here without its main()
+
+#define main	set_distance_main
+#include "set-distance.cpp"
+#undef main
+
+#include "benchmark.h"
+
+struct SET_DISTANCE_ARG
+	{
+	double *x, *y;
+	double sum;						// keeps the calls from being optimized away
+	};
+
+static void run_set_distance(void *arg)
+	{
+	SET_DISTANCE_ARG *a = (SET_DISTANCE_ARG *) arg;
+	a->sum += set_distance(a->x, a->y);
+	}
+
+// 3 double loops over N² pairs, each a subtraction, a square and a sum (3 FLOPs)
+extern "C" void bench_set_distance(int n)
+	{
+	char topology[32];
+	snprintf(topology, sizeof topology, "N=%d", n);
+	N = n;
+
+	SET_DISTANCE_ARG a;
+	a.x = new double[n];
+	a.y = new double[n];
+	for (int i = 0; i < n; ++i)
+		{
+		a.x[i] = random01();
+		a.y[i] = random01();
+		}
+	a.sum = 0.0;
+	bench("set_distance", topology, 1, 9.0 * n * n, 2.0 * n * sizeof (double),
+			run_set_distance, &a);
+	delete[] a.x;
+	delete[] a.y;
+	}
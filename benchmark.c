@@ -0,0 +1,325 @@
+// Micro-benchmarks of the network kernels
+// usage:	benchmark [-t seconds] [-k kernels] [-p]
+//			-t	minimum time of each measurement (default 0.2 s)
+//			-k	force a kernel set, as NN_select_kernels() (default:  the best supported)
+//			-p	add hardware counters (perf-counters.h), per sample over all the runs:
+//				cycles, ipc, cache_misses, l1d_misses, branch_misses, fp_vector
+// Output (stdout) is CSV with a header line:
+//		kernel, topology, batch, ns_per_sample, gflops, bytes_per_sample, gbytes_per_s,
+//		kernels, real [, counters]
+// Each time is the best of BenchRepeats runs of at least (seconds / BenchRepeats).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>				// clock_gettime()
+#include <unistd.h>				// getopt(), sysconf()
+#include "feedforward-NN.h"
+#include "SIMD-kernels.h"
+#include "benchmark.h"
+#include "perf-counters.h"
+
+extern NNET *create_NN(int, int *);
+extern void free_NN(NNET *);
+extern void forward_prop_sigmoid(NNET *, int, double *);
+extern void forward_prop_ReLU(NNET *, int, double *);
+extern void forward_prop_softplus(NNET *, int, double *);
+extern void forward_prop_x2(NNET *, int, double *);
+extern void back_prop(NNET *, double *);
+extern BATCH *create_batch(NNET *, int);
+extern void free_batch(BATCH *);
+extern void forward_batch(NNET *, BATCH *, int, double *, ACTIVATION);
+extern void backward_batch(NNET *, BATCH *, int, double *);
+extern void apply_update(NNET *, BATCH *, double);
+extern TRAINER *create_trainer(NNET *, int, int, ACTIVATION, double);
+extern void free_trainer(TRAINER *);
+extern double train_batch(TRAINER *, int, double *, double *);
+extern PLAN *freeze(const NNET *, ACTIVATION);
+extern void free_plan(PLAN *);
+extern void evaluate(const PLAN *, const double *, double *);
+
+#define BenchRepeats	5
+
+static double benchTime = 0.2;		// seconds per measurement
+static bool counters = false;		// -p
+
+static double now()
+	{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+	}
+
+void bench(const char *kernel, const char *topology, int batch, double flops, double bytes,
+		BENCH_FN fn, void *arg)
+	{
+	fn(arg);							// warm up caches
+
+	// calibrate the # of calls per run
+	long calls = 1;
+	double runTime = benchTime / BenchRepeats, t;
+	while (true)
+		{
+		double t0 = now();
+		for (long c = 0; c < calls; ++c)
+			fn(arg);
+		t = now() - t0;
+		if (t >= runTime)
+			break;
+		calls *= t > 0.0 && runTime / t < 100.0 ? 2 : 10;
+		}
+
+	PERF_SNAPSHOT begin, end;
+	PERF_COUNTS c = {{0.0}, 0};
+	bool counted = counters && perf_snapshot(&begin);
+
+	double best = t;
+	for (int r = 1; r < BenchRepeats; ++r)
+		{
+		double t0 = now();
+		for (long c = 0; c < calls; ++c)
+			fn(arg);
+		t = now() - t0;
+		if (t < best)
+			best = t;
+		}
+
+	if (counted && perf_snapshot(&end))
+		perf_accumulate(&c, &begin, &end);
+
+	double ns = best * 1e9 / ((double) calls * batch);
+	printf("%s,%s,%d,%.2f,%.3f,%.0f,%.3f,%s,%s", kernel, topology, batch, ns,
+			flops / ns, bytes, bytes / ns, NNk.name, sizeof (real) == 4 ? "float" : "double");
+	if (counters)
+		perf_csv(stdout, &c, (BenchRepeats - 1.0) * calls * batch);
+	printf("\n");
+	fflush(stdout);
+	}
+
+char *bench_topology(char *s, int numLayers, const int *neuronsPerLayer)
+	{
+	char *p = s;
+	for (int l = 0; l < numLayers; ++l)
+		p += sprintf(p, l == 0 ? "%d" : "-%d", neuronsPerLayer[l]);
+	return s;
+	}
+
+double bench_weights(int numLayers, const int *neuronsPerLayer)
+	{
+	double w = 0.0;
+	for (int l = 1; l < numLayers; ++l)
+		w += neuronsPerLayer[l] * (neuronsPerLayer[l - 1] + 1.0);
+	return w;
+	}
+
+//************************** feed-forward networks *********************************//
+
+typedef struct FF_ARG
+	{
+	NNET *net;
+	int dimIn, dimOut;
+	double *X, *errors, *out;		// inputs and errors for up to MaxBatch samples
+	double *Y;						// desired outputs for up to MaxBatch samples
+	BATCH *batch;
+	TRAINER *trainer;
+	int B;
+	PLAN *plan;
+	void (*forward)(NNET *, int, double *);
+	ACTIVATION act;
+	} FF_ARG;
+
+static void run_forward_prop(void *arg)
+	{
+	FF_ARG *a = (FF_ARG *) arg;
+	a->forward(a->net, a->dimIn, a->X);
+	}
+
+// forward_prop_sigmoid() then back_prop(), since back_prop() needs the forward pass
+static void run_back_prop(void *arg)
+	{
+	FF_ARG *a = (FF_ARG *) arg;
+	forward_prop_sigmoid(a->net, a->dimIn, a->X);
+	back_prop(a->net, a->errors);
+	}
+
+static void run_evaluate(void *arg)
+	{
+	FF_ARG *a = (FF_ARG *) arg;
+	evaluate(a->plan, a->X, a->out);
+	}
+
+static void run_forward_batch(void *arg)
+	{
+	FF_ARG *a = (FF_ARG *) arg;
+	forward_batch(a->net, a->batch, a->B, a->X, a->act);
+	}
+
+static void run_train_batch(void *arg)
+	{
+	FF_ARG *a = (FF_ARG *) arg;
+	forward_batch(a->net, a->batch, a->B, a->X, a->act);
+	backward_batch(a->net, a->batch, a->B, a->errors);
+	apply_update(a->net, a->batch, 0.0);		// η = 0 keeps the weights fixed
+	}
+
+static void run_trainer(void *arg)
+	{
+	FF_ARG *a = (FF_ARG *) arg;
+	train_batch(a->trainer, a->B, a->X, a->Y);
+	}
+
+#define MaxBatch	128
+
+static void bench_feedforward(int numLayers, int *neuronsPerLayer)
+	{
+	char topology[256];
+	bench_topology(topology, numLayers, neuronsPerLayer);
+	double W = bench_weights(numLayers, neuronsPerLayer);
+	int dimIn = neuronsPerLayer[0], dimOut = neuronsPerLayer[numLayers - 1];
+	double neurons = 0.0;
+	for (int l = 0; l < numLayers; ++l)
+		neurons += neuronsPerLayer[l];
+
+	FF_ARG a;
+	a.net = create_NN(numLayers, neuronsPerLayer);
+	a.dimIn = dimIn;
+	a.dimOut = dimOut;
+	a.X = (double *) malloc(MaxBatch * dimIn * sizeof (double));
+	a.errors = (double *) malloc(MaxBatch * dimOut * sizeof (double));
+	a.out = (double *) malloc(dimOut * sizeof (double));
+	a.Y = (double *) malloc(MaxBatch * dimOut * sizeof (double));
+	for (int i = 0; i < MaxBatch * dimIn; ++i)
+		a.X[i] = rand() / (double) RAND_MAX;
+	for (int i = 0; i < MaxBatch * dimOut; ++i)
+		a.Y[i] = rand() / (double) RAND_MAX;
+	for (int i = 0; i < MaxBatch * dimOut; ++i)
+		a.errors[i] = 1e-6 * (rand() / (double) RAND_MAX - 0.5);	// keep weights stable
+
+	// forward pass:  2 W FLOPs, each weight read once, each neuron's output written
+	double fwdFlops = 2.0 * W;
+	double fwdBytes = W * sizeof (real) + neurons * sizeof (real);
+
+	struct { const char *name; void (*f)(NNET *, int, double *); } fwd[] =
+		{
+		{"forward_prop_sigmoid", forward_prop_sigmoid},
+		{"forward_prop_ReLU", forward_prop_ReLU},
+		{"forward_prop_softplus", forward_prop_softplus},
+		{"forward_prop_x2", forward_prop_x2},
+		};
+	for (int k = 0; k < 4; ++k)
+		{
+		a.forward = fwd[k].f;
+		bench(fwd[k].name, topology, 1, fwdFlops, fwdBytes, run_forward_prop, &a);
+		}
+
+	// back_prop:  ∇ of hidden layers (2 W) and weight update (2 W), weights read twice
+	// and written once.  Timed together with forward_prop_sigmoid.
+	bench("forward_prop_sigmoid+back_prop", topology, 1, fwdFlops + 4.0 * W,
+			fwdBytes + 3.0 * W * sizeof (real) + neurons * sizeof (real), run_back_prop, &a);
+
+	a.plan = freeze(a.net, Act_sigmoid);
+	bench("evaluate", topology, 1, fwdFlops, fwdBytes, run_evaluate, &a);
+	free_plan(a.plan);
+
+	// batched:  weights are read once per batch of B samples
+	a.batch = create_batch(a.net, MaxBatch);
+	a.act = Act_sigmoid;
+	int batchSizes[] = {8, 32, MaxBatch};
+	for (int b = 0; b < 3; ++b)
+		{
+		a.B = batchSizes[b];
+		bench("forward_batch", topology, a.B, fwdFlops,
+				W * sizeof (real) / a.B + neurons * sizeof (real), run_forward_batch, &a);
+		// + ∇ (2 W) and dW accumulation (2 W) per sample;  per batch W is read twice
+		// and written once, dW read and written twice (accumulation, update and clear)
+		bench("forward_batch+backward_batch+apply_update", topology, a.B, fwdFlops + 4.0 * W,
+				7.0 * W * sizeof (real) / a.B + 2.0 * neurons * sizeof (real),
+				run_train_batch, &a);
+		}
+	free_batch(a.batch);
+
+	// data-parallel train_batch() (parallel-trainer.c) on 1, 2, 4 ... all cores:  the
+	// computation of forward_batch+backward_batch+apply_update, split into T shards.  Per
+	// batch each worker reads W twice and reads and writes its dW, and the all-reduce
+	// reads and clears the T dW's and reads and writes W once.
+	int cores = sysconf(_SC_NPROCESSORS_ONLN);
+	a.B = MaxBatch;
+	for (int T = 1; T <= cores; T = T < cores && 2 * T > cores ? cores : 2 * T)
+		{
+		char kernel[64];
+		sprintf(kernel, "train_batch/%d_threads", T);
+		a.trainer = create_trainer(a.net, T, MaxBatch, Act_sigmoid, 0.0);	// η = 0
+		bench(kernel, topology, a.B, fwdFlops + 4.0 * W,
+				(2.0 + 6.0 * T) * W * sizeof (real) / a.B + 2.0 * neurons * sizeof (real),
+				run_trainer, &a);
+		free_trainer(a.trainer);
+		}
+
+	free(a.X);
+	free(a.errors);
+	free(a.out);
+	free(a.Y);
+	free_NN(a.net);
+	}
+
+int main(int argc, char **argv)
+	{
+	int opt;
+	while ((opt = getopt(argc, argv, "t:k:p")) != -1)
+		switch (opt)
+			{
+			case 't':
+				benchTime = atof(optarg);
+				break;
+			case 'k':
+				if (!NN_select_kernels(optarg))
+					{
+					fprintf(stderr, "Kernel set %s is not supported\n", optarg);
+					return 1;
+					}
+				break;
+			case 'p':
+				counters = true;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-t seconds] [-k kernels] [-p]\n", argv[0]);
+				return 1;
+			}
+	srand(1);
+
+	if (counters && !perf_open())
+		fprintf(stderr, "No hardware counters, their columns are blank\n");
+	printf("kernel,topology,batch,ns_per_sample,gflops,bytes_per_sample,gbytes_per_s,"
+			"kernels,real%s\n", counters ?
+			",cycles,ipc,cache_misses,l1d_misses,branch_misses,fp_vector" : "");
+
+	// feed-forward:  the networks of the tests (arithmetic, Q, V), and two larger ones
+	int ff0[] = {8, 13, 10, 6}, ff1[] = {18, 10, 7, 1}, ff2[] = {9, 40, 30, 20, 1},
+		ff3[] = {64, 256, 256, 10}, ff4[] = {256, 1024, 1024, 10};
+	bench_feedforward(4, ff0);
+	bench_feedforward(4, ff1);
+	bench_feedforward(5, ff2);
+	bench_feedforward(4, ff3);
+	bench_feedforward(4, ff4);
+
+	// recurrent:  outputs are fed back to the inputs, so both have the same width
+	int rnn0[] = {4, 10, 10, 4}, rnn1[] = {10, 40, 40, 10}, rnn2[] = {32, 128, 128, 32};
+	int *rnn[] = {rnn0, rnn1, rnn2};
+	for (int r = 0; r < 3; ++r)
+		{
+		bench_BPTT(4, rnn[r]);
+		bench_RTRL(4, rnn[r]);
+		}
+	// RTRL online learning as RNN_sine_test(), on wider nets
+	int sine[] = {2, 128, 128, 1};
+	bench_RTRL(4, sine);
+
+	for (int L = 3; L <= 10; L += 7)
+		bench_quadratic(L);
+
+	for (int n = 3; n <= 300; n *= 10)
+		bench_set_distance(n);
+	return 0;
+	}
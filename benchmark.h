@@ -0,0 +1,32 @@
+//************************** kernel micro-benchmarks **********************************//
+// The "benchmark" program (makefile) times the network kernels over a grid of topologies
+// and batch sizes, and prints one CSV line per measurement (see benchmark.c).
+// FLOPs and bytes are per sample, from a model of each kernel:  a multiply-add counts
+// as 2 FLOPs, activation functions as 0, and bytes are the weights and activations the
+// kernel must at least read or write (each weight once per call).
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Processes "batch" samples per call (the batch given to bench())
+typedef void (*BENCH_FN)(void *arg);
+
+// Time fn(arg) and print a CSV line
+void bench(const char *kernel, const char *topology, int batch, double flops, double bytes,
+		BENCH_FN fn, void *arg);
+
+// "8-13-10-6" for a topology, in a buffer of at least 256 chars
+char *bench_topology(char *s, int numLayers, const int *neuronsPerLayer);
+
+// Σ_l n_l (n_{l-1} + 1):  # of weights including biases (without row padding)
+double bench_weights(int numLayers, const int *neuronsPerLayer);
+
+void bench_BPTT(int numLayers, int *neuronsPerLayer);			// bench-BPTT.c
+void bench_RTRL(int numLayers, int *neuronsPerLayer);			// bench-RTRL.c
+void bench_quadratic(int numLayers);							// bench-quadratic.c
+void bench_set_distance(int n);								// bench-set-distance.cpp
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,7 +5,7 @@
 #include "feedforward-NN.h"
 
 extern NNET *create_NN(int, int *);
-extern void free_NN(NNET *, int *);
+extern void free_NN(NNET *);
 extern void forward_prop_sigmoid(NNET *, int, double *);
 extern void forward_prop_ReLU(NNET *, int, double *);
 extern void forward_prop_softplus(NNET *, int, double *);
@@ -269,7 +269,7 @@ void symmetric_test()
 		pause_graphics();
 	else
 		quit_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
 // Test forward propagation
@@ -330,5 +330,5 @@ void forward_test2()
 		}
 
 	pause_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
@@ -0,0 +1,294 @@
+// Background checkpointing of a training run
+// checkpoint() is called from the training loop:  it copies the weights and the training
+// state (iteration counter and the cyclic error windows errors1 / errors2) into a spare
+// snapshot and returns.  A writer thread saves the snapshot while training continues.
+// The training thread never waits:  if the writer happens to hold the lock (only while
+// it swaps snapshots), or a write is still in progress, the newest snapshot simply
+// replaces the one not yet written.  Only final_checkpoint(), at the end of a run, waits
+// for the lock, so that the last state is always saved.
+//
+// Files are "<name>.0.ckpt" (latest) ... "<name>.<keep-1>.ckpt" (oldest).  Each one is a
+// binary network file (NN-file.h), so load_NN() and map_NN() read it directly, followed
+// by a CKPT_TRAILER and the two error windows.  A checkpoint is written to a temporary
+// file and renamed into place, and the directory is synced after the renames, so a crash
+// never leaves a partial latest checkpoint.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>				// fsync()
+#include <fcntl.h>				// open()
+#include <pthread.h>
+#include <sys/resource.h>		// setpriority()
+#include "feedforward-NN.h"
+#include "NN-file.h"
+#include "NN-trace.h"
+
+extern bool write_NN(FILE *, const NNET *, const real *, ACTIVATION);
+extern NNET *load_NN(const char *, ACTIVATION *);
+extern void free_NN(NNET *);
+
+#define WriterNice	19					// nice value of the writer thread
+
+#define CkptMagic	"NNckpt1"			// 8 bytes with the '\0'
+
+typedef struct CKPT_TRAILER
+	{
+	char magic[8];
+	int64_t iteration;
+	int32_t M;						// length of each error window
+	int32_t tail;					// next index of the cyclic windows
+	} CKPT_TRAILER;					// followed by double errors1[M], errors2[M]
+
+typedef struct SNAPSHOT
+	{
+	real *params;					// copy of net->params
+	long iteration;
+	int tail;
+	double *errors1, *errors2;
+	} SNAPSHOT;
+
+struct CHECKPOINTER
+	{
+	const NNET *net;				// only the topology is read by the writer
+	ACTIVATION act;
+	char *name;
+	int keep;						// # of checkpoints kept on disk
+	int M;
+
+	SNAPSHOT snap[2];
+	SNAPSHOT *next;					// filled by checkpoint(), under the lock
+	SNAPSHOT *writing;				// owned by the writer thread
+	bool pending;					// "next" holds a snapshot not yet written
+	bool quit;
+	int written;					// # of checkpoints written
+
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	};
+
+static void checkpoint_name(const CHECKPOINTER *c, int k, char *fileName, size_t size)
+	{
+	if (k < 0)
+		snprintf(fileName, size, "%s.tmp.ckpt", c->name);
+	else
+		snprintf(fileName, size, "%s.%d.ckpt", c->name, k);
+	}
+
+// fsync() the directory of the checkpoints, so that the renames are on disk too
+static bool sync_directory(const CHECKPOINTER *c)
+	{
+	char dir[1100];
+	snprintf(dir, sizeof dir, "%s", c->name);
+	char *slash = strrchr(dir, '/');
+	if (slash == NULL)
+		strcpy(dir, ".");
+	else if (slash == dir)
+		dir[1] = '\0';
+	else
+		*slash = '\0';
+	int fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return false;
+	bool ok = fsync(fd) == 0;
+	close(fd);
+	return ok;
+	}
+
+static bool write_checkpoint(CHECKPOINTER *c, const SNAPSHOT *s)
+	{
+	char tmp[1100], from[1100], to[1100];
+	checkpoint_name(c, -1, tmp, sizeof tmp);
+	FILE *fp = fopen(tmp, "wb");
+	if (fp == NULL)
+		return false;
+
+	CKPT_TRAILER t;
+	memset(&t, 0, sizeof t);
+	memcpy(t.magic, CkptMagic, sizeof t.magic);
+	t.iteration = s->iteration;
+	t.M = c->M;
+	t.tail = s->tail;
+	bool ok = write_NN(fp, c->net, s->params, c->act);
+	fwrite(&t, sizeof t, 1, fp);
+	fwrite(s->errors1, sizeof (double), c->M, fp);
+	fwrite(s->errors2, sizeof (double), c->M, fp);
+	ok = ok && !ferror(fp) && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+	if (fclose(fp) != 0 || !ok)
+		{
+		remove(tmp);
+		return false;
+		}
+
+	// rotate:  .0 -> .1 -> ... -> .keep-1 (the oldest is overwritten)
+	for (int k = c->keep - 1; k > 0; --k)
+		{
+		checkpoint_name(c, k - 1, from, sizeof from);
+		checkpoint_name(c, k, to, sizeof to);
+		rename(from, to);
+		}
+	checkpoint_name(c, 0, to, sizeof to);
+	return rename(tmp, to) == 0 && sync_directory(c);
+	}
+
+static void *writer_loop(void *arg)
+	{
+	CHECKPOINTER *c = (CHECKPOINTER *) arg;
+	// Lower the priority of this thread only (Linux), so that writing never preempts
+	// training when all cores are busy
+	setpriority(PRIO_PROCESS, 0, WriterNice);
+	trace_thread_name("checkpoint writer");
+	pthread_mutex_lock(&c->lock);
+	while (true)
+		{
+		while (!c->pending && !c->quit)
+			pthread_cond_wait(&c->wake, &c->lock);
+		if (!c->pending)
+			break;						// quit, and everything is written
+		SNAPSHOT *s = c->next;
+		c->next = c->writing;
+		c->writing = s;
+		c->pending = false;
+		pthread_mutex_unlock(&c->lock);
+
+		TRACE_BEGIN(t);
+		if (write_checkpoint(c, s))
+			++c->written;
+		else
+			fprintf(stderr, "Cannot write checkpoint %s\n", c->name);
+		TRACE_END(Trace_checkpoint, t);
+
+		pthread_mutex_lock(&c->lock);
+		}
+	pthread_mutex_unlock(&c->lock);
+	return NULL;
+	}
+
+// Start the writer thread for checkpoints of "net" named "<name>.<k>.ckpt", keeping the
+// latest "keep" of them;  M = length of the error windows passed to checkpoint()
+CHECKPOINTER *start_checkpoints(const NNET *net, ACTIVATION act, const char *name, int keep, int M)
+	{
+	CHECKPOINTER *c = (CHECKPOINTER *) malloc(sizeof (CHECKPOINTER));
+	c->net = net;
+	c->act = act;
+	c->name = strdup(name);
+	c->keep = keep < 1 ? 1 : keep;
+	c->M = M;
+	for (int k = 0; k < 2; ++k)
+		{
+		c->snap[k].params = (real *) aligned_alloc(NN_Align, net->numParams * sizeof (real));
+		c->snap[k].errors1 = (double *) malloc(M * sizeof (double));
+		c->snap[k].errors2 = (double *) malloc(M * sizeof (double));
+		}
+	c->next = &c->snap[0];
+	c->writing = &c->snap[1];
+	c->pending = false;
+	c->quit = false;
+	c->written = 0;
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->wake, NULL);
+	pthread_create(&c->writer, NULL, writer_loop, c);
+	return c;
+	}
+
+// Take a snapshot (the caller holds the lock, which is released) and wake the writer
+static void snapshot(CHECKPOINTER *c, long iteration, const double errors1[], const double errors2[], int tail)
+	{
+	SNAPSHOT *s = c->next;
+	memcpy(s->params, c->net->params, c->net->numParams * sizeof (real));
+	memcpy(s->errors1, errors1, c->M * sizeof (double));
+	memcpy(s->errors2, errors2, c->M * sizeof (double));
+	s->iteration = iteration;
+	s->tail = tail;
+	c->pending = true;
+	pthread_cond_signal(&c->wake);
+	pthread_mutex_unlock(&c->lock);
+	}
+
+// Snapshot the weights and training state for the writer thread.  Returns false (and
+// takes no snapshot) only if the writer holds the lock at this moment.
+bool checkpoint(CHECKPOINTER *c, long iteration, const double errors1[], const double errors2[], int tail)
+	{
+	if (pthread_mutex_trylock(&c->lock) != 0)
+		return false;
+	snapshot(c, iteration, errors1, errors2, tail);
+	return true;
+	}
+
+// As checkpoint(), but waits for the lock:  for the last state of a run, before
+// stop_checkpoints() (which writes it)
+void final_checkpoint(CHECKPOINTER *c, long iteration, const double errors1[], const double errors2[], int tail)
+	{
+	pthread_mutex_lock(&c->lock);
+	snapshot(c, iteration, errors1, errors2, tail);
+	}
+
+// Write any pending snapshot, stop the writer thread and free the checkpointer.
+// Returns the # of checkpoints written.
+int stop_checkpoints(CHECKPOINTER *c)
+	{
+	pthread_mutex_lock(&c->lock);
+	c->quit = true;
+	pthread_cond_signal(&c->wake);
+	pthread_mutex_unlock(&c->lock);
+	pthread_join(c->writer, NULL);
+
+	int written = c->written;
+	pthread_mutex_destroy(&c->lock);
+	pthread_cond_destroy(&c->wake);
+	for (int k = 0; k < 2; ++k)
+		{
+		free(c->snap[k].params);
+		free(c->snap[k].errors1);
+		free(c->snap[k].errors2);
+		}
+	free(c->name);
+	free(c);
+	return written;
+	}
+
+// Read the training state stored after the weights of a checkpoint file
+static bool read_trailer(const char *fileName, long *iteration, int M,
+		double errors1[], double errors2[], int *tail)
+	{
+	FILE *fp = fopen(fileName, "rb");
+	if (fp == NULL)
+		return false;
+	NN_HEADER h;
+	CKPT_TRAILER t;
+	bool ok = fread(&h, sizeof h, 1, fp) == 1 &&
+			fseek(fp, h.headerBytes + h.payloadBytes, SEEK_SET) == 0 &&
+			fread(&t, sizeof t, 1, fp) == 1 &&
+			!memcmp(t.magic, CkptMagic, sizeof t.magic) && t.M == M &&
+			t.tail >= 0 && t.tail < M &&
+			fread(errors1, sizeof (double), M, fp) == (size_t) M &&
+			fread(errors2, sizeof (double), M, fp) == (size_t) M;
+	fclose(fp);
+	if (ok)
+		{
+		*iteration = t.iteration;
+		*tail = t.tail;
+		}
+	return ok;
+	}
+
+// Load the latest readable checkpoint "<name>.<k>.ckpt", k = 0 ... keep-1, and restore
+// the training state.  Returns NULL if there is none (with error windows of length M).
+NNET *resume_checkpoint(const char *name, int keep, ACTIVATION *act, long *iteration,
+		int M, double errors1[], double errors2[], int *tail)
+	{
+	char fileName[1100];
+	for (int k = 0; k < keep; ++k)
+		{
+		snprintf(fileName, sizeof fileName, "%s.%d.ckpt", name, k);
+		if (!read_trailer(fileName, iteration, M, errors1, errors2, tail))
+			continue;
+		NNET *net = load_NN(fileName, act);			// verifies the checksum
+		if (net != NULL)
+			return net;
+		}
+	return NULL;
+	}
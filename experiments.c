@@ -9,13 +9,16 @@
 extern void create_NN(NNET *, int, int *);
 extern void create_RNN(RNN *, int, int *);
 extern void free_RNN(RNN *, int *);
-extern void free_NN(NNET *, int *);
+extern RNN *create_RTRL_NN(int, int *);
+extern void free_RTRL_NN(RNN *);
+extern void free_NN(NNET *);
 extern void forward_prop(NNET *, int, double *);
 extern void forward_prop_ReLU(NNET *, int, double *);
 extern void forward_RNN(RNN *, int, double *);
 extern void back_prop(NNET *);
 extern void back_prop_ReLU(NNET *, double *);
 extern void RTRL(RNN *, double *);
+extern void reset_RTRL(RNN *);
 extern NNET *loadNet(int, int *);
 extern void pause_graphics();
 extern void quit_graphics();
@@ -55,10 +58,9 @@ extern double K[];
 void RTRL_equilibrium_test()
 	{
 	// create RNN
-	RNN *Net = (RNN *) malloc(sizeof (RNN));
 	int neuronsPerLayer[4] = {3, 4, 4, 3}; // first = input layer, last = output layer
 	int numLayers = sizeof(neuronsPerLayer) / sizeof(int);
-	create_RTRL_NN(Net, numLayers, neuronsPerLayer);
+	RNN *Net = create_RTRL_NN(numLayers, neuronsPerLayer);
 	rLAYER lastLayer = Net->layers[numLayers - 1];
 
 	int dimK = 3;
@@ -90,6 +92,7 @@ void RTRL_equilibrium_test()
 		{
 		for (int k = 0; k < dimK; ++k) // initialize K
 			K[k] = K_star[i % DataSize][0][k];
+		reset_RTRL(Net);		// K is not fed back from the last step
 
 		#define MaxIterations 100
 		for (int j = 0; j < MaxIterations; j++) // allow network to converge
@@ -143,5 +146,5 @@ void RTRL_equilibrium_test()
 
 	if (!quit)
 		pause_graphics();
-	free_RTRL_NN(Net, neuronsPerLayer);
+	free_RTRL_NN(Net);
 	}
@@ -1,24 +1,91 @@
+#include "NN-real.h"
+
 
 //**********************struct for NEURON**********************************//
 typedef struct NEURON
 	{
-    double output;
-    double *weights;
-    double grad;		// "local gradient"
+    real output;
+    real *weights;				// points into the layer's weight matrix W (row n)
+    real grad;			// "local gradient"
 	} NEURON;
 
 //**********************struct for LAYER***********************************//
+// Weights of a layer are stored as one row-major matrix W:  row n holds the weights
+// of neuron n, with the bias weight at column 0 and the weight from neuron i of the
+// previous layer at column i + 1.  Rows are padded to "stride" reals so that every
+// row starts on a cache-line boundary.
 typedef struct LAYER
 	{
     int numNeurons;
     NEURON *neurons;
+    int stride;					// row length of W (≥ numNeurons of previous layer + 1)
+    real *W;					// weight matrix, NULL for the input layer
 	} LAYER;
 
+// Accuracy of the sigmoid and softplus activations (see SIMD-kernels.c for error bounds):
+// libm exp / log, polynomial approximations, or table interpolation
+typedef enum { Acc_exact, Acc_fast, Acc_fastest } ACCURACY;
+
 //*********************struct for NNET************************************//
 typedef struct NNET
 	{
     int numLayers;
     LAYER *layers;
+    real *params;				// all weight matrices, one flat aligned buffer
+    int numParams;				// size of params (in reals, including padding)
+    ACCURACY accuracy;			// Acc_exact after create_NN()
 	} NNET; //neural network
 
+//*********************struct for BATCH***********************************//
+// Activations and gradients for a mini-batch of up to "size" samples, used by
+// forward_batch(), backward_batch() and apply_update().  Matrices are row-major with
+// one row per sample:  Y[l] and G[l] are size × numNeurons of layer l.
+typedef struct BATCH
+	{
+    int size;					// maximum number of samples B
+    int count;					// samples accumulated in dW since the last update
+    real **Y;					// Y[l] = outputs of layer l (Y[0] = inputs)
+    real **G;					// G[l] = local gradients ∇ of layer l
+    real *dW;					// accumulated Σ ∇ [1, input], same layout as net->params
+	} BATCH;
+
+//*********************struct for WORKSPACE*******************************//
+// Caller-owned activations for forward().  forward() only reads the NNET, so several
+// threads may evaluate the same network at once, each with its own WORKSPACE.
+typedef struct WORKSPACE
+	{
+    int numLayers;
+    int *width;					// # of neurons of each layer, to check the topology
+    real **Y;					// Y[l] = outputs of layer l (Y[0] = input)
+    real **G;					// G[l] = derivatives of layer l
+	} WORKSPACE;
+
+// Data-parallel mini-batch trainer (parallel-trainer.c), opaque
+typedef struct TRAINER TRAINER;
+
+// Frozen inference plan made by freeze() (back-prop.c), opaque
+typedef struct PLAN PLAN;
+
+// Background checkpoint writer (checkpoint.c), opaque
+typedef struct CHECKPOINTER CHECKPOINTER;
+
+// Thread-safe sample generator for train_hogwild():  fills input x and desired output y,
+// drawing random numbers only through *seed (eg with rand_r)
+typedef void (*SAMPLER)(unsigned int *seed, double *x, double *y);
+
+// Activation function selector for the batched path
+typedef enum { Act_sigmoid, Act_ReLU, Act_softplus, Act_x2 } ACTIVATION;
+
+#define LastAct		true		// If false, activation function DISABLED on output layer
+
+#define NN_Align	64			// alignment of params and of each row of W (bytes)
+#define NN_RowPad	(NN_Align / sizeof (real))
+
+// Weight from neuron i of layer l-1 to neuron n of layer l (i = 0 is the bias)
+#define WEIGHT(net, l, n, i)	((net)->layers[l].W[(n) * (net)->layers[l].stride + (i)])
+
+// Column view of W:  the weights from neuron i of layer l-1 to all neurons of layer l
+// are W_COL(net, l, i)[n * stride], used by the backward pass.
+#define W_COL(net, l, i)		((net)->layers[l].W + (i) + 1)
+
 #define dim_K	10
@@ -0,0 +1,509 @@
+// Int8 quantized inference for trained feed-forward networks
+// quantize_NN() turns an NNET into an NNET8:  the weights of each neuron (or of each layer)
+// are scaled symmetrically into int8, and the inputs of each layer are scaled into 7-bit
+// unsigned integers using ranges calibrated on a sample of inputs.  forward_int8() then
+// evaluates a batch of inputs with integer dot products.  All kernels compute the same
+// exact integer sums, so the outputs do not depend on which kernel is used.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>				// clock_gettime()
+#include <sys/stat.h>			// fstat()
+#include "feedforward-NN.h"
+#include "int8-NN.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NN_X86 1
+#endif
+
+extern double sigmoid(double), rectifier(double), softplus(double), x2(double);
+extern void forward_prop_sigmoid(NNET *, int, double *);
+extern void forward_prop_ReLU(NNET *, int, double *);
+extern void forward_prop_softplus(NNET *, int, double *);
+extern void forward_prop_x2(NNET *, int, double *);
+extern WORKSPACE *create_workspace(const NNET *);
+extern void free_workspace(WORKSPACE *);
+extern real *forward(const NNET *, WORKSPACE *, const double *, ACTIVATION);
+
+//******************************* integer kernels *******************************//
+// Σ a_i w_i for unsigned 7-bit a and signed 8-bit w;  n is a multiple of 64.
+
+static int32_t dot_u8s8_scalar(const uint8_t *a, const int8_t *w, int n)
+	{
+	int32_t sum = 0;
+	for (int i = 0; i < n; ++i)
+		sum += a[i] * w[i];
+	return sum;
+	}
+
+#ifdef NN_X86
+
+// pmaddubsw multiplies u8 × s8 and adds adjacent pairs into s16 (cannot saturate since
+// a ≤ Q8_Max), then pmaddwd with 1's widens the pairs into s32.
+__attribute__((target("avx2")))
+static int32_t dot_u8s8_avx2(const uint8_t *a, const int8_t *w, int n)
+	{
+	__m256i ones = _mm256_set1_epi16(1);
+	__m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+	for (int i = 0; i < n; i += 64)
+		{
+		__m256i p0 = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i *) (a + i)),
+				_mm256_loadu_si256((const __m256i *) (w + i)));
+		__m256i p1 = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i *) (a + i + 32)),
+				_mm256_loadu_si256((const __m256i *) (w + i + 32)));
+		s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(p0, ones));
+		s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(p1, ones));
+		}
+	s0 = _mm256_add_epi32(s0, s1);
+	__m128i h = _mm_add_epi32(_mm256_castsi256_si128(s0), _mm256_extracti128_si256(s0, 1));
+	h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(1, 0, 3, 2)));
+	h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(h);
+	}
+
+// vpdpbusd does the u8 × s8 products and the 4-way sums into s32 in one instruction
+__attribute__((target("avx512f,avx512vnni")))
+static int32_t dot_u8s8_vnni(const uint8_t *a, const int8_t *w, int n)
+	{
+	__m512i s = _mm512_setzero_si512();
+	for (int i = 0; i < n; i += 64)
+		s = _mm512_dpbusd_epi32(s, _mm512_loadu_si512(a + i), _mm512_loadu_si512(w + i));
+	return _mm512_reduce_add_epi32(s);
+	}
+
+#endif // NN_X86
+
+static int32_t (*dot_u8s8)(const uint8_t *, const int8_t *, int) = dot_u8s8_scalar;
+static const char *kernel8 = "scalar";
+
+// Runs before main():  NN_KERNELS=scalar forces the scalar kernel, as in SIMD-kernels.c
+__attribute__((constructor))
+static void init_int8_kernels(void)
+	{
+	char *forced = getenv("NN_KERNELS");
+	if (forced != NULL && !strcmp(forced, "scalar"))
+		return;
+	#ifdef NN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512f"))
+		{
+		dot_u8s8 = dot_u8s8_vnni;
+		kernel8 = "avx512-vnni";
+		}
+	else if (__builtin_cpu_supports("avx2"))
+		{
+		dot_u8s8 = dot_u8s8_avx2;
+		kernel8 = "avx2";
+		}
+	#endif
+	}
+
+//******************************** quantization *********************************//
+
+static double activate(ACTIVATION act, double v)
+	{
+	switch (act)
+		{
+		case Act_sigmoid:	return sigmoid(v);
+		case Act_ReLU:		return rectifier(v);
+		case Act_softplus:	return softplus(v);
+		case Act_x2:		return x2(v);
+		}
+	return v;
+	}
+
+static inline uint8_t quantize8(double x, float scale, int zero)
+	{
+	long a = lrint(x / scale) + zero;
+	return a < 0 ? 0 : (a > Q8_Max ? Q8_Max : a);
+	}
+
+#define Tile8	32				// samples per tile;  a tile's activations stay in L1
+
+// The layers, and the activation scratch q->A
+static LAYER8 *alloc_layers(NNET8 *q, int numLayers, int *neuronsPerLayer)
+	{
+	LAYER8 *layers = (LAYER8 *) calloc(numLayers, sizeof (LAYER8));
+	layers[0].numNeurons = neuronsPerLayer[0];
+	int maxStride = 64;
+	for (int l = 1; l < numLayers; ++l)
+		{
+		LAYER8 *layer = &layers[l];
+		int nn = neuronsPerLayer[l];
+		layer->numNeurons = nn;
+		layer->numInputs = neuronsPerLayer[l - 1];
+		layer->stride = (layer->numInputs + 63) / 64 * 64;
+		layer->W8 = (int8_t *) aligned_alloc(64, nn * layer->stride);
+		memset(layer->W8, 0, nn * layer->stride);
+		layer->scale = (float *) malloc(nn * sizeof (float));
+		layer->bias = (float *) malloc(nn * sizeof (float));
+		layer->rowSum = (int32_t *) malloc(nn * sizeof (int32_t));
+		if (layer->stride > maxStride)
+			maxStride = layer->stride;
+		}
+	// zero-filled so that the row padding (which meets 0 weights) is defined
+	q->A = (uint8_t *) aligned_alloc(64, 2 * Tile8 * maxStride);
+	memset(q->A, 0, 2 * Tile8 * maxStride);
+	return layers;
+	}
+
+void free_NN8(NNET8 *q)
+	{
+	for (int l = 1; l < q->numLayers; ++l)
+		{
+		free(q->layers[l].W8);
+		free(q->layers[l].scale);
+		free(q->layers[l].bias);
+		free(q->layers[l].rowSum);
+		}
+	free(q->layers);
+	free(q->A);
+	free(q);
+	}
+
+// Quantize "net" (which is evaluated with activation "act").  The input ranges of all
+// layers are calibrated by running the numSamples rows of X (numSamples × # of inputs)
+// through the network.  perChannel = one weight scale per neuron, else one per layer.
+NNET8 *quantize_NN(const NNET *net, ACTIVATION act, bool perChannel, int numSamples, const double *X)
+	{
+	int L = net->numLayers;
+	int neuronsPerLayer[L];
+	for (int l = 0; l < L; ++l)
+		neuronsPerLayer[l] = net->layers[l].numNeurons;
+
+	NNET8 *q = (NNET8 *) malloc(sizeof (NNET8));
+	q->numLayers = L;
+	q->act = act;
+	q->perChannel = perChannel;
+	q->layers = alloc_layers(q, L, neuronsPerLayer);
+
+	// calibrate:  range of the outputs of each layer, always including 0
+	double lo[L], hi[L];
+	for (int l = 0; l < L; ++l)
+		lo[l] = hi[l] = 0.0;
+	WORKSPACE *ws = create_workspace(net);
+	for (int s = 0; s < numSamples; ++s)
+		{
+		forward(net, ws, X + s * neuronsPerLayer[0], act);
+		for (int l = 0; l < L - 1; ++l)
+			for (int n = 0; n < neuronsPerLayer[l]; ++n)
+				{
+				lo[l] = fmin(lo[l], ws->Y[l][n]);
+				hi[l] = fmax(hi[l], ws->Y[l][n]);
+				}
+		}
+	free_workspace(ws);
+
+	for (int l = 1; l < L; ++l)
+		{
+		LAYER8 *layer = &q->layers[l];
+		int nn = layer->numNeurons, nx = layer->numInputs;
+
+		// inputs:  asymmetric, x ≈ inScale (a − inZero) with 0 ≤ a ≤ Q8_Max
+		double range = hi[l - 1] - lo[l - 1];
+		layer->inScale = range > 0.0 ? range / Q8_Max : 1.0;
+		layer->inZero = (int) lrint(-lo[l - 1] / layer->inScale);
+
+		// weights:  symmetric, w ≈ sw W8 with |W8| ≤ 127
+		double layerMax = 0.0;
+		for (int n = 0; n < nn; ++n)
+			for (int i = 1; i <= nx; ++i)
+				layerMax = fmax(layerMax, fabs(WEIGHT(net, l, n, i)));
+
+		for (int n = 0; n < nn; ++n)
+			{
+			double wMax = 0.0;
+			if (perChannel)
+				for (int i = 1; i <= nx; ++i)
+					wMax = fmax(wMax, fabs(WEIGHT(net, l, n, i)));
+			else
+				wMax = layerMax;
+			double sw = wMax > 0.0 ? wMax / 127.0 : 1.0;
+
+			int8_t *w8 = layer->W8 + n * layer->stride;
+			int32_t sum = 0;
+			for (int i = 0; i < nx; ++i)
+				{
+				long w = lrint(WEIGHT(net, l, n, i + 1) / sw);
+				w8[i] = w < -127 ? -127 : (w > 127 ? 127 : w);
+				sum += w8[i];
+				}
+			layer->rowSum[n] = sum;
+			layer->scale[n] = sw * layer->inScale;
+			layer->bias[n] = WEIGHT(net, l, n, 0);		// × BIASINPUT = 1
+			}
+		}
+	return q;
+	}
+
+//******************************** forward pass *********************************//
+
+// One tile of B ≤ Tile8 samples through all layers;  in, out = scratch of B × max stride
+static void forward_tile(const NNET8 *q, int B, const double *X, double *Y,
+		uint8_t *in, uint8_t *out)
+	{
+	int L = q->numLayers;
+
+	// quantize the inputs
+	const LAYER8 *first = &q->layers[1];
+	for (int b = 0; b < B; ++b)
+		for (int i = 0; i < first->numInputs; ++i)
+			in[b * first->stride + i] = quantize8(X[b * first->numInputs + i],
+					first->inScale, first->inZero);
+
+	for (int l = 1; l < L; ++l)
+		{
+		const LAYER8 *layer = &q->layers[l];
+		const LAYER8 *next = (l < L - 1) ? &q->layers[l + 1] : NULL;
+		int nn = layer->numNeurons;
+		// the output layer as in forward():  linear if !LastAct
+		bool linear = next == NULL && !LastAct;
+
+		// each row of W8 is re-used for all B samples of the tile
+		for (int n = 0; n < nn; ++n)
+			{
+			const int8_t *w8 = layer->W8 + n * layer->stride;
+			int32_t zeroSum = layer->inZero * layer->rowSum[n];
+			for (int b = 0; b < B; ++b)
+				{
+				int32_t acc = dot_u8s8(in + b * layer->stride, w8, layer->stride);
+				double y = layer->scale[n] * (acc - zeroSum) + layer->bias[n];
+				if (!linear)
+					y = activate(q->act, y);
+				if (next == NULL)
+					Y[b * nn + n] = y;
+				else
+					out[b * next->stride + n] = quantize8(y, next->inScale, next->inZero);
+				}
+			}
+
+		uint8_t *t = in;
+		in = out;
+		out = t;
+		}
+	}
+
+// X = B × (# of inputs), Y = B × (# of outputs), one sample per row
+void forward_int8(const NNET8 *q, int B, const double *X, double *Y)
+	{
+	int dimIn = q->layers[0].numNeurons;
+	int dimOut = q->layers[q->numLayers - 1].numNeurons;
+	int maxStride = 64;
+	for (int l = 1; l < q->numLayers; ++l)
+		if (q->layers[l].stride > maxStride)
+			maxStride = q->layers[l].stride;
+
+	for (int b = 0; b < B; b += Tile8)
+		forward_tile(q, B - b < Tile8 ? B - b : Tile8, X + b * dimIn, Y + b * dimOut,
+				q->A, q->A + Tile8 * maxStride);
+	}
+
+//******************************** save / load **********************************//
+// Binary file:  "NNET8\n", then numLayers, act, perChannel, # of neurons per layer (int32),
+// then for each layer l ≥ 1:  inScale, inZero, W8, scale, bias, rowSum.
+
+#define Magic8	"NNET8\n"
+#define MaxLayers8	1000
+
+// Bytes of the header and topology of an L-layer file
+static uint64_t header_bytes8(int L)
+	{
+	return strlen(Magic8) + (3 + (uint64_t) L) * sizeof (int32_t);
+	}
+
+// Check the header (numLayers, act, perChannel) before anything is allocated:  the
+// topology must fit in the file
+static bool valid_header8(const int32_t header[3], uint64_t fileBytes)
+	{
+	return header[0] >= 2 && header[0] <= MaxLayers8 &&
+			header[1] >= Act_sigmoid && header[1] <= Act_x2 &&
+			(header[2] == 0 || header[2] == 1) && header_bytes8(header[0]) <= fileBytes;
+	}
+
+// Check the topology that follows the header:  the weights of the layers l ≥ 1 must be
+// the rest of the file (and each W8 fit in an int)
+static bool valid_layers8(int L, const int32_t neuronsPerLayer[], uint64_t fileBytes)
+	{
+	for (int l = 0; l < L; ++l)
+		if (neuronsPerLayer[l] <= 0)
+			return false;
+	uint64_t bytes = header_bytes8(L);
+	for (int l = 1; l < L; ++l)
+		{
+		uint64_t nn = neuronsPerLayer[l];
+		uint64_t stride = ((uint64_t) neuronsPerLayer[l - 1] + 63) / 64 * 64;
+		if (nn * stride > INT32_MAX)
+			return false;
+		bytes += sizeof (float) + sizeof (int32_t) + nn * stride +
+				nn * (2 * sizeof (float) + sizeof (int32_t));
+		}
+	return bytes == fileBytes;
+	}
+
+bool save_NN8(const NNET8 *q, const char *fileName)
+	{
+	FILE *fp = fopen(fileName, "wb");
+	if (fp == NULL)
+		return false;
+	fwrite(Magic8, 1, strlen(Magic8), fp);
+	int32_t header[3] = {q->numLayers, q->act, q->perChannel};
+	fwrite(header, sizeof (int32_t), 3, fp);
+	for (int l = 0; l < q->numLayers; ++l)
+		{
+		int32_t nn = q->layers[l].numNeurons;
+		fwrite(&nn, sizeof (int32_t), 1, fp);
+		}
+	for (int l = 1; l < q->numLayers; ++l)
+		{
+		const LAYER8 *layer = &q->layers[l];
+		int nn = layer->numNeurons;
+		int32_t zero = layer->inZero;
+		fwrite(&layer->inScale, sizeof (float), 1, fp);
+		fwrite(&zero, sizeof (int32_t), 1, fp);
+		fwrite(layer->W8, 1, nn * layer->stride, fp);
+		fwrite(layer->scale, sizeof (float), nn, fp);
+		fwrite(layer->bias, sizeof (float), nn, fp);
+		fwrite(layer->rowSum, sizeof (int32_t), nn, fp);
+		}
+	bool ok = !ferror(fp);
+	fclose(fp);
+	return ok;
+	}
+
+// Returns NULL if the file cannot be read or is not an int8 network
+NNET8 *load_NN8(const char *fileName)
+	{
+	FILE *fp = fopen(fileName, "rb");
+	if (fp == NULL)
+		return NULL;
+	struct stat st;
+	char magic[sizeof Magic8] = {0};
+	int32_t header[3];
+	if (fstat(fileno(fp), &st) != 0 ||
+			fread(magic, 1, strlen(Magic8), fp) != strlen(Magic8) || strcmp(magic, Magic8) ||
+			fread(header, sizeof (int32_t), 3, fp) != 3 || !valid_header8(header, st.st_size))
+		{
+		fclose(fp);
+		return NULL;
+		}
+
+	int L = header[0];
+	int32_t *neuronsPerLayer = (int32_t *) malloc(L * sizeof (int32_t));
+	if (fread(neuronsPerLayer, sizeof (int32_t), L, fp) != (size_t) L ||
+			!valid_layers8(L, neuronsPerLayer, st.st_size))
+		{
+		free(neuronsPerLayer);
+		fclose(fp);
+		return NULL;
+		}
+	NNET8 *q = (NNET8 *) malloc(sizeof (NNET8));
+	q->numLayers = L;
+	q->act = (ACTIVATION) header[1];
+	q->perChannel = header[2];
+	q->layers = alloc_layers(q, L, neuronsPerLayer);
+	free(neuronsPerLayer);
+
+	size_t got = 0, want = 0;
+	for (int l = 1; l < L; ++l)
+		{
+		LAYER8 *layer = &q->layers[l];
+		int nn = layer->numNeurons;
+		int32_t zero;
+		got += fread(&layer->inScale, sizeof (float), 1, fp);
+		got += fread(&zero, sizeof (int32_t), 1, fp);
+		got += fread(layer->W8, 1, nn * layer->stride, fp);
+		got += fread(layer->scale, sizeof (float), nn, fp);
+		got += fread(layer->bias, sizeof (float), nn, fp);
+		got += fread(layer->rowSum, sizeof (int32_t), nn, fp);
+		layer->inZero = zero;
+		want += 2 + nn * layer->stride + 3 * nn;
+		}
+	fclose(fp);
+	if (got != want)
+		{
+		free_NN8(q);
+		return NULL;
+		}
+	return q;
+	}
+
+//******************************* accuracy report *******************************//
+
+static double seconds_since(struct timespec *t0)
+	{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) + (t.tv_nsec - t0->tv_nsec) * 1e-9;
+	}
+
+// Compare the int8 network with the original evaluated by forward_prop_*() on the N rows
+// of X:  mean and max |Δ| of the outputs, agreement of the arg-max output, and speed.
+void int8_report(NNET *net, const NNET8 *q, int N, double *X)
+	{
+	int dimIn = net->layers[0].numNeurons;
+	int dimOut = net->layers[net->numLayers - 1].numNeurons;
+	LAYER *lastLayer = &net->layers[net->numLayers - 1];
+	double *Y8 = (double *) malloc(N * dimOut * sizeof (double));
+	double *Y = (double *) malloc(N * dimOut * sizeof (double));
+
+	void (*forward_prop)(NNET *, int, double *) = forward_prop_sigmoid;
+	const char *name = "forward_prop_sigmoid";
+	switch (q->act)
+		{
+		case Act_sigmoid:	break;
+		case Act_ReLU:		forward_prop = forward_prop_ReLU; name = "forward_prop_ReLU"; break;
+		case Act_softplus:	forward_prop = forward_prop_softplus; name = "forward_prop_softplus"; break;
+		case Act_x2:		forward_prop = forward_prop_x2; name = "forward_prop_x2"; break;
+		}
+
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int s = 0; s < N; ++s)
+		{
+		forward_prop(net, dimIn, X + s * dimIn);
+		for (int k = 0; k < dimOut; ++k)
+			Y[s * dimOut + k] = lastLayer->neurons[k].output;
+		}
+	double tRef = seconds_since(&t0);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	forward_int8(q, N, X, Y8);
+	double t8 = seconds_since(&t0);
+
+	double sumErr = 0.0, maxErr = 0.0, sumAbs = 0.0;
+	int agree = 0;
+	for (int s = 0; s < N; ++s)
+		{
+		int best = 0, best8 = 0;
+		for (int k = 0; k < dimOut; ++k)
+			{
+			double d = fabs(Y8[s * dimOut + k] - Y[s * dimOut + k]);
+			sumErr += d;
+			maxErr = fmax(maxErr, d);
+			sumAbs += fabs(Y[s * dimOut + k]);
+			if (Y[s * dimOut + k] > Y[s * dimOut + best])
+				best = k;
+			if (Y8[s * dimOut + k] > Y8[s * dimOut + best8])
+				best8 = k;
+			}
+		agree += (best == best8);
+		}
+
+	printf("int8 network (%s weight scales, %s kernel) vs %s on %d samples:\n",
+			q->perChannel ? "per-neuron" : "per-layer", kernel8, name, N);
+	printf("    mean |Δ| = %g  (%.3f%% of mean |y|),  max |Δ| = %g\n",
+			sumErr / (N * dimOut), 100.0 * sumErr / sumAbs, maxErr);
+	if (dimOut > 1)
+		printf("    arg-max output agrees on %.2f%% of samples\n", 100.0 * agree / N);
+	printf("    %s: %.1f ns/sample,  int8: %.1f ns/sample\n",
+			sizeof (real) == sizeof (double) ? "double" : "float",
+			tRef * 1e9 / N, t8 * 1e9 / N);
+
+	free(Y8);
+	free(Y);
+	}
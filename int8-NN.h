@@ -0,0 +1,39 @@
+#include <stdint.h>
+#include <stdbool.h>
+// needs feedforward-NN.h (for ACTIVATION) to be included first
+
+//******************** int8 quantized feed-forward network ********************//
+// Post-training quantization of an NNET, for fast inference only (see int8-NN.c).
+// Each layer computes its induced local fields with integer dot products
+//		acc_n = Σ_i W8[n][i] a_i			(W8 = int8 weights, a = 7-bit unsigned inputs)
+// and then dequantizes:	v_n = scale[n] (acc_n − inZero rowSum[n]) + bias[n]
+// The activation function is applied to v in float, and the result is re-quantized as
+// the input of the next layer.  The last layer's outputs are returned without
+// re-quantization.
+
+typedef struct LAYER8
+	{
+	int numNeurons;
+	int numInputs;
+	int stride;					// row length of W8 in bytes (multiple of 64, zero padded)
+	int8_t *W8;					// numNeurons × stride weights, without the bias
+	float *scale;				// weight scale × input scale, per neuron
+	float *bias;				// bias weight, not quantized
+	int32_t *rowSum;			// Σ_i W8[n][i], to correct for the input zero point
+	float inScale;				// inputs of this layer:  x ≈ inScale (a − inZero)
+	int inZero;
+	} LAYER8;
+
+typedef struct NNET8
+	{
+	int numLayers;
+	ACTIVATION act;
+	bool perChannel;			// weight scales per neuron, or one per layer
+	LAYER8 *layers;				// layers[0] is unused (input layer)
+	uint8_t *A;					// activations of forward_int8(), 2 tiles of the widest
+								// layer:  one forward_int8() at a time per network
+	} NNET8;
+
+// Largest value of a quantized activation.  Activations use 7 bits so that the u8 × s8
+// pair sums of pmaddubsw (AVX2) cannot saturate 16 bits:  2 × 127 × 127 < 32767.
+#define Q8_Max	127
@@ -258,12 +258,22 @@ extern void forward_test();
 extern void loop_dance_test();
 extern void arithmetic_testA();
 extern void arithmetic_testB();
+extern void arithmetic_testB_async();
+extern void arithmetic_testB_batch();
+extern void arithmetic_testB_resume();
+extern void convert_net_precision();
+extern void arithmetic_test_int8();
+extern void benchmark_activations();
+extern void convert_net_binary();
 extern void arithmetic_testC();
 extern void arithmetic_testD();
 extern void arithmetic_testE();
 extern void RNN_sine_test();
 extern void BPTT_arithmetic_test();
 extern void BPTT_arithmetic_testB();
+extern bool BPTT_batch_test();
+extern bool BPTT_stream_test();
+extern bool BPTT_checkpoint_test();
 extern void evolve();
 extern void main2();
 extern void jacobian_test();
@@ -290,10 +300,20 @@ int main(int argc, char** argv)
 		printf("[7] arthmetic test: test operator\n");
 		printf("[8] arithmetic test: learn operator\n");
 		printf("[9] arithmetic test: test learned operator\n");
+		printf("[k] arithmetic test: learn operator (asynchronous SGD)\n");
+		printf("[r] arithmetic test: learn operator (data-parallel mini-batches)\n");
+		printf("[p] arithmetic test: resume learning operator from checkpoint\n");
+		printf("[l] convert .net file to single / double precision\n");
+		printf("[m] arithmetic test: quantize learned operator to int8\n");
+		printf("[n] benchmark activation functions\n");
+		printf("[o] convert .net file to binary\n");
 		printf("[a] arithmetic test: learn 1-step operator\n");
 		printf("[b] arithmetic test: test learned 1-step operator\n");
 		printf("[c] BPTT arithmetic test\n");
 		printf("[d] BPTT test learned operator\n");
+		printf("[s] BPTT batch test (lengths 5, 2, 4 vs one sequence at a time)\n");
+		printf("[w] BPTT stream test (truncated BPTT, K1 = K, vs whole sequence)\n");
+		printf("[y] BPTT checkpoint test (checkpointed vs every step kept)\n");
 		printf("[e] rectifier BP test (XOR)\n");
 		printf("[f] RNN sine-wave test\n");
 		printf("[g] genetic NN test\n");
@@ -337,6 +357,27 @@ int main(int argc, char** argv)
 			case '8':
 				arithmetic_testB(); // primary-school subtraction arithmetic
 				break; // learn transition operator via back-prop
+			case 'k':
+				arithmetic_testB_async(); // same as [8], lock-free multi-threaded
+				break;
+			case 'r':
+				arithmetic_testB_batch(); // same as [8], mini-batches on all cores
+				break;
+			case 'p':
+				arithmetic_testB_resume(); // [8] from its latest checkpoint
+				break;
+			case 'o':
+				convert_net_binary();
+				break;
+			case 'n':
+				benchmark_activations();
+				break;
+			case 'm':
+				arithmetic_test_int8();
+				break;
+			case 'l':
+				convert_net_precision();
+				break;
 			case '9':
 				arithmetic_testC(); // primary-school subtraction arithmetic
 				break; // test transition operator that was learned
@@ -352,6 +393,15 @@ int main(int argc, char** argv)
 			case 'd':
 				BPTT_arithmetic_testB(); // learn arithmetic operator using BPTT
 				break; // test BPTT learned operator
+			case 's':
+				BPTT_batch_test(); // batched BPTT = each sequence alone
+				break;
+			case 'w':
+				BPTT_stream_test(); // truncated BPTT, K1 = K = BPTT of the sequence
+				break;
+			case 'y':
+				BPTT_checkpoint_test(); // checkpointed BPTT = every step kept
+				break;
 			case 'e':
 				// classic_BP_test_ReLU(); // learn XOR function
 				break;
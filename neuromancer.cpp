@@ -8,7 +8,7 @@
 using namespace std;
 
 extern NNET *create_NN(int, int *);
-extern void free_NN(NNET *, int *);
+extern void free_NN(NNET *);
 extern void forward_prop_sigmoid(NNET *, int, double *);
 extern void forward_prop_ReLU(NNET *, int, double *);
 extern void forward_prop_softplus(NNET *, int, double *);
@@ -378,7 +378,7 @@ int main(int argc, char **argv)
 	//	pause_graphics();
 	// else
 	//	quit_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
 
 // Test forward propagation
@@ -439,5 +439,5 @@ void forward_test()
 		}
 
 	// pause_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
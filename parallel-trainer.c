@@ -0,0 +1,380 @@
+// Data-parallel trainer
+// Each mini-batch is split into equal shards, one per worker thread.  Every worker runs
+// forward_batch() and backward_batch() on its shard, accumulating gradients into its own
+// BATCH (so workers never write shared memory during this phase).  Then the gradients are
+// all-reduced:  the parameter vector is cut into slices, and each worker sums one slice
+// over all workers' dW buffers -- always in worker order 0, 1, 2 ... so the result does
+// not depend on thread timing -- and applies the update to that slice.
+// The calling thread is worker 0;  the other workers wait on a barrier between batches.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>				// clock_gettime()
+#include <unistd.h>				// usleep()
+#include <pthread.h>
+#include "feedforward-NN.h"
+#include "NN-trace.h"
+
+extern BATCH *create_batch(NNET *, int);
+extern void free_batch(BATCH *);
+extern void forward_batch(NNET *, BATCH *, int, double *, ACTIVATION);
+extern void backward_batch(NNET *, BATCH *, int, double *);
+
+#define PadDoubles	8			// keep per-worker slots on separate cache lines
+
+struct TRAINER
+	{
+	NNET *net;
+	ACTIVATION act;
+	double eta;					// learning rate
+	int numThreads;
+	int maxBatch;				// largest mini-batch accepted by train_batch()
+
+	pthread_t *threads;
+	pthread_barrier_t barrier;
+	bool quit;
+
+	BATCH **batch;				// one per worker
+	double **errors;			// one shard of errors per worker
+	double *absErr;				// Σ |e| of each worker's shard, padded
+
+	// current mini-batch
+	int B;
+	double *X, *Y;
+	};
+
+typedef struct WORKER
+	{
+	TRAINER *trainer;
+	int id;
+	} WORKER;
+
+// Process shard "id" of the current mini-batch, then reduce slice "id" of the gradient
+static void train_shard(TRAINER *tr, int id)
+	{
+	NNET *net = tr->net;
+	int T = tr->numThreads;
+	int dimIn = net->layers[0].numNeurons;
+	int dimOut = net->layers[net->numLayers - 1].numNeurons;
+
+	int b0 = tr->B * id / T, b1 = tr->B * (id + 1) / T;
+	int nb = b1 - b0;
+	BATCH *batch = tr->batch[id];
+	double absErr = 0.0;
+	TRACE_BEGIN(t);
+
+	if (nb > 0)
+		{
+		forward_batch(net, batch, nb, tr->X + b0 * dimIn, tr->act);
+		TRACE_END(Trace_forward, t);
+
+		real *out = batch->Y[net->numLayers - 1];
+		double *Y = tr->Y + b0 * dimOut;
+		double *errors = tr->errors[id];
+		for (int i = 0; i < nb * dimOut; ++i)
+			{
+			errors[i] = Y[i] - out[i];			// desired - actual
+			absErr += fabs(errors[i]);
+			}
+		TRACE_END(Trace_error, t);
+
+		backward_batch(net, batch, nb, errors);
+		TRACE_END(Trace_backward, t);
+		}
+	tr->absErr[id * PadDoubles] = absErr;
+
+	pthread_barrier_wait(&tr->barrier);		// all gradients are ready
+	TRACE_END(Trace_barrier, t);
+
+	// all-reduce slice [p0, p1) of the parameters, slices aligned to cache lines
+	int P = net->numParams / NN_RowPad;
+	int p0 = P * id / T * NN_RowPad, p1 = P * (id + 1) / T * NN_RowPad;
+	real a = tr->eta / tr->B;
+	for (int i = p0; i < p1; ++i)
+		{
+		real sum = 0.0;
+		for (int w = 0; w < T; ++w)
+			{
+			sum += tr->batch[w]->dW[i];
+			tr->batch[w]->dW[i] = 0.0;
+			}
+		net->params[i] += a * sum;
+		}
+	batch->count = 0;
+	TRACE_END(Trace_update, t);
+
+	pthread_barrier_wait(&tr->barrier);		// weights are updated
+	TRACE_END(Trace_barrier, t);
+	}
+
+static void *worker_loop(void *arg)
+	{
+	WORKER *worker = (WORKER *) arg;
+	TRAINER *tr = worker->trainer;
+	trace_thread_name("trainer worker");
+
+	while (true)
+		{
+		pthread_barrier_wait(&tr->barrier);		// wait for a mini-batch
+		if (tr->quit)
+			break;
+		train_shard(tr, worker->id);
+		}
+	free(worker);
+	return NULL;
+	}
+
+// numThreads = total # of threads including the caller
+TRAINER *create_trainer(NNET *net, int numThreads, int maxBatch, ACTIVATION act, double eta)
+	{
+	TRAINER *tr = (TRAINER *) malloc(sizeof (TRAINER));
+	tr->net = net;
+	tr->act = act;
+	tr->eta = eta;
+	tr->numThreads = numThreads;
+	tr->maxBatch = maxBatch;
+	tr->quit = false;
+
+	// net->numParams is a multiple of NN_RowPad (rows are padded)
+	int shard = (maxBatch + numThreads - 1) / numThreads;
+	int dimOut = net->layers[net->numLayers - 1].numNeurons;
+	tr->batch = (BATCH **) malloc(numThreads * sizeof (BATCH *));
+	tr->errors = (double **) malloc(numThreads * sizeof (double *));
+	tr->absErr = (double *) malloc(numThreads * PadDoubles * sizeof (double));
+	for (int w = 0; w < numThreads; ++w)
+		{
+		tr->batch[w] = create_batch(net, shard);
+		tr->errors[w] = (double *) malloc(shard * dimOut * sizeof (double));
+		}
+
+	pthread_barrier_init(&tr->barrier, NULL, numThreads);
+	tr->threads = (pthread_t *) malloc(numThreads * sizeof (pthread_t));
+	for (int w = 1; w < numThreads; ++w)
+		{
+		WORKER *worker = (WORKER *) malloc(sizeof (WORKER));
+		worker->trainer = tr;
+		worker->id = w;
+		pthread_create(&tr->threads[w], NULL, worker_loop, worker);
+		}
+	return tr;
+	}
+
+void free_trainer(TRAINER *tr)
+	{
+	tr->quit = true;
+	pthread_barrier_wait(&tr->barrier);		// release the workers
+	for (int w = 1; w < tr->numThreads; ++w)
+		pthread_join(tr->threads[w], NULL);
+	pthread_barrier_destroy(&tr->barrier);
+
+	for (int w = 0; w < tr->numThreads; ++w)
+		{
+		free_batch(tr->batch[w]);
+		free(tr->errors[w]);
+		}
+	free(tr->batch);
+	free(tr->errors);
+	free(tr->absErr);
+	free(tr->threads);
+	free(tr);
+	}
+
+// One step of mini-batch gradient descent on B samples:
+// X = B × (# of inputs), Y = B × (# of outputs) desired values, one sample per row.
+// Returns the mean over samples of Σ |e| (the "|e|" of the training loops).
+double train_batch(TRAINER *tr, int B, double *X, double *Y)
+	{
+	if (B > tr->maxBatch)
+		{
+		fprintf(stderr, "train_batch: batch of %d exceeds maximum %d\n", B, tr->maxBatch);
+		B = tr->maxBatch;
+		}
+	tr->B = B;
+	tr->X = X;
+	tr->Y = Y;
+
+	pthread_barrier_wait(&tr->barrier);		// start the workers
+	train_shard(tr, 0);
+
+	double absErr = 0.0;
+	for (int w = 0; w < tr->numThreads; ++w)
+		absErr += tr->absErr[w * PadDoubles];
+	return absErr / B;
+	}
+
+//************************** asynchronous SGD ("Hogwild") ****************************//
+// For small networks the barriers above cost more than the arithmetic.  In this mode N
+// threads each draw samples from a generator and update the shared weights directly, with
+// no locks:  every weight is read and written with relaxed atomic loads / stores, so an
+// update may occasionally overwrite another thread's concurrent update to the same weight
+// (this is the Hogwild! scheme of Niu, Recht, Ré & Wright, 2011).
+// The forward pass reads the weights with ordinary (vector) loads;  aligned 4- or 8-byte
+// loads cannot tear on x86-64, so a thread at worst sees a mix of old and new weights.
+
+#define ReportInterval	500000	// µs between status lines
+
+typedef struct HOGWILD
+	{
+	NNET *net;
+	ACTIVATION act;
+	double eta;
+	SAMPLER sample;
+	unsigned int seed;
+	int stop;					// set by the monitor, read with relaxed atomics
+	long *count;				// samples done by each thread, padded
+	double *sumErr;				// Σ |e| of each thread, padded
+	} HOGWILD;
+
+typedef struct HWORKER
+	{
+	HOGWILD *hw;
+	int id;
+	} HWORKER;
+
+static void *hogwild_loop(void *arg)
+	{
+	HWORKER *worker = (HWORKER *) arg;
+	HOGWILD *hw = worker->hw;
+	NNET *net = hw->net;
+	int dimIn = net->layers[0].numNeurons;
+	int dimOut = net->layers[net->numLayers - 1].numNeurons;
+	unsigned int seed = hw->seed + worker->id;		// each thread has its own stream
+
+	BATCH *batch = create_batch(net, 1);
+	double x[dimIn], y[dimOut], errors[dimOut];
+	long count = 0;
+	double sumErr = 0.0;
+	trace_thread_name("hogwild worker");
+	TRACE_BEGIN(t);
+
+	while (!__atomic_load_n(&hw->stop, __ATOMIC_RELAXED))
+		{
+		hw->sample(&seed, x, y);
+		TRACE_END(Trace_transition, t);
+
+		forward_batch(net, batch, 1, x, hw->act);
+		TRACE_END(Trace_forward, t);
+		real *out = batch->Y[net->numLayers - 1];
+		for (int k = 0; k < dimOut; ++k)
+			{
+			errors[k] = y[k] - out[k];
+			sumErr += fabs(errors[k]);
+			}
+		TRACE_END(Trace_error, t);
+		backward_batch(net, batch, 1, errors);
+		TRACE_END(Trace_backward, t);
+
+		// lock-free update of the shared weights, row by row:  the padding at the end of
+		// each row is never written
+		for (int l = 1; l < net->numLayers; ++l)
+			{
+			LAYER *layer = &net->layers[l];
+			int len = net->layers[l - 1].numNeurons + 1;
+			for (int n = 0; n < layer->numNeurons; ++n)
+				{
+				real *W = layer->W + (size_t) n * layer->stride;
+				real *dW = batch->dW + (W - net->params);
+				for (int i = 0; i < len; ++i)
+					if (dW[i] != 0.0)
+						{
+						real w;
+						__atomic_load(&W[i], &w, __ATOMIC_RELAXED);
+						w += hw->eta * dW[i];
+						__atomic_store(&W[i], &w, __ATOMIC_RELAXED);
+						dW[i] = 0.0;
+						}
+				}
+			}
+		batch->count = 0;
+		TRACE_END(Trace_update, t);
+
+		// publish progress (only this thread writes its slots)
+		++count;
+		__atomic_store_n(&hw->count[worker->id * PadDoubles], count, __ATOMIC_RELAXED);
+		__atomic_store(&hw->sumErr[worker->id * PadDoubles], &sumErr, __ATOMIC_RELAXED);
+		}
+
+	free_batch(batch);
+	free(worker);
+	return NULL;
+	}
+
+static double seconds_since(struct timespec *t0)
+	{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) + (t.tv_nsec - t0->tv_nsec) * 1e-9;
+	}
+
+// Train "net" asynchronously with numThreads threads until the mean |e| (over the last
+// report interval) drops below threshold, or maxSamples samples have been used.
+// sample(seed, x, y) must be thread-safe, using only *seed (eg with rand_r) for randomness.
+// Prints a status line every ReportInterval with samples/s and the convergence rate
+// -d ln(mean |e|) / dt per wall-clock second.  Returns the final mean |e|.
+double train_hogwild(NNET *net, int numThreads, ACTIVATION act, double eta,
+		SAMPLER sample, unsigned int seed, long maxSamples, double threshold)
+	{
+	HOGWILD hw = {net, act, eta, sample, seed, 0, NULL, NULL};
+	hw.count = (long *) calloc(numThreads * PadDoubles, sizeof (long));
+	hw.sumErr = (double *) calloc(numThreads * PadDoubles, sizeof (double));
+
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	pthread_t threads[numThreads];
+	for (int w = 0; w < numThreads; ++w)
+		{
+		HWORKER *worker = (HWORKER *) malloc(sizeof (HWORKER));
+		worker->hw = &hw;
+		worker->id = w;
+		pthread_create(&threads[w], NULL, hogwild_loop, worker);
+		}
+
+	// monitor
+	long lastCount = 0;
+	double lastSum = 0.0, lastTime = 0.0, lastErr = NAN, mean_err = NAN;
+	while (true)
+		{
+		usleep(ReportInterval);
+
+		long count = 0;
+		double sum = 0.0;
+		for (int w = 0; w < numThreads; ++w)
+			{
+			double s;
+			count += __atomic_load_n(&hw.count[w * PadDoubles], __ATOMIC_RELAXED);
+			__atomic_load(&hw.sumErr[w * PadDoubles], &s, __ATOMIC_RELAXED);
+			sum += s;
+			}
+		double now = seconds_since(&t0), dt = now - lastTime;
+		if (count == lastCount)
+			continue;
+
+		mean_err = (sum - lastSum) / (count - lastCount);
+		double rate = (log(lastErr) - log(mean_err)) / dt;
+		printf("[%08ld] mean |e|=%lf, %.0f samples/s, -dln|e|/dt=%.4f /s   \r",
+				count, mean_err, (count - lastCount) / dt, isnan(rate) ? 0.0 : rate);
+		fflush(stdout);
+
+		lastCount = count;
+		lastSum = sum;
+		lastTime = now;
+		lastErr = mean_err;
+		if (mean_err < threshold || count >= maxSamples)
+			break;
+		}
+
+	__atomic_store_n(&hw.stop, 1, __ATOMIC_RELAXED);
+	for (int w = 0; w < numThreads; ++w)
+		pthread_join(threads[w], NULL);
+
+	double elapsed = seconds_since(&t0);
+	printf("\n%d threads, %ld samples in %.2f s = %.0f samples/s\n",
+			numThreads, lastCount, elapsed, lastCount / elapsed);
+
+	free(hw.count);
+	free(hw.sumErr);
+	return mean_err;
+	}
@@ -0,0 +1,219 @@
+// Hardware performance counters of perf-counters.h, via perf_event_open(2).
+// The events of a thread form one group led by "cycles", so they are scheduled together
+// and read with a single read().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf-counters.h"
+
+long NN_perf_batch = 10000;
+
+static const char *eventName[Perf_Events] =
+	{"cycles", "instructions", "cache-misses", "L1D-misses", "branch-misses", "FP-vector"};
+static const char *regionName[Perf_Regions] =
+	{"forward_prop_sigmoid", "forward_prop_softplus", "forward_prop_ReLU", "forward_prop_x2",
+	"back_prop", "maxQ"};
+
+// Per thread:  state 0 = not opened yet, 1 = open, -1 = unavailable
+static __thread int state = 0;
+static __thread int leader = -1;
+static __thread int fds[Perf_Events];
+static __thread int slot[Perf_Events];		// index of the event in the group read, or -1
+static __thread int numOpen = 0;
+
+static __thread PERF_SNAPSHOT regionStart[Perf_Regions];
+static __thread PERF_COUNTS regionCounts[Perf_Regions];
+static __thread long regionBatch[Perf_Regions];
+
+static int open_event(uint32_t type, uint64_t config, int group)
+	{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof attr);
+	attr.size = sizeof attr;
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = group == -1;			// the leader starts the whole group
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+			PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+	}
+
+// Raw config of the packed FP instruction event, 0 if unknown for this CPU
+static uint64_t fp_vector_config(void)
+	{
+	const char *s = getenv("NN_PERF_FP");
+	if (s != NULL)
+		return strtoull(s, NULL, 16);
+	#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_is("intel"))
+		return 0xfcc7;				// FP_ARITH_INST_RETIRED, umask 128/256/512-bit packed
+	#endif
+	return 0;
+	}
+
+bool perf_open(void)
+	{
+	if (state != 0)
+		return state > 0;
+	state = -1;
+	for (int e = 0; e < Perf_Events; ++e)
+		fds[e] = slot[e] = -1;
+
+	leader = fds[Perf_cycles] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+	if (leader < 0)
+		{
+		perror("perf_event_open (cycles)");
+		return false;
+		}
+	numOpen = 0;
+	slot[Perf_cycles] = numOpen++;
+
+	uint64_t L1D = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	uint64_t fp = fp_vector_config();
+	struct { int e; uint32_t type; uint64_t config; } events[] =
+		{
+		{Perf_instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{Perf_cacheMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+		{Perf_L1DMisses, PERF_TYPE_HW_CACHE, L1D},
+		{Perf_branchMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		{Perf_FPVector, PERF_TYPE_RAW, fp},
+		};
+	for (int i = 0; i < (int) (sizeof events / sizeof events[0]); ++i)
+		{
+		if (events[i].type == PERF_TYPE_RAW && events[i].config == 0)
+			continue;
+		int fd = open_event(events[i].type, events[i].config, leader);
+		if (fd < 0)
+			continue;
+		fds[events[i].e] = fd;
+		slot[events[i].e] = numOpen++;
+		}
+
+	ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	state = 1;
+	return true;
+	}
+
+void perf_close(void)
+	{
+	for (int e = 0; e < Perf_Events; ++e)
+		if (fds[e] >= 0)
+			close(fds[e]);
+	leader = -1;
+	state = 0;
+	}
+
+bool perf_has(int event)
+	{
+	return state > 0 && slot[event] >= 0;
+	}
+
+bool perf_read(uint64_t v[Perf_Events], uint64_t *enabled, uint64_t *running)
+	{
+	uint64_t buf[3 + Perf_Events];			// nr, time enabled, time running, values
+	if (state <= 0 || read(leader, buf, sizeof buf) < (ssize_t) (3 * sizeof (uint64_t)))
+		return false;
+	*enabled = buf[1];
+	*running = buf[2];
+	for (int e = 0; e < Perf_Events; ++e)
+		v[e] = slot[e] >= 0 ? buf[3 + slot[e]] : 0;
+	return true;
+	}
+
+bool perf_snapshot(PERF_SNAPSHOT *s)
+	{
+	return perf_read(s->v, &s->enabled, &s->running);
+	}
+
+void perf_accumulate(PERF_COUNTS *c, const PERF_SNAPSHOT *begin, const PERF_SNAPSHOT *end)
+	{
+	uint64_t running = end->running - begin->running;
+	if (running == 0)			// the group was not scheduled in between
+		{
+		++c->calls;
+		return;
+		}
+	double scale = (double) (end->enabled - begin->enabled) / running;
+	for (int e = 0; e < Perf_Events; ++e)
+		c->v[e] += (end->v[e] - begin->v[e]) * scale;
+	++c->calls;
+	}
+
+void perf_csv(FILE *fp, const PERF_COUNTS *c, double units)
+	{
+	for (int e = 0; e < Perf_Events; ++e)
+		{
+		fprintf(fp, ",");
+		if (e == Perf_instructions)			// as IPC
+			{
+			if (perf_has(Perf_instructions) && c->v[Perf_cycles] > 0.0)
+				fprintf(fp, "%.3f", c->v[Perf_instructions] / c->v[Perf_cycles]);
+			}
+		else if (perf_has(e))
+			fprintf(fp, "%.3f", c->v[e] / units);
+		}
+	}
+
+void perf_print(FILE *fp, const char *name, const PERF_COUNTS *c)
+	{
+	if (c->calls == 0)
+		return;
+	fprintf(fp, "perf %-22s %9llu calls", name, (unsigned long long) c->calls);
+	for (int e = 0; e < Perf_Events; ++e)
+		{
+		if (!perf_has(e))
+			continue;
+		if (e == Perf_instructions)
+			fprintf(fp, "  IPC %.2f", c->v[Perf_cycles] > 0.0 ?
+					c->v[Perf_instructions] / c->v[Perf_cycles] : 0.0);
+		else
+			fprintf(fp, "  %s %.1f", eventName[e], c->v[e] / c->calls);
+		}
+	fprintf(fp, "  /call\n");
+	}
+
+//************************** instrumented regions **********************************//
+
+void NN_perf_enter(int region)
+	{
+	if (state == 0)
+		perf_open();
+	if (state > 0)
+		perf_snapshot(&regionStart[region]);
+	}
+
+void NN_perf_leave(int region)
+	{
+	PERF_SNAPSHOT end;
+	if (state <= 0 || !perf_snapshot(&end))
+		return;
+	PERF_COUNTS *c = &regionCounts[region];
+	perf_accumulate(c, &regionStart[region], &end);
+	if (NN_perf_batch > 0 && (long) c->calls >= NN_perf_batch)
+		{
+		char name[64];
+		snprintf(name, sizeof name, "%s #%ld", regionName[region], ++regionBatch[region]);
+		perf_print(stderr, name, c);
+		memset(c, 0, sizeof *c);
+		}
+	}
+
+void NN_perf_dump(FILE *fp)
+	{
+	for (int r = 0; r < Perf_Regions; ++r)
+		{
+		perf_print(fp, regionName[r], &regionCounts[r]);
+		memset(&regionCounts[r], 0, sizeof regionCounts[r]);
+		}
+	fflush(fp);
+	}
@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+//************************** hardware performance counters ******************************//
+// Linux perf_event_open() counters of the calling thread, user space only:  cycles,
+// instructions, last-level cache misses, L1D read misses, branch misses and retired
+// packed (SIMD) FP instructions.  The last one is a raw event:  Intel's
+// FP_ARITH_INST_RETIRED.*_PACKED by default, or the raw config in hex given by the
+// environment variable NN_PERF_FP (eg "0x0f03" for an AMD Zen FP-ops event).
+// Events that the CPU, the VM or /proc/sys/kernel/perf_event_paranoid do not allow are
+// left out and printed as blank.
+//
+// Built with -DNN_PERF, forward_prop_*(), back_prop() and maxQ() read the counters on
+// entry and exit (2 read() calls per invocation, so their wall time is not meaningful
+// but the counts are), and each thread prints one line per batch of NN_perf_batch
+// invocations of a function to stderr, plus the remainder on NN_perf_dump().
+// Without NN_PERF the PERF_* macros expand to nothing.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { Perf_cycles, Perf_instructions, Perf_cacheMisses, Perf_L1DMisses, Perf_branchMisses,
+		Perf_FPVector, Perf_Events };
+
+enum { Perf_forward_sigmoid, Perf_forward_softplus, Perf_forward_ReLU, Perf_forward_x2,
+		Perf_back_prop, Perf_maxQ, Perf_Regions };
+
+typedef struct PERF_COUNTS
+	{
+	double v[Perf_Events];			// scaled if the events were multiplexed
+	uint64_t calls;
+	} PERF_COUNTS;
+
+extern long NN_perf_batch;			// invocations per printed line, default 10000
+
+bool perf_open(void);				// for the calling thread;  false if no event is available
+void perf_close(void);
+bool perf_has(int event);
+// Current counts (as from perf_open()) into v[Perf_Events] and the time the group was
+// enabled and running
+bool perf_read(uint64_t v[Perf_Events], uint64_t *enabled, uint64_t *running);
+
+// Differences of two snapshots, added to c
+typedef struct PERF_SNAPSHOT
+	{
+	uint64_t v[Perf_Events], enabled, running;
+	} PERF_SNAPSHOT;
+
+bool perf_snapshot(PERF_SNAPSHOT *s);
+void perf_accumulate(PERF_COUNTS *c, const PERF_SNAPSHOT *begin, const PERF_SNAPSHOT *end);
+
+// "cycles,ipc,cache_misses,l1d_misses,branch_misses,fp_vector" per unit, blanks for the
+// missing events
+void perf_csv(FILE *fp, const PERF_COUNTS *c, double units);
+void perf_print(FILE *fp, const char *name, const PERF_COUNTS *c);
+
+void NN_perf_enter(int region);
+void NN_perf_leave(int region);
+void NN_perf_dump(FILE *fp);		// the regions' counts since their last printed batch
+
+#ifdef NN_PERF
+#define PERF_ENTER(region)		NN_perf_enter(region)
+#define PERF_LEAVE(region)		NN_perf_leave(region)
+#else
+#define PERF_ENTER(region)		((void) 0)
+#define PERF_LEAVE(region)		((void) 0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
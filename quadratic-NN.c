@@ -8,10 +8,12 @@
 #include <time.h>			// time as random seed in create_QNN()
 #include "QNET.h"
 
+extern bool NN_fixedSeed;
+
 #define Eta 0.01			// learning rate
 #define BIASINPUT 1.0		// input for bias. It's always 1.
 
-double randomWeight()		// generate random weight between [+1.0, -1.0]
+static double randomWeight()	// generate random weight between [+1.0, -1.0]
 	{
 	// return 0.5 + (rand() / (double) RAND_MAX) * 0.01;
 	return (rand() / (double) RAND_MAX) * 2.0 - 1.0;
@@ -22,7 +24,8 @@ double randomWeight()		// generate random weight between [+1.0, -1.0]
 QNET *create_QNN(int numLayers)
 	{
 	QNET *net = (QNET *) malloc(sizeof (QNET));
-	srand(time(NULL));
+	if (!NN_fixedSeed)
+		srand(time(NULL));
 	net->numLayers = numLayers;
 
 	assert(numLayers >= 3);
@@ -43,9 +46,10 @@ QNET *create_QNN(int numLayers)
 	return net;
 	}
 
-void re_randomize(QNET *net)
+void re_randomize_QNN(QNET *net)
 	{
-	srand(time(NULL));
+	if (!NN_fixedSeed)
+		srand(time(NULL));
 
 	for (int l = 1; l < net->numLayers; ++l)					// for each layer
 		{
@@ -212,24 +216,3 @@ void back_prop_quadratic(QNET *net, double *errors)
 			}
 		}
 	}
-
-// Calculate error between output of forward-prop and a given answer Y
-double calc_error(QNET *net, double Y[], double *errors)
-	{
-	// calculate mean square error
-	// desired value = Y = K* = trainingOUT
-	double sumOfSquareError = 0;
-
-	int numLayers = net->numLayers;
-	LAYER lastLayer = net->layers[numLayers - 1];
-	// This means each output neuron corresponds to a classification label --YKY
-	for (int n = 0; n < dim_V; n++)
-		{
-		//error = desired_value - output
-		double error = Y[n] - lastLayer.neurons[n].output;
-		errors[n] = error;
-		sumOfSquareError += error * error / 2;
-		}
-	double mse = sumOfSquareError / dim_V;
-	return mse; //return mean square error
-	}
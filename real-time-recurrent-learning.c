@@ -39,79 +39,274 @@
 
 // ∂Y_k(t+1)/∂W_ij = sigmoid' (net_k(t)) [ sum_h W_kh ∂Y_h(t)/∂W_ij + δ_ik Y_j(t)]
 
+// Here one time step is a pass through all the layers, and the outputs Y are fed back to
+// the inputs x, so with p^k_ij(t) = ∂Y_k(t)/∂W_ij the recursion is over whole steps:
+//		p^k_ij(t) = ∂Y_k(t)/∂net_i  Y_j  +  sum_r ∂Y_k(t)/∂x_r(t)  p^r_ij(t-1)
+// where the first term is the W_ij of step t alone, and ∂Y_k/∂net_i, ∂Y_k/∂x_r (= J) come
+// from one back-prop per output.  For a net of n units per layer that is O(n³) p's and
+// O(n⁴) operations per step.  The SnAp-n approximations (RNN.h) drop the p^k_ij of the
+// outputs W_ij does not reach within n hops:  SnAp-1 keeps O(n²) p's, and costs O(n³) for
+// the back-props.
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 #include <time.h>				// time as random seed in create_NN()
 #include "RNN.h"
+#include "NN-arena.h"
+#include "NN-profile.h"
+#include "SIMD-kernels.h"
+
+extern bool NN_fixedSeed;
 
 #define Eta 0.001				// learning rate
 #define BIASOUTPUT 1.0			// output for bias. It's always 1.
+#define steepness 3.0			// of sigmoid():  σ' = steepness y (1 - y)
+
+void RTRL_approximate(RNN *, int);
 
 //****************************create neural network*********************//
 // GIVEN: how many layers, and how many neurons in each layer
-void create_RTRL_NN(RNN *net, int numLayers, int *neuronsPerLayer)
+// Lay out a network in the arena:  the RNN, its layers, the neurons of each layer and
+// one weight matrix per layer, whose rows are the neurons' weights (bias first).
+// While the arena is measuring nothing is written and NULL is returned.
+static RNN *layout_RNN(ARENA *a, int numLayers, int *neuronsPerLayer)
 	{
-	srand(time(NULL));
+	RNN *net = (RNN *) arena_take(a, sizeof (RNN));
+	rLAYER *layers = (rLAYER *) arena_take(a, numLayers * sizeof (rLAYER));
+	rNEURON *neurons[numLayers];
+	real *W[numLayers];
+	for (int l = 0; l < numLayers; ++l)
+		{
+		neurons[l] = (rNEURON *) arena_take(a, neuronsPerLayer[l] * sizeof (rNEURON));
+		W[l] = l == 0 ? NULL :
+			(real *) arena_take(a, neuronsPerLayer[l] * (neuronsPerLayer[l - 1] + 1) * sizeof (real));
+		}
+	if (net == NULL)
+		return NULL;
+
 	net->numLayers = numLayers;
+	net->layers = layers;
+	for (int l = 0; l < numLayers; ++l)
+		{
+		layers[l].numNeurons = neuronsPerLayer[l];
+		layers[l].neurons = neurons[l];
+		if (l > 0)
+			// Only 1 array of weights per neuron, because weights are shared across folds
+			for (int n = 0; n < neuronsPerLayer[l]; ++n)
+				neurons[l][n].weights = W[l] + n * (neuronsPerLayer[l - 1] + 1);
+		}
+	return net;
+	}
 
+RNN *create_RTRL_NN(int numLayers, int *neuronsPerLayer)
+	{
 	assert(numLayers >= 3);
+	if (!NN_fixedSeed)
+		srand(time(NULL));
 
-	net->layers = (rLAYER *) malloc(numLayers * sizeof (rLAYER));
-	//construct input layer, no weights
-	net->layers[0].numNeurons = neuronsPerLayer[0];
-	net->layers[0].neurons = (rNEURON *) malloc(neuronsPerLayer[0] * sizeof (rNEURON));
+	ARENA arena = {NULL, 0};
+	layout_RNN(&arena, numLayers, neuronsPerLayer);		// measure
+	arena_open(&arena);
+	RNN *net = layout_RNN(&arena, numLayers, neuronsPerLayer);
 
-	//construct hidden layers
-	for (int l = 1; l < numLayers; l++) //construct layers
-		{
-		net->layers[l].neurons = (rNEURON *) malloc(neuronsPerLayer[l] * sizeof (rNEURON));
-		net->layers[l].numNeurons = neuronsPerLayer[l];
-		for (int n = 0; n < neuronsPerLayer[l]; n++) // construct each neuron in the layer
-			{
-			net->layers[l].neurons[n].weights =
-					(double *) malloc((neuronsPerLayer[l - 1] + 1) * sizeof (double));
+	extern double randomWeight();
+	for (int l = 1; l < numLayers; l++)
+		for (int n = 0; n < neuronsPerLayer[l]; n++)
+			//when i = 0, it's bias weight
 			for (int i = 0; i <= neuronsPerLayer[l - 1]; i++)
-				{
-				//construct weights of neuron from previous layer neurons
-				//when k = 0, it's bias weight
-				extern double randomWeight();
 				net->layers[l].neurons[n].weights[i] = randomWeight();
-				//net->layers[i].neurons[j].weights[k] = 0.0f;
-				}
+
+	net->numRecurrent = neuronsPerLayer[0] < neuronsPerLayer[numLayers - 1] ?
+			neuronsPerLayer[0] : neuronsPerLayer[numLayers - 1];
+	RTRL_approximate(net, RTRL_Exact);
+	return net;
+	}
+
+// The whole net is one arena block (see create_RTRL_NN), and the sensitivities another
+void free_RTRL_NN(RNN *net)
+	{
+	free(net->sensitivities);
+	free(net);
+	}
+
+//************************** sensitivity tensor *****************************//
+// Lay out J, the ∂Y_k / ∂net and p^k_ij of each layer (RNN.h), and the scratch "old" of
+// propagate_sensitivities(), in the arena as create_RTRL_NN() does;  returns the block,
+// NULL while measuring
+static real *layout_sensitivities(ARENA *a, RNN *net)
+	{
+	int L = net->numLayers, m = net->layers[L - 1].numNeurons;
+	real *J = (real *) arena_take(a, m * net->numRecurrent * sizeof (real));
+	int maxLen = 0;
+	for (int l = 1; l < L; ++l)
+		{
+		rLAYER *layer = &net->layers[l];
+		size_t weights = (size_t) layer->numNeurons * (net->layers[l - 1].numNeurons + 1);
+		size_t size = layer->keep == Keep_All ? m * weights :
+				layer->keep == Keep_Own ? weights : 0;
+		real *delta = (real *) arena_take(a, m * layer->numNeurons * sizeof (real));
+		real *S = (real *) arena_take(a, size * sizeof (real));
+		if (layer->keep == Keep_All && net->layers[l - 1].numNeurons + 1 > maxLen)
+			maxLen = net->layers[l - 1].numNeurons + 1;
+		if (J != NULL)
+			{
+			layer->delta = delta;
+			layer->S = size > 0 ? S : NULL;
 			}
 		}
+	real *old = (real *) arena_take(a, (size_t) net->numRecurrent * maxLen * sizeof (real));
+	if (J != NULL)
+		{
+		net->J = J;
+		net->old = maxLen > 0 ? old : NULL;
+		}
+	return J;
 	}
 
-void free_RTRL_NN(RNN *net, int *neuronsPerLayer)
+// Keep the sensitivities of SnAp-n (RNN.h), n = RTRL_Exact for all of them, 0 for none;
+// they start from 0, as after reset_RTRL()
+void RTRL_approximate(RNN *net, int n)
 	{
-	// for input layer
-	free(net->layers[0].neurons);
+	int L = net->numLayers;
+	net->approximation = n;
+	for (int l = 1; l < L; ++l)
+		{
+		rLAYER *layer = &net->layers[l];
+		int hops = l == L - 1 ? L + 1 : L - l;		// to reach every output
+		layer->keep = n == RTRL_Exact || n >= hops ? Keep_All :
+				l == L - 1 && n >= 1 ? Keep_Own : Keep_None;
+		layer->delta = layer->S = NULL;
+		}
+	free(net->sensitivities);
+	net->sensitivities = NULL;
+	net->J = net->old = NULL;
+	if (n == 0)
+		return;
 
-	// for each hidden layer
-	int numLayers = net->numLayers;
-	for (int l = 1; l < numLayers; l++) // for each layer
+	ARENA arena = {NULL, 0};
+	layout_sensitivities(&arena, net);		// measure
+	arena_open(&arena);
+	net->sensitivities = layout_sensitivities(&arena, net);
+	}
+
+// A new sequence:  the inputs of the next step are not fed back outputs
+void reset_RTRL(RNN *net)
+	{
+	if (net->sensitivities == NULL)
+		return;
+	ARENA arena = {NULL, 0};
+	layout_sensitivities(&arena, net);
+	memset(net->sensitivities, 0, arena.used);
+	}
+
+// After the forward pass of step t:  ∂Y_k / ∂net of every neuron for every output k (one
+// back-prop per output), J, then p(t) = ∂Y/∂W + J p(t - 1) one block at a time:  a row
+// of W for all outputs, with the p(t - 1) it needs (R rows) copied aside while in cache.
+static void propagate_sensitivities(RNN *net)
+	{
+	PROF_BEGIN(tl);
+	int L = net->numLayers, R = net->numRecurrent;
+	rLAYER *lastLayer = &net->layers[L - 1];
+	int m = lastLayer->numNeurons;
+
+	// output layer:  ∂Y_k / ∂net_n = σ' if n = k, else 0
+	for (int k = 0; k < m; ++k)
+		for (int n = 0; n < m; ++n)
+			{
+			real y = lastLayer->neurons[n].output;
+			lastLayer->delta[k * m + n] = n == k ? steepness * y * (1.0 - y) : 0.0;
+			}
+	for (int l = L - 2; l > 0; --l)
 		{
-		for (int n = 0; n < neuronsPerLayer[l]; n++) // for each neuron in the layer
+		rLAYER *layer = &net->layers[l], *nextLayer = &net->layers[l + 1];
+		int nn = layer->numNeurons, nNext = nextLayer->numNeurons;
+		real sigma[nn];
+		for (int n = 0; n < nn; ++n)
+			{
+			real y = layer->neurons[n].output;
+			sigma[n] = steepness * y * (1.0 - y);
+			}
+		for (int k = 0; k < m; ++k)
 			{
-			free(net->layers[l].neurons[n].weights);
+			real *delta = layer->delta + k * nn;
+			const real *nextDelta = nextLayer->delta + k * nNext;
+			for (int n = 0; n < nn; ++n)
+				delta[n] = 0.0;
+			for (int i = 0; i < nNext; ++i)
+				if (nextDelta[i] != 0.0)			// of the output layer:  only i = k
+					NNk.axpy(delta, nextDelta[i], nextLayer->neurons[i].weights + 1, nn);
+			for (int n = 0; n < nn; ++n)
+				delta[n] *= sigma[n];
 			}
-		free(net->layers[l].neurons);
+		PROF_LAYER(Prof_RTRL, l, Prof_forward, tl, 2 * m * (nNext + 1) * nn);
 		}
 
-	// free all layers
-	free(net->layers);
-	
-	// free the whole net
-	free(net);
+	// J = ∂Y / ∂x of the recurrent inputs
+	rLAYER *firstLayer = &net->layers[1];
+	for (int k = 0; k < m; ++k)
+		for (int r = 0; r < R; ++r)
+			{
+			real sum = 0.0;
+			for (int n = 0; n < firstLayer->numNeurons; ++n)
+				sum += firstLayer->delta[k * firstLayer->numNeurons + n] *
+						firstLayer->neurons[n].weights[r + 1];
+			net->J[k * R + r] = sum;
+			}
+
+	for (int l = 1; l < L; ++l)
+		{
+		rLAYER *layer = &net->layers[l];
+		if (layer->keep == Keep_None)
+			continue;
+		int nn = layer->numNeurons, len = net->layers[l - 1].numNeurons + 1;
+		real x[len];							// inputs of the layer, bias first
+		x[0] = BIASOUTPUT;
+		for (int i = 1; i < len; ++i)
+			x[i] = net->layers[l - 1].neurons[i - 1].output;
+
+		if (layer->keep == Keep_Own)			// p^n of row n only
+			{
+			for (int n = 0; n < nn; ++n)
+				{
+				real *p = layer->S + (size_t) n * len;
+				real d = layer->delta[n * nn + n], j = n < R ? net->J[n * R + n] : 0.0;
+				for (int i = 0; i < len; ++i)
+					p[i] = d * x[i] + j * p[i];
+				}
+			PROF_LAYER(Prof_RTRL, l, Prof_forward, tl, 3 * nn * len);
+			continue;
+			}
+
+		size_t plane = (size_t) nn * len;		// the p^k of one output k
+		real *old = net->old;					// [r][len]  p^r(t - 1) of one row
+		for (int n = 0; n < nn; ++n)
+			{
+			for (int r = 0; r < R; ++r)
+				memcpy(old + r * len, layer->S + r * plane + (size_t) n * len, len * sizeof (real));
+			for (int k = 0; k < m; ++k)
+				{
+				real *p = layer->S + k * plane + (size_t) n * len;
+				real d = layer->delta[k * nn + n];
+				for (int i = 0; i < len; ++i)
+					p[i] = d * x[i];
+				for (int r = 0; r < R; ++r)
+					NNk.axpy(p, net->J[k * R + r], old + r * len, len);
+				}
+			}
+		PROF_LAYER(Prof_RTRL, l, Prof_forward, tl, (2 * R + 1) * m * plane);
+		}
 	}
 
 //**************************** forward-propagation ***************************//
 
 void forward_RTRL(RNN *net, int dim_V, double V[])
 	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(tl);
 	//set the output of input layer
 	//two inputs x1 and x2
 	for (int i = 0; i < dim_V; ++i)
@@ -122,7 +317,7 @@ void forward_RTRL(RNN *net, int dim_V, double V[])
 		{
 		for (int j = 0; j < net->layers[i].numNeurons; j++)
 			{
-			double v = 0; //induced local field for neurons
+			real v = 0; //induced local field for neurons
 			//calculate v, which is the sum of the product of input and weights
 			for (int k = 0; k <= net->layers[i - 1].numNeurons; k++)
 				{
@@ -140,18 +335,73 @@ void forward_RTRL(RNN *net, int dim_V, double V[])
 			// else
 				extern double sigmoid(double);
 				net->layers[i].neurons[j].output = sigmoid(v);
+			// σ' = steepness y (1 - y) is below Prof_Saturation of its maximum steepness / 4
+			PROF_NEURON(Prof_RTRL, i, net->layers[i].neurons[j].output *
+					(1.0 - net->layers[i].neurons[j].output) < Prof_Saturation / 4);
 			}
+		PROF_LAYER(Prof_RTRL, i, Prof_forward, tl,
+				2 * net->layers[i].numNeurons * (net->layers[i - 1].numNeurons + 1));
 		}
+
+	if (net->approximation != 0)
+		propagate_sensitivities(net);
+	PROF_CALL(Prof_RTRL, Prof_forward, t0);
 	}
 
 //****************************** RTRL ***************************//
 
+// ∆W_ij = η Σ_k error_k p^k_ij, for the errors of the last forward_RTRL():  from the
+// sensitivities where they are kept, else from back-prop of this step
+static void sensitivity_update(RNN *net, double *errors)
+	{
+	PROF_BEGIN(tl);
+	int L = net->numLayers, m = net->layers[L - 1].numNeurons;
+	for (int l = 1; l < L; ++l)
+		{
+		rLAYER *layer = &net->layers[l];
+		int nn = layer->numNeurons, len = net->layers[l - 1].numNeurons + 1;
+		size_t plane = (size_t) nn * len;
+		real x[len];
+		x[0] = BIASOUTPUT;
+		for (int i = 1; i < len; ++i)
+			x[i] = net->layers[l - 1].neurons[i - 1].output;
+
+		for (int n = 0; n < nn; ++n)
+			{
+			real *w = layer->neurons[n].weights;
+			if (layer->keep == Keep_All)
+				for (int k = 0; k < m; ++k)
+					NNk.axpy(w, Eta * errors[k], layer->S + k * plane + (size_t) n * len, len);
+			else if (layer->keep == Keep_Own)
+				NNk.axpy(w, Eta * errors[n], layer->S + (size_t) n * len, len);
+			else
+				{
+				real grad = 0.0;
+				for (int k = 0; k < m; ++k)
+					grad += errors[k] * layer->delta[k * nn + n];
+				layer->neurons[n].grad = grad;
+				NNk.axpy(w, Eta * grad, x, len);
+				}
+			}
+		PROF_LAYER(Prof_RTRL, l, Prof_update, tl, 2 * (layer->keep == Keep_All ? m : 1) * plane);
+		}
+	}
+
 void RTRL(RNN *net, double *errors)
 	{
+	PROF_BEGIN(t0);
+	PROF_BEGIN(tl);
 	int numLayers = net->numLayers;
 	rLAYER lastLayer = net->layers[numLayers - 1];
 
-	#define steepness 3.0
+	if (net->approximation != 0)
+		{
+		sensitivity_update(net, errors);
+		PROF_CALL(Prof_RTRL, Prof_backward, t0);
+		return;
+		}
+
+	// no sensitivities:  back-prop of this step only
 	// calculate ∆ for output layer
 	for (int n = 0; n < lastLayer.numNeurons; ++n)
 		{
@@ -159,6 +409,7 @@ void RTRL(RNN *net, double *errors)
 		//for output layer, ∆ = y∙(1-y)∙error
 		lastLayer.neurons[n].grad = steepness * output * (1.0 - output) * errors[n];
 		}
+	PROF_LAYER(Prof_RTRL, numLayers - 1, Prof_backward, tl, 4 * lastLayer.numNeurons);
 
 	// calculate ∆ for hidden layers
 	for (int l = numLayers - 2; l > 0; --l)		// for each hidden layer
@@ -166,7 +417,7 @@ void RTRL(RNN *net, double *errors)
 		for (int n = 0; n < net->layers[l].numNeurons; n++)		// for each neuron in layer
 			{
 			double output = net->layers[l].neurons[n].output;
-			double sum = 0.0f;
+			real sum = 0.0f;
 			rLAYER nextLayer = net->layers[l + 1];
 			for (int i = 0; i < nextLayer.numNeurons; i++)		// for each weight
 				{
@@ -175,6 +426,8 @@ void RTRL(RNN *net, double *errors)
 				}
 			net->layers[l].neurons[n].grad = steepness * output * (1.0 - output) * sum;
 			}
+		PROF_LAYER(Prof_RTRL, l, Prof_backward, tl,
+				(2 * net->layers[l + 1].numNeurons + 4) * net->layers[l].numNeurons);
 		}
 
 	// update all weights
@@ -191,5 +444,8 @@ void RTRL(RNN *net, double *errors)
 						net->layers[l].neurons[n].grad * inputForThisNeuron;
 				}
 			}
+		PROF_LAYER(Prof_RTRL, l, Prof_update, tl,
+				3 * net->layers[l].numNeurons * (net->layers[l - 1].numNeurons + 1));
 		}
+	PROF_CALL(Prof_RTRL, Prof_backward, t0);
 	}
@@ -36,16 +36,16 @@ void relations_test()
 	{
 	extern void forward_BPTT(RNN *, int, double [], int);
 	extern void backprop_through_time(RNN *, double *, int);
+	extern RNN *create_BPTT_NN(int, int *);
+	extern void free_BPTT_NN(RNN *);
 	#define ForwardPropMethod	forward_BPTT
 	#define BackPropMethod		backprop_through_time
 
 	int dimK = 2;
 	double K[dimK];
 	int neuronsPerLayer[] = {dimK, 5, dimK}; // first = input layer, last = output layer
-	RNN *Net = (RNN *) malloc(sizeof (RNN));
 	int numLayers = sizeof (neuronsPerLayer) / sizeof (int);
-	create_BPTT_NN(Net, numLayers, neuronsPerLayer);
-	rLAYER lastLayer = Net->layers[numLayers - 1];
+	RNN *Net = create_BPTT_NN(numLayers, neuronsPerLayer);
 	double errors[dimK];
 
 	int quit = 0;
@@ -122,7 +122,7 @@ void relations_test()
 
 			// Difference between actual outcome and desired value:
 			int t = 0;
-			double error = ideal - lastLayer.neurons[k].output[t];
+			double error = ideal - BPTT_OUTPUTS(Net, t, numLayers - 1)[k];
 			errors[k] = error; // record this for back-prop
 
 			training_err += fabs(error); // record sum of errors
@@ -176,7 +176,7 @@ void relations_test()
 
 					// Difference between actual outcome and desired value:
 					int t = 0;
-					double error = ideal - lastLayer.neurons[k].output[t];
+					double error = ideal - BPTT_OUTPUTS(Net, t, numLayers - 1)[k];
 
 					single_err += fabs(error); // record sum of errors
 					}
@@ -226,5 +226,5 @@ void relations_test()
 		pause_graphics();
 	else
 		quit_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_BPTT_NN(Net);
 	}
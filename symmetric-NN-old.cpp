@@ -18,7 +18,7 @@
 using namespace std;
 
 extern NNET *create_NN(int, int *);
-extern void free_NN(NNET *, int *);
+extern void free_NN(NNET *);
 extern void forward_prop_sigmoid(NNET *, int, double *);
 extern void forward_prop_ReLU(NNET *, int, double *);
 extern void forward_prop_softplus(NNET *, int, double *);
@@ -385,6 +385,6 @@ int main(int argc, char **argv)
 	//	pause_graphics();
 	// else
 	//	quit_graphics();
-	free_NN(Net_g, neuronsPerLayer);
-	free_NN(Net_h, neuronsPerLayer);
+	free_NN(Net_g);
+	free_NN(Net_h);
 	}
@@ -16,7 +16,7 @@
 using namespace std;
 
 extern NNET *create_NN(int, int *);
-extern void free_NN(NNET *, int *);
+extern void free_NN(NNET *);
 extern void forward_prop_sigmoid(NNET *, int, double *);
 extern void forward_prop_ReLU(NNET *, int, double *);
 extern void forward_prop_softplus(NNET *, int, double *);
@@ -417,7 +417,7 @@ int main(int argc, char **argv)
 	//	pause_graphics();
 	// else
 	//	quit_graphics();
-	free_NN(Net_g, neuronsPerLayer);
+	free_NN(Net_g);
 	for (int m = 0; m < M; ++m)
-		free_NN(Net_h[m], neuronsPerLayer);
+		free_NN(Net_h[m]);
 	}
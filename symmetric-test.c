@@ -6,7 +6,7 @@
 #include "feedforward-NN.h"
 
 extern NNET *create_NN(int, int *);
-extern void free_NN(NNET *, int *);
+extern void free_NN(NNET *);
 extern void forward_prop_sigmoid(NNET *, int, double *);
 extern void forward_prop_ReLU(NNET *, int, double *);
 extern void forward_prop_softplus(NNET *, int, double *);
@@ -272,5 +272,5 @@ void symmetric_test()
 		pause_graphics();
 	else
 		quit_graphics();
-	free_NN(Net, neuronsPerLayer);
+	free_NN(Net);
 	}
@@ -0,0 +1,381 @@
+// Time-to-accuracy harness for the built-in experiments
+// usage:	time-to-accuracy [-n seeds] [-s seed] [-m samples] [-e threshold] [-k kernels]
+//				[-j threads] [-T trace.json] [experiment ...]
+//			-n	# of seeds each experiment is repeated with (default 10)
+//			-s	first seed (default 1);  run r uses seed s + r
+//			-m	give up after this many training samples (default:  per experiment)
+//			-e	error threshold to reach (default:  the experiment's ErrorThreshold)
+//			-k	force a kernel set, as NN_select_kernels()
+//			-j	threads of the data-parallel experiments (default:  all cores)
+//			-T	write a timeline of the training phases (built with -DNN_TRACE, NN-trace.h)
+//			experiments:  xor sine arithmeticB arithmeticB_batch arithmeticD BPTT BPTT_stream
+//				symmetric
+//				(default:  all)
+//
+// Each experiment runs the training loop of its menu version in main.c (training-loops.c,
+// with the same topology and ErrorThreshold), without graphics or keyboard:  a run ends
+// when the experiment's own accuracy criterion is met, or after the sample budget.
+// rand() is seeded once per run (and NN_fixedSeed keeps create_NN() etc from reseeding
+// it), so a run is reproducible from its seed.  The time includes creating the network
+// and any re-randomizations after divergence.
+//
+// Output:	stdout:  CSV, one line per run:  experiment, threshold, seed, reached, samples,
+//			seconds, kernels, real
+//			stderr:  per experiment, the fraction of runs that reached the threshold and
+//			the distribution (min, quartiles, max, mean) of samples and seconds over them
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>				// clock_gettime()
+#include <unistd.h>				// getopt(), sysconf()
+#include "feedforward-NN.h"
+#include "SIMD-kernels.h"
+#include "BPTT-RNN.h"
+#include "NN-profile.h"
+#include "perf-counters.h"
+#include "NN-trace.h"
+#include "training-loops.h"
+
+extern bool NN_fixedSeed;
+extern NNET *create_NN(int, int *);
+extern void free_NN(NNET *);
+extern RNN *create_BPTT_NN(int, int *);
+extern void free_BPTT_NN(RNN *);
+extern BPTT_STREAM *start_BPTT_stream(RNN *, int, int);
+extern void stop_BPTT_stream(BPTT_STREAM *);
+extern void stream_forward_BPTT(BPTT_STREAM *, int, double *);
+extern void stream_backprop_BPTT(BPTT_STREAM *, double *);
+extern bool XOR_loop(NNET *, int, int *, LOOP *);
+extern bool sine_loop(NNET *, int, int *, double *, LOOP *);
+extern bool arithmetic_loop(NNET *, int, int *, int, ERR_WINDOW *, long, LOOP *);
+extern bool arithmetic_batch_loop(NNET *, int, int *, int, int, LOOP *);
+extern bool BPTT_arithmetic_loop(RNN *, int, int *, LOOP *);
+extern bool symmetric_run(LOOP *);						// training-loops-symmetric.c
+
+static int numThreads;					// -j
+
+static double random01()
+	{
+	return rand() / (double) RAND_MAX;
+	}
+
+//************************** experiments *******************************************//
+// Each returns true if "threshold" was reached;  *samples = # of training samples
+
+typedef bool (*EXPERIMENT)(double threshold, long maxSamples, long *samples);
+
+static bool xor_test(double threshold, long maxSamples, long *samples)
+	{
+	int neuronsPerLayer[] = XOR_Layers;
+	int numLayers = sizeof (neuronsPerLayer) / sizeof (int);
+	NNET *Net = create_NN(numLayers, neuronsPerLayer);
+	LOOP loop = {threshold, maxSamples, NULL, NULL, 0};
+	bool reached = XOR_loop(Net, numLayers, neuronsPerLayer, &loop);
+	*samples = loop.samples;
+	free_NN(Net);
+	return reached;
+	}
+
+static bool sine_test(double threshold, long maxSamples, long *samples)
+	{
+	int neuronsPerLayer[] = Sine_Layers;
+	int numLayers = sizeof (neuronsPerLayer) / sizeof (int);
+	NNET *Net = create_NN(numLayers, neuronsPerLayer);
+	double K[10];
+	LOOP loop = {threshold, maxSamples, NULL, NULL, 0};
+	bool reached = sine_loop(Net, numLayers, neuronsPerLayer, K, &loop);
+	*samples = loop.samples;
+	free_NN(Net);
+	return reached;
+	}
+
+static bool arithmetic_test(int numLayers, int *neuronsPerLayer, int steps,
+		double threshold, long maxSamples, long *samples)
+	{
+	NNET *Net = create_NN(numLayers, neuronsPerLayer);
+	ERR_WINDOW w;
+	clear_window(&w);
+	LOOP loop = {threshold, maxSamples, NULL, NULL, 0};
+	bool reached = arithmetic_loop(Net, numLayers, neuronsPerLayer, steps, &w, 1, &loop);
+	*samples = loop.samples;
+	free_NN(Net);
+	return reached;
+	}
+
+static bool arithmeticB_test(double threshold, long maxSamples, long *samples)
+	{
+	int neuronsPerLayer[] = ArithmeticB_Layers;
+	return arithmetic_test(sizeof (neuronsPerLayer) / sizeof (int), neuronsPerLayer, 1,
+			threshold, maxSamples, samples);
+	}
+
+// arithmeticB by data-parallel mini-batches (parallel-trainer.c)
+static bool arithmeticB_batch_test(double threshold, long maxSamples, long *samples)
+	{
+	int neuronsPerLayer[] = ArithmeticB_Layers;
+	int numLayers = sizeof (neuronsPerLayer) / sizeof (int);
+	NNET *Net = create_NN(numLayers, neuronsPerLayer);
+	LOOP loop = {threshold, maxSamples, NULL, NULL, 0};
+	bool reached = arithmetic_batch_loop(Net, numLayers, neuronsPerLayer, numThreads,
+			ArithmeticBatch, &loop);
+	*samples = loop.samples;
+	free_NN(Net);
+	return reached;
+	}
+
+static bool arithmeticD_test(double threshold, long maxSamples, long *samples)
+	{
+	int neuronsPerLayer[] = ArithmeticD_Layers;
+	return arithmetic_test(sizeof (neuronsPerLayer) / sizeof (int), neuronsPerLayer, 2,
+			threshold, maxSamples, samples);
+	}
+
+static bool symmetric_test(double threshold, long maxSamples, long *samples)
+	{
+	LOOP loop = {threshold, maxSamples, NULL, NULL, 0};
+	bool reached = symmetric_run(&loop);
+	*samples = loop.samples;
+	return reached;
+	}
+
+static bool BPTT_test(double threshold, long maxSamples, long *samples)
+	{
+	int neuronsPerLayer[] = BPTT_Layers;
+	int numLayers = sizeof (neuronsPerLayer) / sizeof (int);
+	RNN *Net = create_BPTT_NN(numLayers, neuronsPerLayer);
+	LOOP loop = {threshold, maxSamples, NULL, NULL, 0};
+	bool reached = BPTT_arithmetic_loop(Net, numLayers, neuronsPerLayer, &loop);
+	*samples = loop.samples;
+	free_BPTT_NN(Net);
+	return reached;
+	}
+
+// The sine wave of sine_loop() as one endless stream into a BPTT RNN, trained by
+// truncated BPTT:  back-prop every StreamEvery steps through the last StreamWindow.
+// All outputs are fed back, as the stream's recurrent ∇ assumes, but bounded to
+// ±StreamBound:  unbounded, the ReLU net's outputs grow ~ 1e7 in 40 steps even untrained.
+// Longer windows diverge, since the recurrent ∇ (Σ ∇ of layer 1, to every output) grows
+// with each step back.
+#define SineSteps		20
+#define Pi				3.141592654
+#define Amplitude		0.5
+#define StreamWindow	2
+#define StreamEvery		1
+#define StreamBound		1.0
+static bool BPTT_stream_test(double threshold, long maxSamples, long *samples)
+	{
+	int neuronsPerLayer[] = Sine_Layers;
+	int numLayers = sizeof (neuronsPerLayer) / sizeof (int);
+	RNN *Net = create_BPTT_NN(numLayers, neuronsPerLayer);
+	BPTT_STREAM *stream = start_BPTT_stream(Net, StreamWindow, StreamEvery);
+	double K[10], errors[10];
+
+	for (int k = 0; k < 10; ++k)
+		K[k] = random01() * 2.0 - 1.0;
+
+	bool reached = false;
+	long i = 0;
+	while (i < maxSamples && !reached)
+		{
+		double sum_error2 = 0.0;
+		for (int j = 0; j < SineSteps; ++j, ++i)
+			{
+			K[1] = cos(2 * Pi * j / SineSteps) + 1.0;
+			stream_forward_BPTT(stream, 10, K);
+			real *output = BPTT_OUTPUTS(Net, stream->slot, numLayers - 1);
+
+			double dK_star = Amplitude * (sin(2 * Pi * (j + 1) / SineSteps) - sin(2 * Pi * j / SineSteps));
+			double error = dK_star - (output[0] - K[0]);
+			errors[0] = error;
+			for (int k = 1; k < 10; ++k)
+				errors[k] = 0.0;
+			stream_backprop_BPTT(stream, errors);
+
+			for (int k = 0; k < 10; ++k)
+				K[k] = fmax(-StreamBound, fmin(StreamBound, output[k]));
+			sum_error2 += error * error;
+			}
+		if (isnan(sum_error2))
+			break;
+		reached = sum_error2 < threshold;
+		}
+	*samples = i;
+	stop_BPTT_stream(stream);
+	free_BPTT_NN(Net);
+	return reached;
+	}
+
+//************************** harness ***********************************************//
+
+static struct
+	{
+	const char *name;
+	EXPERIMENT run;
+	double threshold;			// ErrorThreshold of the menu version
+	long maxSamples;			// default budget
+	} experiments[] =
+	{
+	{"xor", xor_test, 0.02, 1000000},
+	{"sine", sine_test, 0.01, 1000000},
+	{"arithmeticB", arithmeticB_test, 0.001, 20000000},
+	{"arithmeticB_batch", arithmeticB_batch_test, 0.001, 20000000},
+	{"arithmeticD", arithmeticD_test, 0.001, 20000000},
+	{"BPTT", BPTT_test, 0.001, 20000000},
+	{"BPTT_stream", BPTT_stream_test, 0.01, 1000000},
+	{"symmetric", symmetric_test, 0.02, 1000000},
+	};
+#define NumExperiments	(int) (sizeof (experiments) / sizeof (experiments[0]))
+
+static double now()
+	{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+	}
+
+static int compare_doubles(const void *a, const void *b)
+	{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+	}
+
+// Linear interpolation between order statistics of sorted x[n]
+static double quantile(const double *x, int n, double q)
+	{
+	double r = q * (n - 1);
+	int i = (int) r;
+	return i + 1 < n ? x[i] + (r - i) * (x[i + 1] - x[i]) : x[i];
+	}
+
+static void print_distribution(const char *what, double *x, int n)
+	{
+	double mean = 0.0;
+	for (int i = 0; i < n; ++i)
+		mean += x[i] / n;
+	qsort(x, n, sizeof (double), compare_doubles);
+	fprintf(stderr, "\t%-8s min %-10.4g p25 %-10.4g median %-10.4g p75 %-10.4g max %-10.4g mean %.4g\n",
+			what, x[0], quantile(x, n, 0.25), quantile(x, n, 0.5), quantile(x, n, 0.75),
+			x[n - 1], mean);
+	}
+
+int main(int argc, char **argv)
+	{
+	int numSeeds = 10;
+	unsigned int firstSeed = 1;
+	long maxSamples = 0;
+	double threshold = 0.0;
+	const char *traceFile = NULL;
+	numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:m:e:k:j:T:")) != -1)
+		switch (opt)
+			{
+			case 'n':
+				numSeeds = atoi(optarg);
+				break;
+			case 's':
+				firstSeed = strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				maxSamples = atol(optarg);
+				break;
+			case 'e':
+				threshold = atof(optarg);
+				break;
+			case 'k':
+				if (!NN_select_kernels(optarg))
+					{
+					fprintf(stderr, "Kernel set %s is not supported\n", optarg);
+					return 1;
+					}
+				break;
+			case 'j':
+				numThreads = atoi(optarg);
+				break;
+			case 'T':
+				traceFile = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n seeds] [-s seed] [-m samples] [-e threshold] [-k kernels] "
+						"[-j threads] [-T trace.json] [experiment ...]\n", argv[0]);
+				return 1;
+			}
+	if (numSeeds < 1)
+		numSeeds = 1;
+	if (numThreads < 1)
+		numThreads = 1;
+
+	bool selected[NumExperiments];
+	for (int e = 0; e < NumExperiments; ++e)
+		selected[e] = optind == argc;
+	for (int a = optind; a < argc; ++a)
+		{
+		int e = 0;
+		while (e < NumExperiments && strcmp(argv[a], experiments[e].name))
+			++e;
+		if (e == NumExperiments)
+			{
+			fprintf(stderr, "Unknown experiment %s\n", argv[a]);
+			return 1;
+			}
+		selected[e] = true;
+		}
+
+	NN_fixedSeed = true;
+	if (traceFile != NULL)
+		{
+		#ifndef NN_TRACE
+		fprintf(stderr, "Built without NN_TRACE:  %s will have no events\n", traceFile);
+		#endif
+		trace_start(traceFile);
+		trace_thread_name("time-to-accuracy");
+		}
+	printf("experiment,threshold,seed,reached,samples,seconds,kernels,real\n");
+	double samples[numSeeds], seconds[numSeeds];
+	for (int e = 0; e < NumExperiments; ++e)
+		{
+		if (!selected[e])
+			continue;
+		double e_max = threshold > 0.0 ? threshold : experiments[e].threshold;
+		int reached = 0;
+		for (int r = 0; r < numSeeds; ++r)
+			{
+			unsigned int seed = firstSeed + r;
+			long n;
+			srand(seed);
+			double t0 = now();
+			bool ok = experiments[e].run(e_max,
+					maxSamples > 0 ? maxSamples : experiments[e].maxSamples, &n);
+			double t = now() - t0;
+			printf("%s,%g,%u,%d,%ld,%.4f,%s,%s\n", experiments[e].name, e_max, seed, ok, n, t,
+					NNk.name, sizeof (real) == 4 ? "float" : "double");
+			fflush(stdout);
+			if (ok)
+				{
+				samples[reached] = n;
+				seconds[reached] = t;
+				++reached;
+				}
+			}
+
+		fprintf(stderr, "%s:  %d / %d runs reached |e| < %g\n", experiments[e].name,
+				reached, numSeeds, e_max);
+		if (reached > 0)
+			{
+			print_distribution("samples", samples, reached);
+			print_distribution("seconds", seconds, reached);
+			}
+		}
+	if (traceFile != NULL)
+		fprintf(stderr, "%ld events written to %s\n", trace_stop(), traceFile);
+	#ifdef NN_PROFILE
+	NN_prof_dump(stderr);
+	#endif
+	#ifdef NN_PERF
+	NN_perf_dump(stderr);
+	#endif
+	return 0;
+	}
@@ -0,0 +1,106 @@
+// The training loop of symmetric_test() (symmetric-test.cpp), see training-loops.h
+// (separate from training-loops.c because QNET.h and feedforward-NN.h both define NEURON
+// and LAYER)
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "QNET.h"
+#include "NN-trace.h"
+#include "training-loops.h"
+
+extern QNET *create_QNN(int);
+extern void free_QNN(QNET *);
+extern void re_randomize_QNN(QNET *);
+extern void forward_prop_quadratic(QNET *, double *);
+extern void back_prop_quadratic(QNET *, double *);
+
+#define f2b(x) (x > 0.5 ? 1 : 0)
+
+static double random01()
+	{
+	return rand() / (double) RAND_MAX;
+	}
+
+// Quadratic symmetric network learning XOR of the first 2 inputs (on all dim_V outputs);
+// the threshold is on the mean |error| of 50 test samples every 2000
+bool symmetric_loop(QNET *Net, LOOP *loop)
+	{
+	LAYER lastLayer = Net->layers[Net->numLayers - 1];
+	double K[dim_V], errors[dim_V];
+	ERR_WINDOW w;
+	clear_window(&w);
+	PROGRESS p = {.window = &w};
+
+	bool reached = false;
+	TRACE_BEGIN(t);
+	for (long n = 1; loop->maxSamples <= 0 || n <= loop->maxSamples; ++n)
+		{
+		p.samples = n;
+		++p.i;
+		for (int k = 0; k < dim_V; ++k)
+			K[k] = random01();
+		TRACE_END(Trace_transition, t);
+		forward_prop_quadratic(Net, K);
+		TRACE_END(Trace_forward, t);
+		double ideal = (double) (f2b(K[0]) ^ f2b(K[1]));
+		TRACE_END(Trace_target, t);
+		p.error = 0.0;
+		for (int k = 0; k < dim_V; ++k)
+			{
+			errors[k] = ideal - lastLayer.neurons[k].output;
+			p.error += fabs(errors[k]);
+			}
+		p.meanErr = add_error(&w, p.error, p.i);
+		TRACE_END(Trace_error, t);
+		back_prop_quadratic(Net, errors);
+		TRACE_END(Trace_backward, t);
+
+		p.testErr = -1.0;
+		if ((p.i % 2000) == 0)
+			{
+			double test_err = 0.0;
+			for (int j = 0; j < 50; ++j)
+				{
+				for (int k = 0; k < dim_V; ++k)
+					K[k] = random01();
+				forward_prop_quadratic(Net, K);
+				ideal = (double) (f2b(K[0]) ^ f2b(K[1]));
+				for (int k = 0; k < dim_V; ++k)
+					test_err += fabs(ideal - lastLayer.neurons[k].output);
+				}
+			TRACE_END(Trace_test, t);
+			p.testErr = test_err / 50.0;
+			reached = p.testErr < loop->threshold;
+			}
+
+		p.restarted = !reached && p.i > 50 && (isnan(p.meanErr) || p.meanErr > 10.0);
+		if (p.restarted)
+			re_randomize_QNN(Net);
+		int action = loop_each(loop, &p);
+		if (loop->each != NULL)
+			TRACE_END(Trace_plot, t);
+		if (reached || action == Loop_stop)
+			break;
+		if (action == Loop_restart && !p.restarted)
+			re_randomize_QNN(Net);
+		if (action == Loop_restart || p.restarted)
+			{
+			clear_window(&w);
+			p.i = 0;
+			}
+		}
+	loop->samples = p.samples;
+	return reached;
+	}
+
+// symmetric_loop() on a new network of symmetric_test(), for callers that cannot include
+// QNET.h (time-to-accuracy.c)
+bool symmetric_run(LOOP *loop)
+	{
+	QNET *Net = create_QNN(3);
+	bool reached = symmetric_loop(Net, loop);
+	free_QNN(Net);
+	return reached;
+	}
@@ -0,0 +1,450 @@
+// The training loops of the built-in experiments, see training-loops.h
+// Each is the loop of its menu version (same activation, targets, test set and error
+// criterion), without graphics or keyboard:  those are in the menu's each().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "feedforward-NN.h"
+#include "BPTT-RNN.h"
+#include "NN-trace.h"
+#include "training-loops.h"
+
+extern void re_randomize(NNET *, int, int *);
+extern void forward_prop_ReLU(NNET *, int, double *);
+extern void back_prop(NNET *, double *);
+extern void BPTT_re_randomize(RNN *, int, int *);
+extern BPTT_BATCH *create_BPTT_batch(RNN *, int, int);
+extern void free_BPTT_batch(BPTT_BATCH *);
+extern void forward_BPTT_batch(RNN *, BPTT_BATCH *, int, double *, int, const int *);
+extern void backprop_BPTT_batch(RNN *, BPTT_BATCH *, double *);
+extern void transition(double K1[], double K2[]);
+extern void arithmetic_sample(unsigned int *seed, double *x, double *y);
+extern TRAINER *create_trainer(NNET *, int, int, ACTIVATION, double);
+extern void free_trainer(TRAINER *);
+extern double train_batch(TRAINER *, int, double *, double *);
+
+static double random01()
+	{
+	return rand() / (double) RAND_MAX;
+	}
+
+//******************************** XOR *******************************************//
+// classic_BP_test():  XOR of 2 inputs thresholded at 0.5.  The threshold is on the mean
+// |error| of 50 test samples every 200.
+
+#define f2b(x) (x > 0.5 ? 1 : 0)
+
+bool XOR_loop(NNET *Net, int numLayers, int *neuronsPerLayer, LOOP *loop)
+	{
+	LAYER lastLayer = Net->layers[numLayers - 1];
+	double K[2], errors[1];
+	ERR_WINDOW w;
+	clear_window(&w);
+	PROGRESS p = {.window = &w};
+
+	bool reached = false;
+	for (long n = 1; loop->maxSamples <= 0 || n <= loop->maxSamples; ++n)
+		{
+		p.samples = n;
+		++p.i;
+		K[0] = random01();
+		K[1] = random01();
+		forward_prop_ReLU(Net, 2, K);
+		errors[0] = (double) (f2b(K[0]) ^ f2b(K[1])) - lastLayer.neurons[0].output;
+		p.error = fabs(errors[0]);
+		p.meanErr = add_error(&w, p.error, p.i);
+		back_prop(Net, errors);
+
+		p.testErr = -1.0;
+		if ((p.i % 200) == 0)
+			{
+			double test_err = 0.0;
+			for (int j = 0; j < 50; ++j)
+				{
+				K[0] = random01();
+				K[1] = random01();
+				forward_prop_ReLU(Net, 2, K);
+				test_err += fabs((double) (f2b(K[0]) ^ f2b(K[1])) - lastLayer.neurons[0].output);
+				}
+			p.testErr = test_err / 50.0;
+			reached = p.testErr < loop->threshold;
+			}
+
+		p.restarted = !reached && p.i > 50 && (isnan(p.meanErr) || p.meanErr > 10.0);
+		if (p.restarted)
+			re_randomize(Net, numLayers, neuronsPerLayer);
+		int action = loop_each(loop, &p);
+		if (reached || action == Loop_stop)
+			break;
+		if (action == Loop_restart && !p.restarted)
+			re_randomize(Net, numLayers, neuronsPerLayer);
+		if (action == Loop_restart || p.restarted)
+			{
+			clear_window(&w);
+			p.i = 0;
+			}
+		}
+	loop->samples = p.samples;
+	return reached;
+	}
+
+//******************************** sine wave *************************************//
+// sine_wave_test():  K[0] moves by the differences of a sine wave, 20 steps per period,
+// with K[1] the phase;  the outputs are fed back as the next K.  Each step is a sample;
+// the threshold is on Σ error² of a period.  K[10] is the caller's, for plotting.
+
+#define SineSteps		20
+#define Pi				3.141592654
+#define Amplitude		0.5
+
+bool sine_loop(NNET *Net, int numLayers, int *neuronsPerLayer, double K[], LOOP *loop)
+	{
+	LAYER lastLayer = Net->layers[numLayers - 1];
+	double errors[10];
+	ERR_WINDOW w;
+	clear_window(&w);
+	PROGRESS p = {.window = &w};
+
+	for (int k = 0; k < 10; ++k)
+		K[k] = random01() * 2.0 - 1.0;
+
+	bool reached = false, stop = false;
+	while ((loop->maxSamples <= 0 || p.samples < loop->maxSamples) && !reached && !stop)
+		{
+		double sum_error2 = 0.0;
+		for (int j = 0; j < SineSteps && !stop; ++j)
+			{
+			++p.samples;
+			++p.i;
+			K[1] = cos(2 * Pi * j / SineSteps) + 1.0;		// phase information to aid learning
+			forward_prop_ReLU(Net, 10, K);
+
+			// K'[0] - K[0] should be sin(θ + dθ) - sin θ
+			p.target = Amplitude * (sin(2 * Pi * (j + 1) / SineSteps) - sin(2 * Pi * j / SineSteps));
+			double error = p.target - (lastLayer.neurons[0].output - K[0]);
+			errors[0] = error;
+			for (int k = 1; k < 10; ++k)
+				errors[k] = 0.0;
+			back_prop(Net, errors);
+
+			for (int k = 0; k < 10; ++k)
+				K[k] = lastLayer.neurons[k].output;
+			sum_error2 += error * error;
+			p.error = fabs(error);
+			p.meanErr = add_error(&w, p.error, p.i);
+
+			p.testErr = j == SineSteps - 1 ? sum_error2 : -1.0;
+			int action = loop_each(loop, &p);
+			if (action == Loop_stop)
+				stop = true;
+			else if (action == Loop_restart)
+				{
+				re_randomize(Net, numLayers, neuronsPerLayer);
+				clear_window(&w);
+				p.i = 0;
+				}
+			}
+		if (stop || isnan(sum_error2))
+			break;
+		reached = sum_error2 < loop->threshold;
+		}
+	loop->samples = p.samples;
+	return reached;
+	}
+
+//******************************** arithmetic ************************************//
+
+// Random K vector of the arithmetic tests:  digits A1 A0 B1 B0, 2 flags, digits C1 C0
+static void random_K(double K[10])
+	{
+	for (int k = 0; k < 4; ++k)
+		K[k] = floor(random01() * 10.0) / 10.0;
+	for (int k = 4; k < 6; ++k)
+		K[k] = random01() > 0.5 ? 1.0 : 0.0;
+	for (int k = 6; k < 8; ++k)
+		K[k] = floor(random01() * 10.0) / 10.0;
+	K[8] = K[9] = 0.0;
+	}
+
+// Target of the arithmetic tests:  components 4..9 of the transition operator applied
+// "steps" times
+static void arithmetic_target(const double K[10], int steps, double Y[6])
+	{
+	double K1[10], K_star[10];
+	memcpy(K1, K, sizeof K1);
+	for (int t = 0; t < steps; ++t)
+		{
+		transition(K1, K_star);
+		memcpy(K1, K_star, sizeof K1);
+		}
+	for (int k = 4; k < 10; ++k)
+		Y[k - 4] = K_star[k];
+	}
+
+// arithmetic_testB() (steps = 1) and arithmetic_testD() (steps = 2):  the threshold is
+// on the mean |error| of the last ErrWindow samples, or of 20 test samples every 5000.
+// The test samples are scored on 1 transition for both, as in the menu's tests.
+// *w and start (the first sample #) are the state of a run resumed from a checkpoint, else
+// a cleared window and 1.
+bool arithmetic_loop(NNET *Net, int numLayers, int *neuronsPerLayer, int steps,
+		ERR_WINDOW *w, long start, LOOP *loop)
+	{
+	LAYER lastLayer = Net->layers[numLayers - 1];
+	double K[10], Y[6], errors[6];
+	PROGRESS p = {.i = start - 1, .window = w};
+
+	bool reached = false;
+	TRACE_BEGIN(t);
+	for (long n = 1; loop->maxSamples <= 0 || n <= loop->maxSamples; ++n)
+		{
+		p.samples = n;
+		++p.i;
+		random_K(K);
+		TRACE_END(Trace_transition, t);
+		forward_prop_ReLU(Net, 8, K);
+		TRACE_END(Trace_forward, t);
+		arithmetic_target(K, steps, Y);
+		TRACE_END(Trace_transition, t);
+		p.error = 0.0;
+		for (int k = 0; k < 6; ++k)
+			{
+			errors[k] = Y[k] - lastLayer.neurons[k].output;
+			p.error += fabs(errors[k]);
+			}
+		p.meanErr = add_error(w, p.error, p.i);
+		TRACE_END(Trace_error, t);
+
+		p.testErr = -1.0;
+		reached = p.meanErr < loop->threshold;
+		p.restarted = !reached && (p.meanErr > 1e10 || p.meanErr < 0.0 ||
+				(p.i > 5000 && isnan(p.meanErr)));
+		if (p.restarted)
+			re_randomize(Net, numLayers, neuronsPerLayer);
+		else if (!reached)
+			{
+			back_prop(Net, errors);
+			TRACE_END(Trace_backward, t);
+
+			if ((p.i % 5000) == 0)
+				{
+				double test_err = 0.0;
+				for (int j = 0; j < 20; ++j)
+					{
+					random_K(K);
+					forward_prop_ReLU(Net, 8, K);
+					arithmetic_target(K, 1, Y);
+					for (int k = 0; k < 6; ++k)
+						test_err += fabs(Y[k] - lastLayer.neurons[k].output);
+					}
+				TRACE_END(Trace_test, t);
+				p.testErr = test_err / 20.0;
+				reached = p.testErr < loop->threshold;
+				}
+			}
+
+		int action = loop_each(loop, &p);
+		if (loop->each != NULL)
+			TRACE_END(Trace_plot, t);
+		if (reached || action == Loop_stop)
+			break;
+		if (action == Loop_restart && !p.restarted)
+			re_randomize(Net, numLayers, neuronsPerLayer);
+		if (action == Loop_restart || p.restarted)
+			{
+			clear_window(w);
+			p.i = 0;
+			}
+		}
+	loop->samples = p.samples;
+	return reached;
+	}
+
+// arithmetic_testB() trained by data-parallel mini-batches of B samples on numThreads
+// threads (parallel-trainer.c).  A PROGRESS is a mini-batch:  its i counts mini-batches and
+// its error is the batch's mean |error|;  loop->maxSamples and loop->samples count samples.
+// The threshold is as arithmetic_loop()'s, with a test every 5000 samples.
+bool arithmetic_batch_loop(NNET *Net, int numLayers, int *neuronsPerLayer, int numThreads,
+		int B, LOOP *loop)
+	{
+	LAYER lastLayer = Net->layers[numLayers - 1];
+	// train_batch() steps by η / B Σ dW:  η = B Eta (back-prop.c) keeps the step of each
+	// sample's gradient, as the "linear scaling" rule for mini-batches
+	TRAINER *trainer = create_trainer(Net, numThreads, B, Act_ReLU, 0.01 * B);
+	double *X = (double *) malloc(B * 8 * sizeof (double));
+	double *Y = (double *) malloc(B * 6 * sizeof (double));
+	double K[10], Y1[6];
+	unsigned int seed = rand();			// reproducible after srand()
+	long testEvery = 5000 / B > 0 ? 5000 / B : 1;
+	ERR_WINDOW w;
+	clear_window(&w);
+	PROGRESS p = {.window = &w};
+
+	bool reached = false;
+	while (loop->maxSamples <= 0 || p.samples < loop->maxSamples)
+		{
+		TRACE_BEGIN(t);					// train_batch() traces its own phases
+		p.samples += B;
+		++p.i;
+		for (int b = 0; b < B; ++b)
+			arithmetic_sample(&seed, X + b * 8, Y + b * 6);
+		TRACE_END(Trace_transition, t);
+		p.error = train_batch(trainer, B, X, Y);
+		p.meanErr = add_error(&w, p.error, p.i);
+
+		p.testErr = -1.0;
+		reached = p.meanErr < loop->threshold;
+		p.restarted = !reached && (p.meanErr > 1e10 || p.meanErr < 0.0 ||
+				(p.i > 5000 && isnan(p.meanErr)));
+		if (p.restarted)
+			re_randomize(Net, numLayers, neuronsPerLayer);
+		else if (!reached && (p.i % testEvery) == 0)
+			{
+			TRACE_BEGIN(t);
+			double test_err = 0.0;
+			for (int j = 0; j < 20; ++j)
+				{
+				random_K(K);
+				forward_prop_ReLU(Net, 8, K);
+				arithmetic_target(K, 1, Y1);
+				for (int k = 0; k < 6; ++k)
+					test_err += fabs(Y1[k] - lastLayer.neurons[k].output);
+				}
+			TRACE_END(Trace_test, t);
+			p.testErr = test_err / 20.0;
+			reached = p.testErr < loop->threshold;
+			}
+
+		TRACE_BEGIN(tp);
+		int action = loop_each(loop, &p);
+		if (loop->each != NULL)
+			TRACE_END(Trace_plot, tp);
+		if (reached || action == Loop_stop)
+			break;
+		if (action == Loop_restart && !p.restarted)
+			re_randomize(Net, numLayers, neuronsPerLayer);
+		if (action == Loop_restart || p.restarted)
+			{
+			clear_window(&w);
+			p.i = 0;
+			}
+		}
+	loop->samples = p.samples;
+	free(X);
+	free(Y);
+	free_trainer(trainer);
+	return reached;
+	}
+
+//******************************** BPTT arithmetic *******************************//
+
+// Random K vector of the BPTT test:  digits A1 A0 B1 B0, the rest 0
+static void random_AB(double K[10])
+	{
+	for (int k = 0; k < 4; ++k)
+		K[k] = floor(random01() * 10.0) / 10.0;
+	for (int k = 4; k < 10; ++k)
+		K[k] = 0.0;
+	}
+
+// B new questions for the batched BPTT:  V = the inputs (K[0..7]), Y = components 4..9
+// of the answer (2 transitions)
+static void BPTT_questions(int B, double *V, double *Y)
+	{
+	double K[10];
+	for (int b = 0; b < B; ++b)
+		{
+		random_AB(K);
+		memcpy(V + b * 8, K, 8 * sizeof (double));
+		arithmetic_target(K, 2, Y + b * 6);
+		}
+	}
+
+// BPTT_arithmetic_test():  the 2-step operator in one step of the network (unfolded once),
+// on mini-batches of BPTTBatch questions in lockstep (forward_BPTT_batch()).  A PROGRESS is
+// a mini-batch, as in arithmetic_batch_loop().  As in the menu's test, the threshold is on
+// the |error| of any one question (before it is trained on), or on the mean |error| of a
+// mini-batch of new questions every 5000 samples;  the run stops if the error ratio is NaN
+// at a test, there is no re-randomizing on divergence.
+bool BPTT_arithmetic_loop(RNN *Net, int numLayers, int *neuronsPerLayer, LOOP *loop)
+	{
+	enum { B = BPTTBatch };
+	BPTT_BATCH *batch = create_BPTT_batch(Net, B, 1);
+	double V[B * 8], Y[B * 6], errors[B * 8];
+	long testEvery = 5000 / B;
+	ERR_WINDOW w;
+	clear_window(&w);
+	PROGRESS p = {.window = &w};
+
+	bool reached = false;
+	TRACE_BEGIN(t);
+	while (loop->maxSamples <= 0 || p.samples < loop->maxSamples)
+		{
+		p.samples += B;
+		++p.i;
+		BPTT_questions(B, V, Y);
+		TRACE_END(Trace_transition, t);
+		forward_BPTT_batch(Net, batch, B, V, 1, NULL);
+		TRACE_END(Trace_forward, t);
+		p.error = 0.0;
+		for (int b = 0; b < B; ++b)
+			{
+			const real *out = BATCH_OUTPUTS(Net, batch, 0, b, numLayers - 1);
+			double error = 0.0;
+			for (int k = 0; k < 6; ++k)
+				{
+				errors[b * 8 + k] = Y[b * 6 + k] - out[k];
+				error += fabs(errors[b * 8 + k]);
+				}
+			errors[b * 8 + 6] = errors[b * 8 + 7] = 0.0;	// only 6 of the 8 outputs count
+			p.error += error;
+			if (error < loop->threshold)
+				reached = true;
+			}
+		p.error /= B;
+		p.meanErr = add_error(&w, p.error, p.i);
+		TRACE_END(Trace_error, t);
+
+		p.testErr = -1.0;
+		bool diverged = false;
+		if (!reached)
+			{
+			backprop_BPTT_batch(Net, batch, errors);
+			TRACE_END(Trace_backward, t);
+
+			if ((p.i % testEvery) == 0)
+				{
+				BPTT_questions(B, V, Y);
+				forward_BPTT_batch(Net, batch, B, V, 1, NULL);
+				double test_err = 0.0;
+				for (int b = 0; b < B; ++b)
+					{
+					const real *out = BATCH_OUTPUTS(Net, batch, 0, b, numLayers - 1);
+					for (int k = 0; k < 6; ++k)
+						test_err += fabs(Y[b * 6 + k] - out[k]);
+					}
+				TRACE_END(Trace_test, t);
+				p.testErr = test_err / B;
+				reached = p.testErr < loop->threshold;
+				diverged = isnan((w.sum2 - w.sum1) / w.sum1);
+				}
+			}
+
+		int action = loop_each(loop, &p);
+		if (loop->each != NULL)
+			TRACE_END(Trace_plot, t);
+		if (reached || diverged || action == Loop_stop)
+			break;
+		if (action == Loop_restart)
+			{
+			BPTT_re_randomize(Net, numLayers, neuronsPerLayer);
+			clear_window(&w);
+			p.i = 0;
+			}
+		}
+	loop->samples = p.samples;
+	free_BPTT_batch(batch);
+	return reached;
+	}
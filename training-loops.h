@@ -0,0 +1,94 @@
+#ifndef TRAINING_LOOPS_H
+#define TRAINING_LOOPS_H
+
+#include <stdbool.h>
+#include <string.h>
+
+//************************** training loops of the experiments ************************//
+// The training loop of each built-in experiment is one function (training-loops.c, and
+// training-loops-symmetric.c for the quadratic network), called by its menu version,
+// which plots, prints and reads keys, and by time-to-accuracy.c, which runs it headless
+// over many seeds.  A loop trains until the experiment's own accuracy criterion is met
+// on loop->threshold (it returns true), or until it is stopped (false):
+//		by loop->each(), called after every sample with a PROGRESS, which answers
+//			Loop_go			go on
+//			Loop_stop		stop (eg the user quit)
+//			Loop_restart	re-randomize the network and start over
+//		after loop->maxSamples samples, if > 0.
+// A diverging error (NaN or out of range) re-randomizes the network by itself;  the
+// next PROGRESS then has "restarted" set.
+
+#define ErrWindow	50				// # of errors averaged in each of errors1, errors2
+
+// The |errors| of the last ErrWindow samples (errors1) and of the ErrWindow before them
+// (errors2), cyclic;  also the training state of a checkpoint (checkpoint.c)
+typedef struct ERR_WINDOW
+	{
+	double errors1[ErrWindow], errors2[ErrWindow];
+	double sum1, sum2;
+	int tail;						// next index of the cyclic arrays
+	} ERR_WINDOW;
+
+typedef struct PROGRESS
+	{
+	long i;							// # of samples since the network was (re-)randomized
+	long samples;					// # of samples in all
+	double error;					// |error| of this sample
+	double meanErr;					// mean |error| of the last ErrWindow samples
+	double ratio;					// (sum2 - sum1) / sum1:  > 0 while the error falls
+	double testErr;					// of the test set if there was one at this sample, else -1;
+									// the sine tests:  Σ error² of a period, at its last step
+	double target;					// the sine tests:  ideal output of this step
+	bool restarted;					// the error diverged and the network was re-randomized
+	const ERR_WINDOW *window;
+	} PROGRESS;
+
+enum { Loop_go, Loop_stop, Loop_restart };
+
+typedef struct LOOP
+	{
+	double threshold;				// the experiment's ErrorThreshold
+	long maxSamples;				// 0 = no limit
+	int (*each)(struct LOOP *, const PROGRESS *);	// NULL = always Loop_go
+	void *arg;						// for each()
+	long samples;					// out:  # of samples trained
+	} LOOP;
+
+// Topologies of the experiments (first = input layer, last = output layer)
+#define XOR_Layers			{2, 10, 9, 1}
+#define Sine_Layers			{10, 12, 10}
+#define ArithmeticB_Layers	{8, 13, 10, 6}
+#define ArithmeticD_Layers	{8, 19, 19, 19, 19, 6}
+#define BPTT_Layers			{8, 13, 10, 8}			// recurrent:  # inputs = # outputs
+
+#define ArithmeticBatch		32		// mini-batch of arithmetic_batch_loop()
+#define BPTTBatch			10		// mini-batch of BPTT_arithmetic_loop()
+
+static inline void clear_window(ERR_WINDOW *w)
+	{
+	memset(w, 0, sizeof (ERR_WINDOW));
+	}
+
+// Record the |error| of sample i (since re-randomizing) and return the mean of the last
+// ErrWindow
+static inline double add_error(ERR_WINDOW *w, double error, long i)
+	{
+	w->sum2 += w->errors1[w->tail] - w->errors2[w->tail];
+	w->sum1 += error - w->errors1[w->tail];
+	w->errors2[w->tail] = w->errors1[w->tail];
+	w->errors1[w->tail] = error;
+	if (++w->tail == ErrWindow)
+		w->tail = 0;
+	return i < ErrWindow ? w->sum1 / i : w->sum1 / ErrWindow;
+	}
+
+// Fill in the ratio of the windows and ask each() (Loop_go if there is none)
+static inline int loop_each(LOOP *loop, PROGRESS *p)
+	{
+	if (loop->each == NULL)
+		return Loop_go;
+	p->ratio = (p->window->sum2 - p->window->sum1) / p->window->sum1;
+	return loop->each(loop, p);
+	}
+
+#endif
@@ -2,18 +2,24 @@
 #include <SDL2/SDL.h>			// SDL graphics library
 #include <stdlib.h>				// For playing system "beep"
 // #include <SDL2/SDL_mixer.h>	// SDL sound, no longer needed
-#include <sys/timeb.h>			// For timing operations
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>				// usleep()
+#include <pthread.h>
 
 #include "feedforward-NN.h"
 #include "BPTT-RNN.h"
+#include "NN-profile.h"				// timers
 
+#ifdef __cplusplus
 extern "C" {
+#endif
 	void beep();
 	void bip();
 	int delay_vis(int delay);
 	void end_timer(char *s);
 	void flush_output();
-	void line(int x1, double y1, int x2, double y2);
 	void pause_graphics();
 	void pause_key();
 	void plot_K();
@@ -28,9 +34,10 @@ extern "C" {
 	void plot_tester(double x, double y);
 	void plot_trainer(double val);
 	void quit_graphics();
-	void rect(int x, int y, int w, int h, float r, float g, float b);
-	void rectI(int x, int y, int w, int h, int r, int g, int b);
 	void restart_LogErr_plot(void);
+	void set_headless(bool on);
+	void spill_LogErr(const char *fileName);
+	bool is_headless(void);
 	void start_K_plot(void);
 	void start_LogErr_plot(void);
 	void start_NN2_plot(void);
@@ -38,197 +45,561 @@ extern "C" {
 	void start_W_plot(void);
 	void start_output_plot(void);
 	void start_timer();
+#ifdef __cplusplus
 }
+#endif
 
 extern double K[];
 
-// ***************** Global variables ****************
+// ******************************* Render thread *************************************
+// All SDL calls are made by one render thread, started by the first start_*_plot().
+// The plot_*() functions called from the training loops only copy what is to be drawn
+// (weights, outputs, K, ...) into the back half of a double buffer per window, and
+// publish it by swapping the halves;  the render thread draws the front half at most
+// NN_VIS_FPS (environment, default 30) times a second.  So training never waits for
+// drawing or for the display's refresh:
+//	*	a snapshot is copied at most once per frame period (eg maxQ() calls plot_W() on
+//		every evaluation, but only ~30 of those a second copy the weights);
+//	*	publishing only try-locks the buffer:  if the render thread is drawing at that
+//		moment the snapshot is dropped, the next one will be shown.
+// Errors given to plot_LogErr() are all added to a fixed-size summary, since the plot is
+// their history.
+// Keyboard state is read by the render thread, delay_vis() and pause_key() only look at
+// its copy.
+//
+// Headless mode (set_headless(true), or NN_HEADLESS=1 in the environment) never
+// initializes SDL:  plots cost nothing, delay_vis() returns 0 at once and pause_key()
+// does not wait.
+
+enum { Win_LogErr, Win_Ideal, Win_Out, Win_W, Win_NN, Win_NN2, Win_K, NumWindows };
 
-SDL_Renderer *gfx_LogErr = NULL; // For log-scale error visualizer
-SDL_Window *win_LogErr = NULL;
-
-SDL_Renderer *gfx_Ideal = NULL; // For ideal output visualizer
-SDL_Window *win_Ideal = NULL;
-
-SDL_Renderer *gfx_Out = NULL; // For YKY's output visualizer
-SDL_Window *win_Out = NULL;
-
-SDL_Renderer *gfx_W = NULL; // For YKY's weights visualizer
-SDL_Window *win_W = NULL;
+#define LogErr_box_width 1000
+#define LogErr_box_height 400
+#define Ideal_box_width 500
+#define Ideal_box_height 500
+#define Out_box_width 300
+#define Out_box_height 300
+#define W_box_width 900
+#define W_box_height 1000
+#define NN_box_width 600
+#define NN_box_height 400
+#define NN2_box_width 150
+#define NN2_box_height 400
+#define K_box_width 600
+#define K_box_height 200
 
-SDL_Renderer *gfx_NN = NULL; // For YKY's NN visualizer
-SDL_Window *win_NN = NULL;
+static const struct
+	{
+	const char *title;
+	int x, y, width, height;
+	} windowDef[NumWindows] =
+	{
+	{"Errors (automatic log-scaled)", 10, 1200, LogErr_box_width, LogErr_box_height},
+	{"Ideal output", 500, 500, Ideal_box_width, Ideal_box_height},
+	{"Output", 10, 10, Out_box_width, Out_box_height},
+	{"Weights (auto gain-adjusted)", 80, 20, W_box_width, W_box_height},
+	{"NN activity", 400, 600, NN_box_width, NN_box_height},
+	{"NN activity", 800, 650, NN2_box_width, NN2_box_height},
+	{"K vector", 400, 200, K_box_width, K_box_height},
+	};
+
+// Owned by the render thread
+static SDL_Window *win[NumWindows];
+static SDL_Renderer *gfx[NumWindows];
+
+// Snapshot of a network:  per layer its size, and either the weights (rows of
+// numNeurons[l - 1] + 1, bias first) or the outputs
+#define MaxPlotLayers	64
+
+typedef struct NET_SNAPSHOT
+	{
+	int numLayers;
+	int numNeurons[MaxPlotLayers];
+	int style;					// plot_NN():  0 = line graph, 1 = plot_NN_old()
+	int capacity;				// # of doubles allocated in v
+	double *v;
+	} NET_SNAPSHOT;
+
+// 2D output (plot_output() and plot_ideal()):  the color of each grid square, and the
+// squares marked by plot_tester()
+#define GridPoints		30
+#define MaxTesters		256
+
+typedef struct GRID
+	{
+	Uint8 rgb[GridPoints][GridPoints][3];
+	int numTesters;
+	int tester[MaxTesters][2];
+	} GRID;
 
-SDL_Renderer *gfx_NN2 = NULL; // For Seh's NN visualizer
-SDL_Window *win_NN2 = NULL;
+typedef struct K_SNAPSHOT
+	{
+	bool hasK, hasTrainer;
+	double K[dim_K];
+	double trainer;				// plot_trainer() bar
+	} K_SNAPSHOT;
+
+// Double buffer of one window:  the trainer fills half 1 - front while the render
+// thread may draw half "front";  publish() swaps them
+typedef struct SLOT
+	{
+	pthread_mutex_t lock;
+	int front;
+	bool fresh;					// the front half has not been drawn yet
+	bool filling;				// the trainer is filling the back half (plot_output)
+	uint64_t published;			// NN_now_ns() of the last publish, trainer side
+	} SLOT;
+
+static SLOT slot[NumWindows];
+static NET_SNAPSHOT snapW[2], snapNN[2], snapNN2[2];
+static GRID snapOut[2], snapIdeal[2];
+static K_SNAPSHOT snapK[2];
+
+// Summary of the error series for the log-scaled plot, one bin per pixel column.  When
+// the bins are full, each pair is merged into one and the first half holds all the
+// history, so older errors are ever more decimated while the newest are at full
+// resolution, and drawing costs the same after any # of iterations.  A bin keeps the
+// min / max of its errors (drawn as an envelope), their mean, and the one error chosen
+// by largest-triangle-three-buckets (LTTB) for the line:  when merging, of the 2 errors
+// chosen for the halves, the one forming the largest triangle with the merged bin to its
+// left and the mean of the bins to its right.
+#define ErrBins			LogErr_box_width
+
+typedef struct ERR_BIN
+	{
+	double min, max, sum;
+	long n;
+	double pickX, pickY;		// LTTB point:  # of the error, error
+	} ERR_BIN;
 
-SDL_Renderer *gfx_K = NULL; // For K-vector visualizer
-SDL_Window *win_K = NULL;
+static struct
+	{
+	pthread_mutex_t lock;
+	int index;					// # of bins used
+	long count;					// # of errors since restart
+	double gain;
+	double target;
+	double last;
+	uint64_t version;			// of the plot, +1 per error
+	ERR_BIN bin[ErrBins];
+	} logErr = {.lock = PTHREAD_MUTEX_INITIALIZER, .gain = 100.0, .version = 1};
+
+static FILE *errSpill = NULL;	// full-resolution errors, see spill_LogErr()
+
+enum { Key_Q, Key_V, Key_Z, Key_L, Key_T, Key_P, Key_R, Key_W, Key_space, Key_close, NumKeys };
+static const int keyCode[NumKeys - 1] =
+	{SDL_SCANCODE_Q, SDL_SCANCODE_V, SDL_SCANCODE_Z, SDL_SCANCODE_L, SDL_SCANCODE_T,
+	SDL_SCANCODE_P, SDL_SCANCODE_R, SDL_SCANCODE_W, SDL_SCANCODE_SPACE};
+static Uint8 keyDown[NumKeys];		// written by the render thread, read with atomics
+
+// headless and rendering are read by the training threads, written by the starting thread
+// (and by set_headless()):  always with atomics
+static int headless = -1;			// -1 = not decided yet (NN_HEADLESS)
+static bool rendering = false;		// the render thread is running and SDL is initialized
+static int sdlState = 0;			// render thread → start_window():  0 = SDL_Init() not
+									// done yet, 1 = succeeded, -1 = failed (under startLock)
+static int quitRender = 0;
+static int wanted = 0;				// bit w = window w was asked for
+static double framePeriod = 1.0 / 30;	// seconds
+static pthread_t renderThread;
+static pthread_mutex_t startLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sdlStarted = PTHREAD_COND_INITIALIZER;
 
 bool display_W = true; // turn W visualization ON/OFF
 
-#define f2i(v) ((int)(255.0f * v))		// for converting color values
+// Time spent in the plot functions by the caller (ie copying a snapshot), per call;
+// recorded only when built with NN_PROFILE, and printed by end_timer(NULL) with the
+// training profile
+#ifdef NN_PROFILE
+enum { Plot_LogErr, Plot_output, Plot_W, Plot_W_BPTT, Plot_NN, Plot_K, Plot_delay, NumPlots };
+static LATENCY plotLatency[NumPlots];
+static const char *plotName[NumPlots] =
+	{"plot_LogErr", "plot_output", "plot_W", "plot_W_BPTT", "plot_NN", "plot_K", "delay_vis"};
+#endif
 
-// ************************* YKY's log-scale error visualizer ***************************
-
-#define LogErr_box_width 1000
-#define LogErr_box_height 400
+#define f2i(v) ((int)(255.0f * v))		// for converting color values
 
-bool new_LogErr_plot = false;
+void set_headless(bool on)
+	{
+	__atomic_store_n(&headless, on, __ATOMIC_RELEASE);
+	}
 
-void start_LogErr_plot(void)
+bool is_headless(void)
 	{
-	if (SDL_Init(SDL_INIT_VIDEO) != 0)
+	int h = __atomic_load_n(&headless, __ATOMIC_ACQUIRE);
+	if (h < 0)
 		{
-		printf("SDL_Init Error: %s \n", SDL_GetError());
-		return;
+		// decide once from the environment, unless set_headless() came first
+		const char *s = getenv("NN_HEADLESS");
+		int env = s != NULL && strcmp(s, "0") != 0;
+		if (__atomic_compare_exchange_n(&headless, &h, env, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			h = env;
 		}
+	return h;
+	}
+
+static bool is_rendering(void)
+	{
+	return __atomic_load_n(&rendering, __ATOMIC_ACQUIRE);
+	}
 
-	win_LogErr = SDL_CreateWindow("Errors (automatic log-scaled)", 10, 1200, LogErr_box_width, LogErr_box_height, SDL_WINDOW_SHOWN);
-	if (win_LogErr == NULL)
+static bool key(int k)
+	{
+	return __atomic_load_n(&keyDown[k], __ATOMIC_RELAXED);
+	}
+
+static void draw_window(int w);
+
+static void open_window(int w)
+	{
+	win[w] = SDL_CreateWindow(windowDef[w].title, windowDef[w].x, windowDef[w].y,
+			windowDef[w].width, windowDef[w].height, SDL_WINDOW_SHOWN);
+	if (win[w] == NULL)
 		{
 		printf("SDL_CreateWindow Error: %s \n", SDL_GetError());
-		SDL_Quit();
 		return;
 		}
 
-	gfx_LogErr = SDL_CreateRenderer(win_LogErr, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	if (gfx_LogErr == NULL)
+	// no SDL_RENDERER_PRESENTVSYNC:  the frame rate is capped by the render loop
+	gfx[w] = SDL_CreateRenderer(win[w], -1, SDL_RENDERER_ACCELERATED);
+	if (gfx[w] == NULL)
 		{
-		SDL_DestroyWindow(win_LogErr);
+		SDL_DestroyWindow(win[w]);
+		win[w] = NULL;
 		printf("SDL_CreateRenderer Error: %s \n", SDL_GetError());
-		SDL_Quit();
 		return;
 		}
-
-	new_LogErr_plot = true;
+	SDL_SetRenderDrawColor(gfx[w], 0, 0, 0, 0xFF);
+	SDL_RenderClear(gfx[w]);
+	SDL_RenderPresent(gfx[w]);
 	}
 
-void restart_LogErr_plot(void)
+// Copy the keyboard state for the training thread;  'W' toggles the weights plot
+static void read_keys(void)
 	{
-	new_LogErr_plot = true;
+	SDL_Event e;
+	bool closed = false;
+	while (SDL_PollEvent(&e) != 0)
+		if (e.type == SDL_QUIT)			// close-window event
+			closed = true;
+	const Uint8 *keys = SDL_GetKeyboardState(NULL);
+
+	bool wasW = key(Key_W);
+	for (int k = 0; k < NumKeys - 1; ++k)
+		__atomic_store_n(&keyDown[k], keys[keyCode[k]], __ATOMIC_RELAXED);
+	if (closed)
+		__atomic_store_n(&keyDown[Key_close], 1, __ATOMIC_RELAXED);
+
+	if (keys[SDL_SCANCODE_W] && !wasW && win[Win_W] != NULL)
+		{
+		display_W = !display_W;
+		if (display_W)
+			SDL_SetWindowTitle(win[Win_W], "Weights (auto gain-adjusted)");
+		else
+			SDL_SetWindowTitle(win[Win_W], "W visualization disabled");
+		}
 	}
 
-void plot_LogErr(double err, double target)
+static void *render_loop(void *arg)
 	{
-	static int errGain = 100.0;
-	#define binSize 1000
-	static double bin[binSize]; // stores plot data in log-scale
-	static int index = 1; // true index of current datum
-
-	if (err > 2.0) err = 2.0;
-	if (err < -2.0) err = -2.0;
-
-	if (new_LogErr_plot)
+	(void) arg;
+	// tell start_window() whether there is a display;  if not it joins this thread
+	bool ok = SDL_Init(SDL_INIT_VIDEO) == 0;
+	if (!ok)
+		printf("SDL_Init Error: %s, running headless\n", SDL_GetError());
+	pthread_mutex_lock(&startLock);
+	sdlState = ok ? 1 : -1;
+	pthread_cond_signal(&sdlStarted);
+	pthread_mutex_unlock(&startLock);
+	if (!ok)
+		return NULL;
+
+	while (!__atomic_load_n(&quitRender, __ATOMIC_ACQUIRE))
 		{
-		index = 1;
-		errGain = 100.0;
-		new_LogErr_plot = false;
-		// clear window
-		SDL_SetRenderDrawColor(gfx_LogErr, 0, 0, 0, 0xFF);
-		SDL_RenderClear(gfx_LogErr); //Clear screen
+		uint64_t t0 = NN_now_ns();
+		int w_mask = __atomic_load_n(&wanted, __ATOMIC_ACQUIRE);
+		for (int w = 0; w < NumWindows; ++w)
+			if ((w_mask & (1 << w)) && win[w] == NULL)
+				open_window(w);
+
+		read_keys();
+		for (int w = 0; w < NumWindows; ++w)
+			if (gfx[w] != NULL)
+				draw_window(w);
+
+		uint64_t spent = NN_now_ns() - t0, period = framePeriod * 1e9;
+		if (spent < period)
+			usleep((period - spent) / 1000);
 		}
 
-	bin[index++] = err; // record the error
+	for (int w = 0; w < NumWindows; ++w)
+		{
+		if (gfx[w] != NULL)
+			SDL_DestroyRenderer(gfx[w]);
+		if (win[w] != NULL)
+			SDL_DestroyWindow(win[w]);
+		gfx[w] = NULL;
+		win[w] = NULL;
+		}
+	SDL_Quit();
+	return NULL;
+	}
 
-	// Overflow?
-	if (index == binSize)
+// Ask the render thread for window w, starting the thread if need be.  False if headless,
+// which it becomes if the render thread cannot initialize SDL (eg no DISPLAY over ssh).
+static bool start_window(int w)
+	{
+	if (is_headless())
+		return false;
+	pthread_mutex_lock(&startLock);
+	bool ok = is_rendering();
+	if (!ok)
 		{
-		// Set gain
-		errGain = LogErr_box_height / bin[index - 1] / 2;
-
-		// squeeze existing data into first half
-		for (int i = 0; i < binSize / 2; ++i)
-			bin[i] = (bin[i * 2] + bin[i * 2 + 1]) / 2;
-
-		// new index appears in the mid-point
-		index = binSize / 2;
-
-		// clear data from beyond middle
-		for (int i = binSize / 2 + 1; i < binSize; ++i)
-			bin[i] = 0.0;
-
-		SDL_SetRenderDrawColor(gfx_LogErr, 0, 0, 0, 0xFF);
-		SDL_RenderClear(gfx_LogErr); //Clear screen
-
-		// Plot the mid axis
-		SDL_SetRenderDrawColor(gfx_LogErr, 0, 0, 0xFF, 0xFF); // blue
-		int baseline_y = LogErr_box_height / 2;
-		SDL_RenderDrawLine(gfx_LogErr, 0,
-						baseline_y,
-						LogErr_box_width,
-						baseline_y);
-
-		// Plot the error target
-		SDL_SetRenderDrawColor(gfx_LogErr, 0xFF, 0, 0, 0xFF); // red
-		baseline_y = LogErr_box_height - target * errGain;
-		SDL_RenderDrawLine(gfx_LogErr, 0,
-						baseline_y,
-						LogErr_box_width,
-						baseline_y);
-
-		// Re-plot the graph
-		SDL_SetRenderDrawColor(gfx_LogErr, 0x40, 0x90, 0, 0x70); // red + green
-		for (int i = 1; i < binSize / 2; ++i)
+		const char *fps = getenv("NN_VIS_FPS");
+		if (fps != NULL && atof(fps) > 0.0)
+			framePeriod = 1.0 / atof(fps);
+		for (int s = 0; s < NumWindows; ++s)
+			pthread_mutex_init(&slot[s].lock, NULL);
+		__atomic_store_n(&quitRender, 0, __ATOMIC_RELEASE);
+		sdlState = 0;
+		if (pthread_create(&renderThread, NULL, render_loop, NULL) == 0)
 			{
-			SDL_RenderDrawLine(gfx_LogErr, i - 1,
-							LogErr_box_height - errGain * bin[i - 1],
-							i,
-							LogErr_box_height - errGain * bin[i]);
+			while (sdlState == 0)
+				pthread_cond_wait(&sdlStarted, &startLock);
+			ok = sdlState > 0;
+			if (!ok)
+				{
+				pthread_join(renderThread, NULL);
+				set_headless(true);
+				}
 			}
+		__atomic_store_n(&rendering, ok, __ATOMIC_RELEASE);
 		}
+	pthread_mutex_unlock(&startLock);
+	if (ok)
+		__atomic_or_fetch(&wanted, 1 << w, __ATOMIC_RELEASE);
+	return ok;
+	}
 
-	// Plot the new datum
-	SDL_SetRenderDrawColor(gfx_LogErr, 0x40, 0x90, 0, 0x70); // red + green
-	SDL_RenderDrawLine(gfx_LogErr, index - 1,
-					LogErr_box_height - errGain * bin[index - 2],
-					index,
-					LogErr_box_height - errGain * err);
+// Trainer side:  is it time to copy a new snapshot for window w?
+static bool due(int w)
+	{
+	if (!is_rendering() || !(__atomic_load_n(&wanted, __ATOMIC_RELAXED) & (1 << w)))
+		return false;
+	return NN_now_ns() - slot[w].published >= framePeriod * 1e9;
+	}
 
-	// Display time and current error on window title bar
-	char s[100];
-	extern void end_timer(char *);
-	end_timer(s + sprintf(s, "ē = %.04f @ ", err));
-	SDL_SetWindowTitle(win_LogErr, s);
+// Trainer side:  show the back half of window w's buffer, unless the render thread is
+// drawing at this moment
+static void publish(int w)
+	{
+	SLOT *s = &slot[w];
+	if (pthread_mutex_trylock(&s->lock) != 0)
+		return;
+	s->front = 1 - s->front;
+	s->fresh = true;
+	s->published = NN_now_ns();
+	pthread_mutex_unlock(&s->lock);
+	}
 
-	SDL_RenderPresent(gfx_LogErr);
+static int back(int w)
+	{
+	return 1 - slot[w].front;
 	}
 
-// **************************** Trainer function visualizer *****************************
+static double *reserve(NET_SNAPSHOT *s, int size)
+	{
+	if (size > s->capacity)
+		{
+		s->v = (double *) realloc(s->v, size * sizeof (double));
+		s->capacity = size;
+		}
+	return s->v;
+	}
 
-#define Ideal_box_width 500
-#define Ideal_box_height 500
+// ************************* YKY's log-scale error visualizer ***************************
 
-void plot_ideal(void)
+void start_LogErr_plot(void)
+	{
+	restart_LogErr_plot();
+	const char *spill = getenv("NN_ERR_SPILL");
+	if (spill != NULL && errSpill == NULL)
+		spill_LogErr(spill);
+	start_window(Win_LogErr);
+	}
+
+void restart_LogErr_plot(void)
 	{
-	if (SDL_Init(SDL_INIT_VIDEO) != 0)
+	pthread_mutex_lock(&logErr.lock);
+	logErr.index = 0;
+	logErr.count = 0;
+	logErr.gain = 100.0;
+	++logErr.version;
+	pthread_mutex_unlock(&logErr.lock);
+	if (errSpill != NULL)
 		{
-		printf("SDL_Init Error: %s \n", SDL_GetError());
-		return;
+		double restart = NAN;
+		fwrite(&restart, sizeof restart, 1, errSpill);
 		}
+	}
+
+// Also write every error given to plot_LogErr() to fileName, as native doubles, a NaN
+// marking each restart_LogErr_plot();  fileName NULL = stop.  Works in headless mode too.
+// Set by the environment variable NN_ERR_SPILL on start_LogErr_plot().
+void spill_LogErr(const char *fileName)
+	{
+	if (errSpill != NULL)
+		fclose(errSpill);
+	errSpill = NULL;
+	if (fileName == NULL)
+		return;
+	if ((errSpill = fopen(fileName, "wb")) == NULL)
+		printf("Cannot write errors to %s\n", fileName);
+	else
+		setvbuf(errSpill, NULL, _IOFBF, 1 << 20);
+	}
 
-	win_Ideal = SDL_CreateWindow("Ideal output", 500, 500, Ideal_box_width, Ideal_box_height, SDL_WINDOW_SHOWN);
-	if (win_Ideal == NULL)
+// Twice the area of the triangle a, b, c
+static double triangle(double ax, double ay, double bx, double by, double cx, double cy)
+	{
+	return fabs((ax - cx) * (by - ay) - (ax - bx) * (cy - ay));
+	}
+
+// Merge the bins pairwise into the first half
+static void squeeze_LogErr(void)
+	{
+	ERR_BIN *bin = logErr.bin;
+	for (int i = 0; i < ErrBins / 2; ++i)
 		{
-		printf("SDL_CreateWindow Error: %s \n", SDL_GetError());
-		SDL_Quit();
+		ERR_BIN *l = &bin[i * 2], *r = &bin[i * 2 + 1];
+		ERR_BIN m;
+		m.min = fmin(l->min, r->min);
+		m.max = fmax(l->max, r->max);
+		m.sum = l->sum + r->sum;
+		m.n = l->n + r->n;
+
+		if (i == 0)						// keep the first point, as LTTB does
+			{
+			m.pickX = l->pickX;
+			m.pickY = l->pickY;
+			}
+		else if (i == ErrBins / 2 - 1)	// ...and the last
+			{
+			m.pickX = r->pickX;
+			m.pickY = r->pickY;
+			}
+		else
+			{
+			// LTTB:  the previous merged bin, and the mean of the next pair
+			ERR_BIN *c0 = &bin[i * 2 + 2], *c1 = &bin[i * 2 + 3];
+			double cx = (c0->pickX + c1->pickX) / 2;
+			double cy = (c0->sum + c1->sum) / (c0->n + c1->n);
+			double ax = bin[i - 1].pickX, ay = bin[i - 1].pickY;
+			bool left = triangle(ax, ay, l->pickX, l->pickY, cx, cy) >=
+						triangle(ax, ay, r->pickX, r->pickY, cx, cy);
+			m.pickX = left ? l->pickX : r->pickX;
+			m.pickY = left ? l->pickY : r->pickY;
+			}
+		bin[i] = m;						// i <= 2i:  l and r are not needed any more
+		}
+	logErr.index = ErrBins / 2;
+	}
+
+void plot_LogErr(double err, double target)
+	{
+	PROF_SCOPE(&plotLatency[Plot_LogErr]);
+	if (errSpill != NULL)
+		fwrite(&err, sizeof err, 1, errSpill);
+	if (!is_rendering())
 		return;
+
+	if (err > 2.0) err = 2.0;
+	if (err < -2.0) err = -2.0;
+	pthread_mutex_lock(&logErr.lock);
+	ERR_BIN *b = &logErr.bin[logErr.index++];
+	b->min = b->max = b->sum = b->pickY = err;
+	b->n = 1;
+	b->pickX = logErr.count++;
+	logErr.target = target;
+	logErr.last = err;
+	++logErr.version;
+
+	// Overflow?
+	if (logErr.index == ErrBins)
+		{
+		// Set gain
+		if (err > 0.0)
+			logErr.gain = LogErr_box_height / err / 2;
+		squeeze_LogErr();
 		}
+	pthread_mutex_unlock(&logErr.lock);
+	}
 
-	gfx_Ideal = SDL_CreateRenderer(win_Ideal, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	if (gfx_Ideal == NULL)
+// Render thread:  redraw the error plot if there are new errors
+static void draw_LogErr(void)
+	{
+	SDL_Renderer *g = gfx[Win_LogErr];
+	static ERR_BIN bin[ErrBins];
+	static uint64_t drawn = 0;
+
+	pthread_mutex_lock(&logErr.lock);
+	if (logErr.version == drawn)
 		{
-		SDL_DestroyWindow(win_Ideal);
-		printf("SDL_CreateRenderer Error: %s \n", SDL_GetError());
-		SDL_Quit();
+		pthread_mutex_unlock(&logErr.lock);
 		return;
 		}
+	drawn = logErr.version;
+	int index = logErr.index;
+	double errGain = logErr.gain, target = logErr.target, lastErr = logErr.last;
+	memcpy(bin, logErr.bin, index * sizeof (ERR_BIN));
+	pthread_mutex_unlock(&logErr.lock);
+
+	SDL_SetRenderDrawColor(g, 0, 0, 0, 0xFF);
+	SDL_RenderClear(g); //Clear screen
+
+	// Plot the mid axis
+	SDL_SetRenderDrawColor(g, 0, 0, 0xFF, 0xFF); // blue
+	int baseline_y = LogErr_box_height / 2;
+	SDL_RenderDrawLine(g, 0, baseline_y, LogErr_box_width, baseline_y);
+
+	// Plot the error target
+	SDL_SetRenderDrawColor(g, 0xFF, 0, 0, 0xFF); // red
+	baseline_y = LogErr_box_height - target * errGain;
+	SDL_RenderDrawLine(g, 0, baseline_y, LogErr_box_width, baseline_y);
+
+	// Plot the min-max envelope of each bin
+	SDL_SetRenderDrawColor(g, 0x20, 0x48, 0, 0xFF); // dark red + green
+	for (int i = 0; i < index; ++i)
+		if (bin[i].n > 1)
+			SDL_RenderDrawLine(g, i, LogErr_box_height - errGain * bin[i].min,
+							i, LogErr_box_height - errGain * bin[i].max);
+
+	// Plot the graph
+	SDL_SetRenderDrawColor(g, 0x40, 0x90, 0, 0x70); // red + green
+	for (int i = 1; i < index; ++i)
+		SDL_RenderDrawLine(g, i - 1,
+						LogErr_box_height - errGain * bin[i - 1].pickY,
+						i,
+						LogErr_box_height - errGain * bin[i].pickY);
 
-	SDL_SetRenderDrawColor(gfx_Out, 0, 0, 0, 0xFF);
-	SDL_RenderClear(gfx_Ideal); //Clear screen
+	// Display time and current error on window title bar
+	char s[100];
+	end_timer(s + sprintf(s, "ē = %.04f @ ", lastErr));
+	SDL_SetWindowTitle(win[Win_LogErr], s);
 
-	#define GridPoints 30
-	#define Square_width	((Ideal_box_width - 20) / GridPoints)
+	SDL_RenderPresent(g);
+	}
+
+// **************************** Trainer function visualizer *****************************
+
+// Colors of the ideal output, computed by the caller into the back buffer
+void plot_ideal(void)
+	{
+	if (!start_window(Win_Ideal))
+		return;
+	GRID *grid = &snapIdeal[back(Win_Ideal)];
+	grid->numTesters = 0;
 
 	// For each grid point:
 	for (int i = 0; i < GridPoints; ++i)
@@ -238,7 +609,6 @@ void plot_ideal(void)
 			input[0] = ((double) i) / (GridPoints - 1);
 			input[1] = ((double) j) / (GridPoints - 1);
 
-			extern void forward_prop(NNET*, int, double []);
 			// double ideal = 1.0f - (0.5f - input[0]) * (0.5f - input[1]);
 			// double ideal = input[0];				/* identity function */
 			#define f2b(x) (x > 0.5f ? 1 : 0)	// convert float to binary
@@ -270,57 +640,68 @@ void plot_ideal(void)
 				c3 = 0xFF;
 				c2 = 0.0;
 				}
-			SDL_SetRenderDrawColor(gfx_Ideal, f2i(c2), f2i(c1), c3, 0xFF);
-
-			// Plot little square
-			SDL_Rect fillRect = {11 + Square_width * i, 11 + Square_width * j,
-								Square_width - 1, Square_width - 1};
-			SDL_RenderFillRect(gfx_Ideal, &fillRect);
+			grid->rgb[i][j][0] = f2i(c2);
+			grid->rgb[i][j][1] = f2i(c1);
+			grid->rgb[i][j][2] = c3;
 			}
 
-	SDL_RenderPresent(gfx_Ideal);
+	// the ideal never changes:  wait until it is shown
+	SLOT *s = &slot[Win_Ideal];
+	pthread_mutex_lock(&s->lock);
+	s->front = 1 - s->front;
+	s->fresh = true;
+	pthread_mutex_unlock(&s->lock);
 	}
 
+// Render thread:  the grid squares of window w (Win_Ideal or Win_Out)
+static void draw_grid(int w, const GRID *grid)
+	{
+	SDL_Renderer *g = gfx[w];
+	int square_width = (windowDef[w].width - 20) / GridPoints;
 
-// **************************** YKY's 2D output visualizer ******************************
-
-#define Out_box_width 300
-#define Out_box_height 300
+	SDL_SetRenderDrawColor(g, 0, 0, 0, 0xFF);
+	SDL_RenderClear(g); //Clear screen
+	for (int i = 0; i < GridPoints; ++i)
+		for (int j = 0; j < GridPoints; ++j)
+			{
+			SDL_SetRenderDrawColor(g, grid->rgb[i][j][0], grid->rgb[i][j][1],
+					grid->rgb[i][j][2], 0xFF);
 
-void start_output_plot(void)
-	{
+			// Plot little square
+			SDL_Rect fillRect = {11 + square_width * i, 11 + square_width * j,
+								square_width - 1, square_width - 1};
+			SDL_RenderFillRect(g, &fillRect);
+			}
 
-	if (SDL_Init(SDL_INIT_VIDEO) != 0)
+	SDL_SetRenderDrawColor(g, 0x80, 0x50, 0xB0, 0xFF);
+	for (int t = 0; t < grid->numTesters; ++t)
 		{
-		printf("SDL_Init Error: %s \n", SDL_GetError());
-		return;
+		SDL_Rect fillRect = {11 + square_width * grid->tester[t][0],
+							11 + square_width * grid->tester[t][1],
+							square_width - 1, square_width - 1};
+		SDL_RenderFillRect(g, &fillRect);
 		}
+	SDL_RenderPresent(g);
+	}
 
-	win_Out = SDL_CreateWindow("Output", 10, 10, Out_box_width, Out_box_height, SDL_WINDOW_SHOWN);
-	if (win_Out == NULL)
-		{
-		printf("SDL_CreateWindow Error: %s \n", SDL_GetError());
-		SDL_Quit();
-		return;
-		}
+// **************************** YKY's 2D output visualizer ******************************
 
-	gfx_Out = SDL_CreateRenderer(win_Out, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	if (gfx_Out == NULL)
-		{
-		SDL_DestroyWindow(win_Out);
-		printf("SDL_CreateRenderer Error: %s \n", SDL_GetError());
-		SDL_Quit();
-		return;
-		}
+void start_output_plot(void)
+	{
+	start_window(Win_Out);
 	}
 
+// Evaluates the network on the grid (in the calling thread, as it changes K[] and the
+// network's outputs);  shown by flush_output()
 void plot_output(NNET *net, void prop(NNET*, int, double []))
 	{
-	SDL_SetRenderDrawColor(gfx_Out, 0, 0, 0, 0xFF);
-	SDL_RenderClear(gfx_Out); //Clear screen
-
-	#define GridPoints 30
-	#define Square_width	((Out_box_width - 20) / GridPoints)
+	PROF_SCOPE(&plotLatency[Plot_output]);
+	SLOT *s = &slot[Win_Out];
+	s->filling = due(Win_Out);
+	if (!s->filling)
+		return;
+	GRID *grid = &snapOut[back(Win_Out)];
+	grid->numTesters = 0;
 
 	// For each grid point:
 	for (int i = 0; i < GridPoints; ++i)
@@ -364,207 +745,128 @@ void plot_output(NNET *net, void prop(NNET*, int, double []))
 				c2 = 0.0;
 				c3 = -c2 + C3gain;
 				}
-			SDL_SetRenderDrawColor(gfx_Out, f2i(c2), f2i(c1), f2i(c3), 0xFF);
-
-			// Plot little square
-			SDL_Rect fillRect = {11 + Square_width * i, 11 + Square_width * j,
-								Square_width - 1, Square_width - 1};
-			SDL_RenderFillRect(gfx_Out, &fillRect);
+			grid->rgb[i][j][0] = f2i(c2);
+			grid->rgb[i][j][1] = f2i(c1);
+			grid->rgb[i][j][2] = f2i(c3);
 			}
 	}
 
 void plot_tester(double x, double y)
 	{
-	int i = (int) (x * (GridPoints - 1));
-	int j = (int) (y * (GridPoints - 1));
-
-	SDL_SetRenderDrawColor(gfx_Out, 0x80, 0x50, 0xB0, 0xFF);
-
-	// Plot little square
-	SDL_Rect fillRect = {11 + Square_width * i, 11 + Square_width * j,
-						Square_width - 1, Square_width - 1};
-	SDL_RenderFillRect(gfx_Out, &fillRect);
+	SLOT *s = &slot[Win_Out];
+	GRID *grid = &snapOut[back(Win_Out)];
+	if (!s->filling || grid->numTesters == MaxTesters)
+		return;
+	grid->tester[grid->numTesters][0] = (int) (x * (GridPoints - 1));
+	grid->tester[grid->numTesters][1] = (int) (y * (GridPoints - 1));
+	++grid->numTesters;
 	}
 
 void flush_output() // This is to allow plotting some dots on the graph before displaying
 	{
-	SDL_RenderPresent(gfx_Out);
+	SLOT *s = &slot[Win_Out];
+	if (s->filling)
+		publish(Win_Out);
+	s->filling = false;
 	}
 
 // *************************** YKY's weights visualizer ********************************
-// TO-DO:  ability to turn off visualization temporarily
-// check for key press, turn flag ON/OFF
-
-#define W_box_width 900
-#define W_box_height 1000
 
 void start_W_plot(void)
 	{
 	display_W = true;
+	if (start_window(Win_W))
+		printf("[P] pause, [R] resume, [W] weights ON/OFF, [T] display time\n");
+	}
 
-	if (SDL_Init(SDL_INIT_VIDEO) != 0)
-		{
-		printf("SDL_Init Error: %s \n", SDL_GetError());
+void plot_W(NNET *net)
+	{
+	PROF_SCOPE(&plotLatency[Plot_W]);
+	if (!display_W || !due(Win_W))
 		return;
-		}
 
-	win_W = SDL_CreateWindow("Weights (auto gain-adjusted)", 80, 20, W_box_width, W_box_height, SDL_WINDOW_SHOWN);
-	if (win_W == NULL)
-		{
-		printf("SDL_CreateWindow Error: %s \n", SDL_GetError());
-		SDL_Quit();
-		return;
-		}
+	NET_SNAPSHOT *s = &snapW[back(Win_W)];
+	int numLayers = net->numLayers < MaxPlotLayers ? net->numLayers : MaxPlotLayers;
+	int size = 0;
+	for (int l = 1; l < numLayers; ++l)
+		size += net->layers[l].numNeurons * (net->layers[l - 1].numNeurons + 1);
+	double *v = reserve(s, size);
 
-	gfx_W = SDL_CreateRenderer(win_W, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	if (gfx_W == NULL)
+	s->numLayers = numLayers;
+	s->numNeurons[0] = net->layers[0].numNeurons;
+	for (int l = 1; l < numLayers; ++l)
 		{
-		SDL_DestroyWindow(win_W);
-		printf("SDL_CreateRenderer Error: %s \n", SDL_GetError());
-		SDL_Quit();
-		return;
+		int numWeights = net->layers[l - 1].numNeurons + 1;
+		s->numNeurons[l] = net->layers[l].numNeurons;
+		for (int n = 0; n < s->numNeurons[l]; ++n)
+			for (int m = 0; m < numWeights; ++m)
+				*v++ = net->layers[l].neurons[n].weights[m];
 		}
-
-	printf("[P] pause, [R] resume, [W] weights ON/OFF, [T] display time\n");
+	publish(Win_W);
 	}
 
-void plot_W(NNET *net)
+void plot_W_BPTT(RNN *net)
 	{
-	if (!display_W)
+	PROF_SCOPE(&plotLatency[Plot_W_BPTT]);
+	if (!due(Win_W))
 		return;
 
-	SDL_SetRenderDrawColor(gfx_W, 0, 0, 0, 0xFF);
-	SDL_RenderClear(gfx_W); //Clear screen
-
-	// SDL_SetRenderDrawBlendMode(gfx_W, SDL_BLENDMODE_BLEND);
+	NET_SNAPSHOT *s = &snapW[back(Win_W)];
+	int numLayers = net->numLayers < MaxPlotLayers ? net->numLayers : MaxPlotLayers;
+	int size = 0;
+	for (int l = 1; l < numLayers; ++l)
+		size += net->layers[l].numNeurons * (net->layers[l - 1].numNeurons + 1);
+	double *v = reserve(s, size);
 
-	int numLayers = net->numLayers;
-	int Y_step = W_box_height / numLayers;
-
-	for (int l = 1; l < numLayers; l++) // Note: layer 0 has no weights
+	s->numLayers = numLayers;
+	s->numNeurons[0] = net->layers[0].numNeurons;
+	for (int l = 1; l < numLayers; ++l)
 		{
-		int nn = net->layers[l].numNeurons;
-		int neuronWidth = (W_box_width - 20) / nn;
-
-		// ***** Automatic gain-adjust
-		// find min and max weights
-		double gain = 1.0f;
-		double min_W, max_W;
-		min_W = max_W = net->layers[l].neurons[0].weights[0];
-		for (int n = 0; n < nn; n++) // for all neurons
-			{
-			int numWeights = net->layers[l - 1].numNeurons + 1; // always >= 2
-
-			for (int m = 0; m < numWeights; ++m)
-				{
-				double weight = net->layers[l].neurons[n].weights[m];
-				if (weight > max_W) max_W = weight;
-				if (weight < min_W) min_W = weight;
-				}
-			}
-		double peak = fmax(fabs(max_W), fabs(min_W));
-		gain = ((double) Y_step) / peak;
-		// printf("Y step = %d\n", Y_step);
-		// printf("min W = %f\n", min_W);
-		// printf("max W = %f\n", max_W);
-		// printf("gain = %f\n", gain);
-
-		// draw baseline
-		SDL_SetRenderDrawColor(gfx_W, 0x00, 0x00, 0xFF, 0xFF); // blue
-		int baseline_y = l * Y_step;
-		SDL_RenderDrawLine(gfx_W, 10, baseline_y, \
-			W_box_width - 10, baseline_y);
-
-		// **** set color
-		// The weights for each layer is scaled to fit in the horizontal strip (Y_step)
-		// But if the weights are large, their line color will move towards red-purple
-		// Otherwise they are green.
-		// float c1 = ((float) l) / (numLayers - 1);
-		// float c2 = 1.0f - ((float) l) / (numLayers - 1);
-		float c1 = peak / 2.0f; // peak starts from ~1.0 and may increase indefinitely
-		float c3 = 0.0f;
-		if (c1 > 1.0f)
-			{
-			c3 = c1 / 10.0f;
-			c1 = 1.0f;
-			}
-		float c2 = 1.0f - c1;
-		SDL_SetRenderDrawColor(gfx_W, f2i(c1), f2i(c2), f2i(c3), 0xFF);
-
-		for (int n = 0; n < nn; n++) // for each neuron on layer l
-			{
-			int numWeights = net->layers[l - 1].numNeurons + 1; // always >= 2
-			int basepoint_x = 10 + neuronWidth * n;
-			int gap = (neuronWidth - 10) / (numWeights - 1);
-
-			SDL_SetRenderDrawColor(gfx_W, f2i(c1), f2i(c2), f2i(c3), 0xFF);
+		int numWeights = net->layers[l - 1].numNeurons + 1;
+		s->numNeurons[l] = net->layers[l].numNeurons;
+		for (int n = 0; n < s->numNeurons[l]; ++n)
 			for (int m = 0; m < numWeights; ++m)
-				// for each weight including bias, but minus one because # line segments
-				// is 1 less than # of weights
-				{
-				int weight0 = gain * net->layers[l].neurons[n].weights[m];
-				SDL_RenderDrawLine(gfx_W, basepoint_x + 5 + gap * m,
-								baseline_y,
-								basepoint_x + 5 + gap * m,
-								baseline_y - weight0);
-				}
-
-			SDL_SetRenderDrawColor(gfx_W, 0x66, 0x66, 0x66, 0xFF); // grey
-			for (int m = 0; m < numWeights - 1; ++m)
-				// for each weight including bias, but minus one because # line segments
-				// is 1 less than # of weights
-				{
-				int weight0 = gain * net->layers[l].neurons[n].weights[m];
-				int weight1 = gain * net->layers[l].neurons[n].weights[m + 1];
-				SDL_RenderDrawLine(gfx_W, basepoint_x + 5 + gap * m,
-								baseline_y - weight0,
-								basepoint_x + 5 + gap * (m + 1),
-								baseline_y - weight1);
-				}
-			}
+				*v++ = net->layers[l].neurons[n].weights[m];
 		}
-
-	SDL_RenderPresent(gfx_W);
+	publish(Win_W);
 	}
 
-void plot_W_BPTT(RNN *net)
+// Render thread
+static void draw_W(const NET_SNAPSHOT *s)
 	{
-	SDL_SetRenderDrawColor(gfx_W, 0, 0, 0, 0xFF);
-	SDL_RenderClear(gfx_W); //Clear screen
+	SDL_Renderer *g = gfx[Win_W];
+	SDL_SetRenderDrawColor(g, 0, 0, 0, 0xFF);
+	SDL_RenderClear(g); //Clear screen
 
-	// SDL_SetRenderDrawBlendMode(gfx_W, SDL_BLENDMODE_BLEND);
+	// SDL_SetRenderDrawBlendMode(g, SDL_BLENDMODE_BLEND);
 
-	int numLayers = net->numLayers;
+	int numLayers = s->numLayers;
 	int Y_step = W_box_height / numLayers;
-	double Gain = Y_step / 1.0;
+	const double *W = s->v;				// weights of layer l
+
 	for (int l = 1; l < numLayers; l++) // Note: layer 0 has no weights
 		{
-		int nn = net->layers[l].numNeurons;
+		int nn = s->numNeurons[l];
+		int numWeights = s->numNeurons[l - 1] + 1; // always >= 2
 		int neuronWidth = (W_box_width - 20) / nn;
 
 		// ***** Automatic gain-adjust
 		// find min and max weights
 		double gain = 1.0f;
 		double min_W, max_W;
-		min_W = max_W = net->layers[l].neurons[0].weights[0];
-		for (int n = 0; n < nn; n++) // for all neurons
+		min_W = max_W = W[0];
+		for (int i = 0; i < nn * numWeights; ++i)
 			{
-			int numWeights = net->layers[l - 1].numNeurons + 1; // always >= 2
-
-			for (int m = 0; m < numWeights; ++m)
-				{
-				double weight = net->layers[l].neurons[n].weights[m];
-				if (weight > max_W) max_W = weight;
-				if (weight < min_W) min_W = weight;
-				}
+			if (W[i] > max_W) max_W = W[i];
+			if (W[i] < min_W) min_W = W[i];
 			}
 		double peak = fmax(fabs(max_W), fabs(min_W));
 		gain = ((double) Y_step) / peak;
 
 		// draw baseline
-		SDL_SetRenderDrawColor(gfx_W, 0x00, 0x00, 0xFF, 0xFF); // blue
+		SDL_SetRenderDrawColor(g, 0x00, 0x00, 0xFF, 0xFF); // blue
 		int baseline_y = l * Y_step;
-		SDL_RenderDrawLine(gfx_W, 10, baseline_y, \
+		SDL_RenderDrawLine(g, 10, baseline_y, \
 			W_box_width - 10, baseline_y);
 
 		// **** set color
@@ -581,387 +883,395 @@ void plot_W_BPTT(RNN *net)
 			c1 = 1.0f;
 			}
 		float c2 = 1.0f - c1;
-		SDL_SetRenderDrawColor(gfx_W, f2i(c1), f2i(c2), f2i(c3), 0xFF);
 
 		for (int n = 0; n < nn; n++) // for each neuron on layer l
 			{
-			int numWeights = net->layers[l - 1].numNeurons + 1; // always >= 2
+			const double *w = W + n * numWeights;
 			int basepoint_x = 10 + neuronWidth * n;
 			int gap = (neuronWidth - 10) / (numWeights - 1);
 
-			SDL_SetRenderDrawColor(gfx_W, f2i(c1), f2i(c2), f2i(c3), 0xFF);
+			SDL_SetRenderDrawColor(g, f2i(c1), f2i(c2), f2i(c3), 0xFF);
 			for (int m = 0; m < numWeights; ++m)
-				// for each weight including bias, but minus one because # line segments
-				// is 1 less than # of weights
 				{
-				int weight0 = gain * net->layers[l].neurons[n].weights[m];
-				SDL_RenderDrawLine(gfx_W, basepoint_x + 5 + gap * m,
+				int weight0 = gain * w[m];
+				SDL_RenderDrawLine(g, basepoint_x + 5 + gap * m,
 								baseline_y,
 								basepoint_x + 5 + gap * m,
 								baseline_y - weight0);
 				}
 
-			SDL_SetRenderDrawColor(gfx_W, 0x66, 0x66, 0x66, 0xFF); // grey
+			SDL_SetRenderDrawColor(g, 0x66, 0x66, 0x66, 0xFF); // grey
 			for (int m = 0; m < numWeights - 1; ++m)
 				// for each weight including bias, but minus one because # line segments
 				// is 1 less than # of weights
 				{
-				int weight0 = gain * net->layers[l].neurons[n].weights[m];
-				int weight1 = gain * net->layers[l].neurons[n].weights[m + 1];
-				SDL_RenderDrawLine(gfx_W, basepoint_x + 5 + gap * m,
+				int weight0 = gain * w[m];
+				int weight1 = gain * w[m + 1];
+				SDL_RenderDrawLine(g, basepoint_x + 5 + gap * m,
 								baseline_y - weight0,
 								basepoint_x + 5 + gap * (m + 1),
 								baseline_y - weight1);
 				}
 			}
+		W += nn * numWeights;
 		}
 
-	SDL_RenderPresent(gfx_W);
+	SDL_RenderPresent(g);
 	}
 
 // *************************** YKY's NN visualizer *************************************
 
-#define NN_box_width 600
-#define NN_box_height 400
-
 void start_NN_plot(void)
 	{
+	start_window(Win_NN);
+	}
 
-	if (SDL_Init(SDL_INIT_VIDEO) != 0)
-		{
-		printf("SDL_Init Error: %s \n", SDL_GetError());
-		return;
-		}
-
-	win_NN = SDL_CreateWindow("NN activity", 400, 600, NN_box_width, NN_box_height, SDL_WINDOW_SHOWN);
-	if (win_NN == NULL)
-		{
-		printf("SDL_CreateWindow Error: %s \n", SDL_GetError());
-		SDL_Quit();
-		return;
-		}
-
-	gfx_NN = SDL_CreateRenderer(win_NN, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	if (gfx_NN == NULL)
+// Outputs of every layer into the back buffer of window w
+static void copy_outputs(int w, NET_SNAPSHOT *s, NNET *net, int style)
+	{
+	int numLayers = net->numLayers < MaxPlotLayers ? net->numLayers : MaxPlotLayers;
+	int size = 0;
+	for (int l = 0; l < numLayers; ++l)
+		size += net->layers[l].numNeurons;
+	double *v = reserve(s, size);
+
+	s->numLayers = numLayers;
+	s->style = style;
+	for (int l = 0; l < numLayers; ++l)
 		{
-		SDL_DestroyWindow(win_NN);
-		printf("SDL_CreateRenderer Error: %s \n", SDL_GetError());
-		SDL_Quit();
-		return;
+		s->numNeurons[l] = net->layers[l].numNeurons;
+		for (int n = 0; n < s->numNeurons[l]; ++n)
+			*v++ = net->layers[l].neurons[n].output;
 		}
+	publish(w);
 	}
 
 void plot_NN(NNET *net)
 	{
-	SDL_SetRenderDrawColor(gfx_NN, 0, 0, 0, 0xFF);
-	SDL_RenderClear(gfx_NN); //Clear screen
+	PROF_SCOPE(&plotLatency[Plot_NN]);
+	if (due(Win_NN))
+		copy_outputs(Win_NN, &snapNN[back(Win_NN)], net, 0);
+	}
 
-	SDL_SetRenderDrawBlendMode(gfx_NN, SDL_BLENDMODE_BLEND);
+// Older version with vertical lines, suitable for many layers
+void plot_NN_old(NNET *net)
+	{
+	if (due(Win_NN))
+		copy_outputs(Win_NN, &snapNN[back(Win_NN)], net, 1);
+	}
+
+// Render thread
+static void draw_NN(const NET_SNAPSHOT *s)
+	{
+	SDL_Renderer *g = gfx[Win_NN];
+	SDL_SetRenderDrawColor(g, 0, 0, 0, 0xFF);
+	SDL_RenderClear(g); //Clear screen
 
 	#define Volume 20.0f
+	int numLayers = s->numLayers;
+	const double *output = s->v;		// of layer l
 
-	#define numLayers (net->numLayers)
-	for (int l = 0; l < numLayers; l++)
+	if (s->style == 0)
 		{
-		double gain = 1.0f;
-		// increase amplitude for hidden layers
-		if (l > 0 && l < numLayers - 1)
-			gain = 4.0f;
-		else
-			gain = 2.0f;
-
-		// draw baselines (blue = base level, faint blue = 1.0 level)
-		#define Y_step2 ((NN_box_height - (int) Volume * 4) / (numLayers - 1))
-		int baseline_y = (int) Volume * 2 + l * Y_step2;
-		SDL_SetRenderDrawColor(gfx_NN, 0x00, 0x00, 0xFF, 0xFF); // blue
-		SDL_RenderDrawLine(gfx_NN, 10, baseline_y, \
-			NN_box_width - 10, baseline_y);
-		SDL_SetRenderDrawColor(gfx_NN, 0x00, 0x00, 0xFF, 0x80); // faint blue
-		SDL_RenderDrawLine(gfx_NN, 10, baseline_y - (int) Volume * gain, \
-			NN_box_width - 10, baseline_y - (int) Volume * gain);
-
-		// set color
-		// float r = ((float) l ) / (numLayers);
-		// float b = 1.0f - ((float) l ) / (numLayers);
-		SDL_SetRenderDrawColor(gfx_NN, 0x00, 0xFF, 0x00, 0xFF); // green
-
-		int numNeurons = net->layers[l].numNeurons;
-		// numNeurons = actual number of neurons, not counting the bias neuron
-		if (numNeurons == 1) // only 1 neuron in the layer
-			{
-			double output = Volume * gain * net->layers[l].neurons[0].output;
+		SDL_SetRenderDrawBlendMode(g, SDL_BLENDMODE_BLEND);
 
-			int basepoint_x = NN_box_width / 2;
-			SDL_RenderDrawLine(gfx_NN, basepoint_x, baseline_y, \
-					basepoint_x, baseline_y - output);
-			}
-		else // > 1 neurons in the layer
+		for (int l = 0; l < numLayers; l++)
 			{
-			// The line is divided into (numNeurons - 1) parts
-			int neuronWidth = (NN_box_width - 20) / (numNeurons - 1);
-
-			// for each neuron except the last
-			// (because # of line segments = 1 less than # of neurons)
-			// (note that "output" does not have a bias element)
-			for (int n = 0; n < numNeurons - 1; n++)
+			double gain = 1.0f;
+			// increase amplitude for hidden layers
+			if (l > 0 && l < numLayers - 1)
+				gain = 4.0f;
+			else
+				gain = 2.0f;
+
+			// draw baselines (blue = base level, faint blue = 1.0 level)
+			#define Y_step2 ((NN_box_height - (int) Volume * 4) / (numLayers - 1))
+			int baseline_y = (int) Volume * 2 + l * Y_step2;
+			SDL_SetRenderDrawColor(g, 0x00, 0x00, 0xFF, 0xFF); // blue
+			SDL_RenderDrawLine(g, 10, baseline_y, \
+				NN_box_width - 10, baseline_y);
+			SDL_SetRenderDrawColor(g, 0x00, 0x00, 0xFF, 0x80); // faint blue
+			SDL_RenderDrawLine(g, 10, baseline_y - (int) Volume * gain, \
+				NN_box_width - 10, baseline_y - (int) Volume * gain);
+
+			SDL_SetRenderDrawColor(g, 0x00, 0xFF, 0x00, 0xFF); // green
+
+			int numNeurons = s->numNeurons[l];
+			// numNeurons = actual number of neurons, not counting the bias neuron
+			if (numNeurons == 1) // only 1 neuron in the layer
 				{
-				double output0 = Volume * gain * net->layers[l].neurons[n].output;
-				double output1 = Volume * gain * net->layers[l].neurons[n + 1].output;
+				double output0 = Volume * gain * output[0];
 
-				int basepoint_x = 10 + neuronWidth * n;
-				SDL_RenderDrawLine(gfx_NN, basepoint_x, baseline_y - output0, \
-					basepoint_x + neuronWidth, baseline_y - output1);
+				int basepoint_x = NN_box_width / 2;
+				SDL_RenderDrawLine(g, basepoint_x, baseline_y, \
+						basepoint_x, baseline_y - output0);
+				}
+			else // > 1 neurons in the layer
+				{
+				// The line is divided into (numNeurons - 1) parts
+				int neuronWidth = (NN_box_width - 20) / (numNeurons - 1);
+
+				// for each neuron except the last
+				// (because # of line segments = 1 less than # of neurons)
+				for (int n = 0; n < numNeurons - 1; n++)
+					{
+					double output0 = Volume * gain * output[n];
+					double output1 = Volume * gain * output[n + 1];
+
+					int basepoint_x = 10 + neuronWidth * n;
+					SDL_RenderDrawLine(g, basepoint_x, baseline_y - output0, \
+						basepoint_x + neuronWidth, baseline_y - output1);
+					}
 				}
+			output += numNeurons;
 			}
 		}
-
-	SDL_RenderPresent(gfx_NN);
-	}
-
-// Older version with vertical lines, suitable for many layers
-
-void plot_NN_old(NNET *net)
-	{
-	SDL_SetRenderDrawColor(gfx_NN, 0, 0, 0, 0xFF);
-	SDL_RenderClear(gfx_NN); //Clear screen
-
-	#define Volume 20.0f
-	#define NeuronWidth 20
-
-	#define numLayers (net->numLayers)
-	for (int l = 0; l < numLayers; l++)
+	else
 		{
-		double gain = 1.0f;
-		// increase amplitude for hidden layers
-		if (l > 0 && l < numLayers - 1)
-			gain = 5.0f;
-		else
-			gain = 1.0f;
-
-		// set color
-		float r = ((float) l) / numLayers;
-		float b = 1.0f - ((float) l) / numLayers;
-		SDL_SetRenderDrawColor(gfx_NN, f2i(r), 0x60, f2i(b), 0xFF);
-
-		int nn = net->layers[l].numNeurons;
-
-		// draw baseline
-		#define X_step ((NN_box_width - 20 - nn * NeuronWidth) / (numLayers - 1))
-		int baseline_x = 10 + l * X_step;
-		#define Y_step3 ((NN_box_height - (int) Volume * 14) / (numLayers - 1))
-		int baseline_y = (int) Volume * 7 + l * Y_step3;
-		SDL_RenderDrawLine(gfx_NN, baseline_x, baseline_y, \
-			baseline_x + nn * NeuronWidth, baseline_y);
-
-		SDL_SetRenderDrawColor(gfx_NN, f2i(r), 0xB0, f2i(b), 0xFF);
+		#define NeuronWidth 20
 
-		for (int n = 0; n < nn; n++)
+		for (int l = 0; l < numLayers; l++)
 			{
-			double output = gain * net->layers[l].neurons[n].output;
-
-			int basepoint_x = baseline_x + NeuronWidth * n;
-			SDL_RenderDrawLine(gfx_NN, basepoint_x, baseline_y, \
-				basepoint_x, baseline_y - output * Volume);
+			double gain = 1.0f;
+			// increase amplitude for hidden layers
+			if (l > 0 && l < numLayers - 1)
+				gain = 5.0f;
+			else
+				gain = 1.0f;
+
+			// set color
+			float r = ((float) l) / numLayers;
+			float b = 1.0f - ((float) l) / numLayers;
+			SDL_SetRenderDrawColor(g, f2i(r), 0x60, f2i(b), 0xFF);
+
+			int nn = s->numNeurons[l];
+
+			// draw baseline
+			#define X_step ((NN_box_width - 20 - nn * NeuronWidth) / (numLayers - 1))
+			int baseline_x = 10 + l * X_step;
+			#define Y_step3 ((NN_box_height - (int) Volume * 14) / (numLayers - 1))
+			int baseline_y = (int) Volume * 7 + l * Y_step3;
+			SDL_RenderDrawLine(g, baseline_x, baseline_y, \
+				baseline_x + nn * NeuronWidth, baseline_y);
+
+			SDL_SetRenderDrawColor(g, f2i(r), 0xB0, f2i(b), 0xFF);
+
+			for (int n = 0; n < nn; n++)
+				{
+				int basepoint_x = baseline_x + NeuronWidth * n;
+				SDL_RenderDrawLine(g, basepoint_x, baseline_y, \
+					basepoint_x, baseline_y - gain * output[n] * Volume);
+				}
+			output += nn;
 			}
 		}
 
-	SDL_RenderPresent(gfx_NN);
+	SDL_RenderPresent(g);
 	}
 
 // *************************** Seh's NN visualizer *************************************
 
-#define NN2_box_width 150
-#define NN2_box_height 400
-
 void start_NN2_plot(void)
 	{
-
-	if (SDL_Init(SDL_INIT_VIDEO) != 0)
-		{
-		printf("SDL_Init Error: %s \n", SDL_GetError());
-		return;
-		}
-
-	win_NN2 = SDL_CreateWindow("NN activity", 800, 650, NN2_box_width, NN2_box_height, SDL_WINDOW_SHOWN);
-	if (win_NN2 == NULL)
-		{
-		printf("SDL_CreateWindow Error: %s \n", SDL_GetError());
-		SDL_Quit();
-		return;
-		}
-
-	gfx_NN2 = SDL_CreateRenderer(win_NN2, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	if (gfx_NN2 == NULL)
-		{
-		SDL_DestroyWindow(win_NN2);
-		printf("SDL_CreateRenderer Error: %s \n", SDL_GetError());
-		SDL_Quit();
-		return;
-		}
+	start_window(Win_NN2);
 	}
 
-void rectI(int x, int y, int w, int h, int r, int g, int b)
+static void rectI(SDL_Renderer *g, int x, int y, int w, int h, int r, int gr, int b)
 	{
 	SDL_Rect fillRect = {x, y, w, h};
-	SDL_SetRenderDrawColor(gfx_NN2, r, g, b, 0xFF);
-	SDL_RenderFillRect(gfx_NN2, &fillRect);
+	SDL_SetRenderDrawColor(g, r, gr, b, 0xFF);
+	SDL_RenderFillRect(g, &fillRect);
 	}
 
-void rect(int x, int y, int w, int h, float r, float g, float b)
+static void rect(SDL_Renderer *g, int x, int y, int w, int h, float r, float gr, float b)
 	{
-	rectI(x, y, w, h, f2i(r), f2i(g), f2i(b));
+	rectI(g, x, y, w, h, f2i(r), f2i(gr), f2i(b));
 	}
 
 void plot_NN2(NNET *net)
 	{
-	SDL_SetRenderDrawColor(gfx_NN2, 0, 0, 0, 0xFF);
-	SDL_RenderClear(gfx_NN2); //Clear screen
+	if (due(Win_NN2))
+		copy_outputs(Win_NN2, &snapNN2[back(Win_NN2)], net, 0);
+	}
+
+// Render thread
+static void draw_NN2(const NET_SNAPSHOT *s)
+	{
+	SDL_Renderer *g = gfx[Win_NN2];
+	SDL_SetRenderDrawColor(g, 0, 0, 0, 0xFF);
+	SDL_RenderClear(g); //Clear screen
 
 	int bwh = 20; /* neuron block width,height*/
-	#define numLayers (net->numLayers)
+	int numLayers = s->numLayers;
 	#define L_margin ((NN2_box_width - (numLayers - 1) * bwh) / 2)
 	#define T_margin ((NN2_box_height - nn * bwh) / 2)
 
+	const double *outputs = s->v;
 	for (int l = 0; l < numLayers - 1; l++)
 		{
-		int nn = net->layers[l].numNeurons;
+		int nn = s->numNeurons[l];
 		for (int n = 0; n < nn; n++)
 			{
-			NEURON neuron = net->layers[l].neurons[n];
-			double output = neuron.output;
+			double output = outputs[n];
 
 			float r = output < 0 ? -output : 0;
 			if (r < -1) r = -1;
 
-			float g = output > 0 ? output : 0;
-			if (g < +1) g = +1;
+			float gr = output > 0 ? output : 0;
+			if (gr < +1) gr = +1;
 
 			// float b = neuron.input;	// ?? seems nothing in here
 			float b = 0.0f;
 
-			rect(L_margin + l*bwh, T_margin + n*bwh, bwh, bwh, r, g, b);
+			rect(g, L_margin + l*bwh, T_margin + n*bwh, bwh, bwh, r, gr, b);
 			}
+		outputs += nn;
 		}
 
-	SDL_RenderPresent(gfx_NN2);
+	SDL_RenderPresent(g);
 	}
 
 //******************************* K vector visualizer ******************************
 
-#define K_box_width 600
-#define K_box_height 200
-
 void start_K_plot(void)
 	{
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0)
-		{
-		printf("SDL_Init Error: %s \n", SDL_GetError());
-		return;
-		}
+	start_window(Win_K);
+	}
 
-	win_K = SDL_CreateWindow("K vector", 400, 200, K_box_width, K_box_height, SDL_WINDOW_SHOWN);
-	if (win_K == NULL)
-		{
-		printf("SDL_CreateWindow Error: %s \n", SDL_GetError());
-		SDL_Quit();
+// Show components of K vector as a line graph
+void plot_K()
+	{
+	PROF_SCOPE(&plotLatency[Plot_K]);
+	if (!due(Win_K))
 		return;
-		}
+	K_SNAPSHOT *s = &snapK[back(Win_K)];
+	*s = snapK[slot[Win_K].front];			// keep the trainer bar
+	memcpy(s->K, K, sizeof s->K);
+	s->hasK = true;
+	publish(Win_K);
+	}
 
-	gfx_K = SDL_CreateRenderer(win_K, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	if (gfx_K == NULL)
-		{
-		SDL_DestroyWindow(win_K);
-		printf("SDL_CreateRenderer Error: %s \n", SDL_GetError());
-		SDL_Quit();
+void plot_trainer(double val)
+	{
+	if (!due(Win_K))
 		return;
-		}
+	K_SNAPSHOT *s = &snapK[back(Win_K)];
+	*s = snapK[slot[Win_K].front];			// keep the K graph
+	s->trainer = val;
+	s->hasTrainer = true;
+	publish(Win_K);
 	}
 
-void line(int x1, double y1, int x2, double y2)
+// Render thread
+static void draw_K(const K_SNAPSHOT *s)
 	{
+	SDL_Renderer *g = gfx[Win_K];
 	#define TopX 20
 	#define TopY (K_box_height / 2)
-	SDL_RenderDrawLine(gfx_K, x1 + TopX, (int) y1 + TopY, x2 + TopX, (int) y2 + TopY);
-	}
+	#define Amplitude 40.0f
 
-// Show components of K vector as a line graph
-extern double K[];
+	//Clear screen
+	SDL_SetRenderDrawColor(g, 0, 0, 0, 0xFF);
+	SDL_RenderClear(g);
 
-void plot_K()
-	{
-	// Draw base line
-	#define K_Width ((K_box_width - TopX * 2) / dim_K)
-	SDL_SetRenderDrawColor(gfx_K, 0xFF, 0x00, 0x00, 0xFF); // red line
-	SDL_RenderDrawLine(gfx_K, 0, TopY, K_box_width, TopY);
+	if (s->hasTrainer)
+		{
+		int y = (int) (Amplitude * s->trainer);
 
-	SDL_SetRenderDrawColor(gfx_K, 0x1E, 0xD3, 0xEB, 0xFF); // blue-smurf blue
-	#define Amplitude 40.0f
-	for (int k = 1; k < dim_K; ++k)
-		line(k * K_Width, -Amplitude * K[k - 1],
-			(k + 1) * K_Width, -Amplitude * K[k]);
+		SDL_SetRenderDrawColor(g, 0xEB, 0xCC, 0x1E, 0xFF);
+		SDL_Rect fillRect = {TopX, TopY - y, 5, y};
+		SDL_RenderFillRect(g, &fillRect);
+		}
+
+	if (s->hasK)
+		{
+		// Draw base line
+		#define K_Width ((K_box_width - TopX * 2) / dim_K)
+		SDL_SetRenderDrawColor(g, 0xFF, 0x00, 0x00, 0xFF); // red line
+		SDL_RenderDrawLine(g, 0, TopY, K_box_width, TopY);
+
+		SDL_SetRenderDrawColor(g, 0x1E, 0xD3, 0xEB, 0xFF); // blue-smurf blue
+		for (int k = 1; k < dim_K; ++k)
+			SDL_RenderDrawLine(g, k * K_Width + TopX, (int) (-Amplitude * s->K[k - 1]) + TopY,
+					(k + 1) * K_Width + TopX, (int) (-Amplitude * s->K[k]) + TopY);
+		}
 
-	SDL_RenderPresent(gfx_K);
+	SDL_RenderPresent(g);
 	}
 
-void plot_trainer(double val)
+// Render thread:  redraw window w if its front buffer is new
+static void draw_window(int w)
 	{
-	//Clear screen
-	SDL_SetRenderDrawColor(gfx_K, 0, 0, 0, 0xFF);
-	SDL_RenderClear(gfx_K);
-
-	int y = (int) (Amplitude * val);
+	if (w == Win_LogErr)
+		{
+		draw_LogErr();
+		return;
+		}
 
-	SDL_SetRenderDrawColor(gfx_K, 0xEB, 0xCC, 0x1E, 0xFF);
-	SDL_Rect fillRect = {TopX, TopY - y, 5, y};
-	SDL_RenderFillRect(gfx_K, &fillRect);
-	SDL_RenderPresent(gfx_K);
+	SLOT *s = &slot[w];
+	pthread_mutex_lock(&s->lock);
+	if (s->fresh)
+		{
+		int f = s->front;
+		switch (w)
+			{
+			case Win_Ideal:
+				draw_grid(w, &snapIdeal[f]);
+				break;
+			case Win_Out:
+				draw_grid(w, &snapOut[f]);
+				break;
+			case Win_W:
+				draw_W(&snapW[f]);
+				break;
+			case Win_NN:
+				draw_NN(&snapNN[f]);
+				break;
+			case Win_NN2:
+				draw_NN2(&snapNN2[f]);
+				break;
+			case Win_K:
+				draw_K(&snapK[f]);
+				break;
+			}
+		s->fresh = false;
+		}
+	pthread_mutex_unlock(&s->lock);
 	}
 
+// ******************************** Keyboard ******************************************
+
 int delay_vis(int delay)
 	{
-	const Uint8 *keys = SDL_GetKeyboardState(NULL); // keyboard states
-
-	SDL_Delay(delay);
-
-	// SDL_Event event;
-	// SDL_PollEvent(&event);
-	// if (event.type == SDL_Quit)
-	//	return 1;
+	PROF_SCOPE(&plotLatency[Plot_delay]);
+	if (!is_rendering())
+		return 0;
 
-	// Read keyboard state, if "Q" is pressed, return 1
-	SDL_PumpEvents();
+	if (delay > 0)
+		usleep(delay * 1000);
 
 	// 'T' --- display time
-	extern void end_timer(char *);
-	if (keys[SDL_SCANCODE_T])
+	if (key(Key_T))
 		end_timer(NULL);
 
 	// 'P' --- pause
-	if (keys[SDL_SCANCODE_P])
+	if (key(Key_P))
 		{
 		printf("\nPress 'R' to resume\n");
-		while (!keys[SDL_SCANCODE_R]) // 'R' to resume
-			SDL_PumpEvents();
+		while (!key(Key_R)) // 'R' to resume
+			usleep(10000);
 		}
 
-	// 'W' --- turn W visualization ON/OFF
-	if (keys[SDL_SCANCODE_W])
-		{
-		display_W = !display_W;
-		if (display_W)
-			SDL_SetWindowTitle(win_W, "Weights (auto gain-adjusted)");
-		else
-			SDL_SetWindowTitle(win_W, "W visualization disabled");
-		}
+	// 'W' (weights ON/OFF) is handled by the render thread
 
 	// 'Q' --- quit
-	if (keys[SDL_SCANCODE_Q]) // || keys[SDL_SCANCODE_SPACE]
+	if (key(Key_Q)) // || key(Key_space)
 		return 1;
-	else if (keys[SDL_SCANCODE_V])			// verify (test operator)
+	else if (key(Key_V))			// verify (test operator)
 		return 2;
-	else if (keys[SDL_SCANCODE_Z])			// restart
+	else if (key(Key_Z))			// restart
 		return 3;
-	else if (keys[SDL_SCANCODE_L])			// load weights
+	else if (key(Key_L))			// load weights
 		return 4;
 	else
 		return 0;
@@ -969,68 +1279,22 @@ int delay_vis(int delay)
 
 void pause_key() // [R] or [space] key to resume
 	{
+	if (!is_rendering())
+		return;
 	printf("\nPress 'R' to resume\n");
-
-	const Uint8 *keys = SDL_GetKeyboardState(NULL); // keyboard states
-
-	SDL_PumpEvents();
-	while (!(keys[SDL_SCANCODE_R] || keys[SDL_SCANCODE_SPACE]))
-		SDL_PumpEvents();
+	while (!(key(Key_R) || key(Key_space)))
+		usleep(10000);
 	}
 
+// Keep the windows until [Q], [space] or a window is closed, then close them all
 void pause_graphics()
 	{
-	const Uint8 *keys = SDL_GetKeyboardState(NULL); // keyboard states
-	bool quit = NULL;
-	SDL_Event e;
-
-	//Update screen
-	SDL_RenderPresent(gfx_K);
-
-	//While application is running
-	while (!quit)
-		{
-		//Handle events on queue
-		while (SDL_PollEvent(&e) != 0)
-			{
-			//User requests quit
-			if (e.type == SDL_QUIT) // This seems to be close-window event
-				quit = true;
-			if (keys[SDL_SCANCODE_Q] || keys[SDL_SCANCODE_SPACE]) // press 'Q' to quit
-				quit = true;
-			}
-
-		if (gfx_LogErr != NULL)
-			SDL_RenderPresent(gfx_LogErr);
-
-		if (gfx_Ideal != NULL)
-			SDL_RenderPresent(gfx_Ideal);
-
-		if (gfx_Out != NULL)
-			SDL_RenderPresent(gfx_Out);
-
-		if (gfx_W != NULL)
-			SDL_RenderPresent(gfx_W);
-
-		if (gfx_NN != NULL)
-			SDL_RenderPresent(gfx_NN);
-
-		if (gfx_NN2 != NULL)
-			SDL_RenderPresent(gfx_NN2);
-
-		if (gfx_K != NULL)
-			SDL_RenderPresent(gfx_K);
-		}
-
-	SDL_DestroyRenderer(gfx_NN);
-	SDL_DestroyRenderer(gfx_NN2);
-	SDL_DestroyRenderer(gfx_K);
-
-	SDL_DestroyWindow(win_NN);
-	SDL_DestroyWindow(win_NN2);
-	SDL_DestroyWindow(win_K);
-
-	SDL_Quit();
+	if (!is_rendering())
+		return;
+	__atomic_store_n(&keyDown[Key_close], 0, __ATOMIC_RELAXED);
+	while (!(key(Key_Q) || key(Key_space) || key(Key_close)))
+		usleep(10000);
+	quit_graphics();
 	}
 
 void beep()
@@ -1055,34 +1319,45 @@ void bip()
 	system("beep -f 1500 -l 100");
 	}
 
+// Stop the render thread, which closes all windows;  the next start_*_plot() restarts it
 void quit_graphics()
 	{
-	SDL_DestroyRenderer(gfx_NN);
-	SDL_DestroyRenderer(gfx_NN2);
-	SDL_DestroyRenderer(gfx_K);
-
-	SDL_DestroyWindow(win_NN);
-	SDL_DestroyWindow(win_NN2);
-	SDL_DestroyWindow(win_K);
-
-	SDL_Quit();
+	pthread_mutex_lock(&startLock);
+	if (is_rendering())
+		{
+		__atomic_store_n(&quitRender, 1, __ATOMIC_RELEASE);
+		pthread_join(renderThread, NULL);
+		__atomic_store_n(&rendering, false, __ATOMIC_RELEASE);
+		__atomic_store_n(&wanted, 0, __ATOMIC_RELEASE);
+		for (int k = 0; k < NumKeys; ++k)
+			keyDown[k] = 0;
+		}
+	pthread_mutex_unlock(&startLock);
 	}
 
-struct timeb startTime, endTime;
+static uint64_t startTime;			// ns, NN_now_ns()
 
 void start_timer()
 	{
-	ftime(&startTime);
+	startTime = NN_now_ns();
 	}
 
+// Elapsed time since start_timer(), as m:ss into s, or printed (with ms) if s is NULL.
+// Printing also dumps the profile, if any (see NN-profile.h).
 void end_timer(char *s)
 	{
-	ftime(&endTime);
-	int duration = endTime.time - startTime.time;
-	int minutes = duration / 60;
-	int seconds = duration % 60;
-	if (s == NULL)
-		printf("\nTime elapsed = %d:%d\n\n", minutes, seconds);
-	else
+	uint64_t ms = (NN_now_ns() - startTime) / 1000000;
+	int minutes = ms / 60000;
+	int seconds = ms / 1000 % 60;
+	if (s != NULL)
+		{
 		sprintf(s, "%d:%02d", minutes, seconds);
+		return;
+		}
+	printf("\nTime elapsed = %d:%02d.%03d\n\n", minutes, seconds, (int) (ms % 1000));
+	#ifdef NN_PROFILE
+	NN_prof_dump(stderr);
+	for (int p = 0; p < NumPlots; ++p)
+		print_latency(stderr, plotName[p], &plotLatency[p]);
+	#endif
 	}